@@ -31,4 +31,14 @@ unsigned long * mcount_arch_parent_location(struct symtabs *symtabs,
 
 #define ARCH_CAN_RESTORE_PLTHOOK   1
 
+/* read performance counter directly (if allowed) */
+#define HAVE_MCOUNT_ARCH_RDPMC
+static inline unsigned long long mcount_arch_rdpmc(unsigned int counter)
+{
+	unsigned int low, high;
+
+	asm volatile ("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+	return low | ((unsigned long long)high << 32);
+}
+
 #endif /* __MCOUNT_ARCH_H__ */
@@ -36,6 +36,16 @@ struct mcount_arch_context {
 #define ARCH_SUPPORT_AUTO_RECOVER  1
 #define ARCH_CAN_RESTORE_PLTHOOK   1
 
+/* read performance counter directly (if allowed) */
+#define HAVE_MCOUNT_ARCH_RDPMC
+static inline unsigned long long mcount_arch_rdpmc(unsigned int counter)
+{
+	unsigned int low, high;
+
+	asm volatile ("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+	return low | ((unsigned long long)high << 32);
+}
+
 struct plthook_arch_context {
 	bool	has_plt_sec;
 };
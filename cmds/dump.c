@@ -4,7 +4,9 @@
 #include <inttypes.h>
 #include <time.h>
 #include <assert.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "uftrace.h"
 #include "version.h"
@@ -14,6 +16,9 @@
 #include "utils/filter.h"
 #include "utils/kernel.h"
 #include "utils/graph.h"
+#include "utils/pack.h"
+#include "utils/perfetto.h"
+#include "utils/arrow.h"
 #include "libtraceevent/kbuffer.h"
 #include "libtraceevent/event-parse.h"
 
@@ -61,6 +66,14 @@ struct uftrace_dump_ops {
 	/* this is called at the end */
 	void (*footer)(struct uftrace_dump_ops *ops,
 		       struct uftrace_data *handle, struct opts *opts);
+	/* these are called in a worker process instead of header and footer */
+	void (*worker_start)(struct uftrace_dump_ops *ops,
+			     struct uftrace_data *handle, struct opts *opts);
+	void (*worker_end)(struct uftrace_dump_ops *ops,
+			   struct uftrace_data *handle, struct opts *opts);
+	/* this is called to merge results of workers (if supported) */
+	int (*merge)(struct uftrace_dump_ops *ops, struct uftrace_data *handle,
+		     struct opts *opts, FILE **fps, int nr_workers);
 };
 
 struct uftrace_raw_dump {
@@ -75,6 +88,19 @@ struct uftrace_chrome_dump {
 	bool last_comma;
 };
 
+struct uftrace_perfetto_dump {
+	struct uftrace_dump_ops ops;
+	struct uftrace_perfetto pf;
+	unsigned lost_event_cnt;
+};
+
+struct uftrace_arrow_dump {
+	struct uftrace_dump_ops ops;
+	struct uftrace_arrow ar;
+	struct rb_root tasks;
+	FILE *fp;
+};
+
 struct uftrace_flame_dump {
 	struct uftrace_dump_ops ops;
 	struct rb_root tasks;
@@ -86,6 +112,73 @@ struct uftrace_graphviz_dump {
 	struct uftrace_dump_ops ops;
 };
 
+/* buffer size of output (and worker pipe) for chrome and flame-graph */
+#define DUMP_BUFSIZE  (1024 * 1024)
+
+/* record sources in the same priority as read_rstack() */
+enum dump_source {
+	DUMP_SRC_USER,
+	DUMP_SRC_PERF,
+	DUMP_SRC_EVENT,
+};
+
+/* order of a record in the single process output */
+struct dump_order {
+	uint64_t	time;
+	uint64_t	seq;
+	uint32_t	idx;	/* index of task or perf data */
+	uint16_t	phase;	/* 0: records, 1: remaining functions */
+	uint16_t	source;
+};
+
+#define DUMP_CHUNK_SEP  (1U << 0)  /* needs a separator (for chrome) */
+#define DUMP_CHUNK_END  (1U << 1)
+
+/* output of a record sent from a worker, followed by the text */
+struct dump_chunk {
+	struct dump_order	order;
+	uint32_t		len;
+	uint32_t		flags;
+	uint32_t		lost;
+	uint32_t		unused;
+};
+
+struct dump_worker {
+	/* tasks handled by this worker */
+	bool			*tasks;
+	/* pipe to the parent */
+	FILE			*out;
+	/* output of the current record */
+	FILE			*buf;
+	char			*buf_ptr;
+	size_t			buf_size;
+	/* chrome needs to know if a separator is printed */
+	bool			*sep;
+	struct dump_order	order;
+};
+
+/* current worker, or NULL if it's not a worker process */
+static struct dump_worker *dump_worker;
+
+static int compare_dump_order(struct dump_order *a, struct dump_order *b)
+{
+	if (a->phase != b->phase)
+		return a->phase - b->phase;
+
+	/* remaining functions are processed in the task order */
+	if (a->phase == 0 && a->time != b->time)
+		return a->time < b->time ? -1 : 1;
+
+	if (a->source != b->source)
+		return a->source - b->source;
+	if (a->idx != b->idx)
+		return a->idx < b->idx ? -1 : 1;
+	if (a->seq != b->seq)
+		return a->seq < b->seq ? -1 : 1;
+
+	return 0;
+}
+
 static const char * rstack_type(struct uftrace_record *frs)
 {
 	return frs->type == UFTRACE_EXIT ? "exit " :
@@ -111,7 +204,7 @@ static int pr_task(struct opts *opts)
 	char *exename = NULL;
 
 	snprintf(buf, sizeof(buf), "%s/task", opts->dirname);
-	fp = fopen(buf, "r");
+	fp = pack_fopen(buf, "r");
 	if (fp == NULL)
 		return -1;
 
@@ -180,7 +273,7 @@ static int pr_task_txt(struct opts *opts)
 	char sid[20];
 
 	snprintf(buf, sizeof(buf), "%s/task.txt", opts->dirname);
-	fp = fopen(buf, "r");
+	fp = pack_fopen(buf, "r");
 	if (fp == NULL)
 		return -1;
 
@@ -987,7 +1080,7 @@ static void dump_chrome_footer(struct uftrace_dump_ops *ops,
 
 	/* read recorded date and time */
 	snprintf(buf, sizeof(buf), "%s/info", opts->dirname);
-	if (stat(buf, &statbuf) < 0)
+	if (pack_stat(buf, &statbuf) < 0)
 		return;
 
 	ctime_r(&statbuf.st_mtime, buf);
@@ -1019,12 +1112,470 @@ static void dump_chrome_footer(struct uftrace_dump_ops *ops,
 	}
 }
 
+static void dump_chrome_worker_start(struct uftrace_dump_ops *ops,
+				     struct uftrace_data *handle,
+				     struct opts *opts)
+{
+	struct uftrace_chrome_dump *chrome = container_of(ops, typeof(*chrome), ops);
+
+	/* the parent will print separators between records */
+	chrome->last_comma = false;
+	dump_worker->sep = &chrome->last_comma;
+}
+
+static void dump_chrome_worker_end(struct uftrace_dump_ops *ops,
+				   struct uftrace_data *handle,
+				   struct opts *opts)
+{
+	struct uftrace_chrome_dump *chrome = container_of(ops, typeof(*chrome), ops);
+	struct dump_chunk chunk = {
+		.flags = DUMP_CHUNK_END,
+		.lost  = chrome->lost_event_cnt,
+	};
+
+	if (fwrite(&chunk, sizeof(chunk), 1, dump_worker->out) != 1)
+		pr_err("failed to send dump result");
+}
+
+static int read_dump_chunk(FILE *fp, struct dump_chunk *chunk,
+			   char **text, size_t *size)
+{
+	if (fread(chunk, sizeof(*chunk), 1, fp) != 1)
+		return -1;
+
+	if (chunk->len > *size) {
+		*size = chunk->len;
+		*text = xrealloc(*text, *size);
+	}
+
+	if (chunk->len && fread(*text, chunk->len, 1, fp) != 1)
+		return -1;
+
+	return 0;
+}
+
+/* print records from workers in the same order as a single process */
+static int dump_chrome_merge(struct uftrace_dump_ops *ops,
+			     struct uftrace_data *handle,
+			     struct opts *opts, FILE **fps, int nr_workers)
+{
+	struct uftrace_chrome_dump *chrome = container_of(ops, typeof(*chrome), ops);
+	struct dump_chunk *chunks = xcalloc(nr_workers, sizeof(*chunks));
+	char **texts = xcalloc(nr_workers, sizeof(*texts));
+	size_t *sizes = xcalloc(nr_workers, sizeof(*sizes));
+	bool *done = xcalloc(nr_workers, sizeof(*done));
+	int i, ret = 0;
+
+	for (i = 0; i < nr_workers; i++) {
+		if (read_dump_chunk(fps[i], &chunks[i], &texts[i], &sizes[i]) < 0) {
+			done[i] = true;
+			ret = -1;
+		}
+	}
+
+	while (!uftrace_done) {
+		int min = -1;
+
+		for (i = 0; i < nr_workers; i++) {
+			if (done[i])
+				continue;
+
+			if (chunks[i].flags & DUMP_CHUNK_END) {
+				chrome->lost_event_cnt += chunks[i].lost;
+				done[i] = true;
+				continue;
+			}
+
+			if (min < 0 || compare_dump_order(&chunks[i].order,
+							  &chunks[min].order) < 0)
+				min = i;
+		}
+
+		if (min < 0)
+			break;
+
+		if (chunks[min].flags & DUMP_CHUNK_SEP) {
+			if (chrome->last_comma)
+				pr_out(",\n");
+			chrome->last_comma = true;
+		}
+		fwrite(texts[min], 1, chunks[min].len, outfp);
+
+		if (read_dump_chunk(fps[min], &chunks[min],
+				    &texts[min], &sizes[min]) < 0) {
+			done[min] = true;
+			ret = -1;
+		}
+	}
+
+	for (i = 0; i < nr_workers; i++)
+		free(texts[i]);
+	free(texts);
+	free(sizes);
+	free(done);
+	free(chunks);
+	return ret;
+}
+
+/* perfetto trace support */
+static void dump_perfetto_header(struct uftrace_dump_ops *ops,
+				 struct uftrace_data *handle,
+				 struct opts *opts)
+{
+	struct uftrace_perfetto_dump *perfetto = container_of(ops, typeof(*perfetto), ops);
+	struct uftrace_info *info = &handle->info;
+	struct uftrace_task *task;
+	int i;
+
+	if (handle->hdr.feat_mask & PERF_EVENT)
+		update_perf_task_comm(handle);
+
+	perfetto_init(&perfetto->pf, outfp);
+
+	/* process tracks should come before their thread tracks */
+	for (i = 0; i < info->nr_tid; i++) {
+		task = find_task(&handle->sessions, info->tids[i]);
+		if (task == NULL)
+			continue;
+
+		/* the main thread of a process might not be traced */
+		if (task->pid == task->tid ||
+		    find_task(&handle->sessions, task->pid) == NULL)
+			perfetto_add_process(&perfetto->pf, task->pid, task->comm);
+	}
+
+	for (i = 0; i < info->nr_tid; i++) {
+		task = find_task(&handle->sessions, info->tids[i]);
+		if (task == NULL)
+			continue;
+
+		perfetto_add_thread(&perfetto->pf, task->pid, task->tid,
+				    task->comm);
+	}
+}
+
+static void dump_perfetto_task_rstack(struct uftrace_dump_ops *ops,
+				      struct uftrace_task_reader *task, char *name)
+{
+	char spec_buf[1024];
+	char *spec = NULL;
+	struct uftrace_record *frs = task->rstack;
+	enum argspec_string_bits str_mode = 0;
+	struct uftrace_perfetto_dump *perfetto = container_of(ops, typeof(*perfetto), ops);
+	int rec_type = frs->type;
+
+	if (rec_type == UFTRACE_EVENT) {
+		switch (frs->addr) {
+		case EVENT_ID_PERF_SCHED_IN:
+			/*
+			 * new thread starts with a sched-in event
+			 * which should be ignored
+			 */
+			if (task->timestamp_last == 0)
+				return;
+			rec_type = UFTRACE_EXIT;
+			break;
+		case EVENT_ID_PERF_SCHED_OUT:
+			rec_type = UFTRACE_ENTRY;
+			break;
+		default:
+			return;
+		}
+	}
+
+	if (rec_type == UFTRACE_ENTRY) {
+		if (frs->more) {
+			str_mode |= NEEDS_PAREN | HAS_MORE;
+			get_argspec_string(task, spec_buf, sizeof(spec_buf), str_mode);
+			spec = spec_buf;
+		}
+		perfetto_slice_begin(&perfetto->pf, frs->time, task->tid,
+				     name, spec);
+	}
+	else if (rec_type == UFTRACE_EXIT) {
+		if (frs->more) {
+			str_mode |= IS_RETVAL | HAS_MORE;
+			get_argspec_string(task, spec_buf, sizeof(spec_buf), str_mode);
+			spec = spec_buf;
+		}
+		perfetto_slice_end(&perfetto->pf, frs->time, task->tid, spec);
+	}
+	else if (rec_type == UFTRACE_LOST)
+		perfetto->lost_event_cnt++;
+}
+
+static void dump_perfetto_kernel_rstack(struct uftrace_dump_ops *ops,
+					struct uftrace_kernel_reader *kernel, int cpu,
+					struct uftrace_record *rec, char *name)
+{
+	int tid;
+	struct uftrace_task_reader *task;
+
+	tid = kernel->tids[cpu];
+	task = get_task_handle(kernel->handle, tid);
+
+	dump_perfetto_task_rstack(ops, task, name);
+}
+
+static void dump_perfetto_perf_event(struct uftrace_dump_ops *ops,
+				     struct uftrace_perf_reader *perf,
+				     struct uftrace_record *frs)
+{
+	struct uftrace_perfetto_dump *perfetto = container_of(ops, typeof(*perfetto), ops);
+	bool is_process = perf->u.comm.pid == perf->tid;
+
+	switch (frs->addr) {
+	case EVENT_ID_PERF_COMM:
+		/* track descriptors with the same uuid update the name */
+		if (is_process) {
+			perfetto_add_process(&perfetto->pf, perf->tid,
+					     perf->u.comm.comm);
+		}
+		perfetto_add_thread(&perfetto->pf, perf->u.comm.pid, perf->tid,
+				    perf->u.comm.comm);
+		break;
+	default:
+		break;
+	};
+}
+
+static void dump_perfetto_footer(struct uftrace_dump_ops *ops,
+				 struct uftrace_data *handle,
+				 struct opts *opts)
+{
+	struct uftrace_perfetto_dump *perfetto = container_of(ops, typeof(*perfetto), ops);
+
+	pr_dbg("perfetto trace: %"PRIu64" bytes written\n",
+	       perfetto->pf.file_size);
+	perfetto_finish(&perfetto->pf);
+
+	/* see dump_chrome_footer() */
+	if (perfetto->lost_event_cnt) {
+		pr_warn("Some of function trace records are lost. "
+			"(%d times shown)\n", perfetto->lost_event_cnt);
+		pr_warn("The output may not show the correct view "
+			"in perfetto UI.\n");
+	}
+}
+
+/* arrow file support */
+struct arrow_task {
+	struct rb_node link;
+	int tid;
+	int nr_args;
+	/* arguments of each function in the stack */
+	char **args;
+};
+
+static struct arrow_task *get_arrow_task(struct uftrace_arrow_dump *arrow,
+					 int tid)
+{
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &arrow->tasks.rb_node;
+	struct arrow_task *at;
+
+	while (*p) {
+		parent = *p;
+		at = rb_entry(parent, struct arrow_task, link);
+
+		if (at->tid == tid)
+			return at;
+
+		if (at->tid > tid)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	at = xzalloc(sizeof(*at));
+	at->tid = tid;
+
+	rb_link_node(&at->link, parent, p);
+	rb_insert_color(&at->link, &arrow->tasks);
+	return at;
+}
+
+/* keep arguments until the function returns */
+static char **get_arrow_args(struct arrow_task *at, int idx)
+{
+	if (idx >= at->nr_args) {
+		int new_nr = ALIGN(idx + 1, 64);
+
+		at->args = xrealloc(at->args, new_nr * sizeof(*at->args));
+		memset(at->args + at->nr_args, 0,
+		       (new_nr - at->nr_args) * sizeof(*at->args));
+		at->nr_args = new_nr;
+	}
+	return &at->args[idx];
+}
+
+static void dump_arrow_header(struct uftrace_dump_ops *ops,
+			      struct uftrace_data *handle,
+			      struct opts *opts)
+{
+	struct uftrace_arrow_dump *arrow = container_of(ops, typeof(*arrow), ops);
+
+	arrow_init(&arrow->ar, arrow->fp,
+		   handle->hdr.feat_mask & ARGUMENT,
+		   handle->hdr.feat_mask & RETVAL);
+}
+
+static bool symtab_has_sym(struct symtab *stab, struct sym *sym)
+{
+	return stab->sym <= sym && sym < stab->sym + stab->nr_sym;
+}
+
+/*
+ * symbols in a module have relative addresses, add the base address of
+ * the module so that the symbol column can identify a function.
+ */
+static uint64_t get_arrow_symbol(struct uftrace_task_reader *task,
+				 struct uftrace_record *rec, struct sym *sym)
+{
+	struct uftrace_session *sess;
+	struct uftrace_mmap *map;
+	struct uftrace_dlopen_list *pos;
+
+	if (sym == NULL)
+		return rec->addr;
+
+	/* kernel symbols have the actual address */
+	if (is_kernel_record(task, rec))
+		return sym->addr;
+
+	sess = find_task_session(&task->h->sessions, task->t, rec->time);
+	if (sess == NULL)
+		return rec->addr;
+
+	map = find_map(&sess->symtabs, rec->addr);
+	if (map && map != MAP_KERNEL && map->mod &&
+	    symtab_has_sym(&map->mod->symtab, sym))
+		return map->start + sym->addr;
+
+	list_for_each_entry(pos, &sess->dlopen_libs, list) {
+		if (pos->mod && symtab_has_sym(&pos->mod->symtab, sym))
+			return pos->base + sym->addr;
+	}
+	return rec->addr;
+}
+
+static void dump_arrow_task_rstack(struct uftrace_dump_ops *ops,
+				   struct uftrace_task_reader *task, char *name)
+{
+	struct uftrace_arrow_dump *arrow = container_of(ops, typeof(*arrow), ops);
+	struct uftrace_record *frs = task->rstack;
+	struct arrow_task *at = NULL;
+	struct fstack *fstack;
+	struct sym *sym;
+	char spec_buf[1024];
+	char **args;
+	struct arrow_row row = {
+		.tid  = task->tid,
+		.name = name,
+	};
+
+	if (arrow->ar.has_args || arrow->ar.has_retval)
+		at = get_arrow_task(arrow, task->tid);
+
+	if (frs->type == UFTRACE_ENTRY) {
+		if (at == NULL || task->stack_count == 0)
+			return;
+
+		args = get_arrow_args(at, task->stack_count - 1);
+		free(*args);
+		*args = NULL;
+
+		if (frs->more && arrow->ar.has_args) {
+			get_argspec_string(task, spec_buf, sizeof(spec_buf),
+					   NEEDS_PAREN | HAS_MORE);
+			*args = xstrdup(spec_buf);
+		}
+		return;
+	}
+
+	/* a row is added when the function returns */
+	if (frs->type != UFTRACE_EXIT)
+		return;
+
+	fstack = &task->func_stack[task->stack_count];
+	sym = task_find_sym(&task->h->sessions, task, frs);
+
+	row.depth = task->stack_count;
+	row.duration = fstack->total_time;
+	row.time = frs->time - fstack->total_time;
+	row.symbol = get_arrow_symbol(task, frs, sym);
+
+	if (at) {
+		args = get_arrow_args(at, task->stack_count);
+		row.args = *args;
+
+		if (frs->more && arrow->ar.has_retval) {
+			get_argspec_string(task, spec_buf, sizeof(spec_buf),
+					   IS_RETVAL | HAS_MORE);
+			row.retval = spec_buf;
+		}
+	}
+
+	arrow_add_row(&arrow->ar, &row);
+
+	if (at) {
+		free(*args);
+		*args = NULL;
+	}
+}
+
+static void dump_arrow_kernel_rstack(struct uftrace_dump_ops *ops,
+				     struct uftrace_kernel_reader *kernel, int cpu,
+				     struct uftrace_record *rec, char *name)
+{
+	int tid;
+	struct uftrace_task_reader *task;
+
+	tid = kernel->tids[cpu];
+	task = get_task_handle(kernel->handle, tid);
+
+	dump_arrow_task_rstack(ops, task, name);
+}
+
+static void dump_arrow_footer(struct uftrace_dump_ops *ops,
+			      struct uftrace_data *handle,
+			      struct opts *opts)
+{
+	struct uftrace_arrow_dump *arrow = container_of(ops, typeof(*arrow), ops);
+	struct rb_node *node;
+	struct arrow_task *at;
+	int i;
+
+	pr_dbg("arrow: %"PRIu64" rows in %u batches, %u names\n",
+	       arrow->ar.total_rows + arrow->ar.nr_rows,
+	       arrow->ar.nr_blocks + !!arrow->ar.nr_rows,
+	       arrow->ar.nr_names);
+	arrow_finish(&arrow->ar);
+
+	while (!RB_EMPTY_ROOT(&arrow->tasks)) {
+		node = rb_first(&arrow->tasks);
+		at = rb_entry(node, struct arrow_task, link);
+
+		rb_erase(node, &arrow->tasks);
+		for (i = 0; i < at->nr_args; i++)
+			free(at->args[i]);
+		free(at->args);
+		free(at);
+	}
+}
+
 /* flamegraph support */
 static struct uftrace_graph flame_graph = {
 	.root.head     = LIST_HEAD_INIT(flame_graph.root.head),
 	.special_nodes = LIST_HEAD_INIT(flame_graph.special_nodes),
 };
 
+struct flame_graph_node {
+	struct uftrace_graph_node	node;
+	/* first entry of the node to keep the order of children */
+	struct dump_order		first;
+};
+
 static void adjust_fg_time(struct uftrace_task_graph *tg, void *arg)
 {
 	struct uftrace_dump_ops *ops = arg;
@@ -1125,7 +1676,7 @@ static void dump_flame_task_rstack(struct uftrace_dump_ops *ops,
 	if (graph->node == NULL)
 		graph->node = &flame_graph.root;
 
-	graph_add_node(graph, frs->type, name, sizeof(struct uftrace_graph_node));
+	graph_add_node(graph, frs->type, name, sizeof(struct flame_graph_node));
 }
 
 static void dump_flame_kernel_rstack(struct uftrace_dump_ops *ops,
@@ -1147,7 +1698,7 @@ static void dump_flame_kernel_rstack(struct uftrace_dump_ops *ops,
 	if (graph->node == NULL)
 		graph->node = &flame_graph.root;
 
-	graph_add_node(graph, rec->type, name, sizeof(struct uftrace_graph_node));
+	graph_add_node(graph, rec->type, name, sizeof(struct flame_graph_node));
 }
 
 static void dump_flame_footer(struct uftrace_dump_ops *ops,
@@ -1160,6 +1711,186 @@ static void dump_flame_footer(struct uftrace_dump_ops *ops,
 	graph_remove_task();
 }
 
+/* parallel flame graph support */
+struct flame_worker_msg {
+	struct dump_order	first;
+	uint64_t		time;
+	uint64_t		child_time;
+	uint64_t		addr;
+	uint32_t		nr_calls;
+	uint32_t		depth;
+	uint32_t		namelen;
+	uint32_t		unused;
+};
+
+static void set_fg_order(struct uftrace_task_graph *tg, void *arg)
+{
+	struct flame_graph_node *fnode;
+
+	/* it's a new node */
+	if (tg->node->nr_calls == 1) {
+		fnode = container_of(tg->node, typeof(*fnode), node);
+		fnode->first = dump_worker->order;
+	}
+}
+
+static void dump_flame_worker_start(struct uftrace_dump_ops *ops,
+				    struct uftrace_data *handle,
+				    struct opts *opts)
+{
+	graph_init_callbacks(set_fg_order, adjust_fg_time, NULL, ops);
+}
+
+static void send_flame_graph(struct uftrace_graph_node *node, int depth,
+			     FILE *fp)
+{
+	struct uftrace_graph_node *child;
+	struct flame_graph_node *fnode;
+	struct flame_worker_msg msg;
+
+	list_for_each_entry(child, &node->head, list) {
+		fnode = container_of(child, typeof(*fnode), node);
+
+		memset(&msg, 0, sizeof(msg));
+		msg.first      = fnode->first;
+		msg.time       = child->time;
+		msg.child_time = child->child_time;
+		msg.addr       = child->addr;
+		msg.nr_calls   = child->nr_calls;
+		msg.depth      = depth;
+		msg.namelen    = strlen(child->name);
+
+		if (fwrite(&msg, sizeof(msg), 1, fp) != 1 ||
+		    fwrite(child->name, msg.namelen, 1, fp) != 1)
+			pr_err("failed to send flame graph");
+
+		send_flame_graph(child, depth + 1, fp);
+	}
+}
+
+static void dump_flame_worker_end(struct uftrace_dump_ops *ops,
+				  struct uftrace_data *handle,
+				  struct opts *opts)
+{
+	send_flame_graph(&flame_graph.root, 1, dump_worker->out);
+}
+
+static int recv_flame_graph(FILE *fp)
+{
+	struct uftrace_graph_node **stack = NULL;
+	struct uftrace_graph_node *parent, *node;
+	struct flame_graph_node *fnode;
+	struct flame_worker_msg msg;
+	unsigned nr_stack = 0;
+	char *name = NULL;
+	size_t name_size = 0;
+	int ret = 0;
+
+	while (fread(&msg, sizeof(msg), 1, fp) == 1) {
+		if (msg.depth == 0 || msg.depth > nr_stack + 1) {
+			ret = -1;
+			break;
+		}
+
+		if (msg.namelen >= name_size) {
+			name_size = msg.namelen + 1;
+			name = xrealloc(name, name_size);
+		}
+		if (msg.namelen && fread(name, msg.namelen, 1, fp) != 1) {
+			ret = -1;
+			break;
+		}
+		name[msg.namelen] = '\0';
+
+		parent = msg.depth == 1 ? &flame_graph.root : stack[msg.depth - 2];
+
+		node = graph_find_child(parent, msg.addr, name);
+		if (node == NULL) {
+			node = graph_new_node(&flame_graph, parent, msg.addr,
+					      name, sizeof(*fnode));
+
+			fnode = container_of(node, typeof(*fnode), node);
+			fnode->first = msg.first;
+		}
+		else {
+			fnode = container_of(node, typeof(*fnode), node);
+			if (compare_dump_order(&msg.first, &fnode->first) < 0)
+				fnode->first = msg.first;
+		}
+
+		node->nr_calls   += msg.nr_calls;
+		node->time       += msg.time;
+		node->child_time += msg.child_time;
+
+		if (msg.depth > nr_stack)
+			stack = xrealloc(stack, msg.depth * sizeof(*stack));
+		stack[msg.depth - 1] = node;
+		nr_stack = msg.depth;
+	}
+
+	if (ferror(fp))
+		ret = -1;
+
+	free(name);
+	free(stack);
+	return ret;
+}
+
+static int cmp_flame_node(const void *a, const void *b)
+{
+	struct flame_graph_node *na = *(struct flame_graph_node **)a;
+	struct flame_graph_node *nb = *(struct flame_graph_node **)b;
+
+	return compare_dump_order(&na->first, &nb->first);
+}
+
+/* sort children by the first entry as if it's done in a single process */
+static void sort_flame_graph(struct uftrace_graph_node *node)
+{
+	struct uftrace_graph_node *child, *tmp;
+	struct flame_graph_node **nodes;
+	int i, nr = 0;
+
+	list_for_each_entry(child, &node->head, list)
+		nr++;
+
+	if (nr == 0)
+		return;
+
+	nodes = xmalloc(nr * sizeof(*nodes));
+
+	i = 0;
+	list_for_each_entry_safe(child, tmp, &node->head, list) {
+		nodes[i++] = container_of(child, struct flame_graph_node, node);
+		list_del(&child->list);
+	}
+
+	qsort(nodes, nr, sizeof(*nodes), cmp_flame_node);
+
+	for (i = 0; i < nr; i++) {
+		child = &nodes[i]->node;
+		list_add_tail(&child->list, &node->head);
+		sort_flame_graph(child);
+	}
+
+	free(nodes);
+}
+
+static int dump_flame_merge(struct uftrace_dump_ops *ops,
+			    struct uftrace_data *handle,
+			    struct opts *opts, FILE **fps, int nr_workers)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < nr_workers; i++) {
+		if (recv_flame_graph(fps[i]) < 0)
+			ret = -1;
+	}
+
+	sort_flame_graph(&flame_graph.root);
+	return ret;
+}
+
 /* to graphviz support */
 static struct uftrace_graph graphviz_graph = {
 	.root.head     = LIST_HEAD_INIT(graphviz_graph.root.head),
@@ -1361,7 +2092,7 @@ static void do_dump_file(struct uftrace_dump_ops *ops, struct opts *opts,
 			}
 
 			addr = get_kernel_address(&fsess->symtabs, frs->addr);
-			sym = find_symtabs(&fsess->symtabs, addr);
+			sym = session_find_sym(fsess, addr);
 			name = symbol_getname(sym, addr);
 
 			call_if_nonull(ops->kernel_func, ops, kernel, i, frs, name);
@@ -1490,18 +2221,97 @@ static void dump_replay_event(struct uftrace_dump_ops *ops,
 	}
 }
 
-static void do_dump_replay(struct uftrace_dump_ops *ops, struct opts *opts,
-			   struct uftrace_data *handle)
+static bool is_worker_task(struct uftrace_data *handle,
+			   struct uftrace_task_reader *task)
+{
+	if (dump_worker == NULL)
+		return true;
+
+	return dump_worker->tasks[task - handle->tasks];
+}
+
+static void begin_worker_record(struct uftrace_data *handle,
+				struct uftrace_task_reader *task, int phase)
+{
+	struct dump_order *order = &dump_worker->order;
+
+	order->time   = task->rstack->time;
+	order->phase  = phase;
+	order->source = DUMP_SRC_USER;
+	order->idx    = task - handle->tasks;
+	order->seq++;
+
+	if (phase == 0 && task->rstack != &task->ustack) {
+		if (task->rstack == &task->estack) {
+			order->source = DUMP_SRC_EVENT;
+		}
+		else {
+			order->source = DUMP_SRC_PERF;
+			order->idx    = handle->last_perf_idx;
+		}
+	}
+
+	if (dump_worker->sep)
+		*dump_worker->sep = false;
+}
+
+/* send the output of the current record to the parent */
+static void end_worker_record(void)
+{
+	struct dump_chunk chunk = {
+		.order = dump_worker->order,
+	};
+
+	fflush(dump_worker->buf);
+
+	if (dump_worker->sep && *dump_worker->sep)
+		chunk.flags |= DUMP_CHUNK_SEP;
+
+	if (dump_worker->buf_size == 0 && chunk.flags == 0)
+		return;
+
+	chunk.len = dump_worker->buf_size;
+
+	if (fwrite(&chunk, sizeof(chunk), 1, dump_worker->out) != 1 ||
+	    fwrite(dump_worker->buf_ptr, 1, chunk.len,
+		   dump_worker->out) != chunk.len)
+		pr_err("failed to send dump result");
+
+	rewind(dump_worker->buf);
+}
+
+static void dump_replay_rstack(struct uftrace_dump_ops *ops,
+			       struct uftrace_data *handle,
+			       struct uftrace_task_reader *task,
+			       struct opts *opts, int phase)
+{
+	if (dump_worker)
+		begin_worker_record(handle, task, phase);
+
+	if (task->rstack->type == UFTRACE_EVENT)
+		dump_replay_event(ops, task);
+	else
+		dump_replay_func(ops, task, opts);
+
+	if (dump_worker)
+		end_worker_record();
+}
+
+static void dump_replay_records(struct uftrace_dump_ops *ops,
+				struct opts *opts,
+				struct uftrace_data *handle)
 {
 	uint64_t prev_time = 0;
 	struct uftrace_task_reader *task;
 	int i;
 
-	ops->header(ops, handle, opts);
-
 	while (!read_rstack(handle, &task) && !uftrace_done) {
 		struct uftrace_record *frs = task->rstack;
 
+		/* perf data has records of other tasks */
+		if (!is_worker_task(handle, task))
+			continue;
+
 		task->timestamp_last = frs->time;
 
 		if (!check_task_rstack(task, opts))
@@ -1511,11 +2321,7 @@ static void do_dump_replay(struct uftrace_dump_ops *ops, struct opts *opts,
 			ops->inverted_time(ops, task);
 		prev_time = frs->time;
 
-
-		if (task->rstack->type == UFTRACE_EVENT)
-			dump_replay_event(ops, task);
-		else
-			dump_replay_func(ops, task, opts);
+		dump_replay_rstack(ops, handle, task, opts, 0);
 	}
 
 	/* add duration of remaining functions */
@@ -1527,6 +2333,9 @@ static void do_dump_replay(struct uftrace_dump_ops *ops, struct opts *opts,
 		if (task->stack_count == 0)
 			continue;
 
+		if (!is_worker_task(handle, task))
+			continue;
+
 		last_time = task->timestamp_last;
 
 		if (handle->time_range.stop && handle->time_range.stop < last_time)
@@ -1565,13 +2374,190 @@ static void do_dump_replay(struct uftrace_dump_ops *ops, struct opts *opts,
 			if (!check_task_rstack(task, opts))
 				continue;
 
-			if (task->rstack->type == UFTRACE_EVENT)
-				dump_replay_event(ops, task);
-			else
-				dump_replay_func(ops, task, opts);
+			dump_replay_rstack(ops, handle, task, opts, 1);
 		}
 	}
+}
+
+/* parallel dump support */
+static bool can_dump_parallel(struct uftrace_dump_ops *ops,
+			      struct uftrace_data *handle,
+			      struct opts *opts)
+{
+	if (ops->merge == NULL)
+		return false;
+
+	/* trace-on/off triggers affect all tasks */
+	if (opts->trigger || opts->disabled)
+		return false;
+
+	/* display depth can be inherited from the parent task */
+	if (opts->depth != OPT_DEPTH_DEFAULT)
+		return false;
+
+	/* time range might need the first timestamp of all tasks */
+	if (handle->time_range.start || handle->time_range.stop)
+		return false;
+
+	if (opts->tid)
+		return false;
+
+	/* the order of kernel and external records is not per-task */
+	if (has_kernel_data(handle->kernel) || has_extern_data(handle))
+		return false;
+
+	return opts->nr_thread > 1 && handle->nr_tasks > 1;
+}
+
+static void __attribute__((noreturn))
+run_dump_worker(struct uftrace_dump_ops *ops, struct uftrace_data *parent,
+		struct opts *opts, int *assign, int idx, int fd)
+{
+	struct uftrace_data data;
+	struct uftrace_data *handle = &data;
+	struct dump_worker worker = {};
+
+	/* capture the output of each record */
+	worker.buf = open_memstream(&worker.buf_ptr, &worker.buf_size);
+	if (worker.buf == NULL)
+		_exit(1);
+	outfp = worker.buf;
+
+	worker.tasks = open_worker_data(opts, handle, parent, assign, idx);
+	if (worker.tasks == NULL)
+		_exit(1);
+
+	/* discard messages during setup, the parent already showed them */
+	rewind(worker.buf);
+
+	worker.out = fdopen(fd, "w");
+	if (worker.out == NULL)
+		_exit(1);
+	setvbuf(worker.out, xmalloc(DUMP_BUFSIZE), _IOFBF, DUMP_BUFSIZE);
+
+	dump_worker = &worker;
+
+	ops->worker_start(ops, handle, opts);
+	dump_replay_records(ops, opts, handle);
+	if (uftrace_done)
+		_exit(1);
+	ops->worker_end(ops, handle, opts);
+
+	if (fclose(worker.out) < 0)
+		_exit(1);
+
+	_exit(0);
+}
+
+/*
+ * dump records using multiple worker processes.  Each worker reads
+ * user records of a subset of tasks, and the parent merges the results
+ * so that the output is same as the single process.  It returns -1 if
+ * it failed to start the workers so that caller can retry without them.
+ */
+static int do_dump_parallel(struct uftrace_dump_ops *ops, struct opts *opts,
+			    struct uftrace_data *handle)
+{
+	int nr_workers = opts->nr_thread;
+	pid_t *pids;
+	FILE **fps;
+	int *assign;
+	int i, status;
+	int ret = 0;
+
+	if (nr_workers > handle->nr_tasks)
+		nr_workers = handle->nr_tasks;
+
+	pr_dbg("dump records using %d workers\n", nr_workers);
+
+	pids = xcalloc(nr_workers, sizeof(*pids));
+	fps = xcalloc(nr_workers, sizeof(*fps));
+	/* flame graph needs to track forked tasks with the parent */
+	assign = assign_worker_tasks(handle, nr_workers, opts->flame_graph);
+
+	/* do not flush the same buffer in the workers */
+	fflush(outfp);
+	fflush(logfp);
 
+	for (i = 0; i < nr_workers; i++) {
+		int pfd[2];
+
+		if (pipe(pfd) < 0) {
+			pr_warn("cannot create pipe for worker: %m\n");
+			ret = -1;
+			break;
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			pr_warn("cannot create worker: %m\n");
+			close(pfd[0]);
+			close(pfd[1]);
+			ret = -1;
+			break;
+		}
+
+		if (pids[i] == 0) {
+			int k;
+
+			close(pfd[0]);
+			for (k = 0; k < i; k++)
+				fclose(fps[k]);
+
+			run_dump_worker(ops, handle, opts, assign, i, pfd[1]);
+		}
+
+		close(pfd[1]);
+		fps[i] = fdopen(pfd[0], "r");
+		if (fps[i] == NULL)
+			pr_err("cannot open worker pipe");
+	}
+	nr_workers = i;
+
+	if (ret == 0) {
+		ops->header(ops, handle, opts);
+
+		if (ops->merge(ops, handle, opts, fps, nr_workers) < 0) {
+			pr_warn("failed to merge dump results of workers\n");
+			ret = 1;
+		}
+	}
+
+	/* workers will get SIGPIPE if it's not finished */
+	for (i = 0; i < nr_workers; i++) {
+		fclose(fps[i]);
+
+		if (waitpid(pids[i], &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status)) {
+			if (ret == 0) {
+				pr_warn("dump worker failed\n");
+				ret = 1;
+			}
+		}
+	}
+
+	if (ret >= 0)
+		ops->footer(ops, handle, opts);
+
+	free(assign);
+	free(fps);
+	free(pids);
+	return ret;
+}
+
+static void do_dump_replay(struct uftrace_dump_ops *ops, struct opts *opts,
+			   struct uftrace_data *handle)
+{
+	if (can_dump_parallel(ops, handle, opts)) {
+		if (do_dump_parallel(ops, opts, handle) >= 0)
+			return;
+
+		/* nothing is printed yet, start over */
+		pr_dbg("parallel dump failed, fallback to single process\n");
+	}
+
+	ops->header(ops, handle, opts);
+	dump_replay_records(ops, opts, handle);
 	ops->footer(ops, handle, opts);
 }
 
@@ -1588,7 +2574,42 @@ int command_dump(int argc, char *argv[], struct opts *opts)
 
 	fstack_setup_filters(opts, &handle);
 
-	if (opts->chrome_trace) {
+	if (opts->perfetto && isatty(fileno(outfp))) {
+		pr_warn("perfetto trace is binary, please redirect the output\n");
+		close_data_file(opts, &handle);
+		return -1;
+	}
+
+	/* these can generate a lot of output */
+	if ((opts->chrome_trace || opts->flame_graph || opts->perfetto) && !debug) {
+		static char outbuf[DUMP_BUFSIZE];
+
+		setvbuf(outfp, outbuf, _IOFBF, sizeof(outbuf));
+	}
+
+	if (opts->arrow_file) {
+		struct uftrace_arrow_dump dump = {
+			.ops = {
+				.header         = dump_arrow_header,
+				.task_rstack    = dump_arrow_task_rstack,
+				.kernel_func    = dump_arrow_kernel_rstack,
+				.footer         = dump_arrow_footer,
+			},
+			.tasks = RB_ROOT,
+		};
+
+		dump.fp = fopen(opts->arrow_file, "w");
+		if (dump.fp == NULL) {
+			pr_warn("cannot open arrow file: %s: %m\n",
+				opts->arrow_file);
+			ret = -1;
+		}
+		else {
+			do_dump_replay(&dump.ops, opts, &handle);
+			fclose(dump.fp);
+		}
+	}
+	else if (opts->chrome_trace) {
 		struct uftrace_chrome_dump dump = {
 			.ops = {
 				.header         = dump_chrome_header,
@@ -1596,6 +2617,22 @@ int command_dump(int argc, char *argv[], struct opts *opts)
 				.kernel_func    = dump_chrome_kernel_rstack,
 				.perf_event     = dump_chrome_perf_event,
 				.footer         = dump_chrome_footer,
+				.worker_start   = dump_chrome_worker_start,
+				.worker_end     = dump_chrome_worker_end,
+				.merge          = dump_chrome_merge,
+			},
+		};
+
+		do_dump_replay(&dump.ops, opts, &handle);
+	}
+	else if (opts->perfetto) {
+		struct uftrace_perfetto_dump dump = {
+			.ops = {
+				.header         = dump_perfetto_header,
+				.task_rstack    = dump_perfetto_task_rstack,
+				.kernel_func    = dump_perfetto_kernel_rstack,
+				.perf_event     = dump_perfetto_perf_event,
+				.footer         = dump_perfetto_footer,
 			},
 		};
 
@@ -1608,6 +2645,9 @@ int command_dump(int argc, char *argv[], struct opts *opts)
 				.task_rstack    = dump_flame_task_rstack,
 				.kernel_func    = dump_flame_kernel_rstack,
 				.footer         = dump_flame_footer,
+				.worker_start   = dump_flame_worker_start,
+				.worker_end     = dump_flame_worker_end,
+				.merge          = dump_flame_merge,
 			},
 			.tasks = RB_ROOT,
 			.sample_time = opts->sample_time,
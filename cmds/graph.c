@@ -12,6 +12,7 @@
 #include "utils/fstack.h"
 #include "utils/field.h"
 #include "utils/graph.h"
+#include "utils/cache.h"
 
 static LIST_HEAD(output_fields);
 
@@ -279,7 +280,7 @@ static int print_backtrace(struct session_graph *graph)
 		pr_out("\n");
 
 		for (k = 0; k < bt->len; k++) {
-			sym = find_symtabs(&graph->ug.sess->symtabs, bt->addr[k]);
+			sym = session_find_sym(graph->ug.sess, bt->addr[k]);
 			if (sym == NULL)
 				sym = session_find_dlsym(graph->ug.sess,
 							 bt->time, bt->addr[k]);
@@ -441,7 +442,7 @@ static void build_graph_node(struct opts *opts,
 
 	tg = get_task_graph(task, time, addr);
 
-	sym = find_symtabs(&tg->utg.graph->sess->symtabs, addr);
+	sym = session_find_sym(tg->utg.graph->sess, addr);
 	if (sym == NULL)
 		sym = session_find_dlsym(tg->utg.graph->sess, time, addr);
 
@@ -612,6 +613,217 @@ static void build_graph(struct opts *opts, struct uftrace_data *handle,
 	}
 }
 
+/* graph cache format: a node is followed by the name and its children */
+struct graph_cache_node {
+	uint64_t addr;
+	uint64_t time;
+	uint64_t child_time;
+	int32_t nr_calls;
+	int32_t nr_edges;
+	uint32_t namelen;
+	uint32_t unused;
+};
+
+struct graph_cache_backtrace {
+	int32_t len;
+	int32_t hit;
+	uint64_t time;
+};
+
+static int save_graph_node(FILE *fp, struct uftrace_graph *graph,
+			   struct uftrace_graph_node *node)
+{
+	struct uftrace_graph_node *child;
+	struct graph_cache_node msg = {
+		.addr       = node->addr,
+		.time       = node->time,
+		.child_time = node->child_time,
+		.nr_calls   = node->nr_calls,
+		.nr_edges   = node->nr_edges,
+	};
+
+	/* root name is not saved as it's set by create_graph() */
+	if (node != &graph->root)
+		msg.namelen = strlen(node->name);
+
+	if (fwrite(&msg, sizeof(msg), 1, fp) != 1 ||
+	    fwrite(node->name, msg.namelen, 1, fp) != !!msg.namelen)
+		return -1;
+
+	list_for_each_entry(child, &node->head, list) {
+		if (save_graph_node(fp, graph, child) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int save_graph_cache(FILE *fp)
+{
+	struct session_graph *graph;
+	struct graph_backtrace *bt;
+	uint32_t nr_bt;
+
+	for (graph = graph_list; graph; graph = graph->next) {
+		nr_bt = 0;
+		list_for_each_entry(bt, &graph->bt_list, list)
+			nr_bt++;
+
+		if (fwrite(graph->ug.sess->sid, SESSION_ID_LEN, 1, fp) != 1 ||
+		    fwrite(&nr_bt, sizeof(nr_bt), 1, fp) != 1)
+			return -1;
+
+		list_for_each_entry(bt, &graph->bt_list, list) {
+			struct graph_cache_backtrace msg = {
+				.len  = bt->len,
+				.hit  = bt->hit,
+				.time = bt->time,
+			};
+
+			if (fwrite(&msg, sizeof(msg), 1, fp) != 1 ||
+			    fwrite(bt->addr, sizeof(*bt->addr), bt->len, fp) != (size_t)bt->len)
+				return -1;
+		}
+
+		if (save_graph_node(fp, &graph->ug, &graph->ug.root) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* read a node and its children, and add it to @parent (NULL for root) */
+static int load_graph_node(FILE *fp, struct uftrace_graph *graph,
+			   struct uftrace_graph_node *parent)
+{
+	struct uftrace_graph_node *node;
+	struct graph_cache_node msg;
+	char *name;
+	int i;
+
+	if (fread(&msg, sizeof(msg), 1, fp) != 1)
+		return -1;
+
+	if (parent == NULL) {
+		if (msg.namelen)
+			return -1;
+		node = &graph->root;
+	}
+	else {
+		name = xmalloc(msg.namelen + 1);
+		if (fread(name, msg.namelen, 1, fp) != !!msg.namelen) {
+			free(name);
+			return -1;
+		}
+		name[msg.namelen] = '\0';
+
+		node = graph_new_node(graph, parent, msg.addr, name,
+				      sizeof(*node));
+		free(name);
+	}
+
+	node->addr       = msg.addr;
+	node->time       = msg.time;
+	node->child_time = msg.child_time;
+	node->nr_calls   = msg.nr_calls;
+
+	for (i = 0; i < msg.nr_edges; i++) {
+		if (load_graph_node(fp, graph, node) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int load_graph_cache(FILE *fp)
+{
+	struct session_graph *graph;
+	struct graph_backtrace *bt;
+	char sid[SESSION_ID_LEN];
+	uint32_t nr_bt;
+
+	for (graph = graph_list; graph; graph = graph->next) {
+		if (fread(sid, sizeof(sid), 1, fp) != 1 ||
+		    memcmp(sid, graph->ug.sess->sid, sizeof(sid)) ||
+		    fread(&nr_bt, sizeof(nr_bt), 1, fp) != 1)
+			return -1;
+
+		while (nr_bt--) {
+			struct graph_cache_backtrace msg;
+
+			if (fread(&msg, sizeof(msg), 1, fp) != 1 ||
+			    msg.len <= 0 || msg.len > OPT_RSTACK_MAX)
+				return -1;
+
+			bt = xmalloc(sizeof(*bt) + msg.len * sizeof(*bt->addr));
+			bt->len  = msg.len;
+			bt->hit  = msg.hit;
+			bt->time = msg.time;
+			list_add_tail(&bt->list, &graph->bt_list);
+
+			if (fread(bt->addr, sizeof(*bt->addr), bt->len, fp) != (size_t)bt->len)
+				return -1;
+		}
+
+		if (load_graph_node(fp, &graph->ug, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void destroy_graph_list(void)
+{
+	struct session_graph *graph;
+	struct graph_backtrace *bt, *btmp;
+
+	while (graph_list) {
+		graph = graph_list;
+		graph_list = graph->next;
+
+		free(graph->func);
+		list_for_each_entry_safe(bt, btmp, &graph->bt_list, list) {
+			list_del(&bt->list);
+			free(bt);
+		}
+		graph_destroy(&graph->ug);
+		free(graph);
+	}
+}
+
+/* build graphs from the data, or load them from the cache */
+static void setup_graph(struct opts *opts, struct uftrace_data *handle,
+			char *func)
+{
+	struct uftrace_cache cache;
+	FILE *fp;
+	bool ok;
+
+	if (cache_init(&cache, opts, "graph", full_graph ? NULL : func) < 0) {
+		build_graph(opts, handle, func);
+		return;
+	}
+
+	fp = cache_read(&cache);
+	if (fp) {
+		setup_graph_list(handle, opts, func);
+
+		ok = load_graph_cache(fp) == 0;
+		cache_close(&cache, ok);
+		if (ok)
+			goto out;
+
+		destroy_graph_list();
+	}
+
+	build_graph(opts, handle, func);
+	if (uftrace_done)
+		goto out;
+
+	fp = cache_write(&cache);
+	if (fp)
+		cache_close(&cache, save_graph_cache(fp) == 0);
+
+out:
+	cache_finish(&cache);
+}
+
 struct find_func_data {
 	char *name;
 	bool found;
@@ -660,7 +872,6 @@ int command_graph(int argc, char *argv[], struct opts *opts)
 	struct uftrace_data handle;
 	struct session_graph *graph;
 	char *func;
-	struct graph_backtrace *bt, *btmp;
 
 	__fsetlocking(outfp, FSETLOCKING_BYCALLER);
 	__fsetlocking(logfp, FSETLOCKING_BYCALLER);
@@ -689,7 +900,7 @@ int command_graph(int argc, char *argv[], struct opts *opts)
 
 	fstack_setup_filters(opts, &handle);
 
-	build_graph(opts, &handle, func);
+	setup_graph(opts, &handle, func);
 
 	graph = graph_list;
 	while (graph && !uftrace_done) {
@@ -703,18 +914,7 @@ int command_graph(int argc, char *argv[], struct opts *opts)
 			pr_out("\t please check your filter settings.\n");
 	}
 
-	while (graph_list) {
-		graph = graph_list;
-		graph_list = graph->next;
-
-		free(graph->func);
-		list_for_each_entry_safe(bt, btmp, &graph->bt_list, list) {
-			list_del(&bt->list);
-			free(bt);
-		}
-		graph_destroy(&graph->ug);
-		free(graph);
-	}
+	destroy_graph_list();
 	graph_remove_task();
 
 	close_data_file(opts, &handle);
@@ -23,6 +23,7 @@
 #include "utils/filter.h"
 #include "utils/symbol.h"
 #include "utils/fstack.h"
+#include "utils/pack.h"
 #include "version.h"
 
 #define BUILD_ID_SIZE 20
@@ -993,7 +994,7 @@ void process_uftrace_info(struct uftrace_data *handle, struct opts *opts,
 
 	snprintf(buf, sizeof(buf), "%s/info", opts->dirname);
 
-	if (stat(buf, &statbuf) < 0)
+	if (pack_stat(buf, &statbuf) < 0)
 		return;
 
 	process(data, "# system information\n");
@@ -3,12 +3,18 @@
 #include <dirent.h>
 #include <signal.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #include "uftrace.h"
 #include "utils/utils.h"
+#include "utils/field.h"
 #include "utils/fstack.h"
 #include "utils/kernel.h"
+#include "utils/list.h"
+#include "utils/rbtree.h"
+#include "utils/symbol.h"
 #include "libmcount/mcount.h"
 
 
@@ -53,6 +59,10 @@ static bool can_skip_replay(struct opts *opts, int record_result)
 	if (opts->nop)
 		return true;
 
+	/* it's already printed during the record */
+	if (opts->stream)
+		return true;
+
 	return false;
 }
 
@@ -95,6 +105,597 @@ static void setup_child_environ(struct opts *opts)
 	free(libpath);
 }
 
+/*
+ * In the streaming mode (--stream), the recorder passes the trace data
+ * in the shmem buffers and the task/session messages to this consumer
+ * directly instead of writing the <tid>.dat files.  The records of each
+ * task are merged by timestamp and printed after the reorder window so
+ * that (late) records of other tasks with an earlier timestamp can be
+ * printed before them.
+ */
+#define STREAM_DATA  (-1)  /* item type for trace data */
+
+struct stream_item {
+	struct list_head list;
+	int type;  /* UFTRACE_MSG_* or STREAM_DATA */
+	int tid;
+	uint64_t arrival;
+	size_t len;
+	char data[];
+};
+
+struct stream_rec {
+	struct uftrace_record rec;
+	uint64_t arrival;
+};
+
+struct stream_task {
+	struct rb_node node;
+	int tid;
+	/* pending records are in [head, nr) */
+	struct stream_rec *recs;
+	unsigned head;
+	unsigned nr;
+	unsigned alloc;
+	/* timestamp of the last printed record */
+	uint64_t last_time;
+	/* entry timestamp of active functions (indexed by depth) */
+	uint64_t *entry_time;
+	int max_depth;
+};
+
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct list_head queue;
+	bool done;
+	bool header;
+	bool comment;
+	bool no_merge;
+	uint64_t window;
+	char *dirname;
+	struct rb_root tasks;
+	struct uftrace_session_link sessions;
+	struct list_head fields;
+} stream = {
+	.lock  = PTHREAD_MUTEX_INITIALIZER,
+	.queue = LIST_HEAD_INIT(stream.queue),
+	.fields = LIST_HEAD_INIT(stream.fields),
+	.tasks = RB_ROOT,
+	.sessions = {
+		.root  = RB_ROOT,
+		.tasks = RB_ROOT,
+	},
+};
+
+static uint64_t stream_gettime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void stream_enqueue(int type, int tid, void *data, size_t len)
+{
+	struct stream_item *item;
+
+	item = xmalloc(sizeof(*item) + len);
+	item->type = type;
+	item->tid = tid;
+	item->len = len;
+	memcpy(item->data, data, len);
+
+	pthread_mutex_lock(&stream.lock);
+	item->arrival = stream_gettime();
+	list_add_tail(&item->list, &stream.queue);
+	pthread_cond_signal(&stream.cond);
+	pthread_mutex_unlock(&stream.lock);
+}
+
+/**
+ * live_stream_msg - pass a message from the recorder to the live stream
+ * @type: message type (UFTRACE_MSG_*)
+ * @data: message payload
+ * @len: length of @data
+ *
+ * The payload of session and dlopen messages should be followed by the
+ * (NUL-terminated) name of the executable or library.
+ */
+void live_stream_msg(int type, void *data, size_t len)
+{
+	stream_enqueue(type, 0, data, len);
+}
+
+/**
+ * live_stream_data - pass trace data from the recorder to the live stream
+ * @tid: task id of the data
+ * @data: trace records copied from a shmem buffer
+ * @len: length of @data
+ */
+void live_stream_data(int tid, void *data, size_t len)
+{
+	stream_enqueue(STREAM_DATA, tid, data, len);
+}
+
+static struct stream_task *stream_get_task(int tid)
+{
+	struct stream_task *t;
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &stream.tasks.rb_node;
+
+	while (*p) {
+		parent = *p;
+		t = rb_entry(parent, struct stream_task, node);
+
+		if (t->tid == tid)
+			return t;
+
+		if (t->tid > tid)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	t = xzalloc(sizeof(*t));
+	t->tid = tid;
+
+	rb_link_node(&t->node, parent, p);
+	rb_insert_color(&t->node, &stream.tasks);
+	return t;
+}
+
+static void stream_handle_msg(struct stream_item *item)
+{
+	struct uftrace_msg_sess *smsg;
+	struct uftrace_msg_dlopen *dmsg;
+	struct uftrace_session *s;
+
+	switch (item->type) {
+	case UFTRACE_MSG_SESSION:
+		smsg = (void *)item->data;
+		create_session(&stream.sessions, smsg, stream.dirname,
+			       smsg->exename, true, true, false);
+		break;
+
+	case UFTRACE_MSG_TASK_START:
+		create_task(&stream.sessions, (void *)item->data, false);
+		break;
+
+	case UFTRACE_MSG_FORK_END:
+		create_task(&stream.sessions, (void *)item->data, true);
+		break;
+
+	case UFTRACE_MSG_DLOPEN:
+		dmsg = (void *)item->data;
+		s = get_session_from_sid(&stream.sessions, dmsg->sid);
+		if (s != NULL)
+			session_add_dlopen(s, dmsg->task.time, dmsg->base_addr,
+					   dmsg->exename);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void stream_add_data(struct stream_item *item)
+{
+	struct stream_task *t = stream_get_task(item->tid);
+	struct uftrace_record *rec;
+	void *ptr = item->data;
+	void *end = ptr + item->len;
+
+	while (ptr + sizeof(*rec) <= end) {
+		rec = ptr;
+		ptr += sizeof(*rec);
+
+		if (rec->magic != RECORD_MAGIC) {
+			pr_dbg("invalid record in task %d\n", t->tid);
+			break;
+		}
+
+		if (rec->type == UFTRACE_EVENT) {
+			/* events are not shown, skip the payload */
+			if (rec->more) {
+				if (ptr + 2 > end)
+					break;
+				ptr += ALIGN(*(uint16_t *)ptr + 2, 8);
+			}
+			continue;
+		}
+
+		if (rec->more) {
+			/* argument data has no size info, skip the rest */
+			pr_dbg("skip record with arguments in task %d\n",
+			       t->tid);
+			break;
+		}
+
+		if (t->nr == t->alloc) {
+			/* reclaim space of printed records first */
+			if (t->head) {
+				t->nr -= t->head;
+				memmove(t->recs, t->recs + t->head,
+					t->nr * sizeof(*t->recs));
+				t->head = 0;
+			}
+			if (t->nr == t->alloc) {
+				t->alloc = t->alloc ? t->alloc * 2 : 1024;
+				t->recs = xrealloc(t->recs,
+						   t->alloc * sizeof(*t->recs));
+			}
+		}
+
+		t->recs[t->nr].rec = *rec;
+		t->recs[t->nr].arrival = item->arrival;
+		t->nr++;
+	}
+}
+
+static struct sym *stream_find_sym(struct stream_task *t,
+				   struct uftrace_record *rec)
+{
+	struct uftrace_task *task;
+	struct uftrace_session *sess;
+	struct sym *sym;
+
+	task = find_task(&stream.sessions, t->tid);
+	if (task == NULL)
+		return NULL;
+
+	sess = find_task_session(&stream.sessions, task, rec->time);
+	if (sess == NULL)
+		return NULL;
+
+	sym = session_find_sym(sess, rec->addr);
+	if (sym == NULL)
+		sym = session_find_dlsym(sess, rec->time, rec->addr);
+
+	return sym;
+}
+
+/* print the leading fields using the replay fields */
+static void stream_print_field(int tid, uint64_t duration, int depth)
+{
+	struct uftrace_task_reader task = {
+		.tid = tid,
+	};
+	struct fstack fstack = {
+		.total_time = duration,
+	};
+	struct field_data fd = {
+		.task = &task,
+		.fstack = &fstack,
+	};
+	char buf[2 * (FIELD_BUFSIZE + 1)];
+	int len;
+
+	if (!stream.header) {
+		print_header(&stream.fields, "#", 1);
+		stream.header = true;
+	}
+
+	len = format_field_data(&stream.fields, &fd, 1, buf);
+	pr_out("%.*s | %*s", len, buf, depth * 2, "");
+}
+
+/*
+ * check if other tasks have a record between @entry and @exit.  Replay
+ * doesn't merge a leaf function in that case.  Records of other tasks
+ * might be printed already if the function ran longer than the window.
+ */
+static bool stream_is_leaf(struct stream_task *task, uint64_t entry,
+			   uint64_t exit)
+{
+	struct stream_task *t;
+	struct rb_node *n;
+
+	for (n = rb_first(&stream.tasks); n; n = rb_next(n)) {
+		t = rb_entry(n, struct stream_task, node);
+
+		if (t == task)
+			continue;
+		if (t->last_time > entry)
+			return false;
+		if (t->head != t->nr && t->recs[t->head].rec.time < exit)
+			return false;
+	}
+	return true;
+}
+
+/* print a record at the head of the task (and its exit for leaf) */
+static void stream_print_rec(struct stream_task *t)
+{
+	struct uftrace_record *rec = &t->recs[t->head++].rec;
+	struct uftrace_record *next = NULL;
+	int depth = rec->depth;
+	struct sym *sym;
+	char *name;
+	const char *paren;
+
+	if (rec->time)
+		t->last_time = rec->time;
+
+	if (rec->type == UFTRACE_LOST) {
+		stream_print_field(t->tid, 0, 0);
+		pr_red("/* LOST %d records!! */\n", (int)rec->addr);
+		return;
+	}
+
+	if (depth >= t->max_depth) {
+		int old = t->max_depth;
+
+		t->max_depth = depth + 16;
+		t->entry_time = xrealloc(t->entry_time,
+					 t->max_depth * sizeof(*t->entry_time));
+		/* functions inherited from the parent have no entry time */
+		memset(t->entry_time + old, 0,
+		       (t->max_depth - old) * sizeof(*t->entry_time));
+	}
+
+	sym = stream_find_sym(t, rec);
+	name = symbol_getname(sym, rec->addr);
+	paren = name[strlen(name) - 1] == ')' ? "" : "()";
+
+	if (rec->type == UFTRACE_ENTRY) {
+		if (t->head < t->nr)
+			next = &t->recs[t->head].rec;
+
+		if (next && !stream.no_merge && next->type == UFTRACE_EXIT &&
+		    next->depth == rec->depth &&
+		    stream_is_leaf(t, rec->time, next->time)) {
+			/* leaf function - also consume the exit record */
+			t->head++;
+			t->last_time = next->time;
+
+			stream_print_field(t->tid, next->time - rec->time, depth);
+			pr_out("%s%s;\n", name, paren);
+		}
+		else {
+			t->entry_time[depth] = rec->time;
+
+			stream_print_field(t->tid, 0, depth);
+			pr_out("%s%s {\n", name, paren);
+		}
+	}
+	else if (rec->type == UFTRACE_EXIT) {
+		uint64_t duration = 0;
+
+		if (t->entry_time[depth] && t->entry_time[depth] < rec->time)
+			duration = rec->time - t->entry_time[depth];
+		t->entry_time[depth] = 0;
+
+		stream_print_field(t->tid, duration, depth);
+		pr_out("}%s", out_color_str(COLOR_CODE_GRAY));
+		if (stream.comment)
+			pr_out(" /* %s */", name);
+		pr_out("\n%s", color_reset);
+	}
+
+	symbol_putname(sym, name);
+}
+
+/*
+ * Print records arrived before the reorder window (or all records if
+ * @all is true) in timestamp order.  Pending records which have earlier
+ * timestamps than those are printed together to keep the order.
+ */
+static void stream_print(bool all)
+{
+	uint64_t now = stream_gettime();
+	uint64_t limit = 0;
+	bool found = false;
+	struct stream_task *t, *next;
+	struct rb_node *n;
+	unsigned i;
+
+	for (n = rb_first(&stream.tasks); n; n = rb_next(n)) {
+		t = rb_entry(n, struct stream_task, node);
+
+		for (i = t->head; i < t->nr; i++) {
+			struct stream_rec *r = &t->recs[i];
+
+			if (!all && r->arrival + stream.window > now)
+				break;
+
+			if (r->rec.time > limit)
+				limit = r->rec.time;
+			found = true;
+		}
+	}
+
+	if (!found)
+		return;
+
+	/* k-way merge of the tasks */
+	while (true) {
+		next = NULL;
+
+		for (n = rb_first(&stream.tasks); n; n = rb_next(n)) {
+			t = rb_entry(n, struct stream_task, node);
+
+			if (t->head == t->nr)
+				continue;
+			if (t->recs[t->head].rec.time > limit)
+				continue;
+
+			if (next == NULL ||
+			    t->recs[t->head].rec.time < next->recs[next->head].rec.time)
+				next = t;
+		}
+
+		if (next == NULL)
+			break;
+
+		stream_print_rec(next);
+	}
+
+	fflush(outfp);
+}
+
+static bool stream_has_pending(void)
+{
+	struct stream_task *t;
+	struct rb_node *n;
+
+	for (n = rb_first(&stream.tasks); n; n = rb_next(n)) {
+		t = rb_entry(n, struct stream_task, node);
+
+		if (t->head != t->nr)
+			return true;
+	}
+	return false;
+}
+
+static void *stream_thread(void *arg)
+{
+	LIST_HEAD(items);
+	struct stream_item *item, *tmp;
+	struct timespec ts;
+	sigset_t sigset;
+	bool done;
+
+	pthread_setname_np(pthread_self(), "LiveStream");
+
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+	pthread_mutex_lock(&stream.lock);
+	while (true) {
+		if (list_empty(&stream.queue) && !stream.done) {
+			if (stream_has_pending()) {
+				/* check the window every millisecond */
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				ts.tv_nsec += NSEC_PER_MSEC;
+				if (ts.tv_nsec >= NSEC_PER_SEC) {
+					ts.tv_sec++;
+					ts.tv_nsec -= NSEC_PER_SEC;
+				}
+				pthread_cond_timedwait(&stream.cond,
+						       &stream.lock, &ts);
+			}
+			else {
+				pthread_cond_wait(&stream.cond, &stream.lock);
+			}
+		}
+
+		list_splice_tail_init(&stream.queue, &items);
+		done = stream.done;
+		pthread_mutex_unlock(&stream.lock);
+
+		list_for_each_entry_safe(item, tmp, &items, list) {
+			if (item->type == STREAM_DATA)
+				stream_add_data(item);
+			else
+				stream_handle_msg(item);
+
+			list_del(&item->list);
+			free(item);
+		}
+
+		stream_print(done);
+
+		pthread_mutex_lock(&stream.lock);
+		if (done && list_empty(&stream.queue))
+			break;
+	}
+	pthread_mutex_unlock(&stream.lock);
+
+	return NULL;
+}
+
+/**
+ * start_live_stream - start a thread to print trace data in the recorder
+ * @opts: uftrace options
+ *
+ * This is called by the recorder when live command is running with the
+ * --stream option.  The data is passed using live_stream_data() and
+ * live_stream_msg() and printed after the reorder window.
+ */
+void start_live_stream(struct opts *opts)
+{
+	pthread_condattr_t attr;
+
+	stream.window = opts->stream_window;
+	stream.comment = opts->comment;
+	stream.no_merge = opts->no_merge;
+	stream.dirname = opts->dirname;
+
+	setup_replay_default_field(&stream.fields);
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&stream.cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	pr_dbg("start live stream with %"PRIu64" usec window\n",
+	       stream.window / 1000);
+
+	if (pthread_create(&stream.thread, NULL, stream_thread, NULL))
+		pr_err("cannot create live stream thread");
+}
+
+/**
+ * finish_live_stream - print all remaining data and stop the thread
+ *
+ * This should be called after the recorder passed all the data.
+ */
+void finish_live_stream(void)
+{
+	struct stream_task *t;
+	struct rb_node *n;
+
+	pthread_mutex_lock(&stream.lock);
+	stream.done = true;
+	pthread_cond_signal(&stream.cond);
+	pthread_mutex_unlock(&stream.lock);
+
+	pthread_join(stream.thread, NULL);
+
+	while (!RB_EMPTY_ROOT(&stream.tasks)) {
+		n = rb_first(&stream.tasks);
+		rb_erase(n, &stream.tasks);
+
+		t = rb_entry(n, struct stream_task, node);
+		free(t->recs);
+		free(t->entry_time);
+		free(t);
+	}
+
+	delete_sessions(&stream.sessions);
+	unload_module_symtabs();
+}
+
+/* disable options not supported in the streaming mode */
+static void setup_stream_opts(struct opts *opts)
+{
+	if (opts->args || opts->retval || opts->auto_args) {
+		pr_warn("--stream doesn't support arguments and return values\n");
+		free(opts->args);
+		opts->args = NULL;
+		free(opts->retval);
+		opts->retval = NULL;
+		opts->auto_args = false;
+	}
+
+	if (opts->kernel || opts->event) {
+		pr_warn("--stream doesn't support kernel tracing and events\n");
+		opts->kernel = false;
+		free(opts->event);
+		opts->event = NULL;
+	}
+
+	if (opts->report) {
+		pr_warn("--stream doesn't support --report\n");
+		opts->report = false;
+	}
+
+	/* default events (i.e. sched) are not shown too */
+	opts->no_event = true;
+}
+
 int command_live(int argc, char *argv[], struct opts *opts)
 {
 	char template[32] = "/tmp/uftrace-live-XXXXXX";
@@ -135,6 +736,9 @@ int command_live(int argc, char *argv[], struct opts *opts)
 		return 0;
 	}
 
+	if (opts->stream)
+		setup_stream_opts(opts);
+
 	ret = command_record(argc, argv, opts);
 	if (!can_skip_replay(opts, ret)) {
 		int ret2;
@@ -0,0 +1,55 @@
+/*
+ * uftrace pack command related routines
+ *
+ * Released under the GPL v2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uftrace.h"
+#include "utils/utils.h"
+#include "utils/pack.h"
+
+int command_pack(int argc, char *argv[], struct opts *opts)
+{
+	char *dirname = xstrdup(opts->dirname);
+	char *filename = NULL;
+	char *info = NULL;
+	size_t len = strlen(dirname);
+	int ret = -1;
+
+	/* remove trailing slashes to get the default pack file name */
+	while (len > 1 && dirname[len - 1] == '/')
+		dirname[--len] = '\0';
+
+	if (is_pack_file(dirname)) {
+		pr_use("%s is already a pack file\n", dirname);
+		goto out;
+	}
+
+	xasprintf(&info, "%s/info", dirname);
+	if (access(info, F_OK) < 0) {
+		pr_warn("cannot open record data: %s: %m\n", dirname);
+		goto out;
+	}
+
+	if (argc > 0)
+		filename = xstrdup(argv[0]);
+	else
+		xasprintf(&filename, "%s.pack", dirname);
+
+	ret = pack_data_dir(dirname, filename);
+	if (ret < 0)
+		pr_warn("cannot save %s to %s: %m\n", dirname, filename);
+	else
+		pr_out("uftrace: %s is saved to %s\n", dirname, filename);
+
+out:
+	free(filename);
+	free(info);
+	free(dirname);
+	return ret;
+}
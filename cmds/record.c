@@ -28,6 +28,10 @@
 #include "utils/filter.h"
 #include "utils/kernel.h"
 #include "utils/perf.h"
+#include "utils/pack.h"
+#include "utils/fstack.h"
+#include "utils/report.h"
+#include "utils/cache.h"
 
 #define SHMEM_NAME_SIZE (64 - (int)sizeof(struct list_head))
 
@@ -39,6 +43,18 @@ struct shmem_list {
 static LIST_HEAD(shmem_list_head);
 static LIST_HEAD(shmem_need_unlink);
 
+/* shmem buffers being read by the live stream (--stream) */
+struct stream_buf {
+	struct list_head list;
+	struct mcount_shmem_buffer *shmem;
+	unsigned pos;
+	int tid;
+	char id[SHMEM_NAME_SIZE];
+};
+
+static LIST_HEAD(stream_buf_list);
+static bool stream_mode;
+
 struct buf_list {
 	struct list_head list;
 	int tid;
@@ -246,6 +262,11 @@ static void setup_child_environ(struct opts *opts, int argc, char *argv[])
 		setenv("UFTRACE_THRESHOLD", buf, 1);
 	}
 
+	if (opts->read_interval) {
+		snprintf(buf, sizeof(buf), "%"PRIu64, opts->read_interval);
+		setenv("UFTRACE_READ_INTERVAL", buf, 1);
+	}
+
 	if (opts->caller) {
 		char *caller_str = uftrace_clear_kernel(opts->caller);
 
@@ -512,10 +533,406 @@ static void write_buffer_file(const char *dirname, struct buf_list *buf)
 	free(filename);
 }
 
+/*
+ * With the --cache option, the writers build statistics of functions in
+ * each task while writing the buffers and they are saved in the report
+ * cache after recording.  It follows fstack_account_time() and
+ * report_update_node() for user records, and gives up if the data has
+ * something it cannot handle in the same way (like LOST records).
+ */
+struct stat_frame {
+	uint64_t addr;
+	uint64_t start;
+	uint64_t child_time;
+};
+
+struct stat_func {
+	struct uftrace_report_node node;
+	struct stat_func *next;
+	uint64_t addr;
+	/* to check the symbol doesn't change (by dlopen) */
+	uint64_t first_time;
+	uint64_t last_time;
+};
+
+struct stat_task {
+	struct rb_node node;
+	int tid;
+	int stack_count;
+	int max_stack;
+	bool fstack_set;
+	/* timestamp of the last record */
+	uint64_t last_time;
+	struct stat_frame *frames;
+	struct stat_func *funcs;
+	struct uftrace_report_hash hash;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct rb_root tasks;
+	int max_stack;
+	bool enabled;
+	bool failed;
+} func_stat = {
+	.lock  = PTHREAD_MUTEX_INITIALIZER,
+	.tasks = RB_ROOT,
+};
+
+/* buffers of a task are written by a writer at a time */
+static struct stat_task *stat_get_task(int tid)
+{
+	struct stat_task *t;
+	struct rb_node *parent = NULL;
+	struct rb_node **p;
+
+	pthread_mutex_lock(&func_stat.lock);
+
+	p = &func_stat.tasks.rb_node;
+	while (*p) {
+		parent = *p;
+		t = rb_entry(parent, struct stat_task, node);
+
+		if (t->tid == tid)
+			goto out;
+
+		if (t->tid > tid)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	t = xzalloc(sizeof(*t));
+	t->tid = tid;
+
+	rb_link_node(&t->node, parent, p);
+	rb_insert_color(&t->node, &func_stat.tasks);
+
+out:
+	pthread_mutex_unlock(&func_stat.lock);
+	return t;
+}
+
+static void stat_fail(int tid, const char *reason)
+{
+	pr_dbg("cannot build function stats of task %d: %s\n", tid, reason);
+	__atomic_store_n(&func_stat.failed, true, __ATOMIC_RELAXED);
+}
+
+static void stat_grow_stack(struct stat_task *t, int count)
+{
+	int old = t->max_stack;
+
+	if (count <= old)
+		return;
+
+	t->max_stack = count + 16;
+	t->frames = xrealloc(t->frames, t->max_stack * sizeof(*t->frames));
+	memset(t->frames + old, 0, (t->max_stack - old) * sizeof(*t->frames));
+}
+
+static struct stat_func *stat_get_func(struct stat_task *t, uint64_t addr,
+				       uint64_t time)
+{
+	struct uftrace_report_node *node;
+	struct stat_func *func;
+
+	node = report_hash_find(&t->hash, addr, true);
+	if (node) {
+		func = container_of(node, struct stat_func, node);
+		func->last_time = time;
+		return func;
+	}
+
+	func = xzalloc(sizeof(*func));
+	func->addr = addr;
+	func->first_time = func->last_time = time;
+	func->node.total.min = -1ULL;
+	func->node.self.min = -1ULL;
+
+	func->next = t->funcs;
+	t->funcs = func;
+
+	report_hash_add(&t->hash, addr, true, &func->node);
+	return func;
+}
+
+/* @fr was popped from the stack already, same as report_update_node() */
+static void stat_add_time(struct stat_task *t, struct stat_frame *fr,
+			  uint64_t addr, uint64_t time, uint64_t total_time)
+{
+	struct stat_func *func = stat_get_func(t, addr, time);
+	bool recursive = false;
+	int i;
+
+	for (i = 0; i < t->stack_count; i++) {
+		if (t->frames[i].addr == fr->addr) {
+			recursive = true;
+			break;
+		}
+	}
+
+	report_add_time(&func->node, total_time, total_time - fr->child_time,
+			recursive);
+}
+
+static void stat_add_buffer(int tid, void *data, size_t len)
+{
+	struct stat_task *t;
+	struct stat_frame *fr;
+	struct uftrace_record *rec;
+	void *ptr = data;
+	void *end = data + len;
+	uint64_t delta;
+	int i;
+
+	if (__atomic_load_n(&func_stat.failed, __ATOMIC_RELAXED))
+		return;
+
+	t = stat_get_task(tid);
+
+	while (ptr + sizeof(*rec) <= end) {
+		rec = ptr;
+		ptr += sizeof(*rec);
+
+		if (rec->magic != RECORD_MAGIC) {
+			stat_fail(tid, "invalid record");
+			return;
+		}
+
+		t->last_time = rec->time;
+
+		if (rec->type == UFTRACE_EVENT) {
+			/* events don't change the stats, skip the payload */
+			if (rec->more) {
+				if (ptr + 2 > end) {
+					stat_fail(tid, "invalid event");
+					return;
+				}
+				ptr += ALIGN(*(uint16_t *)ptr + 2, 8);
+			}
+			continue;
+		}
+
+		if (rec->type == UFTRACE_LOST) {
+			stat_fail(tid, "lost records");
+			return;
+		}
+
+		if (rec->more) {
+			/* argument data has no size info */
+			stat_fail(tid, "arguments");
+			return;
+		}
+
+		if (!t->fstack_set) {
+			/* inherit stack count after fork */
+			t->stack_count = rec->depth;
+			if (rec->type == UFTRACE_EXIT)
+				t->stack_count++;
+
+			stat_grow_stack(t, t->stack_count);
+			for (i = 0; i < t->stack_count; i++)
+				t->frames[i].start = rec->time;
+
+			t->fstack_set = true;
+		}
+
+		if (rec->type == UFTRACE_ENTRY) {
+			if (rec->depth != t->stack_count ||
+			    t->stack_count + 1 >= func_stat.max_stack) {
+				stat_fail(tid, "unexpected depth");
+				return;
+			}
+
+			/* to check the symbol of the fixup functions */
+			stat_get_func(t, rec->addr, rec->time);
+
+			stat_grow_stack(t, t->stack_count + 1);
+			fr = &t->frames[t->stack_count++];
+
+			fr->addr = rec->addr;
+			fr->start = rec->time;
+			fr->child_time = 0;
+		}
+		else {
+			if (rec->depth + 1 != t->stack_count) {
+				stat_fail(tid, "unexpected depth");
+				return;
+			}
+
+			fr = &t->frames[--t->stack_count];
+
+			delta = rec->time - fr->start;
+			if (fr->child_time > delta)
+				fr->child_time = delta;
+
+			/* add current time to parent's child time */
+			if (t->stack_count > 0)
+				fr[-1].child_time += delta;
+
+			stat_add_time(t, fr, rec->addr, rec->time, delta);
+		}
+	}
+}
+
+/* add duration of remaining functions, same as add_remaining_fstack() */
+static void stat_add_remaining(struct stat_task *t)
+{
+	uint64_t last_time = t->last_time;
+	struct stat_frame *fr;
+	uint64_t total_time;
+
+	while (--t->stack_count >= 0) {
+		fr = &t->frames[t->stack_count];
+
+		if (fr->addr == 0 || fr->start > last_time)
+			continue;
+
+		total_time = last_time - fr->start;
+		if (fr->child_time > total_time)
+			total_time = fr->child_time;
+
+		if (t->stack_count > 0)
+			fr[-1].child_time += total_time;
+
+		stat_add_time(t, fr, fr->addr, last_time, total_time);
+	}
+}
+
+/* merge stats of the task into @root by name */
+static int stat_merge_task(struct uftrace_data *handle, struct stat_task *t,
+			   struct rb_root *root)
+{
+	struct uftrace_task_reader task = {
+		.tid = t->tid,
+		.h   = handle,
+	};
+	struct uftrace_report_node *node;
+	struct stat_func *func;
+	struct sym *sym;
+	char *name;
+
+	task.t = find_task(&handle->sessions, t->tid);
+	if (task.t == NULL)
+		return -1;
+
+	stat_add_remaining(t);
+
+	for (func = t->funcs; func; func = func->next) {
+		sym = task_find_sym_addr(&handle->sessions, &task,
+					 func->first_time, func->addr);
+		if (sym != task_find_sym_addr(&handle->sessions, &task,
+					      func->last_time, func->addr))
+			return -1;
+
+		/* it changes the stack count in a different way */
+		if (sym && fstack_is_stack_fixup(sym->name))
+			return -1;
+
+		if (func->node.call == 0)
+			continue;
+
+		name = symbol_getname(sym, func->addr);
+
+		node = report_find_node(root, name);
+		if (node == NULL) {
+			node = xzalloc(sizeof(*node));
+			report_add_node(root, name, node);
+		}
+		report_merge_node(node, &func->node);
+
+		symbol_putname(sym, name);
+	}
+	return 0;
+}
+
+static void stat_free_task(struct stat_task *t)
+{
+	struct stat_func *func;
+
+	while (t->funcs) {
+		func = t->funcs;
+		t->funcs = func->next;
+		free(func);
+	}
+	report_hash_destroy(&t->hash);
+	free(t->frames);
+	free(t);
+}
+
+/* save the function stats in the cache as 'uftrace report' does */
+static void save_func_stats(struct opts *opts)
+{
+	/* the cache key is for the default options of analysis commands */
+	struct opts report_opts = {
+		.dirname	= opts->dirname,
+		.libcall	= true,
+		.depth		= OPT_DEPTH_DEFAULT,
+		.max_stack	= OPT_RSTACK_DEFAULT,
+		.kernel_skip_out= true,
+		.event_skip_out = true,
+		.patt_type      = PATT_REGEX,
+	};
+	struct uftrace_data handle;
+	struct uftrace_cache cache;
+	struct rb_root root = RB_ROOT;
+	struct uftrace_report_node *node;
+	struct stat_task *t;
+	struct rb_node *n;
+	bool opened = false;
+	bool ok = false;
+	FILE *fp;
+
+	if (!func_stat.failed && open_data_file(&report_opts, &handle) == 0) {
+		opened = true;
+		ok = true;
+
+		/* report merges them with the user records */
+		if (has_kernel_data(handle.kernel) || has_perf_data(&handle) ||
+		    handle.extn) {
+			pr_dbg("cannot build function stats with other data\n");
+			ok = false;
+		}
+	}
+
+	while (!RB_EMPTY_ROOT(&func_stat.tasks)) {
+		n = rb_first(&func_stat.tasks);
+		rb_erase(n, &func_stat.tasks);
+
+		t = rb_entry(n, struct stat_task, node);
+		if (ok && stat_merge_task(&handle, t, &root) < 0) {
+			pr_dbg("cannot build function stats of task %d\n",
+			       t->tid);
+			ok = false;
+		}
+		stat_free_task(t);
+	}
+
+	if (ok && cache_init(&cache, &report_opts, "report", NULL) == 0) {
+		fp = cache_write(&cache);
+		if (fp)
+			cache_close(&cache, report_save_nodes(&root, fp) == 0);
+		cache_finish(&cache);
+	}
+
+	if (opened)
+		close_data_file(&report_opts, &handle);
+
+	while (!RB_EMPTY_ROOT(&root)) {
+		node = rb_entry(rb_first(&root), typeof(*node), name_link);
+		report_delete_node(&root, node);
+		free(node);
+	}
+}
+
 static void write_buffer(struct buf_list *buf, struct opts *opts, int sock)
 {
 	struct mcount_shmem_buffer *shmbuf = buf->shmem_buf;
 
+	if (func_stat.enabled)
+		stat_add_buffer(buf->tid, shmbuf->data, shmbuf->size);
+
 	if (!opts->host)
 		write_buffer_file(opts->dirname, buf);
 	else
@@ -800,6 +1217,93 @@ static void copy_to_buffer(struct mcount_shmem_buffer *shm, char *sess_id)
 	pthread_mutex_unlock(&write_list_lock);
 }
 
+static void stream_open_buffer(char *sess_id, int bufsize)
+{
+	struct stream_buf *sb;
+	int fd;
+
+	fd = shm_open(sess_id, O_RDONLY, 0600);
+	if (fd < 0) {
+		pr_dbg("open shmem buffer failed: %s: %m\n", sess_id);
+		return;
+	}
+
+	sb = xzalloc(sizeof(*sb));
+	sb->shmem = mmap(NULL, bufsize, PROT_READ, MAP_SHARED, fd, 0);
+	if (sb->shmem == MAP_FAILED)
+		pr_err("mmap shmem buffer");
+
+	close(fd);
+
+	strcpy(sb->id, sess_id);
+	parse_msg_id(sess_id, NULL, &sb->tid, NULL);
+	list_add_tail(&sb->list, &stream_buf_list);
+}
+
+/* pass new data in the buffer to the live stream */
+static void stream_read_buffer(struct stream_buf *sb)
+{
+	unsigned size = sb->shmem->size;
+
+	/* libmcount updates the size after a write barrier */
+	read_memory_barrier();
+
+	if (size > sb->pos) {
+		live_stream_data(sb->tid, sb->shmem->data + sb->pos,
+				 size - sb->pos);
+		sb->pos = size;
+	}
+}
+
+/* called periodically to print functions as soon as they return */
+static void stream_peek_buffers(void)
+{
+	struct stream_buf *sb;
+
+	list_for_each_entry(sb, &stream_buf_list, list)
+		stream_read_buffer(sb);
+}
+
+/* pass the remaining data and release the buffer to libmcount */
+static void stream_close_buffer(struct mcount_shmem_buffer *shmem,
+				char *sess_id, int bufsize)
+{
+	struct stream_buf *sb;
+	unsigned pos = 0;
+	int tid;
+
+	list_for_each_entry(sb, &stream_buf_list, list) {
+		if (!strcmp(sb->id, sess_id)) {
+			pos = sb->pos;
+
+			list_del(&sb->list);
+			munmap(sb->shmem, bufsize);
+			free(sb);
+			break;
+		}
+	}
+
+	if (shmem->size > pos) {
+		parse_msg_id(sess_id, NULL, &tid, NULL);
+		live_stream_data(tid, shmem->data + pos, shmem->size - pos);
+	}
+
+	/* see write_buf_list() */
+	__sync_synchronize();
+	shmem->flag = SHMEM_FL_WRITTEN;
+}
+
+static void stream_flush_buffers(int bufsize)
+{
+	struct stream_buf *sb, *tmp;
+
+	list_for_each_entry_safe(sb, tmp, &stream_buf_list, list) {
+		list_del(&sb->list);
+		munmap(sb->shmem, bufsize);
+		free(sb);
+	}
+}
+
 static void record_mmap_file(const char *dirname, char *sess_id, int bufsize)
 {
 	int fd;
@@ -842,7 +1346,11 @@ static void record_mmap_file(const char *dirname, char *sess_id, int bufsize)
 			}
 		}
 
-		if (shmem_buf->size) {
+		if (stream_mode) {
+			/* live stream takes the data instead of writers */
+			stream_close_buffer(shmem_buf, sess_id, bufsize);
+		}
+		else if (shmem_buf->size) {
 			/* shmem_buf will be unmapped */
 			copy_to_buffer(shmem_buf, sess_id);
 			return;
@@ -1059,6 +1567,19 @@ struct dlopen_list {
 
 static LIST_HEAD(dlopen_libs);
 
+/* pass a message followed by a name to the live stream */
+static void stream_send_msg(int type, void *msg, size_t len, char *name)
+{
+	size_t namelen = strlen(name) + 1;
+	char *buf = xmalloc(len + namelen);
+
+	memcpy(buf, msg, len);
+	memcpy(buf + len, name, namelen);
+
+	live_stream_msg(type, buf, len + namelen);
+	free(buf);
+}
+
 static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 {
 	char buf[128];
@@ -1093,6 +1614,9 @@ static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 
 		/* link to shmem_list */
 		list_add_tail(&sl->list, &shmem_list_head);
+
+		if (stream_mode)
+			stream_open_buffer(sl->id, bufsize);
 		break;
 
 	case UFTRACE_MSG_REC_END:
@@ -1138,6 +1662,8 @@ static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 			add_tid_list(tmsg.pid, tmsg.tid);
 
 		write_task_info(dirname, &tmsg);
+		if (stream_mode)
+			live_stream_msg(msg.type, &tmsg, sizeof(tmsg));
 		break;
 
 	case UFTRACE_MSG_TASK_END:
@@ -1206,6 +1732,8 @@ static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 		pr_dbg2("MSG FORK2: %d/%d\n", tl->pid, tl->tid);
 
 		write_fork_info(dirname, &tmsg);
+		if (stream_mode)
+			live_stream_msg(msg.type, &tmsg, sizeof(tmsg));
 		break;
 
 	case UFTRACE_MSG_SESSION:
@@ -1226,6 +1754,8 @@ static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 		pr_dbg2("MSG SESSION: %d: %s (%s)\n", sess.task.tid, exename, buf);
 
 		write_session_info(dirname, &sess, exename);
+		if (stream_mode)
+			stream_send_msg(msg.type, &sess, sizeof(sess), exename);
 		free(exename);
 		break;
 
@@ -1258,6 +1788,8 @@ static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 		list_add_tail(&dlib->list, &dlopen_libs);
 
 		write_dlopen_info(dirname, &dmsg, exename);
+		if (stream_mode)
+			stream_send_msg(msg.type, &dmsg, sizeof(dmsg), exename);
 		/* exename will be freed with the dlib */
 		break;
 
@@ -1302,12 +1834,13 @@ static void send_map_files(int sock, const char *dirname)
 	free(map_list);
 }
 
-/* find "XXX.sym" file */
+/* find "XXX.sym" and "XXX.symtab" file */
 static int filter_sym(const struct dirent *de)
 {
 	size_t len = strlen(de->d_name);
 
-	return !strncmp(".sym", de->d_name + len - 4, 4);
+	return (len > 4 && !strncmp(".sym", de->d_name + len - 4, 4)) ||
+		(len > 7 && !strncmp(".symtab", de->d_name + len - 7, 7));
 }
 
 static void send_sym_files(int sock, const char *dirname)
@@ -1720,6 +2253,7 @@ static void setup_writers(struct writer_data *wd, struct opts *opts)
 
 	if (opts->host) {
 		wd->sock = setup_client_socket(opts);
+		start_trace_sender(wd->sock, opts);
 		send_trace_dir_name(wd->sock, opts->dirname);
 	}
 	else
@@ -1771,7 +2305,8 @@ static void setup_writers(struct writer_data *wd, struct opts *opts)
 
 	if (has_perf_event) {
 		if (setup_perf_record(perf, wd->nr_cpu, wd->pid,
-				      opts->dirname, has_sched_event) < 0)
+				      opts->dirname, has_sched_event,
+				      opts->perf_bufsize) < 0)
 			has_perf_event = false;
 	}
 
@@ -1933,6 +2468,8 @@ static void finish_writers(struct writer_data *wd, struct opts *opts)
 	close(thread_ctl[0]);
 
 	flush_shmem_list(opts->dirname, opts->bufsize);
+	if (stream_mode)
+		stream_flush_buffers(opts->bufsize);
 	record_remaining_buffer(opts, wd->sock);
 	unlink_shmem_list();
 	free_tid_list();
@@ -1988,6 +2525,7 @@ static void write_symbol_files(struct writer_data *wd, struct opts *opts)
 			send_log_file(sock, opts->logfile);
 
 		send_trace_end(sock);
+		finish_trace_sender(sock);
 		close(sock);
 
 		remove_directory(opts->dirname);
@@ -1996,6 +2534,69 @@ static void write_symbol_files(struct writer_data *wd, struct opts *opts)
 		chown_directory(opts->dirname);
 }
 
+/* move the data directory into a pack file of the same name */
+static int save_single_file(struct opts *opts)
+{
+	char *tmpname = NULL;
+	char *oldname = NULL;
+	int ret = -1;
+
+	xasprintf(&tmpname, "%s.pack-tmp", opts->dirname);
+	xasprintf(&oldname, "%s.dir-tmp", opts->dirname);
+
+	if (pack_data_dir(opts->dirname, tmpname) < 0) {
+		pr_warn("cannot save trace data to a single file: %m\n");
+		goto out;
+	}
+
+	/* keep the directory until the pack file is in place */
+	if (rename(opts->dirname, oldname) < 0) {
+		pr_warn("rename %s -> %s failed: %m\n", opts->dirname, oldname);
+		unlink(tmpname);
+		goto out;
+	}
+
+	if (rename(tmpname, opts->dirname) < 0) {
+		pr_warn("rename %s -> %s failed: %m\n", tmpname, opts->dirname);
+		if (rename(oldname, opts->dirname) < 0)
+			pr_warn("trace data is left in %s\n", oldname);
+		unlink(tmpname);
+		goto out;
+	}
+
+	if (remove_directory(oldname) < 0)
+		pr_dbg("cannot remove %s: %m\n", oldname);
+
+	ret = 0;
+
+out:
+	free(tmpname);
+	free(oldname);
+	return ret;
+}
+
+/* rename an existing pack file (from --single-file) as create_directory() */
+static int rename_pack_file(const char *dirname)
+{
+	char *oldname = NULL;
+	int ret = 0;
+
+	if (!is_pack_file(dirname))
+		return 0;
+
+	xasprintf(&oldname, "%s.old", dirname);
+
+	if (is_pack_file(oldname))
+		unlink(oldname);
+
+	ret = rename(dirname, oldname);
+	if (ret < 0)
+		pr_warn("rename %s -> %s failed: %m\n", dirname, oldname);
+
+	free(oldname);
+	return ret;
+}
+
 int do_main_loop(int ready, struct opts *opts, int pid)
 {
 	int ret;
@@ -2028,6 +2629,19 @@ int do_main_loop(int ready, struct opts *opts, int pid)
 		pr_out("uftrace: install signal handlers to task %d\n", pid);
 
 	setup_writers(&wd, opts);
+
+	stream_mode = opts->stream && opts->mode == UFTRACE_MODE_LIVE;
+	if (stream_mode)
+		start_live_stream(opts);
+
+	/* pack file cannot have the cache and time filter goes to default.opts */
+	func_stat.enabled = opts->build_cache && !opts->host &&
+		opts->mode == UFTRACE_MODE_RECORD && !opts->single_file &&
+		!opts->kernel && !has_perf_event && !opts->threshold;
+	func_stat.max_stack = opts->max_stack;
+	if (func_stat.max_stack > OPT_DEPTH_DEFAULT)
+		func_stat.max_stack = OPT_DEPTH_DEFAULT;
+
 	start_tracing(&wd, opts, ready);
 	close(ready);
 
@@ -2037,7 +2651,7 @@ int do_main_loop(int ready, struct opts *opts, int pid)
 			.events = POLLIN,
 		};
 
-		ret = poll(&pollfd, 1, 1000);
+		ret = poll(&pollfd, 1, stream_mode ? 1 : 1000);
 		if (ret < 0 && errno == EINTR)
 			continue;
 		if (ret < 0)
@@ -2046,6 +2660,9 @@ int do_main_loop(int ready, struct opts *opts, int pid)
 		if (pollfd.revents & POLLIN)
 			read_record_mmap(wd.pipefd, opts->dirname, opts->bufsize);
 
+		if (stream_mode)
+			stream_peek_buffers();
+
 		if (pollfd.revents & (POLLERR | POLLHUP))
 			break;
 	}
@@ -2053,7 +2670,21 @@ int do_main_loop(int ready, struct opts *opts, int pid)
 	ret = stop_tracing(&wd, opts);
 	finish_writers(&wd, opts);
 
-	write_symbol_files(&wd, opts);
+	/* symbol files are only needed to read the data later */
+	if (stream_mode)
+		finish_live_stream();
+	else
+		write_symbol_files(&wd, opts);
+
+	/* data files should not be changed after this */
+	if (func_stat.enabled)
+		save_func_stats(opts);
+
+	/* 'live' command will remove the (temporary) directory anyway */
+	if (opts->single_file && !opts->host &&
+	    opts->mode == UFTRACE_MODE_RECORD)
+		save_single_file(opts);
+
 	return ret;
 }
 
@@ -2134,6 +2765,9 @@ int command_record(int argc, char *argv[], struct opts *opts)
 	check_perf_event(opts);
 
 	if (!opts->nop) {
+		if (rename_pack_file(opts->dirname) < 0)
+			return -1;
+
 		if (create_directory(opts->dirname) < 0)
 			return -1;
 
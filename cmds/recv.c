@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include <inttypes.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -13,18 +14,46 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <linux/errqueue.h>
 
 #include "uftrace.h"
 #include "utils/utils.h"
 #include "utils/list.h"
+#include "utils/rbtree.h"
+#include "utils/report.h"
+#include "utils/symbol.h"
 
 struct client_data {
 	struct list_head	list;
 	int			sock;
 	char			*dirname;
+	struct rb_root		files;
+	struct rb_root		tasks;  /* for --aggregate */
 };
 
-static LIST_HEAD(client_list);
+/* cached output file in the client directory */
+struct client_file {
+	struct rb_node		node;
+	char			*name;
+	int			fd;
+};
+
+/* each worker handles a set of clients with its own epoll */
+struct recv_worker {
+	pthread_t		thread;
+	int			idx;
+	int			efd;
+	int			ctl[2];
+	int			pipefd[2];
+	bool			use_splice;
+	struct list_head	clients;
+	struct opts		*opts;
+};
+
+#define RECV_PIPE_SIZE  (1024 * 1024)
 
 static int server_socket(struct opts *opts)
 {
@@ -102,6 +131,396 @@ int setup_client_socket(struct opts *opts)
 	return sock;
 }
 
+/*
+ * Asynchronous sender: writer threads copy messages into frames in a
+ * bounded queue and return immediately so that buffers can be recycled
+ * without waiting for the network.  A sender thread writes the frames
+ * to the socket.  Small messages are batched into a frame as long as
+ * the sender is busy.
+ */
+#ifndef SO_ZEROCOPY
+# define SO_ZEROCOPY  60
+#endif
+#ifndef MSG_ZEROCOPY
+# define MSG_ZEROCOPY  0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+# define SO_EE_ORIGIN_ZEROCOPY  5
+#endif
+
+#define SEND_FRAME_SIZE     (256 * 1024)
+#define SEND_ZEROCOPY_MIN   (16 * 1024)
+
+struct send_frame {
+	struct list_head	list;
+	size_t			len;
+	size_t			size;
+	uint32_t		zc_id;  /* last zerocopy send id for this frame */
+	bool			zerocopy;
+	char			data[];
+};
+
+/* serializes messages on the socket (record only has a single socket) */
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct trace_sender {
+	pthread_t		thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;       /* wake up the sender thread */
+	pthread_cond_t		done_cond;  /* wake up the writers */
+	struct list_head	queue;      /* frames to be sent */
+	struct list_head	inflight;   /* frames not released by kernel */
+	struct send_frame	*cur;       /* frame to add new messages */
+	int			sock;
+	bool			running;
+	bool			busy;
+	bool			zerocopy;
+	size_t			queued;     /* bytes in the queue and in-flight */
+	size_t			limit;
+	uint32_t		zc_next;    /* next zerocopy send id */
+	uint32_t		zc_done;    /* number of completed ids */
+
+	/* statistics */
+	uint64_t		nr_msgs;
+	uint64_t		nr_frames;
+	uint64_t		nr_bytes;
+	uint64_t		nr_stall;
+	uint64_t		stall_time;
+	size_t			max_queued;
+} sender = {
+	.lock		= PTHREAD_MUTEX_INITIALIZER,
+	.cond		= PTHREAD_COND_INITIALIZER,
+	.done_cond	= PTHREAD_COND_INITIALIZER,
+	.queue		= LIST_HEAD_INIT(sender.queue),
+	.inflight	= LIST_HEAD_INIT(sender.inflight),
+	.sock		= -1,
+};
+
+static bool use_sender(int sock)
+{
+	return sender.running && sender.sock == sock;
+}
+
+static uint64_t sender_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* read zerocopy completions and free the frames released by kernel */
+static void reap_zerocopy_frames(int timeout)
+{
+	struct pollfd pfd = {
+		.fd = sender.sock,
+	};
+	struct send_frame *frame, *tmp;
+	size_t released = 0;
+
+	if (poll(&pfd, 1, timeout) <= 0 || !(pfd.revents & POLLERR))
+		return;
+
+	while (true) {
+		char control[128];
+		struct msghdr msg = {
+			.msg_control	= control,
+			.msg_controllen	= sizeof(control),
+		};
+		struct cmsghdr *cmsg;
+		struct sock_extended_err *serr;
+
+		if (recvmsg(sender.sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg == NULL)
+			continue;
+
+		serr = (void *)CMSG_DATA(cmsg);
+		if (serr->ee_errno != 0 ||
+		    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+			continue;
+
+		/* notifications have a range of ids [ee_info, ee_data] */
+		sender.zc_done += serr->ee_data - serr->ee_info + 1;
+	}
+
+	/* TCP completes the sends in order */
+	pthread_mutex_lock(&sender.lock);
+	list_for_each_entry_safe(frame, tmp, &sender.inflight, list) {
+		if ((int32_t)(frame->zc_id - sender.zc_done) >= 0)
+			break;
+
+		list_del(&frame->list);
+		released += frame->len;
+		free(frame);
+	}
+	sender.queued -= released;
+	if (released)
+		pthread_cond_broadcast(&sender.done_cond);
+	pthread_mutex_unlock(&sender.lock);
+}
+
+static void send_frame(struct send_frame *frame)
+{
+	int flags = 0;
+	size_t pos = 0;
+	ssize_t ret;
+
+	if (sender.zerocopy && frame->len >= SEND_ZEROCOPY_MIN)
+		flags = MSG_ZEROCOPY;
+
+	while (pos < frame->len) {
+		ret = send(sender.sock, frame->data + pos, frame->len - pos,
+			   flags);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno == ENOBUFS && flags) {
+			/* too many pages are pinned, wait for completion */
+			reap_zerocopy_frames(100);
+			continue;
+		}
+		if (ret <= 0)
+			pr_err("send data failed");
+
+		if (flags)
+			frame->zc_id = sender.zc_next++;
+		pos += ret;
+	}
+
+	frame->zerocopy = flags != 0;
+}
+
+static void *sender_thread(void *arg)
+{
+	struct send_frame *frame, *tmp;
+	sigset_t sigset;
+
+	pthread_setname_np(pthread_self(), "SenderThread");
+
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+	pthread_mutex_lock(&sender.lock);
+	while (true) {
+		LIST_HEAD(head);
+		size_t sent = 0;
+
+		if (sender.cur) {
+			list_add_tail(&sender.cur->list, &sender.queue);
+			sender.cur = NULL;
+		}
+
+		if (list_empty(&sender.queue)) {
+			if (!list_empty(&sender.inflight)) {
+				pthread_mutex_unlock(&sender.lock);
+				reap_zerocopy_frames(10);
+				pthread_mutex_lock(&sender.lock);
+				continue;
+			}
+			if (!sender.running)
+				break;
+
+			pthread_cond_wait(&sender.cond, &sender.lock);
+			continue;
+		}
+
+		list_splice_init(&sender.queue, &head);
+		sender.busy = true;
+		pthread_mutex_unlock(&sender.lock);
+
+		list_for_each_entry(frame, &head, list)
+			send_frame(frame);
+
+		pthread_mutex_lock(&sender.lock);
+		list_for_each_entry_safe(frame, tmp, &head, list) {
+			list_del(&frame->list);
+
+			sender.nr_frames++;
+			sender.nr_bytes += frame->len;
+
+			if (frame->zerocopy) {
+				list_add_tail(&frame->list, &sender.inflight);
+				continue;
+			}
+
+			sent += frame->len;
+			free(frame);
+		}
+		sender.queued -= sent;
+		sender.busy = false;
+		pthread_cond_broadcast(&sender.done_cond);
+	}
+	pthread_mutex_unlock(&sender.lock);
+
+	return NULL;
+}
+
+/* add a message to the current frame, called with sender.lock held */
+static void queue_msg(struct iovec *iov, int count)
+{
+	struct send_frame *frame = sender.cur;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+		len += iov[i].iov_len;
+
+	/* allow a big message if the queue is empty */
+	if (sender.queued && sender.queued + len > sender.limit) {
+		uint64_t start = sender_time();
+
+		sender.nr_stall++;
+		while (sender.queued && sender.queued + len > sender.limit)
+			pthread_cond_wait(&sender.done_cond, &sender.lock);
+		sender.stall_time += sender_time() - start;
+
+		frame = sender.cur;
+	}
+
+	if (frame && frame->len + len > frame->size) {
+		list_add_tail(&frame->list, &sender.queue);
+		frame = NULL;
+	}
+
+	if (frame == NULL) {
+		size_t size = len > SEND_FRAME_SIZE ? len : SEND_FRAME_SIZE;
+
+		frame = xmalloc(sizeof(*frame) + size);
+		frame->len = 0;
+		frame->size = size;
+		frame->zerocopy = false;
+		sender.cur = frame;
+	}
+
+	for (i = 0; i < count; i++) {
+		memcpy(frame->data + frame->len, iov[i].iov_base,
+		       iov[i].iov_len);
+		frame->len += iov[i].iov_len;
+	}
+
+	sender.nr_msgs++;
+	sender.queued += len;
+	if (sender.max_queued < sender.queued)
+		sender.max_queued = sender.queued;
+
+	pthread_cond_signal(&sender.cond);
+}
+
+/*
+ * grab the socket to write a message directly.  If the sender thread is
+ * used, wait for it to send all queued frames first.
+ */
+static void lock_sender(int sock)
+{
+	/* writer threads share the socket, don't mix messages */
+	pthread_mutex_lock(&send_lock);
+
+	if (!use_sender(sock))
+		return;
+
+	pthread_mutex_lock(&sender.lock);
+	while (sender.cur || sender.busy || !list_empty(&sender.queue)) {
+		pthread_cond_signal(&sender.cond);
+		pthread_cond_wait(&sender.done_cond, &sender.lock);
+	}
+}
+
+static void unlock_sender(int sock)
+{
+	if (use_sender(sock))
+		pthread_mutex_unlock(&sender.lock);
+
+	pthread_mutex_unlock(&send_lock);
+}
+
+static int send_msg(int sock, struct iovec *iov, int count)
+{
+	int ret;
+
+	if (!use_sender(sock)) {
+		lock_sender(sock);
+		ret = writev_all(sock, iov, count);
+		unlock_sender(sock);
+		return ret;
+	}
+
+	pthread_mutex_lock(&sender.lock);
+	queue_msg(iov, count);
+	pthread_mutex_unlock(&sender.lock);
+	return 0;
+}
+
+/**
+ * start_trace_sender - start sending data asynchronously
+ * @sock: socket connected to the server
+ * @opts: uftrace options
+ *
+ * This function starts a sender thread for @sock.  Messages will be
+ * queued up to --send-queue bytes and the sender thread writes them in
+ * large frames.  It does nothing if the queue size is 0.
+ */
+void start_trace_sender(int sock, struct opts *opts)
+{
+	int one = 1;
+
+	if (opts->send_queue == 0)
+		return;
+
+	sender.sock = sock;
+	sender.limit = opts->send_queue;
+
+	if (opts->send_zerocopy) {
+		if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY,
+			       &one, sizeof(one)) < 0)
+			pr_warn("zerocopy send is not supported: %m\n");
+		else
+			sender.zerocopy = true;
+	}
+
+	sender.running = true;
+	if (pthread_create(&sender.thread, NULL, sender_thread, NULL)) {
+		pr_dbg("cannot create sender thread, send data directly\n");
+		sender.running = false;
+	}
+}
+
+/**
+ * finish_trace_sender - send all remaining data and stop the sender
+ * @sock: socket connected to the server
+ *
+ * This function waits for the sender thread to send all the queued data
+ * (and the kernel to release the pages for zerocopy) and shows the
+ * statistics.
+ */
+void finish_trace_sender(int sock)
+{
+	if (!use_sender(sock))
+		return;
+
+	pthread_mutex_lock(&sender.lock);
+	sender.running = false;
+	pthread_cond_signal(&sender.cond);
+	pthread_mutex_unlock(&sender.lock);
+
+	pthread_join(sender.thread, NULL);
+
+	pr_dbg("sent %"PRIu64" messages in %"PRIu64" frames (%"PRIu64" bytes)\n",
+	       sender.nr_msgs, sender.nr_frames, sender.nr_bytes);
+	pr_dbg("max send queue depth: %zu bytes, stalled %"PRIu64" times "
+	       "(%"PRIu64" usec)\n", sender.max_queued, sender.nr_stall,
+	       sender.stall_time / 1000);
+
+	if (sender.nr_stall) {
+		pr_warn("sending data stalled %"PRIu64" times for %"PRIu64" msec.\n"
+			"\tPlease consider using bigger --send-queue.\n",
+			sender.nr_stall, sender.stall_time / NSEC_PER_MSEC);
+	}
+
+	sender.sock = -1;
+}
+
 void send_trace_dir_name(int sock, char *name)
 {
 	ssize_t len = strlen(name);
@@ -116,7 +535,7 @@ void send_trace_dir_name(int sock, char *name)
 	};
 
 	pr_dbg2("send UFTRACE_MSG_SEND_HDR\n");
-	if (writev_all(sock, iov, ARRAY_SIZE(iov)) < 0)
+	if (send_msg(sock, iov, ARRAY_SIZE(iov)) < 0)
 		pr_err("send header failed");
 }
 
@@ -135,7 +554,7 @@ void send_trace_data(int sock, int tid, void *data, size_t len)
 	};
 
 	pr_dbg2("send UFTRACE_MSG_SEND_DATA\n");
-	if (writev_all(sock, iov, ARRAY_SIZE(iov)) < 0)
+	if (send_msg(sock, iov, ARRAY_SIZE(iov)) < 0)
 		pr_err("send data failed");
 }
 
@@ -154,8 +573,32 @@ void send_trace_kernel_data(int sock, int cpu, void *data, size_t len)
 	};
 
 	pr_dbg2("send UFTRACE_MSG_SEND_KERNEL_DATA\n");
+	if (send_msg(sock, iov, ARRAY_SIZE(iov)) < 0)
+		pr_err("send kernel data failed");
+}
+
+/* same as above, but @len bytes of data are in the pipe (@pipefd) */
+void send_trace_kernel_pipe(int sock, int cpu, int pipefd, size_t len)
+{
+	int32_t msg_cpu = htonl(cpu);
+	struct uftrace_msg msg = {
+		.magic = htons(UFTRACE_MSG_MAGIC),
+		.type  = htons(UFTRACE_MSG_SEND_KERNEL_DATA),
+		.len   = htonl(sizeof(msg_cpu) + len),
+	};
+	struct iovec iov[] = {
+		{ .iov_base = &msg,     .iov_len = sizeof(msg), },
+		{ .iov_base = &msg_cpu, .iov_len = sizeof(msg_cpu), },
+	};
+
+	pr_dbg2("send UFTRACE_MSG_SEND_KERNEL_DATA\n");
+	/* the header and data are sent directly, and should not be split */
+	lock_sender(sock);
 	if (writev_all(sock, iov, ARRAY_SIZE(iov)) < 0)
 		pr_err("send kernel data failed");
+	if (splice_all(pipefd, sock, len) < 0)
+		pr_err("send kernel data failed");
+	unlock_sender(sock);
 }
 
 void send_trace_perf_data(int sock, int cpu, void *data, size_t len)
@@ -173,7 +616,7 @@ void send_trace_perf_data(int sock, int cpu, void *data, size_t len)
 	};
 
 	pr_dbg2("send UFTRACE_MSG_SEND_PERF_DATA\n");
-	if (writev_all(sock, iov, ARRAY_SIZE(iov)) < 0)
+	if (send_msg(sock, iov, ARRAY_SIZE(iov)) < 0)
 		pr_err("send kernel data failed");
 }
 
@@ -222,7 +665,7 @@ void send_trace_metadata(int sock, const char *dirname, char *filename)
 	namelen = htonl(namelen);
 
 	pr_dbg2("send UFTRACE_MSG_SEND_META_DATA: %s\n", filename);
-	if (writev_all(sock, iov, ARRAY_SIZE(iov)) < 0)
+	if (send_msg(sock, iov, ARRAY_SIZE(iov)) < 0)
 		pr_err("send metadata failed");
 
 	free(pathname);
@@ -251,7 +694,7 @@ void send_trace_info(int sock, struct uftrace_file_header *hdr,
 	hdr->max_stack   = htons(hdr->max_stack);
 
 	pr_dbg2("send UFTRACE_MSG_SEND_INFO\n");
-	if (writev_all(sock, iov, ARRAY_SIZE(iov)) < 0)
+	if (send_msg(sock, iov, ARRAY_SIZE(iov)) < 0)
 		pr_err("send metadata failed");
 }
 
@@ -261,39 +704,485 @@ void send_trace_end(int sock)
 		.magic = htons(UFTRACE_MSG_MAGIC),
 		.type  = htons(UFTRACE_MSG_SEND_END),
 	};
+	struct iovec iov = {
+		.iov_base = &msg, .iov_len = sizeof(msg),
+	};
 
 	pr_dbg2("send UFTRACE_MSG_SEND_END\n");
-	if (write_all(sock, &msg, sizeof(msg)) < 0)
+	if (send_msg(sock, &iov, 1) < 0)
 		pr_err("send end failed");
 }
 
 
 /* server (recv) side API */
-static struct client_data *find_client(int sock)
+static struct client_data *find_client(struct recv_worker *w, int sock)
 {
 	struct client_data *c;
 
-	list_for_each_entry(c, &client_list, list) {
+	list_for_each_entry(c, &w->clients, list) {
 		if (c->sock == sock)
 			return c;
 	}
 	return NULL;
 }
 
-#define O_CLIENT_FLAGS  (O_WRONLY | O_APPEND | O_CREAT)
+/*
+ * Aggregation of function statistics over all clients (--aggregate).
+ * User data is decoded as it's received, but the symbol info comes at
+ * the end, so the result of a client is merged when it finishes.  It
+ * cannot merge running clients periodically since functions are merged
+ * by name.
+ */
+#define AGGREGATE_FILE      "aggregate.txt"
+#define AGGREGATE_INTERVAL  1  /* sec */
+
+struct agg_frame {
+	uint64_t		addr;
+	uint64_t		time;
+	uint64_t		child_time;
+	bool			valid;
+};
 
-static void write_client_file(struct client_data *c, char *filename, int nr, ...)
+struct agg_task {
+	struct rb_node		node;
+	int			tid;
+	int			nr_frames;
+	struct agg_frame	*stack;
+	uint64_t		last_time;
+	/* report nodes by address */
+	struct uftrace_report_hash hash;
+};
+
+static struct {
+	pthread_mutex_t		lock;
+	pthread_mutex_t		load_lock;  /* for open_data_file() */
+	struct rb_root		root;  /* report nodes by name */
+	int			nr_done;
+	int			nr_active;
+	bool			updated;
+} aggregate = {
+	.lock		= PTHREAD_MUTEX_INITIALIZER,
+	.load_lock	= PTHREAD_MUTEX_INITIALIZER,
+	.root		= RB_ROOT,
+};
+
+static struct agg_task *find_agg_task(struct client_data *c, int tid)
 {
-	int i, fd;
-	va_list ap;
-	struct iovec iov[nr];
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &c->tasks.rb_node;
+	struct agg_task *t;
+
+	while (*p) {
+		parent = *p;
+		t = rb_entry(parent, struct agg_task, node);
+
+		if (t->tid == tid)
+			return t;
+
+		if (t->tid > tid)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	t = xzalloc(sizeof(*t));
+	t->tid = tid;
+
+	rb_link_node(&t->node, parent, p);
+	rb_insert_color(&t->node, &c->tasks);
+
+	return t;
+}
+
+static void agg_reset_stack(struct agg_task *t)
+{
+	int i;
+
+	for (i = 0; i < t->nr_frames; i++)
+		t->stack[i].valid = false;
+}
+
+static void agg_func_entry(struct agg_task *t, struct uftrace_record *rec)
+{
+	struct agg_frame *frame;
+
+	if (rec->depth >= t->nr_frames) {
+		int nr = ALIGN(rec->depth + 1, 32);
+
+		t->stack = xrealloc(t->stack, nr * sizeof(*t->stack));
+		memset(&t->stack[t->nr_frames], 0,
+		       (nr - t->nr_frames) * sizeof(*t->stack));
+		t->nr_frames = nr;
+	}
+
+	frame = &t->stack[rec->depth];
+	frame->addr = rec->addr;
+	frame->time = rec->time;
+	frame->child_time = 0;
+	frame->valid = true;
+}
+
+static void agg_func_exit(struct agg_task *t, struct uftrace_record *rec)
+{
+	struct agg_frame *frame;
+	struct uftrace_report_node *node;
+	uint64_t total_time;
+	bool recursive = false;
+	int i;
+
+	if (rec->depth >= t->nr_frames)
+		return;
+
+	frame = &t->stack[rec->depth];
+	if (!frame->valid || frame->addr != rec->addr)
+		return;
+
+	frame->valid = false;
+	total_time = rec->time - frame->time;
+
+	if (rec->depth > 0)
+		t->stack[rec->depth - 1].child_time += total_time;
+
+	for (i = 0; i < rec->depth; i++) {
+		if (t->stack[i].valid && t->stack[i].addr == rec->addr) {
+			recursive = true;
+			break;
+		}
+	}
+
+	node = report_hash_find(&t->hash, rec->addr, true);
+	if (node == NULL) {
+		node = xzalloc(sizeof(*node));
+		node->total.min = -1ULL;
+		node->self.min  = -1ULL;
+		report_hash_add(&t->hash, rec->addr, true, node);
+	}
+
+	report_add_time(node, total_time, total_time - frame->child_time,
+			recursive);
+}
+
+/* decode user data of @tid and update per-address statistics */
+static void aggregate_data(struct client_data *c, int tid,
+			   void *data, size_t len)
+{
+	struct agg_task *t = find_agg_task(c, tid);
+	struct uftrace_record *rec;
+	size_t pos = 0;
+	uint16_t size;
+
+	while (pos + sizeof(*rec) <= len) {
+		rec = data + pos;
+		pos += sizeof(*rec);
+
+		if (rec->magic != RECORD_MAGIC) {
+			pr_dbg("invalid record in %s/%d.dat\n", c->dirname, tid);
+			agg_reset_stack(t);
+			break;
+		}
+
+		t->last_time = rec->time;
+
+		switch (rec->type) {
+		case UFTRACE_ENTRY:
+		case UFTRACE_EXIT:
+			/* argument specs are not known yet, skip the rest */
+			if (rec->more) {
+				pr_dbg2("cannot decode arguments of %d\n", tid);
+				agg_reset_stack(t);
+				return;
+			}
+
+			if (rec->type == UFTRACE_ENTRY)
+				agg_func_entry(t, rec);
+			else
+				agg_func_exit(t, rec);
+			break;
+		case UFTRACE_LOST:
+			agg_reset_stack(t);
+			break;
+		case UFTRACE_EVENT:
+			if (rec->more && pos + sizeof(size) <= len) {
+				memcpy(&size, data + pos, sizeof(size));
+				pos += ALIGN(size + sizeof(size), 8);
+			}
+			break;
+		}
+	}
+}
+
+static struct sym *agg_find_sym(struct uftrace_data *handle,
+				struct agg_task *t, uint64_t addr)
+{
+	struct uftrace_task *task;
+	struct uftrace_session *sess;
+	struct sym *sym;
+
+	task = find_task(&handle->sessions, t->tid);
+	if (task == NULL)
+		return NULL;
+
+	sess = find_task_session(&handle->sessions, task, t->last_time);
+	if (sess == NULL)
+		return NULL;
+
+	sym = session_find_sym(sess, addr);
+	if (sym == NULL)
+		sym = session_find_dlsym(sess, t->last_time, addr);
+
+	return sym;
+}
+
+/* find or add a report node of @name in @root */
+static struct uftrace_report_node *agg_get_node(struct rb_root *root,
+						const char *name)
+{
+	struct uftrace_report_node *node;
+
+	node = report_find_node(root, name);
+	if (node == NULL) {
+		node = xzalloc(sizeof(*node));
+		node->total.min = -1ULL;
+		node->self.min  = -1ULL;
+		report_add_node(root, name, node);
+	}
+	return node;
+}
+
+/* merge statistics of the client into the global tree by name */
+static void finish_aggregate(struct recv_worker *w, struct client_data *c)
+{
+	struct uftrace_data handle;
+	struct opts opts = *w->opts;
+	struct rb_root local = RB_ROOT;
+	bool has_data;
+	unsigned i;
+
+	opts.dirname = c->dirname;
+
+	/*
+	 * symbols might not be available if the client died.  Loading them
+	 * can take long, so merge the result of the client by name first
+	 * without blocking the main thread writing the aggregate file.
+	 */
+	pthread_mutex_lock(&aggregate.load_lock);
+	has_data = open_data_file(&opts, &handle) == 0;
+
+	while (!RB_EMPTY_ROOT(&c->tasks)) {
+		struct rb_node *n = rb_first(&c->tasks);
+		struct agg_task *t = rb_entry(n, struct agg_task, node);
+
+		rb_erase(n, &c->tasks);
+
+		for (i = 0; i < t->hash.size; i++) {
+			struct report_hash_entry *entry = &t->hash.entries[i];
+			struct uftrace_report_node *node;
+			struct sym *sym = NULL;
+			char *name;
+
+			if (entry->node == NULL)
+				continue;
+
+			if (has_data)
+				sym = agg_find_sym(&handle, t, entry->key);
+
+			name = symbol_getname(sym, entry->key);
+			node = agg_get_node(&local, name);
+			symbol_putname(sym, name);
+
+			report_merge_node(node, entry->node);
+			free(entry->node);
+		}
+
+		report_hash_destroy(&t->hash);
+		free(t->stack);
+		free(t);
+	}
+
+	if (has_data)
+		close_data_file(&opts, &handle);
+	pthread_mutex_unlock(&aggregate.load_lock);
+
+	pthread_mutex_lock(&aggregate.lock);
+
+	while (!RB_EMPTY_ROOT(&local)) {
+		struct rb_node *n = rb_first(&local);
+		struct uftrace_report_node *node, *dst;
+
+		node = rb_entry(n, struct uftrace_report_node, name_link);
+		dst = agg_get_node(&aggregate.root, node->name);
+		report_merge_node(dst, node);
+
+		report_delete_node(&local, node);
+		free(node);
+	}
+
+	aggregate.nr_active--;
+	aggregate.nr_done++;
+	aggregate.updated = true;
+
+	pthread_mutex_unlock(&aggregate.lock);
+}
+
+/* rewrite the aggregated report, it's called from the main thread */
+static void write_aggregate_file(void)
+{
+	struct rb_root sort_root;
+	struct rb_node *n;
+	FILE *fp;
+	char total[TIME_UNIT_BUFSIZE];
+	char self[TIME_UNIT_BUFSIZE];
+	int len_total, len_self;
+	const char tmpfile[] = AGGREGATE_FILE ".tmp";
+
+	pthread_mutex_lock(&aggregate.lock);
+
+	if (!aggregate.updated)
+		goto out;
+
+	fp = fopen(tmpfile, "w");
+	if (fp == NULL) {
+		pr_warn("cannot write aggregate file: %m\n");
+		goto out;
+	}
+
+	/* clients in progress are not included until they finish */
+	fprintf(fp, "# %d client(s) finished, %d in progress (not included)\n",
+		aggregate.nr_done, aggregate.nr_active);
+	fprintf(fp, "  %10.10s  %10.10s  %10.10s  %s\n",
+		"Total time", "Self time", "Calls", "Function");
+	fprintf(fp, "  %10.10s  %10.10s  %10.10s  %s\n",
+		"==========", "==========", "==========", "====================");
+
+	report_sort_nodes(&aggregate.root, &sort_root);
+
+	for (n = rb_first(&sort_root); n; n = rb_next(n)) {
+		struct uftrace_report_node *node;
+
+		node = rb_entry(n, struct uftrace_report_node, sort_link);
+
+		len_total = format_time_unit_plain(total, node->total.sum);
+		len_self = format_time_unit_plain(self, node->self.sum);
+		fprintf(fp, "  %.*s  %.*s  %10lu  %s\n", len_total, total,
+			len_self, self, node->call, node->name);
+	}
+
+	fclose(fp);
+
+	if (rename(tmpfile, AGGREGATE_FILE) < 0)
+		pr_warn("cannot rename aggregate file: %m\n");
+
+	aggregate.updated = false;
+
+out:
+	pthread_mutex_unlock(&aggregate.lock);
+}
+
+static int setup_aggregate(void)
+{
+	struct itimerspec its = {
+		.it_interval	= { .tv_sec = AGGREGATE_INTERVAL, },
+		.it_value	= { .tv_sec = AGGREGATE_INTERVAL, },
+	};
+	int fd;
+
+	if (report_setup_sort("total") < 0)
+		pr_err_ns("cannot setup sort key\n");
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (fd < 0)
+		pr_err("timerfd create failed");
+
+	if (timerfd_settime(fd, 0, &its, NULL) < 0)
+		pr_err("timerfd settime failed");
+
+	/* show an empty report */
+	aggregate.updated = true;
+	write_aggregate_file();
+
+	return fd;
+}
+
+static void close_client_files(struct client_data *c)
+{
+	struct rb_node *node;
+	struct client_file *cf;
+
+	while (!RB_EMPTY_ROOT(&c->files)) {
+		node = rb_first(&c->files);
+		cf = rb_entry(node, struct client_file, node);
+
+		rb_erase(node, &c->files);
+		close(cf->fd);
+		free(cf->name);
+		free(cf);
+	}
+}
+
+#define O_CLIENT_FLAGS  (O_WRONLY | O_CREAT)
+
+/*
+ * returns an (cached) fd of the output file in the client directory.
+ * It cannot use O_APPEND since splice() doesn't allow it, so move to
+ * the end of the file when it's opened.
+ */
+static int open_client_file(struct client_data *c, char *filename)
+{
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &c->files.rb_node;
+	struct client_file *cf;
 	char buf[PATH_MAX];
+	int cmp, fd;
+
+	while (*p) {
+		parent = *p;
+		cf = rb_entry(parent, struct client_file, node);
+
+		cmp = strcmp(cf->name, filename);
+		if (cmp == 0)
+			return cf->fd;
+
+		if (cmp > 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
 
 	snprintf(buf, sizeof(buf), "%s/%s", c->dirname, filename);
 	fd = open(buf, O_CLIENT_FLAGS, 0644);
+	if (fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+		/* too many files are open, release cached ones and retry */
+		pr_dbg2("closing files in %s\n", c->dirname);
+		close_client_files(c);
+
+		p = &c->files.rb_node;
+		parent = NULL;
+		fd = open(buf, O_CLIENT_FLAGS, 0644);
+	}
 	if (fd < 0)
 		pr_err("file open failed: %s", buf);
 
+	if (lseek(fd, 0, SEEK_END) < 0)
+		pr_err("file seek failed: %s", buf);
+
+	cf = xmalloc(sizeof(*cf));
+	cf->name = xstrdup(filename);
+	cf->fd = fd;
+
+	rb_link_node(&cf->node, parent, p);
+	rb_insert_color(&cf->node, &c->files);
+
+	return fd;
+}
+
+static void write_client_file(struct client_data *c, char *filename, int nr, ...)
+{
+	int i, fd;
+	va_list ap;
+	struct iovec iov[nr];
+
+	fd = open_client_file(c, filename);
+
 	va_start(ap, nr);
 	for (i = 0; i < nr; i++) {
 		iov[i].iov_base = va_arg(ap, void *);
@@ -302,12 +1191,88 @@ static void write_client_file(struct client_data *c, char *filename, int nr, ...
 	va_end(ap);
 
 	if (writev_all(fd, iov, nr) < 0)
-		pr_err("write client data failed on %s", buf);
+		pr_err("write client data failed on %s", filename);
+}
 
-	close(fd);
+/* move @len bytes in the pipe to @fd without splice() */
+static void copy_pipe_data(int pipefd, int fd, size_t len)
+{
+	char buf[4096];
+	size_t size;
+
+	while (len) {
+		size = len < sizeof(buf) ? len : sizeof(buf);
+
+		if (read_all(pipefd, buf, size) < 0 ||
+		    write_all(fd, buf, size) < 0)
+			pr_err("write client data failed");
+
+		len -= size;
+	}
+}
+
+/*
+ * move @len bytes from the socket to the file (@fd) through the pipe
+ * without copying the data to the user space.  Returns -1 if splice()
+ * is not supported for the socket so caller should fall back to read.
+ */
+static int splice_client_data(struct recv_worker *w, int sock, int fd,
+			      size_t len)
+{
+	bool first = true;
+	ssize_t ret;
+
+	while (len) {
+		ret = splice(sock, NULL, w->pipefd[1], NULL, len,
+			     SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && first && errno == EINVAL) {
+			pr_dbg("splice is not supported, fall back to read\n");
+			w->use_splice = false;
+			return -1;
+		}
+		if (ret <= 0)
+			pr_err("recv buffer failed");
+
+		if (splice_all(w->pipefd[0], fd, ret) < 0)
+			copy_pipe_data(w->pipefd[0], fd, ret);
+
+		len -= ret;
+		first = false;
+	}
+	return 0;
 }
 
-static void recv_trace_dir_name(int sock, int len)
+/* user data of @tid needs to be decoded for --aggregate (-1 if not) */
+static void recv_client_data(struct recv_worker *w, struct client_data *c,
+			     char *filename, int len, int tid)
+{
+	bool decode = w->opts->aggregate && tid > 0;
+	void *buffer;
+	int fd;
+
+	fd = open_client_file(c, filename);
+
+	if (!decode && w->use_splice &&
+	    splice_client_data(w, c->sock, fd, len) == 0)
+		return;
+
+	buffer = xmalloc(len);
+
+	if (read_all(c->sock, buffer, len) < 0)
+		pr_err("recv buffer failed");
+
+	if (write_all(fd, buffer, len) < 0)
+		pr_err("write client data failed on %s", filename);
+
+	if (decode)
+		aggregate_data(c, tid, buffer, len);
+
+	free(buffer);
+}
+
+static void recv_trace_dir_name(struct recv_worker *w, int sock, int len)
 {
 	char dirname[len + 1];
 	struct client_data *client;
@@ -320,112 +1285,75 @@ static void recv_trace_dir_name(int sock, int len)
 
 	client->sock = sock;
 	client->dirname = xstrdup(dirname);
+	client->files = RB_ROOT;
+	client->tasks = RB_ROOT;
 	INIT_LIST_HEAD(&client->list);
 
+	if (w->opts->aggregate) {
+		pthread_mutex_lock(&aggregate.lock);
+		aggregate.nr_active++;
+		aggregate.updated = true;
+		pthread_mutex_unlock(&aggregate.lock);
+	}
+
 	create_directory(dirname);
 	pr_dbg3("create directory: %s\n", dirname);
 
-	list_add(&client->list, &client_list);
+	list_add(&client->list, &w->clients);
 }
 
-static void recv_trace_data(int sock, int len)
+static void recv_trace_data(struct recv_worker *w, struct client_data *client,
+			    int len)
 {
-	struct client_data *client;
 	int32_t tid;
-	char *filename = NULL;
-	void *buffer;
+	char filename[32];
 
-	client = find_client(sock);
-	if (client == NULL)
-		pr_err_ns("no client on this socket\n");
-
-	if (read_all(sock, &tid, sizeof(tid)) < 0)
+	if (read_all(client->sock, &tid, sizeof(tid)) < 0)
 		pr_err("recv tid failed");
 	tid = ntohl(tid);
 
-	xasprintf(&filename, "%d.dat", tid);
-
-	len -= sizeof(tid);
-	buffer = xmalloc(len);
+	snprintf(filename, sizeof(filename), "%d.dat", tid);
 
-	if (read_all(sock, buffer, len) < 0)
-		pr_err("recv buffer failed");
-
-	write_client_file(client, filename, 1, buffer, len);
-
-	free(buffer);
-	free(filename);
+	recv_client_data(w, client, filename, len - sizeof(tid), tid);
 }
 
-static void recv_trace_kernel_data(int sock, int len)
+static void recv_trace_kernel_data(struct recv_worker *w,
+				   struct client_data *client, int len)
 {
-	struct client_data *client;
 	int32_t cpu;
-	char *filename = NULL;
-	void *buffer;
-
-	client = find_client(sock);
-	if (client == NULL)
-		pr_err_ns("no client on this socket\n");
+	char filename[32];
 
-	if (read_all(sock, &cpu, sizeof(cpu)) < 0)
+	if (read_all(client->sock, &cpu, sizeof(cpu)) < 0)
 		pr_err("recv cpu failed");
 	cpu = ntohl(cpu);
 
-	xasprintf(&filename, "kernel-cpu%d.dat", cpu);
+	snprintf(filename, sizeof(filename), "kernel-cpu%d.dat", cpu);
 
-	len -= sizeof(cpu);
-	buffer = xmalloc(len);
-
-	if (read_all(sock, buffer, len) < 0)
-		pr_err("recv buffer failed");
-
-	write_client_file(client, filename, 1, buffer, len);
-
-	free(buffer);
-	free(filename);
+	recv_client_data(w, client, filename, len - sizeof(cpu), -1);
 }
 
-static void recv_trace_perf_data(int sock, int len)
+static void recv_trace_perf_data(struct recv_worker *w,
+				 struct client_data *client, int len)
 {
-	struct client_data *client;
 	int32_t cpu;
-	char *filename = NULL;
-	void *buffer;
-
-	client = find_client(sock);
-	if (client == NULL)
-		pr_err_ns("no client on this socket\n");
+	char filename[32];
 
-	if (read_all(sock, &cpu, sizeof(cpu)) < 0)
+	if (read_all(client->sock, &cpu, sizeof(cpu)) < 0)
 		pr_err("recv cpu failed");
 	cpu = ntohl(cpu);
 
-	xasprintf(&filename, "perf-cpu%d.dat", cpu);
-
-	len -= sizeof(cpu);
-	buffer = xmalloc(len);
-
-	if (read_all(sock, buffer, len) < 0)
-		pr_err("recv buffer failed");
+	snprintf(filename, sizeof(filename), "perf-cpu%d.dat", cpu);
 
-	write_client_file(client, filename, 1, buffer, len);
-
-	free(buffer);
-	free(filename);
+	recv_client_data(w, client, filename, len - sizeof(cpu), -1);
 }
 
-static void recv_trace_metadata(int sock, int len)
+static void recv_trace_metadata(struct client_data *client, int len)
 {
-	struct client_data *client;
+	int sock = client->sock;
 	int32_t namelen;
 	char *filename = NULL;
 	void *filedata;
 
-	client = find_client(sock);
-	if (client == NULL)
-		pr_err_ns("no client on this socket\n");
-
 	if (read_all(sock, &namelen, sizeof(namelen)) < 0)
 		pr_err("recv symfile name length failed");
 
@@ -449,16 +1377,12 @@ static void recv_trace_metadata(int sock, int len)
 	free(filename);
 }
 
-static void recv_trace_info(int sock, int len)
+static void recv_trace_info(struct client_data *client, int len)
 {
-	struct client_data *client;
+	int sock = client->sock;
 	struct uftrace_file_header hdr;
 	void *info;
 
-	client = find_client(sock);
-	if (client == NULL)
-		pr_err_ns("no client on this socket\n");
-
 	if (read_all(sock, &hdr, sizeof(hdr)) < 0)
 		pr_err("recv file header failed");
 
@@ -479,13 +1403,17 @@ static void recv_trace_info(int sock, int len)
 	free(info);
 }
 
-static void recv_trace_end(int sock, int efd)
+static void recv_trace_end(struct recv_worker *w, int sock)
 {
 	struct client_data *client;
 
-	client = find_client(sock);
+	client = find_client(w, sock);
 	if (client) {
 		list_del(&client->list);
+		close_client_files(client);
+
+		if (w->opts->aggregate)
+			finish_aggregate(w, client);
 
 		pr_dbg("wrote client data to %s\n", client->dirname);
 
@@ -493,7 +1421,7 @@ static void recv_trace_end(int sock, int efd)
 		free(client);
 	}
 
-	if (epoll_ctl(efd, EPOLL_CTL_DEL, sock, NULL) < 0)
+	if (epoll_ctl(w->efd, EPOLL_CTL_DEL, sock, NULL) < 0)
 		pr_err("epoll del failed");
 
 	close(sock);
@@ -526,8 +1454,11 @@ static void epoll_add(int efd, int fd, unsigned event)
 		pr_err("epoll add failed");
 }
 
-static void handle_server_sock(struct epoll_event *ev, int efd)
+/* assign new clients to the workers in turn */
+static void handle_server_sock(struct epoll_event *ev,
+			       struct recv_worker *workers, int nr_workers)
 {
+	static int next;
 	int client;
 	int sock = ev->data.fd;
 	struct sockaddr_in addr;
@@ -541,18 +1472,21 @@ static void handle_server_sock(struct epoll_event *ev, int efd)
 	getnameinfo((struct sockaddr *)&addr, len, hbuf, sizeof(hbuf),
 		    NULL, 0, NI_NUMERICHOST);
 
-	epoll_add(efd, client, EPOLLIN);
-	pr_dbg("new connection added from %s\n", hbuf);
+	epoll_add(workers[next].efd, client, EPOLLIN);
+	pr_dbg("new connection added from %s (worker %d)\n", hbuf, next);
+
+	next = (next + 1) % nr_workers;
 }
 
-static void handle_client_sock(struct epoll_event *ev, int efd, struct opts *opts)
+static void handle_client_sock(struct recv_worker *w, struct epoll_event *ev)
 {
 	int sock = ev->data.fd;
 	struct uftrace_msg msg;
+	struct client_data *client;
 
 	if (ev->events & (EPOLLERR | EPOLLHUP)) {
 		pr_dbg("client socket closed\n");
-		recv_trace_end(sock, efd);
+		recv_trace_end(w, sock);
 		return;
 	}
 
@@ -566,35 +1500,41 @@ static void handle_client_sock(struct epoll_event *ev, int efd, struct opts *opt
 	if (msg.magic != UFTRACE_MSG_MAGIC)
 		pr_err_ns("invalid message\n");
 
-	switch (msg.type) {
-	case UFTRACE_MSG_SEND_DIR_NAME:
+	if (msg.type == UFTRACE_MSG_SEND_DIR_NAME) {
 		pr_dbg2("receive UFTRACE_MSG_SEND_DIR_NAME\n");
-		recv_trace_dir_name(sock, msg.len);
-		break;
+		recv_trace_dir_name(w, sock, msg.len);
+		return;
+	}
+
+	client = find_client(w, sock);
+	if (client == NULL && msg.type != UFTRACE_MSG_SEND_END)
+		pr_err_ns("no client on this socket\n");
+
+	switch (msg.type) {
 	case UFTRACE_MSG_SEND_DATA:
 		pr_dbg2("receive UFTRACE_MSG_SEND_DATA\n");
-		recv_trace_data(sock, msg.len);
+		recv_trace_data(w, client, msg.len);
 		break;
 	case UFTRACE_MSG_SEND_KERNEL_DATA:
 		pr_dbg2("receive UFTRACE_MSG_SEND_KERNEL_DATA\n");
-		recv_trace_kernel_data(sock, msg.len);
+		recv_trace_kernel_data(w, client, msg.len);
 		break;
 	case UFTRACE_MSG_SEND_PERF_DATA:
 		pr_dbg2("receive UFTRACE_MSG_SEND_PERF_DATA\n");
-		recv_trace_perf_data(sock, msg.len);
+		recv_trace_perf_data(w, client, msg.len);
 		break;
 	case UFTRACE_MSG_SEND_INFO:
 		pr_dbg2("receive UFTRACE_MSG_SEND_INFO\n");
-		recv_trace_info(sock, msg.len);
+		recv_trace_info(client, msg.len);
 		break;
 	case UFTRACE_MSG_SEND_META_DATA:
 		pr_dbg2("receive UFTRACE_MSG_SEND_META_DATA\n");
-		recv_trace_metadata(sock, msg.len);
+		recv_trace_metadata(client, msg.len);
 		break;
 	case UFTRACE_MSG_SEND_END:
 		pr_dbg2("receive UFTRACE_MSG_SEND_END\n");
-		recv_trace_end(sock, efd);
-		execute_run_cmd(opts->run_cmd);
+		recv_trace_end(w, sock);
+		execute_run_cmd(w->opts->run_cmd);
 		break;
 	default:
 		pr_dbg("unknown message: %d\n", msg.type);
@@ -602,12 +1542,104 @@ static void handle_client_sock(struct epoll_event *ev, int efd, struct opts *opt
 	}
 }
 
+static void *recv_worker_thread(void *arg)
+{
+	struct recv_worker *w = arg;
+	struct client_data *client, *tmp;
+	bool done = false;
+
+	pthread_setname_np(pthread_self(), "RecvWorker");
+	pr_dbg2("start recv worker %d\n", w->idx);
+
+	while (true) {
+		struct epoll_event ev[10];
+		int i, len;
+
+		/* handle remaining data before finishing the clients */
+		len = epoll_wait(w->efd, ev, 10, done ? 0 : -1);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("epoll wait failed");
+		}
+
+		if (done && len == 0)
+			break;
+
+		for (i = 0; i < len; i++) {
+			if (ev[i].data.fd == w->ctl[0]) {
+				char dummy;
+
+				if (read(w->ctl[0], &dummy, sizeof(dummy)) < 0)
+					pr_dbg("cannot read worker control: %m\n");
+				done = true;
+			}
+			else
+				handle_client_sock(w, &ev[i]);
+		}
+	}
+
+	list_for_each_entry_safe(client, tmp, &w->clients, list)
+		recv_trace_end(w, client->sock);
+
+	pr_dbg2("stop recv worker %d\n", w->idx);
+	return NULL;
+}
+
+static void setup_recv_worker(struct recv_worker *w, int idx, struct opts *opts)
+{
+	w->idx = idx;
+	w->opts = opts;
+	w->use_splice = true;
+	INIT_LIST_HEAD(&w->clients);
+
+	w->efd = epoll_create1(EPOLL_CLOEXEC);
+	if (w->efd < 0)
+		pr_err("epoll create failed");
+
+	if (pipe2(w->ctl, O_CLOEXEC) < 0)
+		pr_err("cannot create control pipe for worker");
+
+	if (pipe2(w->pipefd, O_CLOEXEC) < 0)
+		pr_err("cannot create data pipe for worker");
+
+	/* larger pipe means less number of splice() calls */
+	fcntl(w->pipefd[1], F_SETPIPE_SZ, RECV_PIPE_SIZE);
+
+	epoll_add(w->efd, w->ctl[0], EPOLLIN);
+
+	if (pthread_create(&w->thread, NULL, recv_worker_thread, w))
+		pr_err("cannot create recv worker");
+}
+
+static void finish_recv_worker(struct recv_worker *w)
+{
+	char dummy = 0;
+
+	if (write(w->ctl[1], &dummy, sizeof(dummy)) < 0)
+		pr_dbg("cannot notify recv worker: %m\n");
+
+	pthread_join(w->thread, NULL);
+
+	close(w->ctl[0]);
+	close(w->ctl[1]);
+	close(w->pipefd[0]);
+	close(w->pipefd[1]);
+	close(w->efd);
+}
+
 int command_recv(int argc, char *argv[], struct opts *opts)
 {
 	struct signalfd_siginfo si;
+	struct recv_worker *workers;
+	int nr_workers;
 	int sock;
 	int sigfd;
 	int efd;
+	int tfd = -1;
+	int i;
+	/* not using uftrace_done as it'd stop sorting the aggregate report */
+	bool done = false;
 
 	if (strcmp(opts->dirname, UFTRACE_DIR_NAME)) {
 		char *dirname = "current";
@@ -620,8 +1652,18 @@ int command_recv(int argc, char *argv[], struct opts *opts)
 	}
 
 	sock = server_socket(opts);
+	/* signals should be blocked before creating the workers */
 	sigfd = signal_fd(opts);
 
+	nr_workers = opts->nr_thread;
+	if (nr_workers <= 0)
+		nr_workers = DIV_ROUND_UP(sysconf(_SC_NPROCESSORS_ONLN), 4);
+
+	pr_dbg("creating %d worker(s) for receiving\n", nr_workers);
+	workers = xcalloc(nr_workers, sizeof(*workers));
+	for (i = 0; i < nr_workers; i++)
+		setup_recv_worker(&workers[i], i, opts);
+
 	efd = epoll_create1(EPOLL_CLOEXEC);
 	if (efd < 0)
 		pr_err("epoll create failed");
@@ -629,9 +1671,14 @@ int command_recv(int argc, char *argv[], struct opts *opts)
 	epoll_add(efd, sock,  EPOLLIN);
 	epoll_add(efd, sigfd, EPOLLIN);
 
-	while (!uftrace_done) {
+	if (opts->aggregate) {
+		tfd = setup_aggregate();
+		epoll_add(efd, tfd, EPOLLIN);
+	}
+
+	while (!done) {
 		struct epoll_event ev[10];
-		int i, len;
+		int len;
 
 		len = epoll_wait(efd, ev, 10, -1);
 		if (len < 0)
@@ -643,15 +1690,29 @@ int command_recv(int argc, char *argv[], struct opts *opts)
 				if (nr > 0 && si.ssi_signo == SIGCHLD)
 					waitpid(-1, NULL, WNOHANG);
 				else
-					uftrace_done = true;
+					done = true;
 			}
 			else if (ev[i].data.fd == sock)
-				handle_server_sock(&ev[i], efd);
-			else
-				handle_client_sock(&ev[i], efd, opts);
+				handle_server_sock(&ev[i], workers, nr_workers);
+			else if (ev[i].data.fd == tfd) {
+				uint64_t count;
+
+				if (read(tfd, &count, sizeof(count)) > 0)
+					write_aggregate_file();
+			}
 		}
 	}
 
+	for (i = 0; i < nr_workers; i++)
+		finish_recv_worker(&workers[i]);
+	free(workers);
+
+	if (opts->aggregate) {
+		/* clients in progress are merged when the workers finish */
+		write_aggregate_file();
+		close(tfd);
+	}
+
 	close(efd);
 	close(sigfd);
 	close(sock);
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
 #include <stdio_ext.h>
 #include <assert.h>
 
@@ -23,8 +25,64 @@ static int prev_tid = -1;
 static LIST_HEAD(output_fields);
 
 #define NO_TIME  (void *)1  /* to suppress duration */
+#define REPLAY_BUFSIZE  (1024 * 1024)
 
-static void print_duration(struct field_data *fd)
+/* write @val in decimal, aligned to the right in @width */
+static int format_num(char *buf, uint64_t val, int width, char pad)
+{
+	char tmp[24];
+	int n = 0;
+	int len = 0;
+
+	do {
+		tmp[n++] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	while (len < width - n)
+		buf[len++] = pad;
+	while (n > 0)
+		buf[len++] = tmp[--n];
+
+	return len;
+}
+
+static int format_hex(char *buf, uint64_t val, int width)
+{
+	char tmp[24];
+	int n = 0;
+	int len = 0;
+
+	do {
+		tmp[n++] = "0123456789abcdef"[val % 16];
+		val /= 16;
+	} while (val);
+
+	while (len < width - n)
+		buf[len++] = ' ';
+	while (n > 0)
+		buf[len++] = tmp[--n];
+
+	return len;
+}
+
+/* same as "%*.*s" with @width (and @max if positive) */
+static int format_str(char *buf, const char *str, int width, int max)
+{
+	int n = strlen(str);
+	int len = 0;
+
+	if (max > 0 && n > max)
+		n = max;
+
+	while (len < width - n)
+		buf[len++] = ' ';
+
+	memcpy(buf + len, str, n);
+	return len + n;
+}
+
+static int format_duration(struct field_data *fd, char *buf)
 {
 	struct fstack *fstack = fd->fstack;
 	void *arg = fd->arg;
@@ -34,39 +92,52 @@ static void print_duration(struct field_data *fd)
 	if (fstack && arg == NULL)
 		d = fstack->total_time;
 
-	print_time_unit(d);
+	return format_time_unit(buf, d);
 }
 
-static void print_tid(struct field_data *fd)
+static int format_tid(struct field_data *fd, char *buf)
 {
 	struct uftrace_task_reader *task = fd->task;
-	pr_out("[%6d]", task->tid);
+	int len;
+
+	buf[0] = '[';
+	len = format_num(buf + 1, task->tid, 6, ' ');
+	buf[len + 1] = ']';
+
+	return len + 2;
 }
 
-static void print_addr(struct field_data *fd)
+static int format_addr(struct field_data *fd, char *buf)
 {
 	struct fstack *fstack = fd->fstack;
 
 	/* uftrace records (truncated) 48-bit addresses */
 	int width = sizeof(long) == 4 ? 8 : 12;
 
-	if (fstack == NULL)  /* LOST */
-		pr_out("%*s", width, "");
-	else
-		pr_out("%*lx", width, fstack->addr);
+	if (fstack == NULL) {  /* LOST */
+		memset(buf, ' ', width);
+		return width;
+	}
+
+	return format_hex(buf, fstack->addr, width);
 }
 
-static void print_timestamp(struct field_data *fd)
+static int format_timestamp(struct field_data *fd, char *buf)
 {
 	struct uftrace_task_reader *task = fd->task;
 
 	uint64_t  sec = task->timestamp / NSEC_PER_SEC;
 	uint64_t nsec = task->timestamp % NSEC_PER_SEC;
+	int len;
+
+	len = format_num(buf, sec, 8, ' ');
+	buf[len++] = '.';
+	len += format_num(buf + len, nsec, 9, '0');
 
-	pr_out("%8"PRIu64".%09"PRIu64, sec, nsec);
+	return len;
 }
 
-static void print_timedelta(struct field_data *fd)
+static int format_timedelta(struct field_data *fd, char *buf)
 {
 	struct uftrace_task_reader *task = fd->task;
 	uint64_t delta = 0;
@@ -74,25 +145,25 @@ static void print_timedelta(struct field_data *fd)
 	if (task->timestamp_last)
 		delta = task->timestamp - task->timestamp_last;
 
-	print_time_unit(delta);
+	return format_time_unit(buf, delta);
 }
 
-static void print_elapsed(struct field_data *fd)
+static int format_elapsed(struct field_data *fd, char *buf)
 {
 	struct uftrace_task_reader *task = fd->task;
 	uint64_t elapsed = task->timestamp - task->h->time_range.first;
 
-	print_time_unit(elapsed);
+	return format_time_unit(buf, elapsed);
 }
 
-static void print_task(struct field_data *fd)
+static int format_task(struct field_data *fd, char *buf)
 {
 	struct uftrace_task_reader *task = fd->task;
 
-	pr_out("%*s", 15, task->t->comm);
+	return format_str(buf, task->t->comm, 15, 0);
 }
 
-static void print_module(struct field_data *fd)
+static int format_module(struct field_data *fd, char *buf)
 {
 	struct uftrace_task_reader *task = fd->task;
 	struct fstack *fstack = fd->fstack;
@@ -103,8 +174,8 @@ static void print_module(struct field_data *fd)
 
 	/* for EVENT or LOST record */
 	if (fstack == NULL) {
-		pr_out("%*s", 16, "");
-		return;
+		memset(buf, ' ', 16);
+		return 16;
 	}
 
 	s = find_task_session(&task->h->sessions, task->t, timestamp);
@@ -116,7 +187,7 @@ static void print_module(struct field_data *fd)
 			modname = basename(map->libname);
 	}
 
-	pr_out("%*.*s", 16, 16, modname);
+	return format_str(buf, modname, 16, 16);
 }
 
 static struct display_field field_duration = {
@@ -124,7 +195,7 @@ static struct display_field field_duration = {
 	.name    = "duration",
 	.header  = " DURATION ",
 	.length  = 10,
-	.print   = print_duration,
+	.format  = format_duration,
 	.list    = LIST_HEAD_INIT(field_duration.list),
 };
 
@@ -133,7 +204,7 @@ static struct display_field field_tid = {
 	.name    = "tid",
 	.header  = "   TID  ",
 	.length  = 8,
-	.print   = print_tid,
+	.format  = format_tid,
 	.list    = LIST_HEAD_INIT(field_tid.list),
 };
 
@@ -147,7 +218,7 @@ static struct display_field field_addr = {
 	.header  = "   ADDRESS  ",
 	.length  = 12,
 #endif
-	.print   = print_addr,
+	.format  = format_addr,
 	.list    = LIST_HEAD_INIT(field_addr.list),
 };
 
@@ -156,7 +227,7 @@ static struct display_field field_time = {
 	.name    = "time",
 	.header  = "     TIMESTAMP    ",
 	.length  = 18,
-	.print   = print_timestamp,
+	.format  = format_timestamp,
 	.list    = LIST_HEAD_INIT(field_time.list),
 };
 
@@ -165,7 +236,7 @@ static struct display_field field_delta = {
 	.name    = "delta",
 	.header  = " TIMEDELTA",
 	.length  = 10,
-	.print   = print_timedelta,
+	.format  = format_timedelta,
 	.list    = LIST_HEAD_INIT(field_delta.list),
 };
 
@@ -174,7 +245,7 @@ static struct display_field field_elapsed = {
 	.name    = "elapsed",
 	.header  = "  ELAPSED ",
 	.length  = 10,
-	.print   = print_elapsed,
+	.format  = format_elapsed,
 	.list    = LIST_HEAD_INIT(field_elapsed.list),
 };
 
@@ -183,7 +254,7 @@ static struct display_field field_task = {
 	.name    = "task",
 	.header  = "      TASK NAME",
 	.length  = 15,
-	.print   = print_task,
+	.format  = format_task,
 	.list    = LIST_HEAD_INIT(field_task.list),
 };
 
@@ -192,7 +263,7 @@ static struct display_field field_module = {
 	.name    = "module",
 	.header  = "     MODULE NAME",
 	.length  = 16,
-	.print   = print_module,
+	.format  = format_module,
 	.list    = LIST_HEAD_INIT(field_module.list),
 };
 
@@ -208,17 +279,102 @@ static struct display_field *field_table[] = {
 	&field_module,
 };
 
-static void print_field(struct uftrace_task_reader *task,
-			struct fstack *fstack, void *arg)
+/*
+ * A line of output is built in this buffer and written at once rather
+ * than calling pr_out() for each part of the line.
+ */
+static struct {
+	char *buf;
+	size_t len;
+	size_t size;
+} line;
+
+static char *line_reserve(size_t len)
+{
+	if (line.len + len > line.size) {
+		line.size = ALIGN(line.len + len, 4096);
+		line.buf = xrealloc(line.buf, line.size);
+	}
+	return line.buf + line.len;
+}
+
+static void line_add(const char *str, size_t len)
+{
+	memcpy(line_reserve(len), str, len);
+	line.len += len;
+}
+
+static void line_str(const char *str)
+{
+	line_add(str, strlen(str));
+}
+
+static void line_indent(int depth)
+{
+	/* same as pr_out("%*s", depth * 2, "") */
+	if (depth <= 0)
+		return;
+
+	memset(line_reserve(depth * 2), ' ', depth * 2);
+	line.len += depth * 2;
+}
+
+/* same as pr_color() */
+static void line_color(char code, const char *str)
+{
+	line_str(out_color_str(code));
+	line_str(str);
+	line_str(color_reset);
+}
+
+static void line_write(void)
+{
+	fwrite(line.buf, 1, line.len, outfp);
+	line.len = 0;
+}
+
+static void line_field(struct uftrace_task_reader *task,
+		       struct fstack *fstack, void *arg)
 {
 	struct field_data fd = {
 		.task = task,
 		.fstack = fstack,
 		.arg = arg,
 	};
+	char *buf;
+	int len;
 
-	if (print_field_data(&output_fields, &fd, 1))
-		pr_out(" | ");
+	if (list_empty(&output_fields))
+		return;
+
+	buf = line_reserve(ARRAY_SIZE(field_table) * (FIELD_BUFSIZE + 1));
+	len = format_field_data(&output_fields, &fd, 1, buf);
+	if (len < 0) {
+		/* some fields cannot be formatted, print them directly */
+		line_write();
+		print_field_data(&output_fields, &fd, 1);
+	}
+	else
+		line.len += len;
+
+	line_add(" | ", 3);
+}
+
+static void print_field(struct uftrace_task_reader *task,
+			struct fstack *fstack, void *arg)
+{
+	line_field(task, fstack, arg);
+	line_write();
+}
+
+/*
+ * setup the default fields (duration and tid) also for the other commands
+ * which print records in the replay format without the task reader.
+ */
+void setup_replay_default_field(struct list_head *fields)
+{
+	add_field(fields, field_table[REPLAY_F_DURATION]);
+	add_field(fields, field_table[REPLAY_F_TID]);
 }
 
 static void setup_default_field(struct list_head *fields, struct opts *opts)
@@ -229,8 +385,7 @@ static void setup_default_field(struct list_head *fields, struct opts *opts)
 		else
 			add_field(fields, field_table[REPLAY_F_TIMESTAMP]);
 	}
-	add_field(fields, field_table[REPLAY_F_DURATION]);
-	add_field(fields, field_table[REPLAY_F_TID]);
+	setup_replay_default_field(fields);
 }
 
 static int task_column_depth(struct uftrace_task_reader *task, struct opts *opts)
@@ -267,7 +422,7 @@ static void print_backtrace(struct uftrace_task_reader *task)
 			if (field->id == REPLAY_F_DURATION)
 				pr_out("%*s", field->length, "backtrace");
 			else
-				field->print(&fd);
+				print_single_field(field, &fd);
 			pr_out(" ");
 		}
 		if (!list_empty(&output_fields))
@@ -840,19 +995,28 @@ static int print_graph_rstack(struct uftrace_data *handle,
 			}
 			get_argspec_string(task, retval, sizeof(retval), str_mode);
 
-			print_field(task, fstack, NULL);
-			pr_out("%*s", depth * 2, "");
+			line_field(task, fstack, NULL);
+			line_indent(depth);
 			if (tr.flags & TRIGGER_FL_COLOR) {
-				pr_color(tr.color, "%s", symname);
-				if (*libname)
-					pr_color(tr.color, "@%s", libname);
-				pr_out("%s%s\n", args, retval);
+				line_color(tr.color, symname);
+				if (*libname) {
+					line_str(out_color_str(tr.color));
+					line_str("@");
+					line_str(libname);
+					line_str(color_reset);
+				}
 			}
 			else {
-				pr_out("%s%s%s%s%s\n", symname,
-				       *libname ? "@" : "",
-				       libname, args, retval);
+				line_str(symname);
+				if (*libname) {
+					line_str("@");
+					line_str(libname);
+				}
 			}
+			line_str(args);
+			line_str(retval);
+			line_add("\n", 1);
+			line_write();
 
 			/* fstack_update() is not needed here */
 
@@ -860,18 +1024,27 @@ static int print_graph_rstack(struct uftrace_data *handle,
 		}
 		else {
 			/* function entry */
-			print_field(task, fstack, NO_TIME);
-			pr_out("%*s", depth * 2, "");
+			line_field(task, fstack, NO_TIME);
+			line_indent(depth);
 			if (tr.flags & TRIGGER_FL_COLOR) {
-				pr_color(tr.color, "%s", symname);
-				if (*libname)
-					pr_color(tr.color, "@%s", libname);
-				pr_out("%s {\n", args);
+				line_color(tr.color, symname);
+				if (*libname) {
+					line_str(out_color_str(tr.color));
+					line_str("@");
+					line_str(libname);
+					line_str(color_reset);
+				}
 			}
 			else {
-				pr_out("%s%s%s%s {\n", symname,
-				       *libname ? "@" : "", libname, args);
+				line_str(symname);
+				if (*libname) {
+					line_str("@");
+					line_str(libname);
+				}
 			}
+			line_str(args);
+			line_add(" {\n", 3);
+			line_write();
 
 			fstack_update(UFTRACE_ENTRY, task, fstack);
 		}
@@ -900,13 +1073,24 @@ static int print_graph_rstack(struct uftrace_data *handle,
 			if (opts->task_newline)
 				print_task_newline(task->tid);
 
-			print_field(task, fstack, NULL);
-			pr_out("%*s}%s", depth * 2, "", retval);
-			if (opts->comment)
-				pr_gray(" /* %s%s%s */\n", symname,
-					*libname ? "@" : "", libname);
-			else
-				pr_gray("\n");
+			line_field(task, fstack, NULL);
+			line_indent(depth);
+			line_add("}", 1);
+			line_str(retval);
+
+			line_str(out_color_str(COLOR_CODE_GRAY));
+			if (opts->comment) {
+				line_str(" /* ");
+				line_str(symname);
+				if (*libname) {
+					line_str("@");
+					line_str(libname);
+				}
+				line_str(" */");
+			}
+			line_add("\n", 1);
+			line_str(color_reset);
+			line_write();
 		}
 
 		fstack_exit(task);
@@ -1116,6 +1300,13 @@ int command_replay(int argc, char *argv[], struct opts *opts)
 	}
 
 	fstack_setup_filters(opts, &handle);
+
+	/* lines are written in a batch if they don't go to the terminal */
+	if (!isatty(fileno(outfp)) && !debug) {
+		static char outbuf[REPLAY_BUFSIZE];
+
+		setvbuf(outfp, outbuf, _IOFBF, sizeof(outbuf));
+	}
 	setup_field(&output_fields, opts, &setup_default_field,
 		    field_table, ARRAY_SIZE(field_table));
 
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "uftrace.h"
 #include "utils/utils.h"
@@ -9,6 +11,8 @@
 #include "utils/list.h"
 #include "utils/fstack.h"
 #include "utils/report.h"
+#include "utils/cache.h"
+#include "utils/perf.h"
 
 enum {
 	AVG_NONE,
@@ -20,6 +24,18 @@ enum {
 /* maximum length of symbol */
 static int maxlen = 20;
 
+/* tasks handled by current worker (NULL means all tasks) */
+static bool *worker_tasks;
+
+static bool is_worker_task(struct uftrace_data *handle,
+			   struct uftrace_task_reader *task)
+{
+	if (worker_tasks == NULL)
+		return true;
+
+	return worker_tasks[task - handle->tasks];
+}
+
 static void insert_node(struct rb_root *root, struct uftrace_task_reader *task,
 			char *symname)
 {
@@ -33,19 +49,44 @@ static void insert_node(struct rb_root *root, struct uftrace_task_reader *task,
 	report_update_node(node, task);
 }
 
-static void find_insert_node(struct rb_root *root, struct uftrace_task_reader *task,
+/* use the symbol (or address) as a key to find a node without its name */
+static void insert_sym_node(struct rb_root *root, struct uftrace_report_hash *hash,
+			    struct uftrace_task_reader *task,
+			    struct sym *sym, uint64_t addr)
+{
+	struct uftrace_report_node *node;
+	uint64_t key = sym ? (uintptr_t)sym : addr;
+	char *symname;
+
+	node = report_hash_find(hash, key, sym == NULL);
+	if (node == NULL) {
+		/* nodes are merged by name (for --diff and --sort) */
+		symname = symbol_getname(sym, addr);
+
+		node = report_find_node(root, symname);
+		if (node == NULL) {
+			node = xzalloc(sizeof(*node));
+			report_add_node(root, symname, node);
+		}
+		report_hash_add(hash, key, sym == NULL, node);
+
+		symbol_putname(sym, symname);
+	}
+	report_update_node(node, task);
+}
+
+static void find_insert_node(struct rb_root *root, struct uftrace_report_hash *hash,
+			     struct uftrace_task_reader *task,
 			     uint64_t timestamp, uint64_t addr)
 {
 	struct sym *sym;
-	char *symname;
 
 	sym = task_find_sym_addr(&task->h->sessions, task, timestamp, addr);
-	symname = symbol_getname(sym, addr);
-	insert_node(root, task, symname);
-	symbol_putname(sym, symname);
+	insert_sym_node(root, hash, task, sym, addr);
 }
 
-static void add_lost_fstack(struct rb_root *root, struct uftrace_task_reader *task)
+static void add_lost_fstack(struct rb_root *root, struct uftrace_report_hash *hash,
+			    struct uftrace_task_reader *task)
 {
 	struct fstack *fstack;
 
@@ -54,7 +95,7 @@ static void add_lost_fstack(struct rb_root *root, struct uftrace_task_reader *ta
 
 		if (fstack_enabled && fstack->valid &&
 		    !(fstack->flags & FSTACK_FL_NORECORD)) {
-			find_insert_node(root, task, task->timestamp_last,
+			find_insert_node(root, hash, task, task->timestamp_last,
 					 fstack->addr);
 		}
 
@@ -64,7 +105,8 @@ static void add_lost_fstack(struct rb_root *root, struct uftrace_task_reader *ta
 }
 
 static void add_remaining_fstack(struct uftrace_data *handle,
-				 struct rb_root *root)
+				 struct rb_root *root,
+				 struct uftrace_report_hash *hash)
 {
 	struct uftrace_task_reader *task;
 	struct fstack *fstack;
@@ -78,6 +120,9 @@ static void add_remaining_fstack(struct uftrace_data *handle,
 		if (task->stack_count == 0)
 			continue;
 
+		if (!is_worker_task(handle, task))
+			continue;
+
 		last_time = task->rstack->time;
 
 		if (handle->time_range.stop)
@@ -99,7 +144,7 @@ static void add_remaining_fstack(struct uftrace_data *handle,
 			if (task->stack_count > 0)
 				fstack[-1].child_time += fstack->total_time;
 
-			find_insert_node(root, task, last_time, fstack->addr);
+			find_insert_node(root, hash, task, last_time, fstack->addr);
 		}
 	}
 }
@@ -111,11 +156,16 @@ static void build_function_tree(struct uftrace_data *handle,
 	struct sym *sym = NULL;
 	struct uftrace_record *rstack;
 	struct uftrace_task_reader *task;
+	struct uftrace_report_hash hash = {};
 	uint64_t addr;
 
 	while (read_rstack(handle, &task) >= 0 && !uftrace_done) {
 		rstack = task->rstack;
 
+		/* kernel and perf data have records of other tasks */
+		if (!is_worker_task(handle, task))
+			continue;
+
 		if (rstack->type != UFTRACE_LOST)
 			task->timestamp_last = rstack->time;
 
@@ -130,13 +180,13 @@ static void build_function_tree(struct uftrace_data *handle,
 
 		if (rstack->type == UFTRACE_EVENT) {
 			if (rstack->addr == EVENT_ID_PERF_SCHED_IN)
-				insert_node(root, task, sched_sym.name);
+				insert_sym_node(root, &hash, task, &sched_sym, 0);
 			continue;
 		}
 
 		if (rstack->type == UFTRACE_LOST) {
 			/* add partial duration of functions before LOST */
-			add_lost_fstack(root, task);
+			add_lost_fstack(root, &hash, task);
 			continue;
 		}
 
@@ -154,13 +204,13 @@ static void build_function_tree(struct uftrace_data *handle,
 		if (!opts->libcall && sym && sym->type == ST_PLT_FUNC)
 			continue;
 
-		find_insert_node(root, task, rstack->time, addr);
+		insert_sym_node(root, &hash, task, sym, addr);
 	}
 
-	if (uftrace_done)
-		return;
+	if (!uftrace_done)
+		add_remaining_fstack(handle, root, &hash);
 
-	add_remaining_fstack(handle, root);
+	report_hash_destroy(&hash);
 }
 
 static void print_and_delete(struct rb_root *root, bool sorted, void *arg,
@@ -183,6 +233,11 @@ static void print_and_delete(struct rb_root *root, bool sorted, void *arg,
 	}
 }
 
+static void print_nothing(struct uftrace_report_node *node, void *unused)
+{
+	/* just delete */
+}
+
 static void print_function(struct uftrace_report_node *node, void *unused)
 {
 	if (avg_mode == AVG_NONE) {
@@ -215,6 +270,194 @@ static void print_function(struct uftrace_report_node *node, void *unused)
 	}
 }
 
+/* parallel report support */
+/* it's not possible to divide records by time in these cases */
+static bool can_build_parallel(struct uftrace_data *handle, struct opts *opts)
+{
+	/* trace-on/off triggers affect all tasks */
+	if (opts->trigger || opts->disabled)
+		return false;
+
+	/* display depth can be inherited from the parent task */
+	if (opts->depth != OPT_DEPTH_DEFAULT)
+		return false;
+
+	/* time range might need the first timestamp of all tasks */
+	if (handle->time_range.start || handle->time_range.stop)
+		return false;
+
+	if (opts->tid)
+		return false;
+
+	return opts->nr_thread > 1 && handle->nr_tasks > 1;
+}
+
+static void __attribute__((noreturn))
+run_worker(struct uftrace_data *parent, struct opts *opts,
+	   int *assign, int idx, int fd)
+{
+	struct uftrace_data data;
+	struct uftrace_data *handle = &data;
+	struct rb_root root = RB_ROOT;
+	FILE *fp;
+
+	worker_tasks = open_worker_data(opts, handle, parent, assign, idx);
+	if (worker_tasks == NULL)
+		_exit(1);
+
+	build_function_tree(handle, &root, opts);
+	if (uftrace_done)
+		_exit(1);
+
+	fp = fdopen(fd, "w");
+	if (fp == NULL)
+		_exit(1);
+
+	if (report_save_nodes(&root, fp) < 0 || fclose(fp) < 0)
+		_exit(1);
+
+	_exit(0);
+}
+
+/*
+ * build function tree using multiple worker processes.  Each worker
+ * reads user records of a subset of tasks and sends aggregated result
+ * which is merged into @root by name.  It uses processes rather than
+ * threads since symbol tables and filters are not thread-safe.
+ */
+static int build_function_tree_parallel(struct uftrace_data *handle,
+					struct rb_root *root, struct opts *opts)
+{
+	int nr_workers = opts->nr_thread;
+	pid_t *pids;
+	int *fds;
+	int *assign;
+	int i, status;
+	int ret = 0;
+
+	if (nr_workers > handle->nr_tasks)
+		nr_workers = handle->nr_tasks;
+
+	pr_dbg("build function tree using %d workers\n", nr_workers);
+
+	pids = xcalloc(nr_workers, sizeof(*pids));
+	fds = xcalloc(nr_workers, sizeof(*fds));
+	assign = assign_worker_tasks(handle, nr_workers, false);
+
+	/* do not flush the same buffer in the workers */
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < nr_workers; i++) {
+		int pfd[2];
+
+		if (pipe(pfd) < 0) {
+			pr_warn("cannot create pipe for worker: %m\n");
+			ret = -1;
+			break;
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			pr_warn("cannot create worker: %m\n");
+			close(pfd[0]);
+			close(pfd[1]);
+			ret = -1;
+			break;
+		}
+
+		if (pids[i] == 0) {
+			int k;
+
+			close(pfd[0]);
+			for (k = 0; k < i; k++)
+				close(fds[k]);
+
+			run_worker(handle, opts, assign, i, pfd[1]);
+		}
+
+		close(pfd[1]);
+		fds[i] = pfd[0];
+	}
+	nr_workers = i;
+
+	for (i = 0; i < nr_workers; i++) {
+		FILE *fp = fdopen(fds[i], "r");
+
+		if (fp == NULL) {
+			close(fds[i]);
+			ret = -1;
+		}
+		else {
+			if (ret == 0 && report_load_nodes(root, fp) < 0)
+				ret = -1;
+			fclose(fp);
+		}
+
+		if (waitpid(pids[i], &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			ret = -1;
+	}
+
+	free(assign);
+	free(fds);
+	free(pids);
+	return ret;
+}
+
+static void __build_report_tree(struct uftrace_data *handle,
+				struct rb_root *root, struct opts *opts)
+{
+	if (can_build_parallel(handle, opts)) {
+		if (build_function_tree_parallel(handle, root, opts) == 0)
+			return;
+
+		if (uftrace_done)
+			return;
+
+		/* the handle was not touched, start over */
+		pr_dbg("parallel report failed, fallback to single thread\n");
+		print_and_delete(root, false, NULL, print_nothing);
+	}
+
+	build_function_tree(handle, root, opts);
+}
+
+/* the result is saved in the same format as the parallel workers */
+static void build_report_tree(struct uftrace_data *handle,
+			      struct rb_root *root, struct opts *opts)
+{
+	struct uftrace_cache cache;
+	FILE *fp;
+	bool ok;
+
+	if (cache_init(&cache, opts, "report", NULL) < 0) {
+		__build_report_tree(handle, root, opts);
+		return;
+	}
+
+	fp = cache_read(&cache);
+	if (fp) {
+		ok = report_load_nodes(root, fp) == 0;
+		cache_close(&cache, ok);
+		if (ok)
+			goto out;
+
+		print_and_delete(root, false, NULL, print_nothing);
+	}
+
+	__build_report_tree(handle, root, opts);
+	if (uftrace_done)
+		goto out;
+
+	fp = cache_write(&cache);
+	if (fp)
+		cache_close(&cache, report_save_nodes(root, fp) == 0);
+
+out:
+	cache_finish(&cache);
+}
+
 static void report_functions(struct uftrace_data *handle, struct opts *opts)
 {
 	struct rb_root name_root = RB_ROOT;
@@ -222,7 +465,7 @@ static void report_functions(struct uftrace_data *handle, struct opts *opts)
 	const char f_format[] = "  %10.10s  %10.10s  %10.10s  %-.*s\n";
 	const char line[] = "=================================================";
 
-	build_function_tree(handle, &name_root, opts);
+	build_report_tree(handle, &name_root, opts);
 	report_calc_avg(&name_root);
 	report_sort_nodes(&name_root, &sort_root);
 
@@ -476,11 +719,6 @@ static void print_function_diff(struct uftrace_report_node *node, void *arg)
 	}
 }
 
-static void print_nothing(struct uftrace_report_node *node, void *unused)
-{
-	/* just delete */
-}
-
 static void report_diff(struct uftrace_data *handle, struct opts *opts)
 {
 	struct opts dummy_opts = {
@@ -488,6 +726,8 @@ static void report_diff(struct uftrace_data *handle, struct opts *opts)
 		.kernel  = opts->kernel,
 		.depth   = opts->depth,
 		.libcall = opts->libcall,
+		.nr_thread = opts->nr_thread,
+		.no_cache  = opts->no_cache,
 	};
 	struct diff_data data = {
 		.dirname = opts->diff,
@@ -519,7 +759,7 @@ static void report_diff(struct uftrace_data *handle, struct opts *opts)
 		f_idx = 3;
 	}
 
-	build_function_tree(handle, &base_tree, opts);
+	build_report_tree(handle, &base_tree, opts);
 	report_calc_avg(&base_tree);
 
 	if (open_data_file(&dummy_opts, &data.handle) < 0) {
@@ -528,7 +768,7 @@ static void report_diff(struct uftrace_data *handle, struct opts *opts)
 	}
 
 	fstack_setup_filters(&dummy_opts, &data.handle);
-	build_function_tree(&data.handle, &pair_tree, &dummy_opts);
+	build_report_tree(&data.handle, &pair_tree, &dummy_opts);
 	report_calc_avg(&pair_tree);
 
 	report_diff_nodes(&base_tree, &pair_tree, &diff_tree, opts->sort_column);
@@ -595,6 +835,7 @@ char * convert_sort_keys(char *sort_keys)
 int command_report(int argc, char *argv[], struct opts *opts)
 {
 	int ret;
+	uint64_t lost;
 	char *sort_keys;
 	struct uftrace_data handle;
 
@@ -613,6 +854,12 @@ int command_report(int argc, char *argv[], struct opts *opts)
 		return -1;
 	}
 
+	lost = get_perf_lost_events(&handle);
+	if (lost) {
+		pr_warn("%"PRIu64" perf events were lost, schedule info might be incomplete.\n"
+			"\tPlease consider using bigger --perf-buffer when record.\n", lost);
+	}
+
 	fstack_setup_filters(opts, &handle);
 
 	sort_keys = convert_sort_keys(opts->sort_keys);
@@ -9,7 +9,9 @@
 #include <inttypes.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 
 #include "uftrace.h"
 #include "version.h"
@@ -21,23 +23,27 @@
 #include "utils/rbtree.h"
 #include "utils/field.h"
 #include "utils/dwarf.h"
+#include "utils/pack.h"
 
 #define KEY_ESCAPE  27
 #define BLANK  32
 
+/* number of records to read before publishing new data to the UI */
+#define TUI_LOAD_BATCH  10000
+/* screen update interval (in msec) while loading */
+#define TUI_LOAD_REFRESH  200
+
 static bool tui_finished;
 static bool tui_debug;
 
+/* keep it small as it's allocated for every call path */
 struct tui_graph_node {
 	struct uftrace_graph_node n;
-	struct uftrace_graph *graph;
-	struct list_head link; // for tui_report_node.head
 	bool folded;
 };
 
 struct tui_report_node {
 	struct uftrace_report_node n;
-	struct list_head head; // links tui_graph_node.link
 };
 
 struct tui_list_node {
@@ -62,6 +68,7 @@ struct tui_window_ops {
 	void (*footer)(struct tui_window *win, struct uftrace_data *handle);
 	void (*display)(struct tui_window *win, void *node);
 	bool (*search)(struct tui_window *win, void *node, char *str);
+	int (*search_count)(struct tui_window *win, char *str);
 	bool (*longest_child)(struct tui_window *win, void *node);
 	struct debug_location * (*location)(struct tui_window *win, void *node);
 };
@@ -75,6 +82,8 @@ struct tui_window {
 	int curr_index;
 	int last_index;
 	int search_count;
+	/* loader version of the data shown in the window */
+	unsigned long version;
 };
 
 struct tui_report {
@@ -115,12 +124,39 @@ static struct tui_list tui_info;
 static struct tui_list tui_session;
 static char *tui_search;
 
+/*
+ * The data is read by a separate thread which builds the graph and
+ * report nodes in batches.  The UI thread holds the lock except when
+ * it waits for a key so that the nodes don't change under it.
+ */
+static struct tui_loader {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct uftrace_data *handle;
+	struct opts *opts;
+	/* data size of all tasks (for progress) */
+	uint64_t total_size;
+	int percent;
+	/* increased whenever new nodes are added */
+	unsigned long version;
+	/* flags below are accessed with __atomic builtins */
+	bool ui_waiting;
+	bool stop;
+	bool done;
+} tui_loader = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
 static const struct tui_window_ops graph_ops;
 static const struct tui_window_ops report_ops;
 static const struct tui_window_ops info_ops;
 static const struct tui_window_ops session_ops;
 
 static void tui_window_move_down(struct tui_window *win);
+static void tui_window_reindex(struct tui_window *win);
+static bool tui_window_update(struct tui_window *win);
 
 #define FIELD_SPACE  2
 #define FIELD_SEP  " :"
@@ -360,16 +396,10 @@ static struct uftrace_graph * get_graph(struct uftrace_task_reader *task,
 	return NULL;
 }
 
-static bool list_is_none(struct list_head *list)
-{
-	return list->next == NULL && list->prev == NULL;
-}
-
 static void update_report_node(struct uftrace_task_reader *task, char *symname,
 			       struct uftrace_task_graph *tg)
 {
 	struct tui_report_node *node;
-	struct tui_graph_node *graph_node;
 
 	/* graph is not set probably due to filters (or error?) */
 	if (tg->node == NULL)
@@ -379,15 +409,10 @@ static void update_report_node(struct uftrace_task_reader *task, char *symname,
 							  symname);
 	if (node == NULL) {
 		node = xzalloc(sizeof(*node));
-		INIT_LIST_HEAD(&node->head);
 		report_add_node(&tui_report.name_tree, symname, (void *)node);
 		tui_report.nr_func++;
 	}
 
-	graph_node = (struct tui_graph_node *)tg->node;
-	if (list_is_none(&graph_node->link))
-		list_add_tail(&graph_node->link, &node->head);
-
 	report_update_node(&node->n, task);
 }
 
@@ -397,7 +422,6 @@ static int build_tui_node(struct uftrace_task_reader *task,
 {
 	struct uftrace_task_graph *tg;
 	struct uftrace_graph *graph;
-	struct tui_graph_node *graph_node;
 	struct sym *sym;
 	char *name;
 	uint64_t addr = rec->addr;
@@ -443,10 +467,6 @@ static int build_tui_node(struct uftrace_task_reader *task,
 		return 0;
 
 	graph_add_node(tg, rec->type, name, sizeof(struct tui_graph_node));
-	if (tg->node && tg->node != &graph->root) {
-		graph_node = (struct tui_graph_node *)tg->node;
-		graph_node->graph = graph;
-	}
 
 	symbol_putname(sym, name);
 	return 0;
@@ -507,23 +527,137 @@ static void add_remaining_node(struct opts *opts, struct uftrace_data *handle)
 	}
 }
 
-static struct tui_graph_node * append_graph_node(struct uftrace_graph_node *dst,
-						 struct tui_graph *graph,
-						 char *name)
+static bool loader_stopped(struct tui_loader *ld)
 {
-	struct tui_graph_node *node;
+	return __atomic_load_n(&ld->stop, __ATOMIC_ACQUIRE);
+}
+
+static bool loader_done(void)
+{
+	return __atomic_load_n(&tui_loader.done, __ATOMIC_ACQUIRE);
+}
+
+static void tui_lock(void)
+{
+	__atomic_store_n(&tui_loader.ui_waiting, true, __ATOMIC_RELEASE);
+	pthread_mutex_lock(&tui_loader.lock);
+	__atomic_store_n(&tui_loader.ui_waiting, false, __ATOMIC_RELEASE);
+}
+
+static void tui_unlock(void)
+{
+	pthread_cond_signal(&tui_loader.cond);
+	pthread_mutex_unlock(&tui_loader.lock);
+}
+
+static void loader_update_progress(struct tui_loader *ld)
+{
+	struct uftrace_data *handle = ld->handle;
+	uint64_t pos = 0;
+	int i;
+
+	ld->version++;
+
+	if (ld->total_size == 0)
+		return;
+
+	for (i = 0; i < handle->nr_tasks; i++) {
+		struct uftrace_task_reader *task = &handle->tasks[i];
+
+		if (task->fp)
+			pos += ftello(task->fp);
+	}
+
+	ld->percent = pos * 100 / ld->total_size;
+	if (ld->percent > 99)
+		ld->percent = 99;
+}
+
+static void * tui_loader_thread(void *arg)
+{
+	struct tui_loader *ld = arg;
+	struct uftrace_data *handle = ld->handle;
+	struct uftrace_task_reader *task;
+	struct opts *opts = ld->opts;
+	unsigned long count = 0;
+
+	pthread_mutex_lock(&ld->lock);
+
+	while (!loader_stopped(ld) && read_rstack(handle, &task) == 0 && !uftrace_done) {
+		struct uftrace_record *rec = task->rstack;
+
+		if (++count % TUI_LOAD_BATCH == 0) {
+			loader_update_progress(ld);
+
+			/* give the UI a chance to see the new nodes */
+			while (__atomic_load_n(&ld->ui_waiting, __ATOMIC_ACQUIRE) &&
+			       !loader_stopped(ld))
+				pthread_cond_wait(&ld->cond, &ld->lock);
+		}
+
+		if (!fstack_check_opts(task, opts))
+			continue;
+
+		if (!fstack_check_filter(task))
+			continue;
+
+		if (build_tui_node(task, rec, opts))
+			break;
+	}
+
+	if (!loader_stopped(ld))
+		add_remaining_node(opts, handle);
+
+	ld->version++;
+	ld->percent = 100;
+	__atomic_store_n(&ld->done, true, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&ld->lock);
+	return NULL;
+}
+
+static void tui_loader_start(struct opts *opts, struct uftrace_data *handle)
+{
+	struct stat stbuf;
+	char *filename;
+	int i;
+
+	tui_loader.opts = opts;
+	tui_loader.handle = handle;
+
+	for (i = 0; i < handle->nr_tasks; i++) {
+		struct uftrace_task_reader *task = &handle->tasks[i];
+
+		/* skip filtered tasks */
+		if (task->fp == NULL)
+			continue;
+
+		xasprintf(&filename, "%s/%d.dat", handle->dirname, task->tid);
+		if (pack_stat(filename, &stbuf) == 0)
+			tui_loader.total_size += stbuf.st_size;
+		free(filename);
+	}
 
-	node = xzalloc(sizeof(*node));
+	errno = pthread_create(&tui_loader.thread, NULL, tui_loader_thread,
+			       &tui_loader);
+	if (errno)
+		pr_err("cannot start loader thread");
+}
 
-	node->n.name = xstrdup(name);
-	INIT_LIST_HEAD(&node->n.head);
+static void tui_loader_stop(void)
+{
+	__atomic_store_n(&tui_loader.stop, true, __ATOMIC_RELEASE);
+	tui_unlock();
 
-	node->n.parent = dst;
-	node->graph = &graph->ug;
-	list_add_tail(&node->n.list, &dst->head);
-	dst->nr_edges++;
+	pthread_join(tui_loader.thread, NULL);
+}
 
-	return node;
+static struct tui_graph_node * append_graph_node(struct uftrace_graph_node *dst,
+						 uint64_t addr, char *name)
+{
+	/* nodes are added to the partial graph only */
+	return (void *)graph_new_node(&partial_graph.ug, dst, addr, name,
+				      sizeof(struct tui_graph_node));
 }
 
 static void copy_graph_node(struct uftrace_graph_node *dst,
@@ -533,22 +667,10 @@ static void copy_graph_node(struct uftrace_graph_node *dst,
 	struct tui_graph_node *node;
 
 	list_for_each_entry(child, &src->head, list) {
-		list_for_each_entry(node, &dst->head, n.list) {
-			if (!strcmp(child->name, node->n.name))
-				break;
-		}
-
-		if (list_no_entry(node, &dst->head, n.list)) {
-			struct tui_graph *graph;
-
-			node = (struct tui_graph_node *)src;
-			graph = container_of(node->graph, typeof(*graph), ug);
-
-			node = append_graph_node(dst, graph,
-						 child->name);
-		}
+		node = (void *)graph_find_child(dst, child->addr, child->name);
+		if (node == NULL)
+			node = append_graph_node(dst, child->addr, child->name);
 
-		node->n.addr        = child->addr;
 		node->n.time       += child->time;
 		node->n.child_time += child->child_time;
 		node->n.nr_calls   += child->nr_calls;
@@ -587,22 +709,28 @@ static void tui_window_init(struct tui_window *win,
 	win->last_index = tui_last_index(win);
 }
 
+/* top (root) is an artificial node, fill the info */
+static void update_graph_root(struct tui_graph *graph)
+{
+	struct uftrace_graph_node *top, *node;
+
+	top = &graph->ug.root;
+	top->name = basename(graph->ug.sess->exename);
+	top->nr_calls = 1;
+	top->time = top->child_time = 0;
+
+	list_for_each_entry(node, &graph->ug.root.head, list) {
+		top->time       += node->time;
+		top->child_time += node->time;
+	}
+}
+
 static struct tui_graph * tui_graph_init(struct opts *opts)
 {
 	struct tui_graph *graph;
-	struct uftrace_graph_node *top, *node;
 
 	list_for_each_entry(graph, &tui_graph_list, list) {
-		/* top (root) is an artificial node, fill the info */
-		top = &graph->ug.root;
-		top->name = basename(graph->ug.sess->exename);
-		top->nr_calls = 1;
-
-		list_for_each_entry(node, &graph->ug.root.head, list) {
-			top->time       += node->time;
-			top->child_time += node->time;
-		}
-
+		update_graph_root(graph);
 		tui_window_init(&graph->win, &graph_ops);
 
 		graph->mask_size = sizeof(*graph->top_mask) * opts->max_stack;
@@ -648,6 +776,7 @@ static void build_partial_graph(struct tui_report_node *root_node,
 {
 	struct tui_graph *graph = &partial_graph;
 	struct tui_graph_node *root, *node;
+	struct tui_graph_node *first;
 	char *str;
 
 	graph_destroy(&graph->ug);
@@ -664,24 +793,23 @@ static void build_partial_graph(struct tui_report_node *root_node,
 	root->n.child_time = 0;
 	root->n.nr_calls   = 0;
 
+	first = (void *)graph_first_node(&target->ug, root_node->n.name);
+
 	/* special node */
-	root = append_graph_node(&graph->ug.root, target,
+	root = append_graph_node(&graph->ug.root, 0,
 				 "========== Back-trace ==========");
 
-	list_for_each_entry(node, &root_node->head, link) {
+	for (node = first; node; node = (void *)node->n.name_next) {
 		struct tui_graph_node *tmp, *parent;
 		int n = 0;
 
-		if (node->graph != &target->ug)
-			continue;
-
 		tmp = root;
 		parent = node;
 
 		while (parent->n.parent) {
-			tmp = append_graph_node(&tmp->n, target, parent->n.name);
+			tmp = append_graph_node(&tmp->n, parent->n.addr,
+						parent->n.name);
 
-			tmp->n.addr       = parent->n.addr;
 			tmp->n.time       = node->n.time;
 			tmp->n.child_time = node->n.child_time;
 			tmp->n.nr_calls   = node->n.nr_calls;
@@ -699,16 +827,13 @@ static void build_partial_graph(struct tui_report_node *root_node,
 	}
 
 	/* special node */
-	root = append_graph_node(&graph->ug.root, target,
+	root = append_graph_node(&graph->ug.root, 0,
 				 "========== Call Graph ==========");
 
-	root = append_graph_node(&root->n, target, root_node->n.name);
+	root = append_graph_node(&root->n, first ? first->n.addr : 0,
+				 root_node->n.name);
 
-	list_for_each_entry(node, &root_node->head, link) {
-		if (node->graph != &target->ug)
-			continue;
-
-		root->n.addr        = node->n.addr;
+	for (node = first; node; node = (void *)node->n.name_next) {
 		root->n.time       += node->n.time;
 		root->n.child_time += node->n.child_time;
 		root->n.nr_calls   += node->n.nr_calls;
@@ -716,6 +841,9 @@ static void build_partial_graph(struct tui_report_node *root_node,
 		copy_graph_node(&root->n, &node->n);
 	}
 
+	graph_search_names(&graph->ug, tui_search);
+	graph->win.search_count = -1;
+
 	tui_window_init(&graph->win, &graph_ops);
 
 	memset(graph->top_mask, 0, graph->mask_size);
@@ -1019,6 +1147,9 @@ out:
 
 static int win_pos_percent(struct tui_window *win)
 {
+	if (win->last_index == 0)
+		return 100;
+
 	return win->curr_index * 100.0 / win->last_index;
 }
 
@@ -1033,6 +1164,20 @@ static void win_footer(struct tui_window *win, char *msg)
 	if (pos_start > msg_len)
 		snprintf(footer + pos_start, POS_SIZE, "%3d%%", win_pos_percent(win));
 
+	if (!loader_done()) {
+		char loading[32];
+		int len;
+
+		if (tui_loader.total_size)
+			len = snprintf(loading, sizeof(loading), "[loading %d%%] ",
+				       tui_loader.percent);
+		else
+			len = snprintf(loading, sizeof(loading), "[loading] ");
+
+		if (pos_start - len > msg_len)
+			memcpy(footer + pos_start - len, loading, len);
+	}
+
 	footer[COLS] = '\0';
 
 	printw("%-*s", COLS, footer);
@@ -1191,7 +1336,45 @@ static bool win_search_graph(struct tui_window *win, void *node, char *str)
 {
 	struct tui_graph_node *curr = node;
 
-	return strstr(curr->n.name, str);
+	/* names of the root nodes are not managed by the graph */
+	if (curr->n.parent == NULL)
+		return strstr(curr->n.name, str);
+
+	/* see tui_search_names() */
+	return graph_name_matched(&curr->n);
+}
+
+/* a node is shown unless one of its parents (but the root) is folded */
+static bool is_visible_node(struct uftrace_graph_node *node)
+{
+	struct tui_graph_node *parent = (void *)node->parent;
+
+	while (parent && parent->n.parent) {
+		if (parent->folded)
+			return false;
+		parent = (void *)parent->n.parent;
+	}
+	return true;
+}
+
+/* visit the nodes of matched names only, instead of all visible nodes */
+static int win_search_count_graph(struct tui_window *win, char *str)
+{
+	struct tui_graph *graph = (struct tui_graph *)win;
+	struct uftrace_graph_node *node;
+	int count = 0;
+
+	if (strstr(graph->ug.root.name, str))
+		count++;
+
+	node = graph_next_matched(&graph->ug, NULL);
+	while (node) {
+		if (is_visible_node(node))
+			count++;
+
+		node = graph_next_matched(&graph->ug, node);
+	}
+	return count;
 }
 
 static bool win_longest_child_graph(struct tui_window *win, void *node)
@@ -1247,6 +1430,7 @@ static const struct tui_window_ops graph_ops = {
 	.footer = win_footer_graph,
 	.display = win_display_graph,
 	.search = win_search_graph,
+	.search_count = win_search_count_graph,
 	.longest_child = win_longest_child_graph,
 	.location = win_location_graph,
 };
@@ -1273,20 +1457,54 @@ static void * win_parent_no(struct tui_window *win, void *node)
 }
 
 /* per-window operations for report window */
-static struct tui_report * tui_report_init(struct opts *opts)
+static void tui_report_update(void)
 {
 	struct tui_window *win = &tui_report.win;
 
-	report_setup_sort("total");
+	/* the window is not available until the first function is added */
+	if (RB_EMPTY_ROOT(&tui_report.name_tree))
+		return;
+
 	report_sort_nodes(&tui_report.name_tree, &tui_report.sort_tree);
 
-	tui_window_init(win, &report_ops);
+	if (win->top == NULL)
+		tui_window_init(win, &report_ops);
+	else
+		tui_window_reindex(win);
+}
+
+static struct tui_report * tui_report_init(struct opts *opts)
+{
+	struct tui_window *win = &tui_report.win;
+
+	report_setup_sort("total");
+	tui_report_update();
+	win->version = tui_loader.version;
 
 	return &tui_report;
 }
 
+/* make sure the report window has the current data */
+static bool tui_report_ready(void)
+{
+	tui_window_update(&tui_report.win);
+
+	return tui_report.win.top != NULL;
+}
+
 static void tui_report_finish(void)
 {
+	struct tui_report_node *node;
+	struct rb_node *n;
+
+	while (!RB_EMPTY_ROOT(&tui_report.name_tree)) {
+		n = rb_first(&tui_report.name_tree);
+		node = rb_entry(n, struct tui_report_node, n.name_link);
+
+		report_delete_node(&tui_report.name_tree, &node->n);
+		free(node);
+	}
+	tui_report.sort_tree = RB_ROOT;
 }
 
 static void * win_top_report(struct tui_window *win, bool update)
@@ -1294,6 +1512,9 @@ static void * win_top_report(struct tui_window *win, bool update)
 	struct tui_report *report = (struct tui_report *)win;
 	struct rb_node *node = rb_first(&report->sort_tree);
 
+	if (node == NULL)
+		return NULL;
+
 	return rb_entry(node, struct tui_report_node, n.sort_link);
 }
 
@@ -1322,6 +1543,15 @@ static void * win_next_report(struct tui_window *win, void *node, bool update)
 static bool win_search_report(struct tui_window *win, void *node, char *str)
 {
 	struct tui_report_node *curr = node;
+	struct uftrace_graph_node *gnode;
+	struct tui_graph *graph;
+
+	/* use the result of tui_search_names() if possible */
+	list_for_each_entry(graph, &tui_graph_list, list) {
+		gnode = graph_first_node(&graph->ug, curr->n.name);
+		if (gnode)
+			return graph_name_matched(gnode);
+	}
 
 	return strstr(curr->n.name, str);
 }
@@ -1387,16 +1617,21 @@ static struct debug_location *win_location_report(struct tui_window *win,
 						  void *node)
 {
 	struct tui_report_node *curr = node;
-	struct tui_graph_node *gnode;
+	struct uftrace_graph_node *gnode;
+	struct tui_graph *graph;
 	struct uftrace_session *sess;
 	struct debug_location *dloc;
 
-	list_for_each_entry(gnode, &curr->head, link) {
-		sess = gnode->graph->sess;
-		dloc = find_file_line(&sess->symtabs, gnode->n.addr);
+	list_for_each_entry(graph, &tui_graph_list, list) {
+		sess = graph->ug.sess;
+		gnode = graph_first_node(&graph->ug, curr->n.name);
+
+		for (; gnode; gnode = gnode->name_next) {
+			dloc = find_file_line(&sess->symtabs, gnode->addr);
 
-		if (dloc != NULL && dloc->file != NULL)
-			return dloc;
+			if (dloc != NULL && dloc->file != NULL)
+				return dloc;
+		}
 	}
 	return NULL;
 }
@@ -1468,6 +1703,13 @@ static void build_info_node(void *data, const char *fmt, ...)
 static struct tui_list * tui_info_init(struct opts *opts,
 				       struct uftrace_data *handle)
 {
+	/* it reads task and perf data again, wait until loading is done */
+	if (!loader_done())
+		return NULL;
+
+	if (tui_info.win.ops)
+		return &tui_info;
+
 	INIT_LIST_HEAD(&tui_info.head);
 	process_uftrace_info(handle, opts, build_info_node, &tui_info);
 
@@ -1480,6 +1722,9 @@ static void tui_info_finish(void)
 {
 	struct tui_list_node *node, *tmp;
 
+	if (tui_info.win.ops == NULL)
+		return;
+
 	list_for_each_entry_safe(node, tmp, &tui_info.head, list) {
 		list_del(&node->list);
 		free(node->data);
@@ -1912,6 +2157,78 @@ static bool tui_window_move_next(struct tui_window *win)
 	return count;
 }
 
+/* recalculate indexes of the window after new nodes are added */
+static void tui_window_reindex(struct tui_window *win)
+{
+	void *node, *next;
+	void *top = win->top;
+	int top_index = -1;
+	int curr_index = -1;
+	int count = 0;
+
+	node = win->ops->top(win, false);
+	while (node) {
+		if (node == win->top)
+			top_index = count;
+		if (node == win->curr)
+			curr_index = count;
+
+		next = win->ops->next(win, node, false);
+		if (next == NULL)
+			break;
+
+		count++;
+		if (win->ops->needs_blank(win, node, next))
+			count++;
+
+		node = next;
+	}
+	win->last_index = count;
+
+	if (curr_index < 0) {
+		tui_window_move_home(win);
+		return;
+	}
+
+	/* keep the current node in the screen */
+	if (top_index < 0 || top_index > curr_index ||
+	    curr_index - top_index >= LINES - 2) {
+		top = win->curr;
+		top_index = curr_index;
+	}
+
+	/* walk again to update the state (i.e. depth) of the top node */
+	node = win->ops->top(win, true);
+	while (node != top)
+		node = win->ops->next(win, node, true);
+
+	win->top = top;
+	win->top_index = top_index;
+	win->curr_index = curr_index;
+}
+
+/* returns true if the window was updated with newly loaded data */
+static bool tui_window_update(struct tui_window *win)
+{
+	if (win->version == tui_loader.version)
+		return false;
+
+	win->version = tui_loader.version;
+
+	if (win == &tui_report.win) {
+		tui_report_update();
+		return true;
+	}
+
+	/* other lists and the partial graph don't change */
+	if (win->ops != &graph_ops || win == &partial_graph.win)
+		return false;
+
+	update_graph_root(container_of(win, struct tui_graph, win));
+	tui_window_reindex(win);
+	return true;
+}
+
 static void tui_window_display(struct tui_window *win, bool full_redraw,
 			       struct uftrace_data *handle)
 {
@@ -2100,6 +2417,16 @@ out:
 	return str;
 }
 
+/* check function names in graphs once, instead of every node */
+static void tui_search_names(void)
+{
+	struct tui_graph *graph;
+
+	list_for_each_entry(graph, &tui_graph_list, list)
+		graph_search_names(&graph->ug, tui_search);
+	graph_search_names(&partial_graph.ug, tui_search);
+}
+
 static void tui_window_search_count(struct tui_window *win)
 {
 	void *node;
@@ -2110,6 +2437,11 @@ static void tui_window_search_count(struct tui_window *win)
 	if (win->search_count != -1)
 		return;
 
+	if (win->ops->search_count) {
+		win->search_count = win->ops->search_count(win, tui_search);
+		return;
+	}
+
 	win->search_count = 0;
 
 	node = win->ops->top(win, false);
@@ -2121,6 +2453,17 @@ static void tui_window_search_count(struct tui_window *win)
 	}
 }
 
+/* check it with the name index before walking the nodes */
+static bool tui_window_no_match(struct tui_window *win)
+{
+	if (win->ops->search_count == NULL)
+		return false;
+
+	/* folding might change the count after the search started */
+	win->search_count = win->ops->search_count(win, tui_search);
+	return win->search_count == 0;
+}
+
 static void tui_window_search_prev(struct tui_window *win)
 {
 	void *node = win->curr;
@@ -2128,6 +2471,9 @@ static void tui_window_search_prev(struct tui_window *win)
 	if (tui_search == NULL || win->ops->search == NULL)
 		return;
 
+	if (tui_window_no_match(win))
+		return;
+
 	while (true) {
 		node = win->ops->prev(win, node, false);
 		if (node == NULL)
@@ -2147,6 +2493,9 @@ static void tui_window_search_next(struct tui_window *win)
 	if (tui_search == NULL || win->ops->search == NULL)
 		return;
 
+	if (tui_window_no_match(win))
+		return;
+
 	while (true) {
 		node = win->ops->next(win, node, false);
 		if (node == NULL)
@@ -2313,14 +2662,19 @@ static void tui_window_help(void)
 
 static inline void cancel_search()
 {
+	if (tui_search == NULL)
+		return;
+
 	free(tui_search);
 	tui_search = NULL;
+	tui_search_names();
 }
 
 static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 {
 	int key = 0;
 	bool full_redraw = true;
+	bool updated;
 	struct tui_graph *graph;
 	struct tui_report *report;
 	struct tui_list *info;
@@ -2328,11 +2682,15 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 	struct tui_window *win;
 	void *old_top;
 
+	tui_lock();
+
 	graph = tui_graph_init(opts);
 	report = tui_report_init(opts);
-	info = tui_info_init(opts, handle);
 	session = tui_session_init(opts);
 
+	/* read the data in background and show the screen immediately */
+	tui_loader_start(opts, handle);
+
 	/* start with graph only if there's one session */
 	if (session->nr_node > 1)
 		win = &session->win;
@@ -2381,10 +2739,15 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 
 				switch ((long)cmd->data) {
 				case TUI_SESS_REPORT:
+					if (!tui_report_ready())
+						break;
 					win = &report->win;
 					tui_window_move_home(win);
 					break;
 				case TUI_SESS_INFO:
+					info = tui_info_init(opts, handle);
+					if (info == NULL)
+						break;
 					win = &info->win;
 					tui_window_move_home(win);
 					break;
@@ -2437,6 +2800,8 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 			full_redraw = true;
 			break;
 		case 'R':
+			if (!tui_report_ready())
+				break;
 			if (tui_window_change(win, &report->win)) {
 				win = &report->win;
 				tui_window_move_home(win);
@@ -2444,6 +2809,8 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 			}
 			break;
 		case 'r':
+			if (!tui_report_ready())
+				break;
 			if (tui_window_change(win, &report->win)) {
 				struct tui_report_node *func;
 				struct tui_graph_node *graph_curr = win->curr;
@@ -2464,6 +2831,9 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 			}
 			break;
 		case 'I':
+			info = tui_info_init(opts, handle);
+			if (info == NULL)
+				break;
 			if (tui_window_change(win, &info->win)) {
 				win = &info->win;
 				full_redraw = true;
@@ -2509,6 +2879,7 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 			if (tui_window_can_search(win)) {
 				free(tui_search);
 				tui_search = tui_search_start();
+				tui_search_names();
 				tui_window_search_count(win);
 
 				/* move to the next match if found */
@@ -2540,13 +2911,15 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 			break;
 		}
 
+		updated = tui_window_update(win);
+
 		if (win->top != old_top)
 			full_redraw = true;
 
 		if (full_redraw)
 			clear();
 
-		tui_window_display(win, full_redraw, handle);
+		tui_window_display(win, full_redraw || updated, handle);
 		refresh();
 
 		full_redraw = false;
@@ -2554,32 +2927,28 @@ static void tui_main_loop(struct opts *opts, struct uftrace_data *handle)
 		win->old = win->curr;
 		old_top = win->top;
 
+		/* wake up periodically to show new data while loading */
+		timeout(loader_done() ? -1 : TUI_LOAD_REFRESH);
+
 		move(LINES-1, COLS-1);
+		tui_unlock();
 		key = getch();
+		tui_lock();
 	}
 
 out:
+	tui_loader_stop();
+
 	tui_graph_finish();
 	tui_report_finish();
 	tui_info_finish();
 	tui_session_finish();
 }
 
-static void display_loading_msg()
-{
-	char *tuimsg = "Building graph for TUI...";
-	int row, col;
-
-	getmaxyx(stdscr, row, col);
-	mvprintw(row / 2, (col - strlen(tuimsg)) / 2, "%s", tuimsg);
-	refresh();
-}
-
 int command_tui(int argc, char *argv[], struct opts *opts)
 {
 	int ret;
 	struct uftrace_data handle;
-	struct uftrace_task_reader *task;
 
 	ret = open_data_file(opts, &handle);
 	if (ret < 0) {
@@ -2596,27 +2965,9 @@ int command_tui(int argc, char *argv[], struct opts *opts)
 
 	atexit(tui_cleanup);
 
-	/* Print a message before main screen is launched. */
-	display_loading_msg();
-
 	tui_setup(&handle, opts);
 	fstack_setup_filters(opts, &handle);
 
-	while (read_rstack(&handle, &task) == 0 && !uftrace_done) {
-		struct uftrace_record *rec = task->rstack;
-
-		if (!fstack_check_opts(task, opts))
-			continue;
-
-		if (!fstack_check_filter(task))
-			continue;
-
-		ret = build_tui_node(task, rec, opts);
-		if (ret)
-			break;
-	}
-	add_remaining_node(opts, &handle);
-
 	tui_main_loop(opts, &handle);
 
 	close_data_file(opts, &handle);
@@ -89,6 +89,13 @@ enum mcount_watch_item {
 	MCOUNT_WATCH_CPU	= (1 << 0),
 };
 
+/* last data of read triggers to reuse within the read interval */
+#define MCOUNT_READ_CACHE_NR  2
+struct mcount_read_cache {
+	uint64_t	time;
+	uint64_t	data[3];
+};
+
 struct mcount_watchpoint {
 	bool		inited;
 	/* per-thread watch points */
@@ -136,6 +143,7 @@ struct mcount_thread_data {
 	int				nr_events;
 	struct mcount_mem_regions	mem_regions;
 	struct mcount_watchpoint	watch;
+	struct mcount_read_cache	read_cache[MCOUNT_READ_CACHE_NR];
 	struct mcount_arch_context	arch;
 };
 
@@ -165,6 +173,7 @@ bool mcount_guard_recursion(struct mcount_thread_data *mtdp);
 void mcount_unguard_recursion(struct mcount_thread_data *mtdp);
 
 extern uint64_t mcount_threshold;  /* nsec */
+extern uint64_t mcount_read_interval;  /* nsec */
 extern pthread_key_t mtd_key;
 extern int shmem_bufsize;
 extern int pfd;
@@ -386,6 +395,8 @@ void save_trigger_read(struct mcount_thread_data *mtdp,
 		       enum trigger_read_type type, bool diff);
 #endif  /* DISABLE_MCOUNT_FILTER */
 
+void reset_trigger_read(struct mcount_thread_data *mtdp);
+
 void save_watchpoint(struct mcount_thread_data *mtdp,
 		     struct mcount_ret_stack *rstack,
 		     unsigned long watchpoints);
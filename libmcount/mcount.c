@@ -33,6 +33,9 @@
 /* time filter in nsec */
 uint64_t mcount_threshold;
 
+/* time interval to reuse data of read triggers */
+uint64_t mcount_read_interval;
+
 /* symbol table of main executable */
 struct symtabs symtabs = {
 	.flags = SYMTAB_FL_DEMANGLE | SYMTAB_FL_ADJ_OFFSET,
@@ -1631,6 +1634,8 @@ static void atfork_child_handler(void)
 	mtdp->tid = tmsg.tid;
 	/* flush event data */
 	mtdp->nr_events = 0;
+	/* memory stat and page faults are different in the child */
+	reset_trigger_read(mtdp);
 
 	clear_shmem_buffer(mtdp);
 	prepare_shmem_buffer(mtdp);
@@ -1673,6 +1678,7 @@ static __used void mcount_startup(void)
 	char *bufsize_str;
 	char *maxstack_str;
 	char *threshold_str;
+	char *read_interval_str;
 	char *color_str;
 	char *demangle_str;
 	char *plthook_str;
@@ -1702,6 +1708,7 @@ static __used void mcount_startup(void)
 	maxstack_str = getenv("UFTRACE_MAX_STACK");
 	color_str = getenv("UFTRACE_COLOR");
 	threshold_str = getenv("UFTRACE_THRESHOLD");
+	read_interval_str = getenv("UFTRACE_READ_INTERVAL");
 	demangle_str = getenv("UFTRACE_DEMANGLE");
 	plthook_str = getenv("UFTRACE_PLTHOOK");
 	patch_str = getenv("UFTRACE_PATCH");
@@ -1792,6 +1799,9 @@ static __used void mcount_startup(void)
 	if (threshold_str)
 		mcount_threshold = strtoull(threshold_str, NULL, 0);
 
+	if (read_interval_str)
+		mcount_read_interval = strtoull(read_interval_str, NULL, 0);
+
 	if (patch_str)
 		mcount_dynamic_update(&symtabs, patch_str, patt_type, &disasm);
 
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <linux/perf_event.h>
 
@@ -10,19 +11,20 @@
 #include "libmcount/mcount.h"
 #include "libmcount/internal.h"
 #include "utils/utils.h"
-#include "utils/list.h"
+#include "utils/compiler.h"
+
+#define PMU_MAX_MEMBERS  2
 
 /* PMU management data for given event */
 struct pmu_data {
-	struct list_head list;
 	enum uftrace_event_id evt_id;
 	int n_members;
-	int fd[];
+	int tid;  /* the counters are for this thread only */
+	int fd[PMU_MAX_MEMBERS];
+	/* mmap-ed user page to read the counter directly (using rdpmc) */
+	struct perf_event_mmap_page *page[PMU_MAX_MEMBERS];
 };
 
-/* list of pmu_data */
-static LIST_HEAD(pmu_fds);
-
 /* attribute for perf_event_open(2) */
 struct pmu_config {
 	uint32_t	type;
@@ -55,6 +57,23 @@ static const struct pmu_info {
 	{ EVENT_ID_READ_PMU_BRANCH, ARRAY_SIZE(branch), branch },
 };
 
+/* pmu_data for each pmu_configs */
+static struct pmu_data *pmu_data[ARRAY_SIZE(pmu_configs)];
+
+static int pmu_index(enum uftrace_event_id id)
+{
+	switch (id) {
+	case EVENT_ID_READ_PMU_CYCLE:
+		return 0;
+	case EVENT_ID_READ_PMU_CACHE:
+		return 1;
+	case EVENT_ID_READ_PMU_BRANCH:
+		return 2;
+	default:
+		return -1;
+	}
+}
+
 #ifndef  PERF_FLAG_FD_CLOEXEC
 # define PERF_FLAG_FD_CLOEXEC  0
 #endif
@@ -86,83 +105,173 @@ static void read_perf_event(int fd, void *buf, ssize_t len)
 		pr_dbg("reading perf_event failed: %m\n");
 }
 
+static void close_pmu_data(struct pmu_data *pd)
+{
+	int i;
+
+	for (i = 0; i < pd->n_members; i++) {
+		if (pd->page[i])
+			munmap(pd->page[i], getpagesize());
+		close(pd->fd[i]);
+	}
+	free(pd);
+}
+
+#ifdef HAVE_MCOUNT_ARCH_RDPMC
+static void map_pmu_page(struct pmu_data *pd)
+{
+	int i;
+
+	for (i = 0; i < pd->n_members; i++) {
+		pd->page[i] = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED,
+				   pd->fd[i], 0);
+		if (pd->page[i] == MAP_FAILED) {
+			pr_dbg("cannot map perf event page: %m\n");
+			pd->page[i] = NULL;
+			return;
+		}
+
+		if (!pd->page[i]->cap_user_rdpmc) {
+			pr_dbg("rdpmc is not allowed, use read() instead\n");
+			return;
+		}
+	}
+}
+
+/* see the comment in struct perf_event_mmap_page (linux/perf_event.h) */
+static int read_pmu_counter(volatile struct perf_event_mmap_page *pc,
+			    uint64_t *count)
+{
+	uint32_t seq, idx;
+	uint64_t offset;
+	int64_t pmc;
+	unsigned shift;
+
+	do {
+		seq = pc->lock;
+		compiler_barrier();
+
+		idx = pc->index;
+		offset = pc->offset;
+
+		/* the counter is not active now */
+		if (!pc->cap_user_rdpmc || idx == 0)
+			return -1;
+
+		shift = 64 - pc->pmc_width;
+		pmc = mcount_arch_rdpmc(idx - 1);
+		pmc = (int64_t)((uint64_t)pmc << shift) >> shift;
+
+		compiler_barrier();
+	} while (pc->lock != seq);
+
+	*count = offset + pmc;
+	return 0;
+}
+
+static int read_pmu_counters(struct pmu_data *pd, uint64_t *data)
+{
+	int i;
+
+	/* other threads cannot read the counters using rdpmc */
+	if (pd->tid != mcount_gettid(&mtd))
+		return -1;
+
+	for (i = 0; i < pd->n_members; i++) {
+		if (pd->page[i] == NULL)
+			return -1;
+		if (read_pmu_counter(pd->page[i], &data[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
+#else
+static void map_pmu_page(struct pmu_data *pd) {}
+static int read_pmu_counters(struct pmu_data *pd, uint64_t *data)
+{
+	return -1;
+}
+#endif
+
 int prepare_pmu_event(enum uftrace_event_id id)
 {
 	struct pmu_data *pd;
 	const struct pmu_info *info;
-	unsigned i, k;
+	unsigned k;
+	int idx = pmu_index(id);
 	int group_fd;
 
-	list_for_each_entry(pd, &pmu_fds, list) {
-		if (pd->evt_id == id)
-			return 0;
+	if (idx < 0) {
+		pr_dbg("unknown pmu event: %d - ignoring\n", id);
+		return 0;
 	}
 
+	if (pmu_data[idx])
+		return 0;
+
 	pr_dbg("setup PMU event (%d) using perf syscall\n", id);
 
-	for (i = 0; i < ARRAY_SIZE(pmu_configs); i++) {
-		info = &pmu_configs[i];
-		if (id != info->event_id)
-			continue;
+	info = &pmu_configs[idx];
+
+	pd = xzalloc(sizeof(*pd));
+	pd->evt_id = id;
+	pd->tid = syscall(SYS_gettid);
 
-		pd = xmalloc(sizeof(*pd) + info->n_members * sizeof(int));
-		pd->evt_id = id;
+	group_fd = open_perf_event(info->setting[0].type,
+				   info->setting[0].config,
+				   -1);
+	if (group_fd < 0) {
+		pr_warn("failed to open '%s' perf event: %m\n",
+			info->setting[0].name);
+		free(pd);
+		return -1;
+	}
+
+	pd->fd[0] = group_fd;
+	pd->n_members = 1;
 
-		group_fd = open_perf_event(info->setting[0].type,
-					   info->setting[0].config,
-					   -1);
-		if (group_fd < 0) {
+	for (k = 1; k < info->n_members; k++) {
+		pd->fd[k] = open_perf_event(info->setting[k].type,
+					    info->setting[k].config,
+					    group_fd);
+		if (pd->fd[k] < 0) {
 			pr_warn("failed to open '%s' perf event: %m\n",
-				info->setting[0].name);
-			free(pd);
+				info->setting[k].name);
+			close_pmu_data(pd);
 			return -1;
 		}
-
-		pd->fd[0] = group_fd;
-		for (k = 1; k < info->n_members; k++) {
-			pd->fd[k] = open_perf_event(info->setting[k].type,
-						    info->setting[k].config,
-						    group_fd);
-			if (pd->fd[k] < 0) {
-				pr_warn("failed to open '%s' perf event: %m\n",
-					info->setting[k].name);
-				free(pd);
-				return -1;
-			}
-		}
-
-		pd->n_members = info->n_members;
-		break;
+		pd->n_members++;
 	}
 
-	if (i == ARRAY_SIZE(pmu_configs))
-		pr_dbg("unknown pmu event: %d - ignoring\n", id);
-	else
-		list_add_tail(&pd->list, &pmu_fds);
+	map_pmu_page(pd);
 
+	pmu_data[idx] = pd;
 	return 0;
 }
 
 int read_pmu_event(enum uftrace_event_id id, void *buf)
 {
 	struct pmu_data *pd;
+	int idx = pmu_index(id);
 	struct {
 		uint64_t	nr_members;
-		uint64_t	data[2];
+		uint64_t	data[PMU_MAX_MEMBERS];
 	} read_buf;
 
-	list_for_each_entry(pd, &pmu_fds, list) {
-		if (pd->evt_id == id)
-			break;
-	}
-
-	if (list_no_entry(pd, &pmu_fds, list)) {
+	if (idx < 0 || pmu_data[idx] == NULL) {
 		/* unsupported pmu events */
 		return -1;
 	}
+	pd = pmu_data[idx];
+
+	/* try to read the counters without syscall */
+	if (read_pmu_counters(pd, read_buf.data) == 0)
+		read_buf.nr_members = pd->n_members;
+	else {
+		/* read group events at once */
+		read_perf_event(pd->fd[0], &read_buf, sizeof(read_buf));
+	}
 
-	/* read group events at once */
-	read_perf_event(pd->fd[0], &read_buf, sizeof(read_buf));
 	mcount_memcpy4(buf, read_buf.data,
 		       sizeof(*read_buf.data) * read_buf.nr_members);
 
@@ -171,21 +280,13 @@ int read_pmu_event(enum uftrace_event_id id, void *buf)
 
 void finish_pmu_event(void)
 {
-	struct pmu_data *pd, *tmp;
-
-	list_for_each_entry_safe(pd, tmp, &pmu_fds, list) {
-		list_del(&pd->list);
-
-		switch (pd->evt_id) {
-		case EVENT_ID_READ_PMU_CYCLE:
-		case EVENT_ID_READ_PMU_CACHE:
-		case EVENT_ID_READ_PMU_BRANCH:
-			close(pd->fd[0]);
-			close(pd->fd[1]);
-			break;
-		default:
-			break;
-		}
-		free(pd);
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(pmu_data); i++) {
+		if (pmu_data[i] == NULL)
+			continue;
+
+		close_pmu_data(pmu_data[i]);
+		pmu_data[i] = NULL;
 	}
 }
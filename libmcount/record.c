@@ -540,17 +540,62 @@ void save_retval(struct mcount_thread_data *mtdp,
 	*(uint32_t *)argbuf = size;
 }
 
-static int save_proc_statm(void *buf)
+/* keep the file open to read it without open/close every time */
+static int statm_fd = -1;
+
+static int open_proc_statm(void)
 {
-	FILE *fp;
-	struct uftrace_proc_statm *statm = buf;
+	int fd = statm_fd;
 
-	fp = fopen("/proc/self/statm", "r");
-	if (fp == NULL)
+	if (fd >= 0)
+		return fd;
+
+	fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
 		pr_err("failed to open /proc/self/statm");
 
-	if (fscanf(fp, "%"SCNu64" %"SCNu64" %"SCNu64,
-		   &statm->vmsize, &statm->vmrss, &statm->shared) != 3)
+	/* other thread might open it at the same time */
+	if (!__sync_bool_compare_and_swap(&statm_fd, -1, fd)) {
+		close(fd);
+		fd = statm_fd;
+	}
+	return fd;
+}
+
+/* parse a decimal number and skip following spaces */
+static char *parse_statm_value(char *str, uint64_t *val)
+{
+	uint64_t n = 0;
+
+	if (str == NULL || *str < '0' || *str > '9')
+		return NULL;
+
+	while (*str >= '0' && *str <= '9')
+		n = n * 10 + (*str++ - '0');
+	while (*str == ' ')
+		str++;
+
+	*val = n;
+	return str;
+}
+
+static int save_proc_statm(void *buf)
+{
+	struct uftrace_proc_statm *statm = buf;
+	char data[128];
+	char *pos;
+	ssize_t len;
+
+	/* reading at offset 0 gets the current value */
+	len = pread(open_proc_statm(), data, sizeof(data) - 1, 0);
+	if (len <= 0)
+		pr_err("failed to read /proc/self/statm");
+	data[len] = '\0';
+
+	pos = parse_statm_value(data, &statm->vmsize);
+	pos = parse_statm_value(pos, &statm->vmrss);
+	pos = parse_statm_value(pos, &statm->shared);
+	if (pos == NULL)
 		pr_err("failed to scan /proc/self/statm");
 
 	/* Since /proc/[pid]/statm prints the number of pages for each field,
@@ -559,7 +604,6 @@ static int save_proc_statm(void *buf)
 	statm->vmrss  *= page_size_in_kb;
 	statm->shared *= page_size_in_kb;
 
-	fclose(fp);
 	return 0;
 }
 
@@ -650,18 +694,57 @@ static struct read_event_data {
 	size_t			size;
 	int (*save)(void *buf);
 	void (*diff)(void *dst, void *src);
+	int			cache;  /* index of read_cache (or -1) */
 } read_events[] = {
-	{ TR_ID(PROC_STATM), TR_DS(proc_statm), TR_FN(proc_statm) },
-	{ TR_ID(PAGE_FAULT), TR_DS(page_fault), TR_FN(page_fault) },
-	{ TR_ID(PMU_CYCLE),  TR_DS(pmu_cycle),  TR_FN(pmu_cycle)  },
-	{ TR_ID(PMU_CACHE),  TR_DS(pmu_cache),  TR_FN(pmu_cache)  },
-	{ TR_ID(PMU_BRANCH), TR_DS(pmu_branch), TR_FN(pmu_branch) },
+	{ TR_ID(PROC_STATM), TR_DS(proc_statm), TR_FN(proc_statm), 0  },
+	{ TR_ID(PAGE_FAULT), TR_DS(page_fault), TR_FN(page_fault), 1  },
+	{ TR_ID(PMU_CYCLE),  TR_DS(pmu_cycle),  TR_FN(pmu_cycle),  -1 },
+	{ TR_ID(PMU_CACHE),  TR_DS(pmu_cache),  TR_FN(pmu_cache),  -1 },
+	{ TR_ID(PMU_BRANCH), TR_DS(pmu_branch), TR_FN(pmu_branch), -1 },
 };
 
 #undef TR_ID
 #undef TR_DS
 #undef TR_FN
 
+/*
+ * Process-wide data (memory stat and page faults) can be reused if
+ * it's read recently (within --read-interval) by the same thread.
+ * PMU counters are always read since they change too fast.
+ */
+static int read_event_data(struct mcount_thread_data *mtdp,
+			   struct read_event_data *red,
+			   struct mcount_event *event)
+{
+	struct mcount_read_cache *cache;
+
+	if (mcount_read_interval == 0 || red->cache < 0)
+		return red->save(event->data);
+
+	cache = &mtdp->read_cache[red->cache];
+
+	if (cache->time == 0 || event->time < cache->time ||
+	    event->time - cache->time >= mcount_read_interval) {
+		if (red->save(cache->data) < 0)
+			return -1;
+		cache->time = event->time;
+	}
+
+	mcount_memcpy4(event->data, cache->data, red->size);
+	return 0;
+}
+
+void reset_trigger_read(struct mcount_thread_data *mtdp)
+{
+	/* the file was opened for the parent process */
+	if (statm_fd >= 0) {
+		close(statm_fd);
+		statm_fd = -1;
+	}
+
+	memset(mtdp->read_cache, 0, sizeof(mtdp->read_cache));
+}
+
 void save_trigger_read(struct mcount_thread_data *mtdp,
 		       struct mcount_ret_stack *rstack,
 		       enum trigger_read_type type, bool diff)
@@ -694,7 +777,7 @@ void save_trigger_read(struct mcount_thread_data *mtdp,
 		event->dsize = red->size;
 		event->idx   = mtdp->idx;
 
-		if (red->save(event->data) < 0)
+		if (read_event_data(mtdp, red, event) < 0)
 			continue;
 
 		if (diff) {
@@ -784,6 +867,10 @@ void save_trigger_read(struct mcount_thread_data *mtdp,
 {
 }
 
+void reset_trigger_read(struct mcount_thread_data *mtdp)
+{
+}
+
 void save_watchpoint(struct mcount_thread_data *mtdp,
 		     struct mcount_ret_stack *rstack,
 		     unsigned long watchpoints)
@@ -853,6 +940,8 @@ static int record_event(struct mcount_thread_data *mtdp,
 		memcpy(ptr + 2, event->data, data_size);
 	}
 
+	/* live stream reads records up to the size while recording */
+	write_memory_barrier();
 	curr_buf->size += size;
 
 	return 0;
@@ -941,19 +1030,22 @@ static int record_ret_stack(struct mcount_thread_data *mtdp,
 	buf[1] = rec;
 #endif
 
-	curr_buf->size += sizeof(*frstack);
-	mrstack->flags |= MCOUNT_FL_WRITTEN;
-
 	if (argbuf) {
-		unsigned int *ptr = (void *)curr_buf->data + curr_buf->size;
+		unsigned int *ptr = (void *)curr_buf->data + curr_buf->size +
+				    sizeof(*frstack);
 
 		size -= sizeof(*frstack);
 
 		mcount_memcpy4(ptr, argbuf + 4, size);
 
-		curr_buf->size += ALIGN(size, 8);
+		size = sizeof(*frstack) + ALIGN(size, 8);
 	}
 
+	/* live stream reads records up to the size while recording */
+	write_memory_barrier();
+	curr_buf->size += size;
+	mrstack->flags |= MCOUNT_FL_WRITTEN;
+
 	pr_dbg3("rstack[%d] %s %lx\n", mrstack->depth,
 	       type == UFTRACE_ENTRY? "ENTRY" : "EXIT ", mrstack->child_ip);
 
@@ -0,0 +1,30 @@
+#!/bin/bash
+#
+# Measure the time to replay a big trace (to /dev/null).
+#
+#   $ misc/bench-replay.sh [<uftrace binary>] [<count>]
+#
+
+uftrace=${1:-./uftrace}
+count=${2:-5}
+
+if [ ! -x $uftrace ]; then
+	echo "Error: cannot find '$uftrace': Please build it first."
+	exit 1
+fi
+
+tmpdir=$(mktemp -d /tmp/uftrace-bench.XXXXXX)
+trap "rm -rf $tmpdir" EXIT
+
+# fib(25) makes about 250K function calls (500K records)
+gcc -pg -o $tmpdir/fib tests/s-fibonacci.c || exit 1
+
+$uftrace record -L libmcount -d $tmpdir/uftrace.data $tmpdir/fib 25 || exit 1
+
+size=$(du -sh $tmpdir/uftrace.data | cut -f1)
+echo "replaying $size of data $count times"
+
+TIMEFORMAT="%R sec"
+for i in $(seq $count); do
+	time $uftrace replay --no-pager -d $tmpdir/uftrace.data > /dev/null
+done
@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+import subprocess as sp
+
+TDIR='xxx'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'fork', """
+  Total time   Self time       Calls  Function
+  ==========  ==========  ==========  ====================================
+    2.754 us    0.306 us           2  a
+    2.448 us    0.351 us           2  b
+    2.097 us    0.727 us           2  c
+  447.840 us   98.246 us           2  fork
+    1.370 us    1.370 us           2  getpid
+  459.252 us    4.362 us           2  main
+    0.389 us    0.389 us           1  __cxa_atexit   # ignore this
+    0.770 us    0.770 us           1  __monstartup   # and this too
+    5.960 us    5.960 us           1  wait
+""", sort='report')
+
+    def pre(self):
+        record_cmd = '%s record --no-event -d %s %s' % (TestBase.uftrace_cmd, TDIR, 't-' + self.name)
+        sp.call(record_cmd.split())
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        return '%s report -d %s -j 2 -s call,func' % (TestBase.uftrace_cmd, TDIR)
+
+    def post(self, ret):
+        sp.call(['rm', '-rf', TDIR])
+        return ret
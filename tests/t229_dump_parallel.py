@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+import subprocess as sp
+
+TDIR='xxx'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'thread', """
+main 1
+main;pthread_create 4
+main;pthread_join 4
+foo 4
+foo;a 4
+foo;a;b 4
+foo;a;b;c 4
+""", ldflags='-pthread')
+
+    def pre(self):
+        record_cmd = '%s record --no-event -d %s %s' % (TestBase.uftrace_cmd, TDIR, 't-' + self.name)
+        sp.call(record_cmd.split())
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        return '%s dump -d %s -j 2 --flame-graph' % (TestBase.uftrace_cmd, TDIR)
+
+    def post(self, ret):
+        sp.call(['rm', '-rf', TDIR])
+        return ret
+
+    def sort(self, output):
+        """ This function post-processes output of the test to be compared .
+            It ignores blank lines and internal functions.  """
+        result = []
+        for ln in output.split('\n'):
+            if ln.strip() == '':
+                continue
+            if ln.startswith('__'):
+                continue
+            result.append(ln)
+        return '\n'.join(result)
@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+import subprocess as sp
+import os
+import glob
+
+TDIR='xxx'
+
+def cache_entries(cmd):
+    return sorted(glob.glob(os.path.join(TDIR, 'cache', cmd + '-*')))
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'sort', """
+  Total time   Self time       Calls  Function
+  ==========  ==========  ==========  ====================================
+    1.152 ms   71.683 us           1  main
+    1.080 ms    1.813 us           1  bar
+    1.078 ms    1.078 ms           1  usleep
+   70.176 us   70.176 us           1  __monstartup   # ignore this
+   37.525 us    1.137 us           2  foo
+   36.388 us   36.388 us           6  loop
+    1.200 us    1.200 us           1  __cxa_atexit   # and this too
+""", sort='report')
+
+    def report(self, opts=''):
+        report_cmd = '%s report -d %s %s' % (TestBase.uftrace_cmd, TDIR, opts)
+        sp.call(report_cmd.split(), stdout=sp.PIPE)
+
+    def pre(self):
+        record_cmd = '%s record -d %s %s' % (TestBase.uftrace_cmd, TDIR, 't-' + self.name)
+        sp.call(record_cmd.split())
+
+        # save the result in the cache (with a different sort order)
+        self.report('-s call')
+        entries = cache_entries('report')
+        if len(entries) != 1:
+            return TestBase.TEST_DIFF_RESULT
+
+        # output options should use the same entry
+        self.report('--avg-total')
+        if cache_entries('report') != entries:
+            return TestBase.TEST_DIFF_RESULT
+
+        # but filter options should not
+        self.report('-F foo')
+        if len(cache_entries('report')) != 2:
+            return TestBase.TEST_DIFF_RESULT
+
+        # changing data should remove existing entries
+        for dat in glob.glob(os.path.join(TDIR, '*.dat')):
+            st = os.stat(dat)
+            os.utime(dat, (st.st_atime, st.st_mtime + 10))
+        self.report('-s call')
+        if len(cache_entries('report')) != 1:
+            return TestBase.TEST_DIFF_RESULT
+
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        return '%s report -d %s' % (TestBase.uftrace_cmd, TDIR)
+
+    def post(self, ret):
+        sp.call(['rm', '-rf', TDIR])
+        return ret
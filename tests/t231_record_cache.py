@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+import subprocess as sp
+import os
+import glob
+
+TDIR='xxx'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'sort', """
+  Total time   Self time       Calls  Function
+  ==========  ==========  ==========  ====================================
+    1.152 ms   71.683 us           1  main
+    1.080 ms    1.813 us           1  bar
+    1.078 ms    1.078 ms           1  usleep
+   70.176 us   70.176 us           1  __monstartup   # ignore this
+   37.525 us    1.137 us           2  foo
+   36.388 us   36.388 us           6  loop
+    1.200 us    1.200 us           1  __cxa_atexit   # and this too
+""", sort='report')
+
+    def pre(self):
+        record_cmd = '%s record -d %s --cache --no-event %s' % \
+                     (TestBase.uftrace_cmd, TDIR, 't-' + self.name)
+        sp.call(record_cmd.split())
+
+        # the writers should save the result before running report
+        entries = glob.glob(os.path.join(TDIR, 'cache', 'report-*'))
+        if len(entries) != 1:
+            return TestBase.TEST_DIFF_RESULT
+
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        return '%s report -d %s' % (TestBase.uftrace_cmd, TDIR)
+
+    def post(self, ret):
+        sp.call(['rm', '-rf', TDIR])
+        return ret
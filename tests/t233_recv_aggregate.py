@@ -0,0 +1,50 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+import subprocess as sp
+
+TDIR  = 'xxx'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+# 2 client(s) finished, 0 in progress (not included)
+  Total time   Self time       Calls  Function
+  ==========  ==========  ==========  ====================
+    6.010 us    1.200 us           2  main
+    4.810 us    0.970 us           2  a
+    3.830 us    0.970 us           2  b
+    2.860 us    1.354 us           2  c
+    1.506 us    1.506 us           2  getpid
+""", sort='report')
+        self.gen_port()
+
+    recv_p = None
+
+    def pre(self):
+        # the file should not have color even if it's enabled
+        recv_cmd = '%s recv -d %s --port %s --aggregate --color=on' % \
+                   (TestBase.uftrace_cmd, TDIR, self.port)
+        self.recv_p = sp.Popen(recv_cmd.split())
+
+        for name in ['abc1', 'abc2']:
+            record_cmd = '%s record -H %s --port %s -d %s %s' % \
+                         (TestBase.uftrace_cmd, 'localhost', self.port, name, 't-abc')
+            sp.call(record_cmd.split())
+
+        # the aggregate file is written at exit
+        self.recv_p.terminate()
+        self.recv_p.wait()
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        return 'cat %s/aggregate.txt' % TDIR
+
+    def post(self, ret):
+        # the report sort ignores escape sequences, check them here
+        if ret == TestBase.TEST_SUCCESS:
+            with open('%s/aggregate.txt' % TDIR) as f:
+                if '\x1b' in f.read():
+                    ret = TestBase.TEST_DIFF_RESULT
+        sp.call(['rm', '-rf', TDIR])
+        return ret
@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+import subprocess as sp
+import binascii
+
+TDIR='xxx'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+process t-abc
+thread t-abc
+clock 3
+B main
+B a
+B b
+B c
+E c
+E b
+E a
+E main
+""")
+
+    def pre(self):
+        record_cmd = '%s record -d %s %s' % (TestBase.uftrace_cmd, TDIR, 't-' + self.name)
+        sp.call(record_cmd.split())
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        # convert the binary (protobuf) output to hex digits
+        return '%s dump -d %s -F main -D 4 --perfetto | od -An -v -tx1' % \
+            (TestBase.uftrace_cmd, TDIR)
+
+    def post(self, ret):
+        sp.call(['rm', '-rf', TDIR])
+        return ret
+
+    def varint(self, buf, i):
+        val = 0
+        shift = 0
+        while True:
+            b = buf[i]
+            i += 1
+            val |= (b & 0x7f) << shift
+            shift += 7
+            if b < 0x80:
+                return val, i
+
+    def decode(self, buf):
+        """ This function returns a list of (field, value) in a protobuf message. """
+        fields = []
+        i = 0
+        while i < len(buf):
+            key, i = self.varint(buf, i)
+            field, wire = key >> 3, key & 7
+            if wire == 0:     # varint
+                val, i = self.varint(buf, i)
+            elif wire == 2:   # length-delimited
+                n, i = self.varint(buf, i)
+                val = buf[i:i+n]
+                i += n
+            else:
+                break
+            fields.append((field, val))
+        return fields
+
+    def sort(self, output):
+        """ This function decodes the trace packets and prints the tracks
+            and slice events in order.  """
+        words = output.split()
+        if any(len(w) != 2 for w in words):
+            # expected result is already decoded
+            return '\n'.join([ln for ln in output.split('\n') if ln.strip()])
+
+        data = bytearray(binascii.unhexlify(''.join(words)))
+        names = {}
+        stack = []
+        result = []
+        for field, pkt in self.decode(data):
+            if field != 1:   # Trace.packet
+                continue
+            for f, val in self.decode(pkt):
+                if f == 58:      # timestamp_clock_id
+                    result.append('clock %d' % val)
+                elif f == 60:    # track_descriptor
+                    for df, desc in self.decode(val):
+                        if df == 3 or df == 4:  # process or thread
+                            name = [v for (k, v) in self.decode(desc) if k in (5, 6)]
+                            kind = 'process' if df == 3 else 'thread'
+                            result.append('%s %s' % (kind, name[0].decode()))
+                elif f == 12:    # interned_data
+                    for nf, name in self.decode(val):
+                        if nf != 2:  # event_names
+                            continue
+                        ent = dict(self.decode(name))
+                        names[ent[1]] = ent[2].decode()
+                elif f == 11:    # track_event
+                    ev = dict(self.decode(val))
+                    if ev.get(9) == 1:    # slice begin
+                        stack.append(names[ev[10]])
+                        result.append('B ' + stack[-1])
+                    elif ev.get(9) == 2:  # slice end
+                        result.append('E ' + stack.pop())
+        return '\n'.join(result)
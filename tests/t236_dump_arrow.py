@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+import subprocess as sp
+
+TDIR='xxx'
+AFILE='xxx.arrow'
+
+# print depth and name of each row (function call) in the arrow file
+READER="""
+import pyarrow as pa
+t = pa.ipc.open_file('%s').read_all().to_pydict()
+for d, n, dur in zip(t['depth'], t['name'], t['duration']):
+    print('%%d %%s %%s' %% (d, n, 'ok' if dur > 0 else 'zero'))
+""" % AFILE
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+3 c ok
+2 b ok
+1 a ok
+0 main ok
+""", sort='simple')
+
+    def pre(self):
+        # it needs pyarrow to read the file
+        if sp.call(['python3', '-c', 'import pyarrow'], stderr=sp.PIPE) != 0:
+            return TestBase.TEST_SKIP
+
+        record_cmd = '%s record -d %s %s' % (TestBase.uftrace_cmd, TDIR, 't-' + self.name)
+        sp.call(record_cmd.split())
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        return '%s dump -d %s -F main -D 4 --arrow=%s && python3 -c "%s"' % \
+            (TestBase.uftrace_cmd, TDIR, AFILE, READER)
+
+    def post(self, ret):
+        sp.call(['rm', '-rf', TDIR, AFILE])
+        return ret
@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'fork', """
+# DURATION     TID     FUNCTION
+            [   956] | __monstartup() {
+   1.178 us [   956] | } /* __monstartup */
+            [   956] | __cxa_atexit() {
+   0.539 us [   956] | } /* __cxa_atexit */
+            [   956] | main() {
+            [   956] |   fork() {
+            [   959] |   } /* fork */
+            [   959] |   a() {
+            [   959] |     b() {
+            [   959] |       c() {
+            [   959] |         getpid() {
+   5.870 us [   959] |         } /* getpid */
+   6.943 us [   959] |       } /* c */
+   7.252 us [   959] |     } /* b */
+   7.681 us [   959] |   } /* a */
+            [   959] | } /* main */
+   1.799 ms [   956] |   } /* fork */
+            [   956] |   wait() {
+   8.875 us [   956] |   } /* wait */
+            [   956] |   a() {
+            [   956] |     b() {
+            [   956] |       c() {
+            [   956] |         getpid() {
+   0.866 us [   956] |         } /* getpid */
+   1.290 us [   956] |       } /* c */
+   1.491 us [   956] |     } /* b */
+   1.685 us [   956] |   } /* a */
+   1.815 ms [   956] | } /* main */
+""")
+
+    def runcmd(self):
+        # leaf functions can be merged or not depending on the timing
+        return '%s live --stream --no-merge %s' % \
+               (TestBase.uftrace_cmd, 't-' + self.name)
@@ -38,6 +38,7 @@
 #include "utils/list.h"
 #include "utils/fstack.h"
 #include "utils/filter.h"
+#include "utils/pack.h"
 
 /* output of --version option (generated by argp runtime) */
 const char *argp_program_version = "uftrace " UFTRACE_VERSION;
@@ -76,15 +77,20 @@ enum options {
 	OPT_chrome_trace,
 	OPT_flame_graph,
 	OPT_graphviz,
+	OPT_perfetto,
+	OPT_arrow,
 	OPT_sample_time,
 	OPT_diff,
 	OPT_sort_column,
 	OPT_tid_filter,
-	OPT_num_thread,
 	OPT_no_comment,
 	OPT_libmcount_single,
 	OPT_rt_prio,
 	OPT_kernel_bufsize,
+	OPT_perf_bufsize,
+	OPT_send_queue,
+	OPT_send_zerocopy,
+	OPT_aggregate,
 	OPT_kernel_skip_out,
 	OPT_kernel_full,
 	OPT_kernel_only,
@@ -101,6 +107,12 @@ enum options {
 	OPT_no_event,
 	OPT_signal,
 	OPT_srcline,
+	OPT_single_file,
+	OPT_no_cache,
+	OPT_build_cache,
+	OPT_read_interval,
+	OPT_stream,
+	OPT_stream_window,
 };
 
 static struct argp_option uftrace_options[] = {
@@ -133,6 +145,9 @@ static struct argp_option uftrace_options[] = {
 	{ "kernel", 'k', 0, 0, "Trace kernel functions also (if supported)" },
 	{ "host", 'H', "HOST", 0, "Send trace data to HOST instead of write to file" },
 	{ "port", OPT_port, "PORT", 0, "Use PORT for network connection (default: 8090)" },
+	{ "send-queue", OPT_send_queue, "SIZE", 0, "Queue up to SIZE data to send to network (default: 16M)" },
+	{ "send-zerocopy", OPT_send_zerocopy, 0, 0, "Use zerocopy to send data to network" },
+	{ "aggregate", OPT_aggregate, 0, 0, "Aggregate function statistics of received data" },
 	{ "no-pager", OPT_nopager, 0, 0, "Do not use pager" },
 	{ "sort", 's', "KEY[,KEY,...]", 0, "Sort reported functions by KEYs (default: total)" },
 	{ "avg-total", OPT_avg_total, 0, 0, "Show average/min/max of total function time" },
@@ -142,6 +157,8 @@ static struct argp_option uftrace_options[] = {
 	{ "demangle", OPT_demangle, "TYPE", 0, "C++ symbol demangling: full, simple, no (default: simple)" },
 	{ "debug-domain", OPT_dbg_domain, "DOMAIN", 0, "Filter debugging domain" },
 	{ "report", OPT_report, 0, 0, "Show live report" },
+	{ "stream", OPT_stream, 0, 0, "Print functions while running without saving data" },
+	{ "stream-window", OPT_stream_window, "TIME", 0, "Wait TIME to reorder records of tasks in --stream (default: 10ms)" },
 	{ "column-view", OPT_column_view, 0, 0, "Print tasks in separate columns" },
 	{ "column-offset", OPT_column_offset, "DEPTH", 0, "Offset of each column (default: 8)" },
 	{ "no-pltbind", OPT_bind_not, 0, 0, "Do not bind dynamic symbols (LD_BIND_NOT)" },
@@ -149,18 +166,21 @@ static struct argp_option uftrace_options[] = {
 	{ "chrome", OPT_chrome_trace, 0, 0, "Dump recorded data in chrome trace format" },
 	{ "diff", OPT_diff, "DATA", 0, "Report differences" },
 	{ "sort-column", OPT_sort_column, "INDEX", 0, "Sort diff report on column INDEX (default: 2)" },
-	{ "num-thread", OPT_num_thread, "NUM", 0, "Create NUM recorder threads" },
+	{ "num-thread", 'j', "NUM", 0, "Create NUM recorder threads (or report/dump workers)" },
 	{ "no-comment", OPT_no_comment, 0, 0, "Don't show comments of returned functions" },
 	{ "libmcount-single", OPT_libmcount_single, 0, 0, "Use single thread version of libmcount" },
 	{ "rt-prio", OPT_rt_prio, "PRIO", 0, "Record with real-time (FIFO) priority" },
 	{ "kernel-depth", 'K', "DEPTH", 0, "Trace kernel functions within DEPTH (default: 1)" },
 	{ "kernel-buffer", OPT_kernel_bufsize, "SIZE", 0, "Size of kernel tracing buffer (default: 1408K)" },
+	{ "perf-buffer", OPT_perf_bufsize, "SIZE", 0, "Size of perf event buffer per cpu (default: 128K)" },
 	{ "kernel-skip-out", OPT_kernel_skip_out, 0, 0, "Skip kernel functions outside of user (deprecated)" },
 	{ "kernel-full", OPT_kernel_full, 0, 0, "Show kernel functions outside of user" },
 	{ "kernel-only", OPT_kernel_only, 0, 0, "Dump kernel data only" },
 	{ "flame-graph", OPT_flame_graph, 0, 0, "Dump recorded data in FlameGraph format" },
 	{ "sample-time", OPT_sample_time, "TIME", 0, "Show flame graph with this sampling time" },
 	{ "graphviz", OPT_graphviz, 0, 0, "Dump recorded data in DOT format" },
+	{ "perfetto", OPT_perfetto, 0, 0, "Dump recorded data in Perfetto trace format" },
+	{ "arrow", OPT_arrow, "FILE", 0, "Dump function calls to FILE in Arrow IPC format" },
 	{ "output-fields", 'f', "FIELD", 0, "Show FIELDs in the replay or graph output" },
 	{ "time-range", 'r', "TIME~TIME", 0, "Show output within the TIME(timestamp or elapsed time) range only" },
 	{ "Event", 'E', "EVENT", 0, "Enable EVENT to save more information" },
@@ -181,6 +201,10 @@ static struct argp_option uftrace_options[] = {
 	{ "watch", 'W', "POINT", 0, "Watch and report POINT if it's changed" },
 	{ "signal", OPT_signal, "SIG@act[,act,...]", 0, "Trigger action on those SIGnal" },
 	{ "srcline", OPT_srcline, 0, 0, "Enable recording source line info" },
+	{ "single-file", OPT_single_file, 0, 0, "Save trace data in a single (pack) file" },
+	{ "no-cache", OPT_no_cache, 0, 0, "Don't use (or save) cached analysis result" },
+	{ "cache", OPT_build_cache, 0, 0, "Build function statistics while recording" },
+	{ "read-interval", OPT_read_interval, "TIME", 0, "Reuse data of read triggers within TIME" },
 	{ "help", 'h', 0, 0, "Give this help list" },
 	{ 0 }
 };
@@ -600,6 +624,18 @@ static error_t parse_option(int key, char *arg, struct argp_state *state)
 		}
 		break;
 
+	case OPT_send_queue:
+		opts->send_queue = parse_size(arg);
+		break;
+
+	case OPT_send_zerocopy:
+		opts->send_zerocopy = true;
+		break;
+
+	case OPT_aggregate:
+		opts->aggregate = true;
+		break;
+
 	case OPT_nopager:
 		opts->use_pager = false;
 		break;
@@ -672,6 +708,14 @@ static error_t parse_option(int key, char *arg, struct argp_state *state)
 		opts->graphviz = true;
 		break;
 
+	case OPT_perfetto:
+		opts->perfetto = true;
+		break;
+
+	case OPT_arrow:
+		opts->arrow_file = arg;
+		break;
+
 	case OPT_diff:
 		opts->diff = arg;
 		break;
@@ -689,7 +733,7 @@ static error_t parse_option(int key, char *arg, struct argp_state *state)
 		}
 		break;
 
-	case OPT_num_thread:
+	case 'j':
 		opts->nr_thread = strtol(arg, NULL, 0);
 		if (opts->nr_thread < 0) {
 			pr_use("invalid thread number: %s\n", arg);
@@ -723,6 +767,22 @@ static error_t parse_option(int key, char *arg, struct argp_state *state)
 		}
 		break;
 
+	case OPT_perf_bufsize:
+		opts->perf_bufsize = parse_size(arg);
+		if (opts->perf_bufsize & (opts->perf_bufsize - 1)) {
+			unsigned long size = getpagesize();
+
+			pr_use("perf buffer size should be power of 2\n");
+			while (size < opts->perf_bufsize)
+				size <<= 1;
+			opts->perf_bufsize = size;
+		}
+		else if (opts->perf_bufsize && opts->perf_bufsize < (unsigned long)getpagesize()) {
+			pr_use("perf buffer size should be multiple of page size\n");
+			opts->perf_bufsize = getpagesize();
+		}
+		break;
+
 	case OPT_kernel_skip_out:  /* deprecated */
 		opts->kernel_skip_out = true;
 		break;
@@ -796,6 +856,30 @@ static error_t parse_option(int key, char *arg, struct argp_state *state)
 		opts->srcline = true;
 		break;
 
+	case OPT_single_file:
+		opts->single_file = true;
+		break;
+
+	case OPT_no_cache:
+		opts->no_cache = true;
+		break;
+
+	case OPT_build_cache:
+		opts->build_cache = true;
+		break;
+
+	case OPT_read_interval:
+		opts->read_interval = parse_time(arg, 3);
+		break;
+
+	case OPT_stream:
+		opts->stream = true;
+		break;
+
+	case OPT_stream_window:
+		opts->stream_window = parse_time(arg, 3);
+		break;
+
 	case ARGP_KEY_ARG:
 		if (state->arg_num) {
 			/*
@@ -825,6 +909,8 @@ static error_t parse_option(int key, char *arg, struct argp_state *state)
 			opts->mode = UFTRACE_MODE_SCRIPT;
 		else if (!strcmp("tui", arg))
 			opts->mode = UFTRACE_MODE_TUI;
+		else if (!strcmp("pack", arg))
+			opts->mode = UFTRACE_MODE_PACK;
 		else
 			return ARGP_ERR_UNKNOWN; /* almost same as fall through */
 		break;
@@ -877,19 +963,19 @@ static void parse_opt_file(int *argc, char ***argv, char *filename, struct opts
 	struct argp file_argp = {
 		.options = uftrace_options,
 		.parser = parse_option,
-		.args_doc = "[record|replay|live|report|info|dump|recv|graph|script|tui] [<program>]",
+		.args_doc = "[record|replay|live|report|info|dump|recv|graph|script|tui|pack] [<program>]",
 		.doc = "uftrace -- function (graph) tracer for userspace",
 	};
 	char *orig_exename = NULL;
 	int orig_idx = 0;
 
-	if (stat(filename, &stbuf) < 0) {
+	if (pack_stat(filename, &stbuf) < 0) {
 		pr_use("Cannot use opt-file: %s: %m\n", filename);
 		exit(0);
 	}
 
 	buf = xmalloc(stbuf.st_size + 1);
-	fp = fopen(filename, "r");
+	fp = pack_fopen(filename, "r");
 	if (fp == NULL)
 		pr_err("Open failed: %s", filename);
 	fread_all(buf, stbuf.st_size, fp);
@@ -950,7 +1036,7 @@ void parse_script_opt(struct opts *opts)
 	struct argp opt_argp = {
 		.options = uftrace_options,
 		.parser = parse_option,
-		.args_doc = "[record|replay|live|report|info|dump|recv|graph|script|tui] [<program>]",
+		.args_doc = "[record|replay|live|report|info|dump|recv|graph|script|tui|pack] [<program>]",
 		.doc = "uftrace -- function (graph) tracer for userspace",
 	};
 
@@ -1025,7 +1111,7 @@ static void apply_default_opts(int *argc, char ***argv, struct opts *opts)
 	parsing_default_opts = true;
 
 	snprintf(opts_file, PATH_MAX, "%s/%s", opts->dirname, basename);
-	if (!stat(opts_file, &stbuf) && stbuf.st_size > 0) {
+	if (!pack_stat(opts_file, &stbuf) && stbuf.st_size > 0) {
 		pr_dbg("apply '%s' option file\n", opts_file);
 		parse_opt_file(argc, argv, opts_file, opts);
 	}
@@ -1049,6 +1135,8 @@ int main(int argc, char *argv[])
 		.depth		= OPT_DEPTH_DEFAULT,
 		.max_stack	= OPT_RSTACK_DEFAULT,
 		.port		= UFTRACE_RECV_PORT,
+		.send_queue	= UFTRACE_SEND_QUEUE,
+		.stream_window	= UFTRACE_STREAM_WINDOW,
 		.use_pager	= true,
 		.color		= COLOR_AUTO,  /* default to 'auto' (turn on if terminal) */
 		.column_offset	= 8,
@@ -1062,7 +1150,7 @@ int main(int argc, char *argv[])
 	struct argp argp = {
 		.options = uftrace_options,
 		.parser = parse_option,
-		.args_doc = "[record|replay|live|report|info|dump|recv|graph|script|tui] [<program>]",
+		.args_doc = "[record|replay|live|report|info|dump|recv|graph|script|tui|pack] [<program>]",
 		.doc = "uftrace -- function (graph) tracer for userspace",
 	};
 	int ret = -1;
@@ -1111,6 +1199,9 @@ int main(int argc, char *argv[])
 		opts.use_pager = false;
 	if (opts.nop)
 		opts.use_pager = false;
+	/* perfetto trace is not a text and arrow output goes to a file */
+	if (opts.perfetto || opts.arrow_file)
+		opts.use_pager = false;
 
 	if (opts.use_pager)
 		pager = setup_pager();
@@ -1166,12 +1257,16 @@ int main(int argc, char *argv[])
 	case UFTRACE_MODE_TUI:
 		ret = command_tui(argc, argv, &opts);
 		break;
+	case UFTRACE_MODE_PACK:
+		ret = command_pack(argc, argv, &opts);
+		break;
 	case UFTRACE_MODE_INVALID:
 		ret = 1;
 		break;
 	}
 
 	wait_for_pager();
+	pack_cleanup();
 
 	if (opts.logfile)
 		fclose(logfp);
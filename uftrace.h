@@ -21,6 +21,8 @@
 #define UFTRACE_DIR_OLD_NAME  "ftrace.dir"
 
 #define UFTRACE_RECV_PORT  8090
+#define UFTRACE_SEND_QUEUE  (16 * 1024 * 1024)
+#define UFTRACE_STREAM_WINDOW  (10 * 1000 * 1000)  /* 10 msec */
 
 #define OPT_RSTACK_MAX      65535
 #define OPT_RSTACK_DEFAULT  1024
@@ -190,6 +192,7 @@ bool data_is_lp64(struct uftrace_data *handle);
 #define UFTRACE_MODE_GRAPH   8
 #define UFTRACE_MODE_SCRIPT  9
 #define UFTRACE_MODE_TUI     10
+#define UFTRACE_MODE_PACK    11
 
 #define UFTRACE_MODE_DEFAULT  UFTRACE_MODE_LIVE
 
@@ -217,6 +220,7 @@ struct opts {
 	char *diff_policy;
 	char *caller;
 	char *extern_data;
+	char *arrow_file;
 	int mode;
 	int idx;
 	int depth;
@@ -231,7 +235,11 @@ struct opts {
 	int size_filter;
 	unsigned long bufsize;
 	unsigned long kernel_bufsize;
+	unsigned long perf_bufsize;
+	unsigned long send_queue;
 	uint64_t threshold;
+	uint64_t read_interval;
+	uint64_t stream_window;
 	uint64_t sample_time;
 	bool flat;
 	bool libcall;
@@ -267,7 +275,14 @@ struct opts {
 	bool libname;
 	bool no_randomize_addr;
 	bool graphviz;
+	bool perfetto;
 	bool srcline;
+	bool single_file;
+	bool no_cache;
+	bool build_cache;
+	bool send_zerocopy;
+	bool aggregate;
+	bool stream;
 	struct uftrace_time_range range;
 	enum uftrace_pattern_type patt_type;
 };
@@ -292,12 +307,17 @@ int command_dump(int argc, char *argv[], struct opts *opts);
 int command_graph(int argc, char *argv[], struct opts *opts);
 int command_script(int argc, char *argv[], struct opts *opts);
 int command_tui(int argc, char *argv[], struct opts *opts);
+int command_pack(int argc, char *argv[], struct opts *opts);
 
 extern volatile bool uftrace_done;
 
 int open_data_file(struct opts *opts, struct uftrace_data *handle);
 int open_info_file(struct opts *opts, struct uftrace_data *handle);
 void close_data_file(struct opts *opts, struct uftrace_data *handle);
+int *assign_worker_tasks(struct uftrace_data *handle, int nr_workers,
+			 bool by_family);
+bool *open_worker_data(struct opts *opts, struct uftrace_data *handle,
+		       struct uftrace_data *parent, int *assign, int idx);
 int read_task_file(struct uftrace_session_link *sess, char *dirname,
 		   bool needs_symtab, bool sym_rel_addr, bool needs_srcline);
 int read_task_txt_file(struct uftrace_session_link *sess, char *dirname,
@@ -319,12 +339,25 @@ struct uftrace_session {
 	struct rb_root		 filters;
 	struct rb_root		 fixups;
 	struct list_head	 dlopen_libs;
+	struct uftrace_sym_cache *symcache;
 	int 			 namelen;
 	char 			 exename[];
 };
 
+/*
+ * direct-mapped cache of address to symbol in a session.  It's updated
+ * on lookup without locking, so a session should be accessed by a single
+ * thread only (parallel analysis uses separate processes).
+ */
+#define SESSION_SYMCACHE_BITS  12
+#define SESSION_SYMCACHE_SIZE  (1U << SESSION_SYMCACHE_BITS)
+
+struct uftrace_sym_cache {
+	uint64_t		 addr;
+	struct sym		*sym;
+};
+
 struct uftrace_sess_ref {
-	struct uftrace_sess_ref	*next;
 	struct uftrace_session	*sess;
 	uint64_t		 start, end;
 };
@@ -340,8 +373,12 @@ struct uftrace_task {
 	int			 pid, tid, ppid;
 	char			 comm[TASK_COMM_LEN];
 	struct rb_node		 node;
-	struct uftrace_sess_ref	 sref;
-	struct uftrace_sess_ref	*sref_last;
+	/* session references sorted by start time */
+	struct uftrace_sess_ref	*sref;
+	int			 nr_sref;
+	/* last result of find_task_session() */
+	struct uftrace_sess_ref	 sref_cache;
+	unsigned		 sref_gen;
 };
 
 #define UFTRACE_MSG_MAGIC 0xface
@@ -419,6 +456,7 @@ void session_add_dlopen(struct uftrace_session *sess, uint64_t timestamp,
 			unsigned long base_addr, const char *libname);
 struct sym * session_find_dlsym(struct uftrace_session *sess, uint64_t timestamp,
 				unsigned long addr);
+struct sym * session_find_sym(struct uftrace_session *sess, uint64_t addr);
 void delete_sessions(struct uftrace_session_link *sess);
 
 struct uftrace_record;
@@ -440,11 +478,21 @@ int setup_client_socket(struct opts *opts);
 void send_trace_dir_name(int sock, char *name);
 void send_trace_data(int sock, int tid, void *data, size_t len);
 void send_trace_kernel_data(int sock, int cpu, void *data, size_t len);
+void send_trace_kernel_pipe(int sock, int cpu, int pipefd, size_t len);
 void send_trace_perf_data(int sock, int cpu, void *data, size_t len);
 void send_trace_metadata(int sock, const char *dirname, char *filename);
 void send_trace_info(int sock, struct uftrace_file_header *hdr,
 		     void *info, int len);
 void send_trace_end(int sock);
+void start_trace_sender(int sock, struct opts *opts);
+void finish_trace_sender(int sock);
+
+void start_live_stream(struct opts *opts);
+void live_stream_msg(int type, void *data, size_t len);
+void live_stream_data(int tid, void *data, size_t len);
+void finish_live_stream(void);
+
+void setup_replay_default_field(struct list_head *fields);
 
 void write_task_info(const char *dirname, struct uftrace_msg_task *tmsg);
 void write_fork_info(const char *dirname, struct uftrace_msg_task *tmsg);
@@ -0,0 +1,873 @@
+/*
+ * Apache Arrow IPC file format support
+ *
+ * The file consists of a schema message, record batches of function
+ * calls, a dictionary batch for function names and the footer.  Message
+ * metadata is encoded in flatbuffers which are built back to front here
+ * (children first) like the reference implementation.  See the .fbs files
+ * in format/ of the Arrow source for the definitions.
+ *
+ * Note that it assumes a little-endian host.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/utils.h"
+#include "utils/arrow.h"
+
+#define ARROW_MAGIC			"ARROW1"
+#define ARROW_CONTINUATION		0xffffffffU
+
+/* MetadataVersion.V5 */
+#define ARROW_VERSION			4
+
+/* MessageHeader union */
+#define HEADER_SCHEMA			1
+#define HEADER_DICTIONARY_BATCH		2
+#define HEADER_RECORD_BATCH		3
+
+/* Type union */
+#define TYPE_INT			2
+#define TYPE_UTF8			5
+
+/* field (slot) numbers in the tables */
+#define MESSAGE_VERSION			0
+#define MESSAGE_HEADER_TYPE		1
+#define MESSAGE_HEADER			2
+#define MESSAGE_BODY_LENGTH		3
+
+#define SCHEMA_ENDIANNESS		0
+#define SCHEMA_FIELDS			1
+
+#define FIELD_NAME			0
+#define FIELD_NULLABLE			1
+#define FIELD_TYPE_TYPE			2
+#define FIELD_TYPE			3
+#define FIELD_DICTIONARY		4
+#define FIELD_CHILDREN			5
+
+#define INT_BIT_WIDTH			0
+#define INT_IS_SIGNED			1
+
+#define DICT_ENCODING_ID		0
+#define DICT_ENCODING_INDEX_TYPE	1
+
+#define RECORD_BATCH_LENGTH		0
+#define RECORD_BATCH_NODES		1
+#define RECORD_BATCH_BUFFERS		2
+
+#define DICT_BATCH_ID			0
+#define DICT_BATCH_DATA			1
+
+#define FOOTER_VERSION			0
+#define FOOTER_SCHEMA			1
+#define FOOTER_DICTIONARIES		2
+#define FOOTER_RECORD_BATCHES		3
+
+/* the only dictionary (for function names) */
+#define NAME_DICT_ID			0
+
+#define FB_MAX_FIELDS			8
+#define ARROW_MAX_BUFFERS		32
+
+/* flatbuffer builder: positions are offsets from the end of the buffer */
+struct fb_builder {
+	unsigned char		*buf;
+	size_t			size;
+	size_t			head;
+	size_t			minalign;
+	/* fields of the current table */
+	uint32_t		fields[FB_MAX_FIELDS];
+	int			nr_fields;
+	uint32_t		table_start;
+};
+
+/* FieldNode and Buffer structs in RecordBatch */
+struct fb_node {
+	int64_t			length;
+	int64_t			null_count;
+};
+
+struct fb_buffer {
+	int64_t			offset;
+	int64_t			length;
+};
+
+/* Block struct in Footer */
+struct fb_block {
+	int64_t			offset;
+	int32_t			meta_len;
+	int32_t			pad;
+	int64_t			body_len;
+};
+
+/* message body and its layout */
+struct arrow_body {
+	const void		*data[ARROW_MAX_BUFFERS];
+	struct fb_buffer	bufs[ARROW_MAX_BUFFERS];
+	int			nr_bufs;
+	struct fb_node		nodes[ARROW_MAX_BUFFERS];
+	int			nr_nodes;
+	uint64_t		len;
+};
+
+struct arrow_name {
+	struct rb_node		link;
+	char			*name;
+	int32_t			idx;
+};
+
+static void fb_reset(struct fb_builder *fb)
+{
+	fb->head = 0;
+	fb->minalign = 1;
+}
+
+static unsigned char *fb_alloc(struct fb_builder *fb, size_t len)
+{
+	if (fb->head + len > fb->size) {
+		size_t new_size = ALIGN((fb->head + len) * 2, 1024);
+		unsigned char *new_buf = xmalloc(new_size);
+
+		/* data is at the end of the buffer */
+		memcpy(new_buf + new_size - fb->head,
+		       fb->buf + fb->size - fb->head, fb->head);
+		free(fb->buf);
+
+		fb->buf = new_buf;
+		fb->size = new_size;
+	}
+
+	fb->head += len;
+	return fb->buf + fb->size - fb->head;
+}
+
+static void fb_pad(struct fb_builder *fb, size_t len)
+{
+	memset(fb_alloc(fb, len), 0, len);
+}
+
+/* align the buffer so that it's aligned after adding @extra bytes */
+static void fb_prep(struct fb_builder *fb, size_t align, size_t extra)
+{
+	if (align > fb->minalign)
+		fb->minalign = align;
+
+	fb_pad(fb, -(fb->head + extra) & (align - 1));
+}
+
+static void fb_put(struct fb_builder *fb, const void *val, size_t len)
+{
+	fb_prep(fb, len, 0);
+	memcpy(fb_alloc(fb, len), val, len);
+}
+
+static uint32_t fb_put_offset(struct fb_builder *fb, uint32_t pos)
+{
+	uint32_t off;
+
+	fb_prep(fb, 4, 0);
+	off = fb->head + 4 - pos;
+	memcpy(fb_alloc(fb, 4), &off, 4);
+	return fb->head;
+}
+
+static uint32_t fb_create_string(struct fb_builder *fb, const char *str)
+{
+	uint32_t len = strlen(str);
+
+	fb_prep(fb, 4, len + 1);
+	fb_pad(fb, 1);
+	memcpy(fb_alloc(fb, len), str, len);
+	fb_put(fb, &len, sizeof(len));
+	return fb->head;
+}
+
+/* elements should be added in reverse order */
+static void fb_start_vector(struct fb_builder *fb, size_t elem_size,
+			    size_t nr, size_t align)
+{
+	fb_prep(fb, 4, elem_size * nr);
+	fb_prep(fb, align, elem_size * nr);
+}
+
+static uint32_t fb_end_vector(struct fb_builder *fb, uint32_t nr)
+{
+	fb_put(fb, &nr, sizeof(nr));
+	return fb->head;
+}
+
+static uint32_t fb_create_offsets(struct fb_builder *fb,
+				  uint32_t *pos, int nr)
+{
+	int i;
+
+	fb_start_vector(fb, 4, nr, 4);
+	for (i = nr - 1; i >= 0; i--)
+		fb_put_offset(fb, pos[i]);
+	return fb_end_vector(fb, nr);
+}
+
+static uint32_t fb_create_structs(struct fb_builder *fb, const void *data,
+				  size_t elem_size, int nr)
+{
+	int i;
+
+	fb_start_vector(fb, elem_size, nr, 8);
+	for (i = nr - 1; i >= 0; i--)
+		memcpy(fb_alloc(fb, elem_size),
+		       (const char *)data + i * elem_size, elem_size);
+	return fb_end_vector(fb, nr);
+}
+
+static void fb_start_table(struct fb_builder *fb)
+{
+	memset(fb->fields, 0, sizeof(fb->fields));
+	fb->nr_fields = 0;
+	fb->table_start = fb->head;
+}
+
+static void fb_set_field(struct fb_builder *fb, int slot)
+{
+	fb->fields[slot] = fb->head;
+	if (slot >= fb->nr_fields)
+		fb->nr_fields = slot + 1;
+}
+
+static void fb_add_u8(struct fb_builder *fb, int slot, uint8_t val)
+{
+	fb_put(fb, &val, sizeof(val));
+	fb_set_field(fb, slot);
+}
+
+static void fb_add_i16(struct fb_builder *fb, int slot, int16_t val)
+{
+	fb_put(fb, &val, sizeof(val));
+	fb_set_field(fb, slot);
+}
+
+static void fb_add_i32(struct fb_builder *fb, int slot, int32_t val)
+{
+	fb_put(fb, &val, sizeof(val));
+	fb_set_field(fb, slot);
+}
+
+static void fb_add_i64(struct fb_builder *fb, int slot, int64_t val)
+{
+	fb_put(fb, &val, sizeof(val));
+	fb_set_field(fb, slot);
+}
+
+static void fb_add_offset(struct fb_builder *fb, int slot, uint32_t pos)
+{
+	fb_put_offset(fb, pos);
+	fb_set_field(fb, slot);
+}
+
+static uint32_t fb_end_table(struct fb_builder *fb)
+{
+	uint32_t table;
+	int32_t vtable;
+	uint16_t val;
+	int i;
+
+	/* placeholder for the vtable offset */
+	fb_prep(fb, 4, 0);
+	fb_alloc(fb, 4);
+	table = fb->head;
+
+	for (i = fb->nr_fields - 1; i >= 0; i--) {
+		val = fb->fields[i] ? table - fb->fields[i] : 0;
+		fb_put(fb, &val, sizeof(val));
+	}
+	val = table - fb->table_start;
+	fb_put(fb, &val, sizeof(val));
+	val = (fb->nr_fields + 2) * sizeof(val);
+	fb_put(fb, &val, sizeof(val));
+
+	/* vtable is located before the table */
+	vtable = fb->head - table;
+	memcpy(fb->buf + fb->size - table, &vtable, sizeof(vtable));
+	return table;
+}
+
+static void fb_finish(struct fb_builder *fb, uint32_t root)
+{
+	fb_prep(fb, fb->minalign, 4);
+	fb_put_offset(fb, root);
+}
+
+static void *fb_data(struct fb_builder *fb)
+{
+	return fb->buf + fb->size - fb->head;
+}
+
+static void arrow_buf_add(struct arrow_buf *buf, const void *data, size_t len)
+{
+	if (buf->len + len > buf->size) {
+		buf->size = ALIGN((buf->len + len) * 2, 4096);
+		buf->data = xrealloc(buf->data, buf->size);
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void arrow_buf_free(struct arrow_buf *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->size = 0;
+}
+
+static void string_reset(struct arrow_string *str)
+{
+	int32_t zero = 0;
+
+	str->valid.len = 0;
+	str->offset.len = 0;
+	str->data.len = 0;
+	str->nr_null = 0;
+
+	arrow_buf_add(&str->offset, &zero, sizeof(zero));
+}
+
+static void string_add(struct arrow_string *str, unsigned idx, const char *s)
+{
+	int32_t offset;
+	unsigned char bits = 0;
+
+	if (idx % 8 == 0)
+		arrow_buf_add(&str->valid, &bits, 1);
+
+	if (s) {
+		str->valid.data[idx / 8] |= 1 << (idx % 8);
+		arrow_buf_add(&str->data, s, strlen(s));
+	}
+	else
+		str->nr_null++;
+
+	offset = str->data.len;
+	arrow_buf_add(&str->offset, &offset, sizeof(offset));
+}
+
+static void string_free(struct arrow_string *str)
+{
+	arrow_buf_free(&str->valid);
+	arrow_buf_free(&str->offset);
+	arrow_buf_free(&str->data);
+}
+
+static void body_add_node(struct arrow_body *body, int64_t len,
+			  int64_t nr_null)
+{
+	struct fb_node *node = &body->nodes[body->nr_nodes++];
+
+	node->length = len;
+	node->null_count = nr_null;
+}
+
+/* buffers in the body are aligned to 8 bytes */
+static void body_add_buf(struct arrow_body *body, const void *data,
+			 size_t len)
+{
+	struct fb_buffer *buf = &body->bufs[body->nr_bufs];
+
+	body->data[body->nr_bufs++] = data;
+	buf->offset = body->len;
+	buf->length = len;
+	body->len += ALIGN(len, 8);
+}
+
+static void body_add_column(struct arrow_body *body, struct arrow_buf *col,
+			    unsigned nr_rows)
+{
+	body_add_node(body, nr_rows, 0);
+	body_add_buf(body, NULL, 0);  /* no validity bitmap */
+	body_add_buf(body, col->data, col->len);
+}
+
+static void body_add_string(struct arrow_body *body, struct arrow_string *str,
+			    unsigned nr_rows)
+{
+	body_add_node(body, nr_rows, str->nr_null);
+	if (str->nr_null)
+		body_add_buf(body, str->valid.data, str->valid.len);
+	else
+		body_add_buf(body, NULL, 0);
+	body_add_buf(body, str->offset.data, str->offset.len);
+	body_add_buf(body, str->data.data, str->data.len);
+}
+
+static void write_data(struct uftrace_arrow *ar, const void *data, size_t len)
+{
+	static const char zero[8];
+	size_t pad = ALIGN(len, 8) - len;
+
+	if ((len && fwrite(data, len, 1, ar->fp) != 1) ||
+	    (pad && fwrite(zero, pad, 1, ar->fp) != 1))
+		pr_err("failed to write arrow file");
+
+	ar->file_size += len + pad;
+}
+
+/* write an encapsulated message with the body */
+static void write_message(struct uftrace_arrow *ar, struct fb_builder *fb,
+			  struct arrow_body *body, struct arrow_block *block)
+{
+	uint32_t prefix[2] = {
+		ARROW_CONTINUATION,
+		ALIGN(fb->head, 8),
+	};
+	int i;
+
+	if (block) {
+		block->offset = ar->file_size;
+		block->meta_len = sizeof(prefix) + prefix[1];
+		block->body_len = body ? body->len : 0;
+	}
+
+	write_data(ar, prefix, sizeof(prefix));
+	write_data(ar, fb_data(fb), fb->head);
+
+	for (i = 0; body && i < body->nr_bufs; i++)
+		write_data(ar, body->data[i], body->bufs[i].length);
+}
+
+static uint32_t put_int_type(struct fb_builder *fb, int bits, bool is_signed)
+{
+	fb_start_table(fb);
+	fb_add_i32(fb, INT_BIT_WIDTH, bits);
+	fb_add_u8(fb, INT_IS_SIGNED, is_signed);
+	return fb_end_table(fb);
+}
+
+static uint32_t put_field(struct fb_builder *fb, const char *name,
+			  int bits, bool is_signed, bool dictionary)
+{
+	uint32_t name_pos, type_pos, dict_pos = 0, children;
+	int type_type = bits ? TYPE_INT : TYPE_UTF8;
+
+	children = fb_create_offsets(fb, NULL, 0);
+	name_pos = fb_create_string(fb, name);
+
+	if (bits) {
+		type_pos = put_int_type(fb, bits, is_signed);
+	}
+	else {
+		fb_start_table(fb);
+		type_pos = fb_end_table(fb);
+	}
+
+	if (dictionary) {
+		uint32_t index_pos = put_int_type(fb, 32, true);
+
+		fb_start_table(fb);
+		fb_add_i64(fb, DICT_ENCODING_ID, NAME_DICT_ID);
+		fb_add_offset(fb, DICT_ENCODING_INDEX_TYPE, index_pos);
+		dict_pos = fb_end_table(fb);
+	}
+
+	fb_start_table(fb);
+	fb_add_offset(fb, FIELD_NAME, name_pos);
+	fb_add_offset(fb, FIELD_TYPE, type_pos);
+	fb_add_offset(fb, FIELD_CHILDREN, children);
+	if (dict_pos)
+		fb_add_offset(fb, FIELD_DICTIONARY, dict_pos);
+	fb_add_u8(fb, FIELD_NULLABLE, !bits && !dictionary);
+	fb_add_u8(fb, FIELD_TYPE_TYPE, type_type);
+	return fb_end_table(fb);
+}
+
+static uint32_t put_schema(struct uftrace_arrow *ar, struct fb_builder *fb)
+{
+	uint32_t fields[8];
+	uint32_t fields_pos;
+	int nr = 0;
+
+	/* the order should match to add_record_batch() */
+	fields[nr++] = put_field(fb, "tid", 32, true, false);
+	fields[nr++] = put_field(fb, "timestamp", 64, false, false);
+	fields[nr++] = put_field(fb, "duration", 64, false, false);
+	fields[nr++] = put_field(fb, "depth", 32, true, false);
+	fields[nr++] = put_field(fb, "symbol", 64, false, false);
+	fields[nr++] = put_field(fb, "name", 0, false, true);
+	if (ar->has_args)
+		fields[nr++] = put_field(fb, "args", 0, false, false);
+	if (ar->has_retval)
+		fields[nr++] = put_field(fb, "retval", 0, false, false);
+
+	fields_pos = fb_create_offsets(fb, fields, nr);
+
+	fb_start_table(fb);
+	fb_add_offset(fb, SCHEMA_FIELDS, fields_pos);
+	fb_add_i16(fb, SCHEMA_ENDIANNESS, 0);  /* little */
+	return fb_end_table(fb);
+}
+
+static uint32_t put_record_batch(struct fb_builder *fb, uint64_t nr_rows,
+				 struct arrow_body *body)
+{
+	uint32_t nodes, buffers;
+
+	nodes = fb_create_structs(fb, body->nodes, sizeof(*body->nodes),
+				  body->nr_nodes);
+	buffers = fb_create_structs(fb, body->bufs, sizeof(*body->bufs),
+				    body->nr_bufs);
+
+	fb_start_table(fb);
+	fb_add_i64(fb, RECORD_BATCH_LENGTH, nr_rows);
+	fb_add_offset(fb, RECORD_BATCH_NODES, nodes);
+	fb_add_offset(fb, RECORD_BATCH_BUFFERS, buffers);
+	return fb_end_table(fb);
+}
+
+static void put_message(struct fb_builder *fb, int type, uint32_t header,
+			struct arrow_body *body)
+{
+	uint32_t msg;
+
+	fb_start_table(fb);
+	fb_add_i64(fb, MESSAGE_BODY_LENGTH, body ? body->len : 0);
+	fb_add_offset(fb, MESSAGE_HEADER, header);
+	fb_add_i16(fb, MESSAGE_VERSION, ARROW_VERSION);
+	fb_add_u8(fb, MESSAGE_HEADER_TYPE, type);
+	msg = fb_end_table(fb);
+
+	fb_finish(fb, msg);
+}
+
+static void reset_columns(struct uftrace_arrow *ar)
+{
+	ar->nr_rows = 0;
+
+	ar->tid.len = 0;
+	ar->time.len = 0;
+	ar->duration.len = 0;
+	ar->depth.len = 0;
+	ar->symbol.len = 0;
+	ar->name.len = 0;
+	string_reset(&ar->args);
+	string_reset(&ar->retval);
+}
+
+static void write_record_batch(struct uftrace_arrow *ar)
+{
+	struct fb_builder fb = {};
+	struct arrow_body body = {};
+	struct arrow_block *block;
+	uint32_t batch;
+
+	if (ar->nr_rows == 0)
+		return;
+
+	body_add_column(&body, &ar->tid, ar->nr_rows);
+	body_add_column(&body, &ar->time, ar->nr_rows);
+	body_add_column(&body, &ar->duration, ar->nr_rows);
+	body_add_column(&body, &ar->depth, ar->nr_rows);
+	body_add_column(&body, &ar->symbol, ar->nr_rows);
+	body_add_column(&body, &ar->name, ar->nr_rows);
+	if (ar->has_args)
+		body_add_string(&body, &ar->args, ar->nr_rows);
+	if (ar->has_retval)
+		body_add_string(&body, &ar->retval, ar->nr_rows);
+
+	fb_reset(&fb);
+	batch = put_record_batch(&fb, ar->nr_rows, &body);
+	put_message(&fb, HEADER_RECORD_BATCH, batch, &body);
+
+	ar->blocks = xrealloc(ar->blocks, (ar->nr_blocks + 1) * sizeof(*block));
+	block = &ar->blocks[ar->nr_blocks++];
+
+	write_message(ar, &fb, &body, block);
+	free(fb.buf);
+
+	ar->total_rows += ar->nr_rows;
+	reset_columns(ar);
+}
+
+/*
+ * The dictionary is written at the end since function names are not
+ * known in advance.  It's fine for the file format as readers find the
+ * dictionary batches from the footer.
+ */
+static void write_dictionary(struct uftrace_arrow *ar,
+			     struct arrow_block *block)
+{
+	struct fb_builder fb = {};
+	struct arrow_body body = {};
+	uint32_t batch, dict;
+
+	body_add_string(&body, &ar->dict, ar->nr_names);
+
+	fb_reset(&fb);
+	batch = put_record_batch(&fb, ar->nr_names, &body);
+
+	fb_start_table(&fb);
+	fb_add_i64(&fb, DICT_BATCH_ID, NAME_DICT_ID);
+	fb_add_offset(&fb, DICT_BATCH_DATA, batch);
+	dict = fb_end_table(&fb);
+
+	put_message(&fb, HEADER_DICTIONARY_BATCH, dict, &body);
+
+	write_message(ar, &fb, &body, block);
+	free(fb.buf);
+}
+
+static uint32_t put_blocks(struct fb_builder *fb, struct arrow_block *blocks,
+			   int nr)
+{
+	struct fb_block *fb_blocks = xcalloc(nr ?: 1, sizeof(*fb_blocks));
+	uint32_t pos;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		fb_blocks[i].offset   = blocks[i].offset;
+		fb_blocks[i].meta_len = blocks[i].meta_len;
+		fb_blocks[i].body_len = blocks[i].body_len;
+	}
+
+	pos = fb_create_structs(fb, fb_blocks, sizeof(*fb_blocks), nr);
+	free(fb_blocks);
+	return pos;
+}
+
+static void write_footer(struct uftrace_arrow *ar, struct arrow_block *dict)
+{
+	struct fb_builder fb = {};
+	uint32_t schema, dicts, batches, footer;
+	int32_t len;
+
+	fb_reset(&fb);
+	schema = put_schema(ar, &fb);
+	dicts = put_blocks(&fb, dict, 1);
+	batches = put_blocks(&fb, ar->blocks, ar->nr_blocks);
+
+	fb_start_table(&fb);
+	fb_add_offset(&fb, FOOTER_SCHEMA, schema);
+	fb_add_offset(&fb, FOOTER_DICTIONARIES, dicts);
+	fb_add_offset(&fb, FOOTER_RECORD_BATCHES, batches);
+	fb_add_i16(&fb, FOOTER_VERSION, ARROW_VERSION);
+	footer = fb_end_table(&fb);
+	fb_finish(&fb, footer);
+
+	len = fb.head;
+	write_data(ar, fb_data(&fb), fb.head);
+	if (fwrite(&len, sizeof(len), 1, ar->fp) != 1 ||
+	    fwrite(ARROW_MAGIC, strlen(ARROW_MAGIC), 1, ar->fp) != 1)
+		pr_err("failed to write arrow file");
+
+	ar->file_size += sizeof(len) + strlen(ARROW_MAGIC);
+	free(fb.buf);
+}
+
+/* returns index of the name in the dictionary */
+static int32_t find_name(struct uftrace_arrow *ar, const char *name)
+{
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &ar->names.rb_node;
+	struct arrow_name *iname;
+	int cmp;
+
+	while (*p) {
+		parent = *p;
+		iname = rb_entry(parent, struct arrow_name, link);
+
+		cmp = strcmp(iname->name, name);
+		if (cmp == 0)
+			return iname->idx;
+
+		if (cmp > 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	iname = xmalloc(sizeof(*iname));
+	iname->name = xstrdup(name);
+	iname->idx  = ar->nr_names;
+
+	rb_link_node(&iname->link, parent, p);
+	rb_insert_color(&iname->link, &ar->names);
+
+	string_add(&ar->dict, ar->nr_names++, name);
+	return iname->idx;
+}
+
+/**
+ * arrow_init - initialize arrow file writer
+ * @ar: arrow file writer
+ * @fp: file to write
+ * @has_args: whether to add the 'args' column
+ * @has_retval: whether to add the 'retval' column
+ *
+ * This function writes the file header and the schema.
+ */
+void arrow_init(struct uftrace_arrow *ar, FILE *fp,
+		bool has_args, bool has_retval)
+{
+	struct fb_builder fb = {};
+	uint32_t schema;
+	char magic[8] = ARROW_MAGIC;
+
+	memset(ar, 0, sizeof(*ar));
+
+	ar->fp = fp;
+	ar->names = RB_ROOT;
+	ar->has_args = has_args;
+	ar->has_retval = has_retval;
+
+	string_reset(&ar->dict);
+	reset_columns(ar);
+
+	write_data(ar, magic, sizeof(magic));
+
+	fb_reset(&fb);
+	schema = put_schema(ar, &fb);
+	put_message(&fb, HEADER_SCHEMA, schema, NULL);
+	write_message(ar, &fb, NULL, NULL);
+	free(fb.buf);
+}
+
+/**
+ * arrow_add_row - add a row (function call) to arrow file
+ * @ar: arrow file writer
+ * @row: data of the row
+ *
+ * The row is added to the current record batch and it's written to the
+ * file when the batch is full.
+ */
+void arrow_add_row(struct uftrace_arrow *ar, struct arrow_row *row)
+{
+	int32_t idx = find_name(ar, row->name);
+
+	arrow_buf_add(&ar->tid, &row->tid, sizeof(int32_t));
+	arrow_buf_add(&ar->time, &row->time, sizeof(uint64_t));
+	arrow_buf_add(&ar->duration, &row->duration, sizeof(uint64_t));
+	arrow_buf_add(&ar->depth, &row->depth, sizeof(int32_t));
+	arrow_buf_add(&ar->symbol, &row->symbol, sizeof(uint64_t));
+	arrow_buf_add(&ar->name, &idx, sizeof(idx));
+	if (ar->has_args)
+		string_add(&ar->args, ar->nr_rows, row->args);
+	if (ar->has_retval)
+		string_add(&ar->retval, ar->nr_rows, row->retval);
+
+	if (++ar->nr_rows == ARROW_BATCH_ROWS)
+		write_record_batch(ar);
+}
+
+/**
+ * arrow_finish - finish arrow file writer
+ * @ar: arrow file writer
+ *
+ * This function writes the remaining rows, the dictionary and the
+ * footer and then releases resources in @ar.  The file is not closed.
+ */
+void arrow_finish(struct uftrace_arrow *ar)
+{
+	struct arrow_block dict;
+	struct rb_node *node;
+	struct arrow_name *iname;
+
+	write_record_batch(ar);
+	write_dictionary(ar, &dict);
+	write_footer(ar, &dict);
+	fflush(ar->fp);
+
+	while (!RB_EMPTY_ROOT(&ar->names)) {
+		node = rb_first(&ar->names);
+		iname = rb_entry(node, struct arrow_name, link);
+
+		rb_erase(node, &ar->names);
+		free(iname->name);
+		free(iname);
+	}
+
+	arrow_buf_free(&ar->tid);
+	arrow_buf_free(&ar->time);
+	arrow_buf_free(&ar->duration);
+	arrow_buf_free(&ar->depth);
+	arrow_buf_free(&ar->symbol);
+	arrow_buf_free(&ar->name);
+	string_free(&ar->args);
+	string_free(&ar->retval);
+	string_free(&ar->dict);
+	free(ar->blocks);
+}
+
+#ifdef UNIT_TEST
+
+TEST_CASE(arrow_flatbuffer)
+{
+	struct fb_builder fb = {};
+	unsigned char *data;
+	uint32_t root, str;
+	int32_t vtable;
+	uint16_t *vt;
+	unsigned char *table;
+
+	pr_dbg("build a table with a scalar and a string\n");
+	fb_reset(&fb);
+	str = fb_create_string(&fb, "abc");
+	fb_start_table(&fb);
+	fb_add_offset(&fb, 1, str);
+	fb_add_i16(&fb, 0, 42);
+	root = fb_end_table(&fb);
+	fb_finish(&fb, root);
+
+	TEST_EQ(fb.head % 8, 0);
+	data = fb_data(&fb);
+
+	pr_dbg("check the root table and its vtable\n");
+	table = data + *(uint32_t *)data;
+	vtable = *(int32_t *)table;
+	vt = (void *)(table - vtable);
+
+	TEST_EQ(vt[0], 8);  /* vtable size: 2 fields */
+	TEST_EQ(*(int16_t *)(table + vt[2]), 42);
+
+	pr_dbg("check the string field\n");
+	table += vt[3];
+	table += *(uint32_t *)table;
+	TEST_EQ(*(uint32_t *)table, 3);
+	TEST_MEMEQ(table + 4, "abc", 4);
+
+	free(fb.buf);
+	return TEST_OK;
+}
+
+TEST_CASE(arrow_name_dictionary)
+{
+	struct uftrace_arrow ar;
+	FILE *fp = tmpfile();
+	char buf[8];
+
+	TEST_NE(fp, NULL);
+	arrow_init(&ar, fp, false, false);
+
+	pr_dbg("new names are added to the dictionary\n");
+	TEST_EQ(find_name(&ar, "foo"), 0);
+	TEST_EQ(find_name(&ar, "bar"), 1);
+	TEST_EQ(find_name(&ar, "foo"), 0);
+	TEST_EQ(ar.nr_names, 2);
+	TEST_EQ(ar.dict.data.len, strlen("foobar"));
+
+	arrow_finish(&ar);
+
+	pr_dbg("file should start and end with the magic\n");
+	TEST_EQ((uint64_t)ftell(fp), ar.file_size);
+
+	rewind(fp);
+	TEST_EQ(fread(buf, 8, 1, fp), 1);
+	TEST_MEMEQ(buf, ARROW_MAGIC "\0\0", 8);
+
+	fseek(fp, -6, SEEK_END);
+	TEST_EQ(fread(buf, 6, 1, fp), 1);
+	TEST_MEMEQ(buf, ARROW_MAGIC, 6);
+
+	fclose(fp);
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
@@ -0,0 +1,75 @@
+#ifndef UFTRACE_ARROW_H
+#define UFTRACE_ARROW_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils/rbtree.h"
+
+/* number of rows in a record batch */
+#define ARROW_BATCH_ROWS  (64 * 1024)
+
+struct arrow_buf {
+	unsigned char		*data;
+	size_t			len;
+	size_t			size;
+};
+
+/* a (nullable) string column */
+struct arrow_string {
+	struct arrow_buf	valid;
+	struct arrow_buf	offset;
+	struct arrow_buf	data;
+	unsigned		nr_null;
+};
+
+/* location of a message in the file (for the footer) */
+struct arrow_block {
+	uint64_t		offset;
+	uint32_t		meta_len;
+	uint64_t		body_len;
+};
+
+struct arrow_row {
+	int			tid;
+	int			depth;
+	uint64_t		time;
+	uint64_t		duration;
+	uint64_t		symbol;
+	const char		*name;
+	const char		*args;
+	const char		*retval;
+};
+
+struct uftrace_arrow {
+	FILE			*fp;
+	uint64_t		file_size;
+	bool			has_args;
+	bool			has_retval;
+	/* columns of the current record batch */
+	unsigned		nr_rows;
+	uint64_t		total_rows;
+	struct arrow_buf	tid;
+	struct arrow_buf	time;
+	struct arrow_buf	duration;
+	struct arrow_buf	depth;
+	struct arrow_buf	symbol;
+	struct arrow_buf	name;
+	struct arrow_string	args;
+	struct arrow_string	retval;
+	/* dictionary of function names */
+	struct rb_root		names;
+	struct arrow_string	dict;
+	unsigned		nr_names;
+	/* record batches written */
+	struct arrow_block	*blocks;
+	unsigned		nr_blocks;
+};
+
+void arrow_init(struct uftrace_arrow *ar, FILE *fp,
+		bool has_args, bool has_retval);
+void arrow_add_row(struct uftrace_arrow *ar, struct arrow_row *row);
+void arrow_finish(struct uftrace_arrow *ar);
+
+#endif /* UFTRACE_ARROW_H */
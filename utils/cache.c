@@ -0,0 +1,510 @@
+/*
+ * persistent cache of analysis results
+ *
+ * Analysis commands like report and graph read all the records in the
+ * data directory every time even if it's run with the same options.
+ * They can save the result in the cache directory and reuse it as long
+ * as the data files and the relevant options are not changed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT     "cache"
+#define PR_DOMAIN  DBG_UFTRACE
+
+#include "uftrace.h"
+#include "version.h"
+#include "utils/utils.h"
+#include "utils/symbol.h"
+#include "utils/cache.h"
+
+#define FNV_OFFSET_BASIS  0xcbf29ce484222325ULL
+#define FNV_PRIME         0x100000001b3ULL
+
+/**
+ * cache_hash - update a (FNV-1a) hash value with given data
+ * @hash: previous hash value
+ * @data: pointer to the data
+ * @len: length of the data
+ *
+ * This function returns the updated hash value.
+ */
+uint64_t cache_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/* NULL string is different from an empty string */
+uint64_t cache_hash_str(uint64_t hash, const char *str)
+{
+	if (str == NULL)
+		return cache_hash(hash, "", 1);
+
+	return cache_hash(hash, str, strlen(str) + 1);
+}
+
+#define cache_hash_val(hash, val)  cache_hash(hash, &(val), sizeof(val))
+
+static int cache_filter(const struct dirent *de)
+{
+	/* skip hidden files like ".channel" */
+	return de->d_name[0] != '.';
+}
+
+static int cache_sort(const struct dirent **a, const struct dirent **b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/* hash of the name, size and modification time of the data files */
+static int hash_data_files(const char *dirname, uint64_t *hash)
+{
+	struct dirent **list;
+	int nr_files;
+	int i;
+
+	nr_files = scandir(dirname, &list, cache_filter, cache_sort);
+	if (nr_files < 0)
+		return -1;
+
+	*hash = FNV_OFFSET_BASIS;
+
+	for (i = 0; i < nr_files; i++) {
+		char *pathname = NULL;
+		struct stat stbuf;
+
+		xasprintf(&pathname, "%s/%s", dirname, list[i]->d_name);
+
+		if (stat(pathname, &stbuf) == 0 && S_ISREG(stbuf.st_mode)) {
+			*hash = cache_hash_str(*hash, list[i]->d_name);
+			*hash = cache_hash_val(*hash, stbuf.st_ino);
+			*hash = cache_hash_val(*hash, stbuf.st_size);
+			*hash = cache_hash_val(*hash, stbuf.st_mtim.tv_sec);
+			*hash = cache_hash_val(*hash, stbuf.st_mtim.tv_nsec);
+		}
+
+		free(pathname);
+		free(list[i]);
+	}
+	free(list);
+
+	return 0;
+}
+
+/* hash of the options which affect reading records */
+static uint64_t hash_opts(uint64_t hash, struct opts *opts)
+{
+	hash = cache_hash_str(hash, opts->filter);
+	hash = cache_hash_str(hash, opts->trigger);
+	hash = cache_hash_str(hash, opts->caller);
+	hash = cache_hash_str(hash, opts->tid);
+	hash = cache_hash_str(hash, opts->event);
+
+	hash = cache_hash_val(hash, opts->depth);
+	hash = cache_hash_val(hash, opts->kernel_depth);
+	hash = cache_hash_val(hash, opts->max_stack);
+	hash = cache_hash_val(hash, opts->threshold);
+	hash = cache_hash_val(hash, opts->libcall);
+	hash = cache_hash_val(hash, opts->nest_libcall);
+	hash = cache_hash_val(hash, opts->kernel);
+	hash = cache_hash_val(hash, opts->kernel_skip_out);
+	hash = cache_hash_val(hash, opts->kernel_only);
+	hash = cache_hash_val(hash, opts->event_skip_out);
+	hash = cache_hash_val(hash, opts->no_event);
+	hash = cache_hash_val(hash, opts->disabled);
+	hash = cache_hash_val(hash, opts->patt_type);
+
+	hash = cache_hash_val(hash, opts->range.start);
+	hash = cache_hash_val(hash, opts->range.stop);
+	hash = cache_hash_val(hash, opts->range.start_elapsed);
+	hash = cache_hash_val(hash, opts->range.stop_elapsed);
+
+	/* symbol names */
+	hash = cache_hash_val(hash, demangler);
+
+	return hash;
+}
+
+/* remove all entries in the cache directory */
+static void clear_cache_dir(const char *dirname)
+{
+	struct dirent **list;
+	int nr_files;
+	int i;
+
+	nr_files = scandir(dirname, &list, cache_filter, NULL);
+	if (nr_files < 0)
+		return;
+
+	for (i = 0; i < nr_files; i++) {
+		char *pathname = NULL;
+
+		xasprintf(&pathname, "%s/%s", dirname, list[i]->d_name);
+		if (unlink(pathname) < 0)
+			pr_dbg("cannot remove %s: %m\n", pathname);
+
+		free(pathname);
+		free(list[i]);
+	}
+	free(list);
+}
+
+/* check the stamp file and remove stale entries if data was changed */
+static int check_cache_stamp(const char *dirname, uint64_t data_hash)
+{
+	char *stamp = NULL;
+	char *tmpname = NULL;
+	uint64_t old_hash;
+	FILE *fp;
+	int fd;
+	int ret = -1;
+
+	xasprintf(&stamp, "%s/%s", dirname, UFTRACE_CACHE_STAMP);
+
+	fp = fopen(stamp, "r");
+	if (fp) {
+		int n = fscanf(fp, "%"SCNx64, &old_hash);
+
+		fclose(fp);
+		if (n == 1 && old_hash == data_hash) {
+			ret = 0;
+			goto out;
+		}
+	}
+
+	pr_dbg("data was changed, clear the cache\n");
+	clear_cache_dir(dirname);
+
+	xasprintf(&tmpname, "%s/.%s.XXXXXX", dirname, UFTRACE_CACHE_STAMP);
+	fd = mkstemp(tmpname);
+	if (fd < 0)
+		goto out;
+
+	fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		close(fd);
+		unlink(tmpname);
+		goto out;
+	}
+
+	fprintf(fp, "%016"PRIx64"\n", data_hash);
+	if (fclose(fp) == 0 && rename(tmpname, stamp) == 0)
+		ret = 0;
+	else
+		unlink(tmpname);
+
+out:
+	free(tmpname);
+	free(stamp);
+	return ret;
+}
+
+/**
+ * cache_init - setup a cache entry for the given analysis
+ * @cache: cache entry to setup
+ * @opts: uftrace options (with the data directory)
+ * @name: name of the analysis (e.g. "report")
+ * @extra: additional string to identify the result (can be %NULL)
+ *
+ * This function finds the key of the cache entry using the data files
+ * and the options.  Stale entries are removed if the data was changed.
+ * It returns 0 on success, -1 if the cache cannot be used.  Callers
+ * should not use the other cache functions after failure, and should
+ * call cache_finish() after using the entry.
+ */
+int cache_init(struct uftrace_cache *cache, struct opts *opts,
+	       const char *name, const char *extra)
+{
+	char *dirname = NULL;
+	struct stat stbuf;
+	uint64_t data_hash;
+	uint64_t key;
+	int ret = -1;
+
+	memset(cache, 0, sizeof(*cache));
+
+	if (opts->no_cache)
+		return -1;
+
+	/* pack files cannot have the cache directory */
+	if (stat(opts->dirname, &stbuf) < 0 || !S_ISDIR(stbuf.st_mode))
+		return -1;
+
+	if (hash_data_files(opts->dirname, &data_hash) < 0)
+		return -1;
+
+	xasprintf(&dirname, "%s/%s", opts->dirname, UFTRACE_CACHE_DIR);
+	if (mkdir(dirname, 0755) < 0 && errno != EEXIST) {
+		pr_dbg("cannot create cache directory: %m\n");
+		goto out;
+	}
+
+	if (check_cache_stamp(dirname, data_hash) < 0) {
+		pr_dbg("cannot update cache stamp: %m\n");
+		goto out;
+	}
+
+	key = cache_hash_val(data_hash, (int){ UFTRACE_CACHE_VERSION });
+	key = cache_hash_str(key, UFTRACE_VERSION);
+	key = cache_hash_str(key, name);
+	key = cache_hash_str(key, extra);
+	key = hash_opts(key, opts);
+
+	cache->key = key;
+	xasprintf(&cache->filename, "%s/%s-%016"PRIx64, dirname, name, key);
+	ret = 0;
+
+out:
+	free(dirname);
+	return ret;
+}
+
+/**
+ * cache_read - open the cache entry to read
+ * @cache: cache entry
+ *
+ * This function returns a file pointer to read the saved result,
+ * or %NULL if there's no (valid) entry.  The file pointer should be
+ * closed by cache_close().
+ */
+FILE *cache_read(struct uftrace_cache *cache)
+{
+	struct uftrace_cache_header hdr;
+	struct stat stbuf;
+	FILE *fp;
+
+	fp = fopen(cache->filename, "rb");
+	if (fp == NULL)
+		return NULL;
+
+	/* also check the size in case it was truncated */
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    strncmp(hdr.magic, UFTRACE_CACHE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != UFTRACE_CACHE_VERSION || hdr.key != cache->key ||
+	    fstat(fileno(fp), &stbuf) < 0 ||
+	    (uint64_t)stbuf.st_size != sizeof(hdr) + hdr.size) {
+		pr_dbg("invalid cache entry: %s\n", cache->filename);
+		fclose(fp);
+		return NULL;
+	}
+
+	pr_dbg("use cache entry: %s\n", cache->filename);
+	cache->fp = fp;
+	return fp;
+}
+
+/**
+ * cache_write - create a new cache entry to write
+ * @cache: cache entry
+ *
+ * This function returns a file pointer to write the result, or %NULL
+ * if it failed.  The data is written to a temporary file and it will
+ * be renamed to the actual entry by cache_close().
+ */
+FILE *cache_write(struct uftrace_cache *cache)
+{
+	struct uftrace_cache_header hdr = {
+		.magic   = UFTRACE_CACHE_MAGIC,
+		.version = UFTRACE_CACHE_VERSION,
+		.key     = cache->key,
+	};
+	FILE *fp;
+	int fd;
+
+	xasprintf(&cache->tmpname, "%s.XXXXXX", cache->filename);
+
+	fd = mkstemp(cache->tmpname);
+	if (fd < 0) {
+		pr_dbg("cannot create cache entry: %m\n");
+		goto err;
+	}
+
+	fp = fdopen(fd, "wb");
+	if (fp == NULL) {
+		close(fd);
+		unlink(cache->tmpname);
+		goto err;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+		fclose(fp);
+		unlink(cache->tmpname);
+		goto err;
+	}
+
+	cache->fp = fp;
+	return fp;
+
+err:
+	free(cache->tmpname);
+	cache->tmpname = NULL;
+	return NULL;
+}
+
+/**
+ * cache_close - close the cache entry opened by cache_read/write()
+ * @cache: cache entry
+ * @success: whether the result was written (or read) successfully
+ *
+ * If the entry was opened by cache_write(), it's saved only when
+ * @success is %true.  An entry failed to read is removed so that it
+ * can be written again.
+ */
+void cache_close(struct uftrace_cache *cache, bool success)
+{
+	if (cache->fp == NULL)
+		return;
+
+	/* update the data size in the header */
+	if (cache->tmpname && success) {
+		uint64_t size = ftello(cache->fp) - sizeof(struct uftrace_cache_header);
+
+		if (fseeko(cache->fp, offsetof(struct uftrace_cache_header, size),
+			   SEEK_SET) < 0 ||
+		    fwrite(&size, sizeof(size), 1, cache->fp) != 1)
+			success = false;
+	}
+
+	if (fclose(cache->fp) < 0)
+		success = false;
+	cache->fp = NULL;
+
+	if (cache->tmpname) {
+		if (success && rename(cache->tmpname, cache->filename) == 0)
+			pr_dbg("save cache entry: %s\n", cache->filename);
+		else
+			unlink(cache->tmpname);
+
+		free(cache->tmpname);
+		cache->tmpname = NULL;
+	}
+	else if (!success) {
+		unlink(cache->filename);
+	}
+}
+
+/**
+ * cache_finish - release resources of the cache entry
+ * @cache: cache entry
+ */
+void cache_finish(struct uftrace_cache *cache)
+{
+	cache_close(cache, false);
+
+	free(cache->filename);
+	cache->filename = NULL;
+}
+
+#ifdef UNIT_TEST
+
+#define CACHE_TEST_DIR  "cache-test.dir"
+
+static void write_test_file(const char *name, const char *data)
+{
+	char *pathname = NULL;
+	FILE *fp;
+
+	xasprintf(&pathname, "%s/%s", CACHE_TEST_DIR, name);
+	fp = fopen(pathname, "w");
+	if (fp) {
+		fputs(data, fp);
+		fclose(fp);
+	}
+	free(pathname);
+}
+
+TEST_CASE(cache_hash)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	TEST_EQ(cache_hash(hash, "", 0), FNV_OFFSET_BASIS);
+	/* known value of FNV-1a 64-bit hash */
+	TEST_EQ(cache_hash(hash, "a", 1), 0xaf63dc4c8601ec8cULL);
+
+	TEST_NE(cache_hash_str(hash, NULL), cache_hash_str(hash, "a"));
+	TEST_NE(cache_hash_str(hash, NULL), hash);
+	TEST_NE(cache_hash_str(cache_hash_str(hash, "ab"), "c"),
+		cache_hash_str(cache_hash_str(hash, "a"), "bc"));
+
+	return TEST_OK;
+}
+
+TEST_CASE(cache_entry)
+{
+	struct opts opts = {
+		.dirname = CACHE_TEST_DIR,
+		.depth   = OPT_DEPTH_DEFAULT,
+	};
+	struct uftrace_cache cache;
+	char buf[64];
+	FILE *fp;
+
+	mkdir(CACHE_TEST_DIR, 0755);
+	write_test_file("info", "uftrace info");
+	write_test_file("1234.dat", "task data");
+
+	pr_dbg("cache miss for the first time\n");
+	TEST_EQ(cache_init(&cache, &opts, "test", NULL), 0);
+	TEST_EQ(cache_read(&cache), NULL);
+
+	fp = cache_write(&cache);
+	TEST_NE(fp, NULL);
+	fputs("cached result", fp);
+	cache_close(&cache, true);
+	cache_finish(&cache);
+
+	pr_dbg("cache hit with the same options\n");
+	TEST_EQ(cache_init(&cache, &opts, "test", NULL), 0);
+	fp = cache_read(&cache);
+	TEST_NE(fp, NULL);
+	TEST_NE(fgets(buf, sizeof(buf), fp), NULL);
+	TEST_STREQ(buf, "cached result");
+	cache_close(&cache, true);
+	cache_finish(&cache);
+
+	pr_dbg("cache miss if the entry was truncated\n");
+	TEST_EQ(cache_init(&cache, &opts, "test", NULL), 0);
+	TEST_EQ(truncate(cache.filename, sizeof(struct uftrace_cache_header) + 6), 0);
+	TEST_EQ(cache_read(&cache), NULL);
+	cache_finish(&cache);
+
+	pr_dbg("cache miss with different options\n");
+	TEST_EQ(cache_init(&cache, &opts, "test", "extra"), 0);
+	TEST_EQ(cache_read(&cache), NULL);
+	cache_finish(&cache);
+
+	opts.depth = 2;
+	TEST_EQ(cache_init(&cache, &opts, "test", NULL), 0);
+	TEST_EQ(cache_read(&cache), NULL);
+	cache_finish(&cache);
+	opts.depth = OPT_DEPTH_DEFAULT;
+
+	pr_dbg("cache miss after data was changed\n");
+	write_test_file("1234.dat", "new task data");
+	TEST_EQ(cache_init(&cache, &opts, "test", NULL), 0);
+	TEST_EQ(cache_read(&cache), NULL);
+	cache_finish(&cache);
+
+	pr_dbg("cache is not used if disabled\n");
+	opts.no_cache = true;
+	TEST_LT(cache_init(&cache, &opts, "test", NULL), 0);
+
+	remove_directory(CACHE_TEST_DIR);
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
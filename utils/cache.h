@@ -0,0 +1,47 @@
+#ifndef UFTRACE_CACHE_H
+#define UFTRACE_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+struct opts;
+
+#define UFTRACE_CACHE_DIR      "cache"
+#define UFTRACE_CACHE_STAMP    "stamp"
+#define UFTRACE_CACHE_MAGIC    "uftrace-cache"
+#define UFTRACE_CACHE_VERSION  1
+
+/*
+ * Results of analysis commands can be saved in the "cache" subdirectory
+ * of the data directory to be reused later.  Each entry is a file named
+ * "<name>-<key>" where the key is a hash of the data files and options
+ * which affect the result.  The "stamp" file has the hash of the data
+ * files and all entries are removed when it doesn't match.
+ */
+struct uftrace_cache_header {
+	char			magic[16];
+	uint32_t		version;
+	uint32_t		unused;
+	uint64_t		key;
+	uint64_t		size;  /* size of data after the header */
+};
+
+struct uftrace_cache {
+	char			*filename;
+	char			*tmpname;
+	uint64_t		key;
+	FILE			*fp;
+};
+
+uint64_t cache_hash(uint64_t hash, const void *data, size_t len);
+uint64_t cache_hash_str(uint64_t hash, const char *str);
+
+int cache_init(struct uftrace_cache *cache, struct opts *opts,
+	       const char *name, const char *extra);
+FILE *cache_read(struct uftrace_cache *cache);
+FILE *cache_write(struct uftrace_cache *cache);
+void cache_close(struct uftrace_cache *cache, bool success);
+void cache_finish(struct uftrace_cache *cache);
+
+#endif /* UFTRACE_CACHE_H */
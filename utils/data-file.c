@@ -6,7 +6,6 @@
 #include <errno.h>
 #include <assert.h>
 #include <byteswap.h>
-#include <glob.h>
 #include <sys/stat.h>
 
 #include "uftrace.h"
@@ -16,6 +15,7 @@
 #include "utils/symbol.h"
 #include "utils/kernel.h"
 #include "utils/perf.h"
+#include "utils/pack.h"
 #include "libmcount/mcount.h"
 
 
@@ -37,7 +37,7 @@
 int read_task_file(struct uftrace_session_link *sess, char *dirname,
 		   bool needs_symtab, bool sym_rel_addr, bool needs_srcline)
 {
-	int fd;
+	FILE *fp;
 	char pad[8];
 	char buf[1024];
 	struct uftrace_msg msg;
@@ -46,23 +46,23 @@ int read_task_file(struct uftrace_session_link *sess, char *dirname,
 	int ret = -1;
 
 	snprintf(buf, sizeof(buf), "%s/task", dirname);
-	fd = open(buf, O_RDONLY);
-	if (fd < 0)
+	fp = pack_fopen(buf, "rb");
+	if (fp == NULL)
 		return -1;
 
 	pr_dbg("reading task file\n");
-	while (read_all(fd, &msg, sizeof(msg)) == 0) {
+	while (fread_all(&msg, sizeof(msg), fp) == 0) {
 		if (msg.magic != UFTRACE_MSG_MAGIC)
 			goto out;
 
 		switch (msg.type) {
 		case UFTRACE_MSG_SESSION:
-			if (read_all(fd, &smsg, sizeof(smsg)) < 0)
+			if (fread_all(&smsg, sizeof(smsg), fp) < 0)
 				goto out;
-			if (read_all(fd, buf, smsg.namelen) < 0)
+			if (fread_all(buf, smsg.namelen, fp) < 0)
 				goto out;
 			if (smsg.namelen % 8 &&
-			    read_all(fd, pad, 8 - (smsg.namelen % 8)) < 0)
+			    fread_all(pad, 8 - (smsg.namelen % 8), fp) < 0)
 				goto out;
 
 			create_session(sess, &smsg, dirname, buf,
@@ -71,14 +71,14 @@ int read_task_file(struct uftrace_session_link *sess, char *dirname,
 			break;
 
 		case UFTRACE_MSG_TASK_START:
-			if (read_all(fd, &tmsg, sizeof(tmsg)) < 0)
+			if (fread_all(&tmsg, sizeof(tmsg), fp) < 0)
 				goto out;
 
 			create_task(sess, &tmsg, false);
 			break;
 
 		case UFTRACE_MSG_FORK_END:
-			if (read_all(fd, &tmsg, sizeof(tmsg)) < 0)
+			if (fread_all(&tmsg, sizeof(tmsg), fp) < 0)
 				goto out;
 
 			create_task(sess, &tmsg, true);
@@ -92,7 +92,7 @@ int read_task_file(struct uftrace_session_link *sess, char *dirname,
 	ret = 0;
 
 out:
-	close(fd);
+	fclose(fp);
 	return ret;
 }
 
@@ -126,7 +126,7 @@ int read_task_txt_file(struct uftrace_session_link *sess, char *dirname,
 
 	xasprintf(&fname, "%s/%s", dirname, "task.txt");
 
-	fp = fopen(fname, "r");
+	fp = pack_fopen(fname, "r");
 	if (fp == NULL) {
 		free(fname);
 		return -errno;
@@ -238,7 +238,7 @@ int read_events_file(struct uftrace_data *handle)
 
 	xasprintf(&fname, "%s/%s", handle->dirname, "events.txt");
 
-	fp = fopen(fname, "r");
+	fp = pack_fopen(fname, "r");
 	if (fp == NULL) {
 		/* it might hit no events, so no file is ok */
 		if (errno == ENOENT)
@@ -384,25 +384,24 @@ static void check_data_order(struct uftrace_data *handle)
 static bool check_data_file(struct uftrace_data *handle,
 			    const char *pattern)
 {
-	glob_t g;
-	size_t i;
+	char **paths;
+	int i, count;
 	bool found = false;
 
-	if (glob(pattern, 0, NULL, &g) == GLOB_ERR) {
-		pr_dbg("glob matching failed: %s: %m\n", pattern);
+	count = pack_glob(pattern, &paths);
+	if (count < 0)
 		return false;
-	}
 
-	for (i = 0; i < g.gl_pathc; i++) {
+	for (i = 0; i < count; i++) {
 		struct stat stbuf;
 
-		if (stat(g.gl_pathv[i], &stbuf) == 0 && stbuf.st_size) {
+		if (pack_stat(paths[i], &stbuf) == 0 && stbuf.st_size) {
 			found = true;
 			break;
 		}
 	}
 
-	globfree(&g);
+	pack_globfree(paths, count);
 	return found;
 }
 
@@ -422,7 +421,7 @@ int open_info_file(struct opts *opts, struct uftrace_data *handle)
 
 	snprintf(buf, sizeof(buf), "%s/info", opts->dirname);
 
-	fp = fopen(buf, "rb");
+	fp = pack_fopen(buf, "rb");
 	if (fp != NULL)
 		goto ok;
 
@@ -672,3 +671,179 @@ void close_data_file(struct opts *opts, struct uftrace_data *handle)
 	clear_uftrace_info(&handle->info);
 	reset_task_handle(handle);
 }
+
+/* find the oldest traced ancestor so that forked tasks stay together */
+static int task_family(struct uftrace_data *handle, struct uftrace_task *t)
+{
+	struct uftrace_session_link *sessions = &handle->sessions;
+	struct uftrace_task *parent;
+	int max_depth = handle->nr_tasks;
+	int i;
+
+	/* threads are independent unless the process has a child */
+	if (t->pid != t->tid) {
+		parent = find_task(sessions, t->pid);
+		if (parent == NULL)
+			return t->tid;
+
+		for (i = 0; i < handle->nr_tasks; i++) {
+			struct uftrace_task *child = handle->tasks[i].t;
+
+			if (child && child->ppid == parent->pid)
+				break;
+		}
+		if (i == handle->nr_tasks)
+			return t->tid;
+
+		t = parent;
+	}
+
+	while (t->ppid && max_depth-- > 0) {
+		parent = find_task(sessions, t->ppid);
+		if (parent == NULL || parent == t)
+			break;
+
+		t = parent;
+	}
+
+	return t->tid;
+}
+
+/**
+ * assign_worker_tasks - distribute tasks to worker processes
+ * @handle: handle for uftrace data
+ * @nr_workers: number of worker processes
+ * @by_family: keep forked tasks with their parent
+ *
+ * This function assigns each task in @handle to one of @nr_workers
+ * workers so that the size of data files is balanced.  Larger task is
+ * assigned first to the least loaded worker.  When @by_family is
+ * %true, a forked task is assigned to the same worker as the parent
+ * (including the threads of the parent).
+ *
+ * It returns an array of worker index for each task.
+ */
+int *assign_worker_tasks(struct uftrace_data *handle, int nr_workers,
+			 bool by_family)
+{
+	int *worker = xcalloc(handle->nr_tasks, sizeof(*worker));
+	int *group = xcalloc(handle->nr_tasks, sizeof(*group));
+	int *family = xcalloc(handle->nr_tasks, sizeof(*family));
+	uint64_t *load = xcalloc(nr_workers, sizeof(*load));
+	uint64_t *size = xcalloc(handle->nr_tasks, sizeof(*size));
+	bool *done = xcalloc(handle->nr_tasks, sizeof(*done));
+	char *filename = NULL;
+	struct stat stbuf;
+	int i, k;
+
+	for (i = 0; i < handle->nr_tasks; i++) {
+		struct uftrace_task_reader *task = &handle->tasks[i];
+
+		xasprintf(&filename, "%s/%d.dat", handle->dirname, task->tid);
+		if (pack_stat(filename, &stbuf) == 0)
+			size[i] = stbuf.st_size;
+		free(filename);
+
+		group[i] = i;
+		if (!by_family || task->t == NULL)
+			continue;
+
+		family[i] = task_family(handle, task->t);
+
+		/* account the size to the first task in the group */
+		for (k = 0; k < i; k++) {
+			if (family[k] == family[i]) {
+				group[i] = group[k];
+				size[group[k]] += size[i];
+				size[i] = 0;
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < handle->nr_tasks; i++) {
+		int max = -1;
+		int min = 0;
+
+		for (k = 0; k < handle->nr_tasks; k++) {
+			if (group[k] != k || done[k])
+				continue;
+			if (max < 0 || size[k] > size[max])
+				max = k;
+		}
+		if (max < 0)
+			break;
+
+		for (k = 1; k < nr_workers; k++) {
+			if (load[k] < load[min])
+				min = k;
+		}
+
+		worker[max] = min;
+		load[min] += size[max];
+		done[max] = true;
+	}
+
+	for (i = 0; i < handle->nr_tasks; i++)
+		worker[i] = worker[group[i]];
+
+	free(done);
+	free(size);
+	free(load);
+	free(family);
+	free(group);
+	return worker;
+}
+
+/**
+ * open_worker_data - open data file in a worker process
+ * @opts: uftrace user options
+ * @handle: handle for uftrace data (to be opened)
+ * @parent: data handle of the parent process
+ * @assign: worker index of each task returned by assign_worker_tasks()
+ * @idx: index of the current worker
+ *
+ * This function opens the data file again in a forked worker since the
+ * file offsets are shared with the parent (and other workers) after
+ * fork.  User records of tasks not assigned to @idx will not be read,
+ * but kernel and perf data might still have records of other tasks.
+ *
+ * It returns an array which has %true for tasks of the worker (indexed
+ * same as @handle->tasks), or %NULL on error.
+ */
+bool *open_worker_data(struct opts *opts, struct uftrace_data *handle,
+		       struct uftrace_data *parent, int *assign, int idx)
+{
+	bool *tasks;
+	int i, k;
+
+	if (open_data_file(opts, handle) < 0)
+		return NULL;
+
+	fstack_setup_filters(opts, handle);
+
+	tasks = xcalloc(handle->nr_tasks, sizeof(*tasks));
+
+	for (i = 0; i < handle->nr_tasks; i++) {
+		struct uftrace_task_reader *task = &handle->tasks[i];
+
+		for (k = 0; k < parent->nr_tasks; k++) {
+			if (parent->tasks[k].tid == task->tid)
+				break;
+		}
+
+		if (k < parent->nr_tasks && assign[k] == idx) {
+			tasks[i] = true;
+			continue;
+		}
+
+		/* do not read user records of other tasks */
+		task->done = true;
+		if (task->fp) {
+			fclose(task->fp);
+			task->fp = NULL;
+		}
+	}
+
+	return tasks;
+}
@@ -235,91 +235,168 @@ void __pr_color(char code, const char *fmt, ...)
 	color(TERM_COLOR_RESET, outfp);
 }
 
-static void __print_time_unit(int64_t delta_nsec, bool needs_sign)
+/* return the escape sequence of the color for the output (if enabled) */
+const char *out_color_str(char code)
 {
-	uint64_t delta = llabs(delta_nsec);
-	uint64_t delta_small = 0;
-	char *units[] = { "us", "ms", " s", " m", " h", };
-	char *color_units[] = {
+	size_t i;
+
+	if (out_color != COLOR_ON)
+		return "";
+
+	for (i = 0; i < ARRAY_SIZE(colors); i++) {
+		if (code == colors[i].code)
+			return colors[i].color;
+	}
+	return TERM_COLOR_NORMAL;
+}
+
+/* split time into a 3-digit integer and fraction parts with its unit */
+static const char *split_time_unit(uint64_t delta_nsec, uint64_t *delta,
+				   uint64_t *delta_small, bool color)
+{
+	const char *units[] = { "us", "ms", " s", " m", " h", };
+	const char *color_units[] = {
 		TERM_COLOR_NORMAL "us" TERM_COLOR_RESET,
 		TERM_COLOR_GREEN  "ms" TERM_COLOR_RESET,
 		TERM_COLOR_YELLOW " s" TERM_COLOR_RESET,
 		TERM_COLOR_RED    " m" TERM_COLOR_RESET,
 		TERM_COLOR_RED    " h" TERM_COLOR_RESET,
 	};
-	char *unit;
 	unsigned limit[] = { 1000, 1000, 1000, 60, 24, INT_MAX, };
 	unsigned idx;
 
-	if (delta_nsec == 0UL) {
-		if (needs_sign)
-			pr_out(" ");
-		pr_out("%7s %2s", "", "");
-		return;
-	}
+	*delta = delta_nsec;
+	*delta_small = 0;
 
 	for (idx = 0; idx < ARRAY_SIZE(units); idx++) {
-		delta_small = delta % limit[idx];
-		delta = delta / limit[idx];
+		*delta_small = *delta % limit[idx];
+		*delta = *delta / limit[idx];
 
-		if (delta < limit[idx+1])
+		if (*delta < limit[idx+1])
 			break;
 	}
 
 	assert(idx < ARRAY_SIZE(units));
 
 	/* for some error cases */
-	if (delta > 999)
-		delta = delta_small = 999;
+	if (*delta > 999)
+		*delta = *delta_small = 999;
 
-	if (out_color == COLOR_ON)
-		unit = color_units[idx];
+	if (color)
+		return color_units[idx];
 	else
-		unit = units[idx];
-
-	if (needs_sign) {
-		const char *signs[] = { "+", "-" };
-		const char *color_signs[] = {
-			TERM_COLOR_RED     "+",
-			TERM_COLOR_MAGENTA "+",
-			TERM_COLOR_NORMAL  "+",
-			TERM_COLOR_BLUE    "-",
-			TERM_COLOR_CYAN    "-",
-			TERM_COLOR_NORMAL  "-",
-		};
-		int sign_idx = (delta_nsec > 0);
-		int indent = (delta >= 100) ? 0 : (delta >= 10) ? 1 : 2;
-		const char *sign = signs[sign_idx];
-		const char *ends = TERM_COLOR_NORMAL;
-
-		if (out_color == COLOR_ON) {
-			if (delta_nsec >= 100000)
-				sign_idx = 0;
-			else if (delta_nsec >= 5000)
-				sign_idx = 1;
-			else if (delta_nsec > 0)
-				sign_idx = 2;
-			else if (delta_nsec <= -100000)
-				sign_idx = 3;
-			else if (delta_nsec <= -5000)
-				sign_idx = 4;
-			else
-				sign_idx = 5;
-
-			sign = color_signs[sign_idx];
-			ends = TERM_COLOR_RESET;
-		}
+		return units[idx];
+}
+
+static int __format_time_unit(char *buf, uint64_t delta_nsec, bool color)
+{
+	uint64_t delta, delta_small;
+	const char *unit;
+	char *p = buf;
 
-		pr_out("%*s%s%"PRId64".%03"PRIu64"%s %s", indent, "",
-		       sign, delta, delta_small, ends, unit);
+	if (delta_nsec == 0UL) {
+		memset(buf, ' ', 10);
+		return 10;
 	}
-	else
-		pr_out("%3"PRIu64".%03"PRIu64" %s", delta, delta_small, unit);
+
+	unit = split_time_unit(delta_nsec, &delta, &delta_small, color);
+
+	/* same as "%3"PRIu64".%03"PRIu64" %s" */
+	*p++ = delta >= 100 ? '0' + delta / 100 : ' ';
+	*p++ = delta >= 10 ? '0' + delta / 10 % 10 : ' ';
+	*p++ = '0' + delta % 10;
+	*p++ = '.';
+	*p++ = '0' + delta_small / 100;
+	*p++ = '0' + delta_small / 10 % 10;
+	*p++ = '0' + delta_small % 10;
+	*p++ = ' ';
+
+	while (*unit)
+		*p++ = *unit++;
+
+	return p - buf;
+}
+
+/**
+ * format_time_unit - format time like print_time_unit() into a buffer
+ * @buf: buffer to save the result (at least TIME_UNIT_BUFSIZE)
+ * @delta_nsec: time to format
+ *
+ * This is for hot paths which don't want to use printf.  It returns
+ * the length of the result which is not NUL-terminated.
+ */
+int format_time_unit(char *buf, uint64_t delta_nsec)
+{
+	return __format_time_unit(buf, delta_nsec, out_color == COLOR_ON);
+}
+
+/* same as format_time_unit() but never uses color (e.g. for files) */
+int format_time_unit_plain(char *buf, uint64_t delta_nsec)
+{
+	return __format_time_unit(buf, delta_nsec, false);
+}
+
+static void __print_time_unit(int64_t delta_nsec, bool needs_sign)
+{
+	uint64_t delta, delta_small;
+	const char *unit;
+	const char *signs[] = { "+", "-" };
+	const char *color_signs[] = {
+		TERM_COLOR_RED     "+",
+		TERM_COLOR_MAGENTA "+",
+		TERM_COLOR_NORMAL  "+",
+		TERM_COLOR_BLUE    "-",
+		TERM_COLOR_CYAN    "-",
+		TERM_COLOR_NORMAL  "-",
+	};
+	int sign_idx = (delta_nsec > 0);
+	const char *sign = signs[sign_idx];
+	const char *ends = TERM_COLOR_NORMAL;
+	int indent;
+
+	if (!needs_sign) {
+		print_time_unit(llabs(delta_nsec));
+		return;
+	}
+
+	if (delta_nsec == 0UL) {
+		pr_out(" %7s %2s", "", "");
+		return;
+	}
+
+	unit = split_time_unit(llabs(delta_nsec), &delta, &delta_small,
+			       out_color == COLOR_ON);
+	indent = (delta >= 100) ? 0 : (delta >= 10) ? 1 : 2;
+
+	if (out_color == COLOR_ON) {
+		if (delta_nsec >= 100000)
+			sign_idx = 0;
+		else if (delta_nsec >= 5000)
+			sign_idx = 1;
+		else if (delta_nsec > 0)
+			sign_idx = 2;
+		else if (delta_nsec <= -100000)
+			sign_idx = 3;
+		else if (delta_nsec <= -5000)
+			sign_idx = 4;
+		else
+			sign_idx = 5;
+
+		sign = color_signs[sign_idx];
+		ends = TERM_COLOR_RESET;
+	}
+
+	pr_out("%*s%s%"PRId64".%03"PRIu64"%s %s", indent, "",
+	       sign, delta, delta_small, ends, unit);
 }
 
 void print_time_unit(uint64_t delta_nsec)
 {
-	__print_time_unit(delta_nsec, false);
+	char buf[TIME_UNIT_BUFSIZE];
+	int len;
+
+	len = format_time_unit(buf, delta_nsec);
+	fwrite(buf, 1, len, outfp);
 }
 
 void print_diff_percent(uint64_t base_nsec, uint64_t pair_nsec)
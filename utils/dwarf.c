@@ -16,6 +16,7 @@
 #include "utils/dwarf.h"
 #include "utils/symbol.h"
 #include "utils/filter.h"
+#include "utils/pack.h"
 
 bool debug_info_has_argspec(struct debug_info *dinfo)
 {
@@ -1335,7 +1336,7 @@ static int load_debug_file(struct debug_info *dinfo, struct symtab *symtab,
 
 	xasprintf(&pathname, "%s/%s.dbg", dirname, basename(filename));
 
-	fp = fopen(pathname, "r");
+	fp = pack_fopen(pathname, "r");
 	if (fp == NULL) {
 		if (errno == ENOENT) {
 			free(pathname);
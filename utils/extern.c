@@ -22,6 +22,7 @@
 #include "uftrace.h"
 #include "utils/utils.h"
 #include "utils/fstack.h"
+#include "utils/pack.h"
 
 #define DEFAULT_FILENAME  "extern.dat"
 
@@ -37,7 +38,7 @@ int setup_extern_data(struct uftrace_data *handle, struct opts *opts)
 	if (filename == NULL)
 		xasprintf(&filename, "%s/%s", opts->dirname, DEFAULT_FILENAME);
 
-	fp = fopen(filename, "r");
+	fp = pack_fopen(filename, "r");
 
 	if (opts->extern_data == NULL)
 		free(filename);
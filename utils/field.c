@@ -21,6 +21,20 @@ void print_header(struct list_head *output_fields, const char *prefix,
 	pr_out("   FUNCTION\n");
 }
 
+void print_single_field(struct display_field *field, struct field_data *fd)
+{
+	char buf[FIELD_BUFSIZE];
+	int len;
+
+	if (field->print) {
+		field->print(fd);
+		return;
+	}
+
+	len = field->format(fd, buf);
+	fwrite(buf, 1, len, outfp);
+}
+
 int print_field_data(struct list_head *output_fields, struct field_data *fd,
 		     int space)
 {
@@ -31,11 +45,39 @@ int print_field_data(struct list_head *output_fields, struct field_data *fd,
 
 	list_for_each_entry(field, output_fields, list) {
 		pr_out("%*s", space, "");
-		field->print(fd);
+		print_single_field(field, fd);
 	}
 	return 1;
 }
 
+/**
+ * format_field_data - write output fields to a buffer
+ * @output_fields: list of fields
+ * @fd: field data
+ * @space: number of spaces before each field
+ * @buf: buffer to write (should have FIELD_BUFSIZE + @space per field)
+ *
+ * This is same as print_field_data() but writes the fields to @buf
+ * without stdio.  It returns the length written or -1 if some of the
+ * fields don't support ->format.
+ */
+int format_field_data(struct list_head *output_fields, struct field_data *fd,
+		      int space, char *buf)
+{
+	struct display_field *field;
+	char *p = buf;
+
+	list_for_each_entry(field, output_fields, list) {
+		if (field->format == NULL)
+			return -1;
+
+		memset(p, ' ', space);
+		p += space;
+		p += field->format(fd, p);
+	}
+	return p - buf;
+}
+
 int print_empty_field(struct list_head *output_fields, int space)
 {
 	struct display_field *field;
@@ -28,6 +28,9 @@ enum display_field_id {
 	GRAPH_F_ADDR,
 };
 
+/* max length of a formatted field */
+#define FIELD_BUFSIZE  64
+
 struct display_field {
 	struct list_head list;
 	enum display_field_id id;
@@ -36,13 +39,18 @@ struct display_field {
 	int length;
 	bool used;
 	void (*print)(struct field_data *fd);
+	/* alternative to print: write to @buf and return the length */
+	int (*format)(struct field_data *fd, char *buf);
 	const char *alias;
 };
 
 void print_header(struct list_head *output_fields, const char *prefix,
 		  int space);
+void print_single_field(struct display_field *field, struct field_data *fd);
 int print_field_data(struct list_head *output_fields, struct field_data *fd,
 		     int space);
+int format_field_data(struct list_head *output_fields, struct field_data *fd,
+		      int space, char *buf);
 int print_empty_field(struct list_head *output_fields, int space);
 void add_field(struct list_head *output_fields, struct display_field *field);
 void setup_field(struct list_head *output_fields, struct opts *opts,
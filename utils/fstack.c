@@ -16,6 +16,7 @@
 #include "utils/rbtree.h"
 #include "utils/kernel.h"
 #include "utils/arch.h"
+#include "utils/pack.h"
 #include "libmcount/mcount.h"
 
 
@@ -107,7 +108,7 @@ static void prepare_task_handle(struct uftrace_data *handle,
 	task->t = find_task(&handle->sessions, tid);
 
 	xasprintf(&filename, "%s/%d.dat", handle->dirname, tid);
-	task->fp = fopen(filename, "rb");
+	task->fp = pack_fopen(filename, "rb");
 	if (task->fp == NULL) {
 		pr_dbg("cannot open task data file: %s: %m\n", filename);
 		task->done = true;
@@ -322,6 +323,28 @@ static const char *fixup_syms[] = {
 static int setjmp_depth;
 static int setjmp_count;
 
+/**
+ * fstack_is_stack_fixup - check if the function changes the stack count
+ * @name: symbol name
+ *
+ * The fixup functions except fork ones reset the stack count in
+ * fstack_update() so the function stack doesn't follow the depth of
+ * the records after them.
+ */
+bool fstack_is_stack_fixup(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(fixup_syms); i++) {
+		if (strcmp(name, fixup_syms[i]))
+			continue;
+
+		/* fork only changes the display depth */
+		return strstr(name, "fork") == NULL && strcmp(name, "daemon");
+	}
+	return false;
+}
+
 static int build_fixup_filter(struct uftrace_session *s, void *arg)
 {
 	size_t i;
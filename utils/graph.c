@@ -10,6 +10,364 @@ static void *cb_arg;
 
 static struct rb_root task_graph_root = RB_ROOT;
 
+/* use a hash table to find a child if it has more than this */
+#define GRAPH_HASH_MIN  8
+
+#define GRAPH_CHUNK_SIZE  (64 * 1024)
+
+struct graph_hash_entry {
+	uint64_t			addr;
+	struct uftrace_graph_node	*node;
+};
+
+struct graph_hash {
+	unsigned			size;  /* power of 2 */
+	unsigned			nr;
+	struct graph_hash_entry		entries[];
+};
+
+struct graph_chunk {
+	struct graph_chunk		*next;
+	size_t				used;
+	size_t				size;
+	char				data[];
+};
+
+/* nodes and names are freed at once, no need to free them individually */
+static void *graph_alloc(struct uftrace_graph *graph, size_t size)
+{
+	struct graph_chunk *chunk = graph->arena;
+	void *ptr;
+
+	size = ALIGN(size, sizeof(long));
+
+	if (chunk == NULL || chunk->used + size > chunk->size) {
+		size_t chunk_size = GRAPH_CHUNK_SIZE;
+
+		if (size > chunk_size - sizeof(*chunk))
+			chunk_size = size + sizeof(*chunk);
+
+		chunk = xzalloc(chunk_size);
+		chunk->size = chunk_size - sizeof(*chunk);
+		chunk->next = graph->arena;
+		graph->arena = chunk;
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+
+struct graph_name {
+	struct rb_node			link;
+	/* nodes of the function in the order of creation */
+	struct uftrace_graph_node	*first;
+	struct uftrace_graph_node	*last;
+	/* whether it contains graph->search */
+	bool				matched;
+	char				name[];
+};
+
+static inline struct graph_name *node_name(struct uftrace_graph_node *node)
+{
+	return container_of(node->name, struct graph_name, name[0]);
+}
+
+/* nodes of a same function share a single copy of the name */
+static struct graph_name *graph_intern_name(struct uftrace_graph *graph,
+					    const char *name)
+{
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &graph->names.rb_node;
+	struct graph_name *gname;
+	size_t len;
+	int cmp;
+
+	while (*p) {
+		parent = *p;
+		gname = rb_entry(parent, struct graph_name, link);
+
+		cmp = strcmp(gname->name, name);
+		if (cmp == 0)
+			return gname;
+
+		if (cmp > 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	len = strlen(name) + 1;
+	gname = graph_alloc(graph, sizeof(*gname) + len);
+	memcpy(gname->name, name, len);
+	gname->first = gname->last = NULL;
+
+	if (graph->search)
+		gname->matched = strstr(name, graph->search);
+
+	rb_link_node(&gname->link, parent, p);
+	rb_insert_color(&gname->link, &graph->names);
+
+	return gname;
+}
+
+static struct graph_name *graph_find_name(struct uftrace_graph *graph,
+					  const char *name)
+{
+	struct rb_node *node = graph->names.rb_node;
+	struct graph_name *gname;
+	int cmp;
+
+	while (node) {
+		gname = rb_entry(node, struct graph_name, link);
+
+		cmp = strcmp(gname->name, name);
+		if (cmp == 0)
+			return gname;
+
+		if (cmp > 0)
+			node = node->rb_left;
+		else
+			node = node->rb_right;
+	}
+	return NULL;
+}
+
+/**
+ * graph_search_names - check function names in the graph for a search
+ * @graph: graph to search
+ * @str: string to find in the names, or %NULL to clear
+ *
+ * This checks each (distinct) function name only once so that nodes can
+ * be checked quickly with graph_name_matched() later.  Names of nodes
+ * added after this are checked when they're added.
+ */
+void graph_search_names(struct uftrace_graph *graph, const char *str)
+{
+	struct rb_node *node;
+	struct graph_name *gname;
+
+	free(graph->search);
+	graph->search = str ? xstrdup(str) : NULL;
+
+	for (node = rb_first(&graph->names); node; node = rb_next(node)) {
+		gname = rb_entry(node, struct graph_name, link);
+		gname->matched = str && strstr(gname->name, str);
+	}
+}
+
+/**
+ * graph_name_matched - check if the node name matches the current search
+ * @node: graph node (but not the root)
+ *
+ * This returns the result of the last graph_search_names() for the
+ * function name of @node.
+ */
+bool graph_name_matched(struct uftrace_graph_node *node)
+{
+	return node_name(node)->matched;
+}
+
+/**
+ * graph_first_node - find the first node of a function
+ * @graph: graph to search
+ * @name: name of the function
+ *
+ * This returns the first node created for @name in @graph, or %NULL.
+ * Other nodes of the function can be found with the @name_next link.
+ */
+struct uftrace_graph_node * graph_first_node(struct uftrace_graph *graph,
+					     const char *name)
+{
+	struct graph_name *gname = graph_find_name(graph, name);
+
+	return gname ? gname->first : NULL;
+}
+
+/**
+ * graph_next_matched - iterate nodes matching the current search
+ * @graph: graph to search
+ * @node: current node, or %NULL to get the first one
+ *
+ * This returns the next node after @node whose name is matched by the
+ * last graph_search_names(), or %NULL if there's no more.  It only
+ * visits the matched names and their nodes, not in the tree order.
+ */
+struct uftrace_graph_node * graph_next_matched(struct uftrace_graph *graph,
+					       struct uftrace_graph_node *node)
+{
+	struct rb_node *rbnode;
+	struct graph_name *gname;
+
+	if (node) {
+		if (node->name_next)
+			return node->name_next;
+
+		rbnode = rb_next(&node_name(node)->link);
+	}
+	else {
+		rbnode = rb_first(&graph->names);
+	}
+
+	while (rbnode) {
+		gname = rb_entry(rbnode, struct graph_name, link);
+
+		if (gname->matched && gname->first)
+			return gname->first;
+
+		rbnode = rb_next(rbnode);
+	}
+	return NULL;
+}
+
+static inline unsigned hash_addr(uint64_t addr)
+{
+	/* Fibonacci hashing */
+	return (addr * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+static void hash_insert(struct graph_hash *hash,
+			struct uftrace_graph_node *node, uint64_t addr)
+{
+	unsigned mask = hash->size - 1;
+	unsigned i = hash_addr(addr) & mask;
+
+	while (hash->entries[i].node) {
+		if (hash->entries[i].addr == addr) {
+			/* prefer the recent one */
+			hash->entries[i].node = node;
+			return;
+		}
+		i = (i + 1) & mask;
+	}
+
+	hash->entries[i].addr = addr;
+	hash->entries[i].node = node;
+	hash->nr++;
+}
+
+static void add_child_hash(struct uftrace_graph_node *parent,
+			   struct uftrace_graph_node *node, uint64_t addr)
+{
+	struct graph_hash *hash = parent->children;
+
+	if (hash == NULL || hash->nr * 2 >= hash->size) {
+		unsigned size = hash ? hash->size * 2 : GRAPH_HASH_MIN * 4;
+		struct graph_hash *new_hash;
+		unsigned i;
+
+		new_hash = xzalloc(sizeof(*new_hash) +
+				   size * sizeof(*new_hash->entries));
+		new_hash->size = size;
+
+		if (hash) {
+			for (i = 0; i < hash->size; i++) {
+				if (hash->entries[i].node == NULL)
+					continue;
+				hash_insert(new_hash, hash->entries[i].node,
+					    hash->entries[i].addr);
+			}
+			free(hash);
+		}
+		parent->children = hash = new_hash;
+	}
+
+	hash_insert(hash, node, addr);
+}
+
+static struct uftrace_graph_node * find_child_hash(struct uftrace_graph_node *parent,
+						   uint64_t addr)
+{
+	struct graph_hash *hash = parent->children;
+	unsigned mask = hash->size - 1;
+	unsigned i = hash_addr(addr) & mask;
+
+	while (hash->entries[i].node) {
+		if (hash->entries[i].addr == addr)
+			return hash->entries[i].node;
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+/**
+ * graph_find_child - find a child node with the given name
+ * @parent: parent node
+ * @addr: address of the function
+ * @name: name of the function
+ *
+ * Children are merged by name, but it looks up the address first when
+ * the parent has many children so that it doesn't need to compare the
+ * names of all children.  Returns %NULL if not found.
+ */
+struct uftrace_graph_node * graph_find_child(struct uftrace_graph_node *parent,
+					     uint64_t addr, const char *name)
+{
+	struct uftrace_graph_node *node;
+
+	if (parent->nr_edges > GRAPH_HASH_MIN && parent->children == NULL) {
+		list_for_each_entry(node, &parent->head, list)
+			add_child_hash(parent, node, node->addr);
+	}
+
+	if (parent->children) {
+		node = find_child_hash(parent, addr);
+		if (node && !strcmp(name, node->name))
+			return node;
+	}
+
+	list_for_each_entry(node, &parent->head, list) {
+		if (!strcmp(name, node->name)) {
+			/* same name with a different address */
+			if (parent->children)
+				add_child_hash(parent, node, addr);
+			return node;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * graph_new_node - allocate a new node and add it to the parent
+ * @graph: graph to have the node
+ * @parent: parent node
+ * @addr: address of the function
+ * @name: name of the function
+ * @node_size: size of the node (can be larger than uftrace_graph_node)
+ *
+ * The node and its name are allocated from the memory owned by @graph.
+ * The name is shared with other nodes of the same function.
+ */
+struct uftrace_graph_node * graph_new_node(struct uftrace_graph *graph,
+					   struct uftrace_graph_node *parent,
+					   uint64_t addr, const char *name,
+					   size_t node_size)
+{
+	struct uftrace_graph_node *node;
+	struct graph_name *gname;
+
+	node = graph_alloc(graph, node_size);
+	gname = graph_intern_name(graph, name);
+	node->name = gname->name;
+	node->addr = addr;
+	INIT_LIST_HEAD(&node->head);
+
+	if (gname->last)
+		gname->last->name_next = node;
+	else
+		gname->first = node;
+	gname->last = node;
+
+	node->parent = parent;
+	list_add_tail(&node->list, &parent->head);
+	parent->nr_edges++;
+
+	if (parent->children)
+		add_child_hash(parent, node, addr);
+
+	return node;
+}
+
 void graph_init(struct uftrace_graph *graph, struct uftrace_session *s)
 {
 	memset(graph, 0, sizeof(*graph));
@@ -76,24 +434,16 @@ static int add_graph_entry(struct uftrace_task_graph *tg, char *name,
 	if (curr == NULL)
 		return -1;
 
-	list_for_each_entry(node, &curr->head, list) {
-		if (name && !strcmp(name, node->name))
-			break;
-	}
+	if (name == NULL)
+		name = "none";
 
-	if (list_no_entry(node, &curr->head, list)) {
+	node = graph_find_child(curr, fstack->addr, name);
+	if (node == NULL) {
 		struct uftrace_trigger tr;
 		struct uftrace_session *sess = tg->graph->sess;
 
-		node = xzalloc(node_size);
-
-		node->addr = fstack->addr;
-		node->name = xstrdup(name ?: "none");
-		INIT_LIST_HEAD(&node->head);
-
-		node->parent = curr;
-		list_add_tail(&node->list, &node->parent->head);
-		node->parent->nr_edges++;
+		node = graph_new_node(tg->graph, curr, fstack->addr, name,
+				      node_size);
 
 		if (uftrace_match_filter(fstack->addr, &sess->fixups, &tr)) {
 			struct sym *sym;
@@ -215,23 +565,32 @@ int graph_add_node(struct uftrace_task_graph *tg, int type, char *name,
 
 static void graph_destroy_node(struct uftrace_graph_node *node)
 {
-	struct uftrace_graph_node *child, *tmp;
+	struct uftrace_graph_node *child;
 
-	list_for_each_entry_safe(child, tmp, &node->head, list)
+	list_for_each_entry(child, &node->head, list)
 		graph_destroy_node(child);
 
-	list_del(&node->list);
-	free(node->name);
-	free(node);
+	free(node->children);
+	node->children = NULL;
 }
 
 void graph_destroy(struct uftrace_graph *graph)
 {
-	struct uftrace_graph_node *node, *tmp;
 	struct uftrace_special_node *snode, *stmp;
+	struct graph_chunk *chunk;
 
-	list_for_each_entry_safe(node, tmp, &graph->root.head, list)
-		graph_destroy_node(node);
+	graph_destroy_node(&graph->root);
+	INIT_LIST_HEAD(&graph->root.head);
+
+	while (graph->arena) {
+		chunk = graph->arena;
+		graph->arena = chunk->next;
+		free(chunk);
+	}
+	graph->names = RB_ROOT;
+
+	free(graph->search);
+	graph->search = NULL;
 
 	list_for_each_entry_safe(snode, stmp, &graph->special_nodes, list) {
 		list_del(&snode->list);
@@ -252,3 +611,80 @@ void graph_remove_task(void)
 		free(tg);
 	}
 }
+
+#ifdef UNIT_TEST
+
+TEST_CASE(graph_find_child)
+{
+	struct uftrace_graph graph;
+	struct uftrace_graph_node *node, *child;
+	char name[32];
+	int i;
+
+	graph_init(&graph, NULL);
+
+	pr_dbg("add many children to the root\n");
+	for (i = 0; i < 100; i++) {
+		snprintf(name, sizeof(name), "func%d", i);
+		node = graph_new_node(&graph, &graph.root, 0x1000 + i * 16,
+				      name, sizeof(*node));
+		TEST_NE(node, NULL);
+	}
+	TEST_EQ(graph.root.nr_edges, 100);
+
+	pr_dbg("find children by address and name\n");
+	for (i = 0; i < 100; i++) {
+		snprintf(name, sizeof(name), "func%d", i);
+		node = graph_find_child(&graph.root, 0x1000 + i * 16, name);
+		TEST_NE(node, NULL);
+		TEST_STREQ(node->name, name);
+	}
+	TEST_NE(graph.root.children, NULL);
+
+	pr_dbg("children are merged by name\n");
+	node = graph_find_child(&graph.root, 0x8000, "func10");
+	TEST_NE(node, NULL);
+	TEST_EQ(node->addr, 0x1000 + 10 * 16);
+	TEST_EQ(graph_find_child(&graph.root, 0x1000, "func10"), node);
+	TEST_EQ(graph_find_child(&graph.root, 0x1000, "nothing"), NULL);
+
+	pr_dbg("nodes of a same function share the name\n");
+	child = graph_new_node(&graph, node, 0x1000 + 20 * 16, "func20",
+			       sizeof(*child));
+	TEST_EQ(child->name, graph_find_child(&graph.root, 0x1000 + 20 * 16,
+					      "func20")->name);
+
+	pr_dbg("nodes of a function are linked in order\n");
+	TEST_EQ(graph_first_node(&graph, "func20"), graph_find_child(&graph.root,
+					0x1000 + 20 * 16, "func20"));
+	TEST_EQ(graph_first_node(&graph, "func20")->name_next, child);
+	TEST_EQ(child->name_next, NULL);
+	TEST_EQ(graph_first_node(&graph, "nothing"), NULL);
+
+	pr_dbg("search names in the graph\n");
+	graph_search_names(&graph, "c2");
+	TEST_EQ(graph_name_matched(child), true);
+	TEST_EQ(graph_name_matched(node), false);
+	child = graph_new_node(&graph, child, 0x9000, "func200", sizeof(*child));
+	TEST_EQ(graph_name_matched(child), true);
+
+	pr_dbg("iterate nodes of the matched names\n");
+	i = 0;
+	for (node = graph_next_matched(&graph, NULL); node;
+	     node = graph_next_matched(&graph, node)) {
+		TEST_NE(strstr(node->name, "c2"), NULL);
+		i++;
+	}
+	/* func2, func20 (x2), func21 ~ func29 and func200 */
+	TEST_EQ(i, 13);
+	graph_search_names(&graph, NULL);
+	TEST_EQ(graph_name_matched(child), false);
+
+	graph_destroy(&graph);
+	TEST_EQ(graph.root.children, NULL);
+	TEST_EQ(list_empty(&graph.root.head), true);
+
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
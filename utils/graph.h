@@ -9,6 +9,9 @@
 #include "utils/rbtree.h"
 #include "utils/fstack.h"
 
+struct graph_hash;
+struct graph_chunk;
+
 struct uftrace_graph_node {
 	uint64_t			addr;
 	char				*name;
@@ -19,6 +22,10 @@ struct uftrace_graph_node {
 	struct list_head		head;
 	struct list_head		list;
 	struct uftrace_graph_node	*parent;
+	/* children by address, only used when it has many children */
+	struct graph_hash		*children;
+	/* next node of the same function in the graph */
+	struct uftrace_graph_node	*name_next;
 };
 
 enum uftrace_graph_node_type {
@@ -39,6 +46,11 @@ struct uftrace_graph {
 	struct uftrace_session		*sess;
 	struct list_head		special_nodes;
 	struct uftrace_graph_node	root;
+	/* memory for nodes and names, freed by graph_destroy() */
+	struct graph_chunk		*arena;
+	/* function names shared by nodes */
+	struct rb_root			names;
+	char				*search;
 };
 
 struct uftrace_task_graph {
@@ -64,4 +76,18 @@ void graph_remove_task(void);
 int graph_add_node(struct uftrace_task_graph *tg, int type, char *name,
 		   size_t node_size);
 
+struct uftrace_graph_node * graph_find_child(struct uftrace_graph_node *parent,
+					     uint64_t addr, const char *name);
+struct uftrace_graph_node * graph_new_node(struct uftrace_graph *graph,
+					   struct uftrace_graph_node *parent,
+					   uint64_t addr, const char *name,
+					   size_t node_size);
+
+void graph_search_names(struct uftrace_graph *graph, const char *str);
+bool graph_name_matched(struct uftrace_graph_node *node);
+struct uftrace_graph_node * graph_first_node(struct uftrace_graph *graph,
+					     const char *name);
+struct uftrace_graph_node * graph_next_matched(struct uftrace_graph *graph,
+					       struct uftrace_graph_node *node);
+
 #endif /* UFTRACE_GRAPH_H */
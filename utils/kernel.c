@@ -24,11 +24,21 @@
 #include "utils/filter.h"
 #include "utils/rbtree.h"
 #include "utils/kernel.h"
+#include "utils/pack.h"
 #include "libtraceevent/kbuffer.h"
 #include "libtraceevent/event-parse.h"
 
 #define TRACING_DIR  "/sys/kernel/debug/tracing"
 
+/* max size to splice at once: default pipe capacity (16 pages) */
+#define KERNEL_SPLICE_SIZE  (16 * 4096)
+
+/* max size of kernel data (per-cpu) to map at once */
+#define KERNEL_MAP_SIZE  (32 * 1024 * 1024)
+
+/* wake up readers when the per-cpu buffer is filled by this percent */
+#define KERNEL_BUFFER_PERCENT  "25"
+
 static bool kernel_tracing_enabled;
 
 /* tree of executed kernel functions */
@@ -269,6 +279,12 @@ bool check_kernel_pid_filter(void)
 	return ret;
 }
 
+static void set_tracing_watermark(void)
+{
+	/* old kernels don't have the file, ignore errors */
+	write_tracing_file("buffer_percent", KERNEL_BUFFER_PERCENT);
+}
+
 static int set_tracing_options(struct uftrace_kernel_writer *kernel)
 {
 	/* old kernels don't have the options, ignore errors */
@@ -486,6 +502,9 @@ static int reset_tracing_files(void)
 	if (write_tracing_file("buffer_size_kb", "1408") < 0)
 		return -1;
 
+	/* ignore error on old kernel */
+	write_tracing_file("buffer_percent", "50");
+
 	kernel_tracing_enabled = false;
 	return 0;
 }
@@ -531,6 +550,8 @@ static int __setup_kernel_tracing(struct uftrace_kernel_writer *kernel)
 	if (set_tracing_bufsize(kernel) < 0)
 		goto out;
 
+	set_tracing_watermark();
+
 	if (write_tracing_file("current_tracer", kernel->tracer) < 0)
 		goto out;
 
@@ -654,11 +675,15 @@ int setup_kernel_tracing(struct uftrace_kernel_writer *kernel, struct opts *opts
 
 	kernel->traces	= xcalloc(n, sizeof(*kernel->traces));
 	kernel->fds	= xcalloc(n, sizeof(*kernel->fds));
+	kernel->pipes	= xcalloc(n * 2, sizeof(*kernel->pipes));
 
  	for (i = 0; i < kernel->nr_cpus; i++) {
 		kernel->traces[i] = -1;
 		kernel->fds[i] = -1;
+		kernel->pipes[i * 2] = -1;
+		kernel->pipes[i * 2 + 1] = -1;
 	}
+	kernel->use_splice = true;
 
 	return 0;
 }
@@ -674,7 +699,8 @@ int setup_kernel_tracing(struct uftrace_kernel_writer *kernel, struct opts *opts
  *
  * The kernel ftrace data is captured from per-cpu trace_pipe_raw file
  * as binary form and saved to kernel-cpuXX.dat file in the ftrace
- * data directory.
+ * data directory.  A pipe is created for each cpu so that the data
+ * can be moved to the file (or socket) using splice(2).
  */
 int start_kernel_tracing(struct uftrace_kernel_writer *kernel)
 {
@@ -714,6 +740,11 @@ int start_kernel_tracing(struct uftrace_kernel_writer *kernel)
 			pr_dbg("failed to open output file: %s: %m\n", buf);
 			goto out;
 		}
+
+		if (kernel->use_splice && pipe(&kernel->pipes[i * 2]) < 0) {
+			pr_dbg("failed to create pipe, fallback to read: %m\n");
+			kernel->use_splice = false;
+		}
 	}
 
 	if (write_tracing_file("tracing_on", "1") < 0) {
@@ -725,34 +756,59 @@ int start_kernel_tracing(struct uftrace_kernel_writer *kernel)
 	return 0;
 
 out:
-	for (i = 0; kernel->nr_cpus; i++) {
+	for (i = 0; i < kernel->nr_cpus; i++) {
 		close(kernel->traces[i]);
 		close(kernel->fds[i]);
+		close(kernel->pipes[i * 2]);
+		close(kernel->pipes[i * 2 + 1]);
 	}
 
 	free(kernel->traces);
 	free(kernel->fds);
+	free(kernel->pipes);
 
 	reset_tracing_files();
 	return -1;
 }
 
-/**
- * record_kernel_trace_pipe - read and save kernel ftrace data for specific cpu
- * @kernel - kernel ftrace handle
- * @cpu - cpu to read
- * @sock - socket descriptor (for network transfer)
- *
- * This function read trace data for @cpu and save it to file.
- */
-int record_kernel_trace_pipe(struct uftrace_kernel_writer *kernel,
-			     int cpu, int sock)
+static ssize_t splice_kernel_trace_pipe(struct uftrace_kernel_writer *kernel,
+					int cpu, int sock)
 {
-	char buf[PATH_MAX];
+	int *pipefd = &kernel->pipes[cpu * 2];
+	ssize_t bytes = 0;
 	ssize_t n;
 
-	if (cpu < 0 || cpu >= kernel->nr_cpus)
-		return 0;
+	/* move all available pages to the pipe (and then to output) */
+	while (true) {
+		n = splice(kernel->traces[cpu], NULL, pipefd[1], NULL,
+			   KERNEL_SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			return -errno;
+		}
+
+		if (n == 0)
+			break;
+
+		if (sock > 0)
+			send_trace_kernel_pipe(sock, cpu, pipefd[0], n);
+		else if (splice_all(pipefd[0], kernel->fds[cpu], n) < 0)
+			return -errno;
+
+		bytes += n;
+	}
+
+	return bytes;
+}
+
+static ssize_t read_kernel_trace_pipe(struct uftrace_kernel_writer *kernel,
+				      int cpu, int sock)
+{
+	char buf[PATH_MAX];
+	ssize_t n;
 
 retry:
 	n = read(kernel->traces[cpu], buf, sizeof(buf));
@@ -776,6 +832,40 @@ retry:
 	return n;
 }
 
+/**
+ * record_kernel_trace_pipe - read and save kernel ftrace data for specific cpu
+ * @kernel - kernel ftrace handle
+ * @cpu - cpu to read
+ * @sock - socket descriptor (for network transfer)
+ *
+ * This function read trace data for @cpu and save it to file.  It moves
+ * full pages using splice(2) first and reads the remaining (partial)
+ * page only if there's nothing to splice.
+ */
+int record_kernel_trace_pipe(struct uftrace_kernel_writer *kernel,
+			     int cpu, int sock)
+{
+	ssize_t n;
+
+	if (cpu < 0 || cpu >= kernel->nr_cpus)
+		return 0;
+
+	if (kernel->use_splice) {
+		n = splice_kernel_trace_pipe(kernel, cpu, sock);
+		if (n > 0)
+			return n;
+
+		if (n == -EINVAL || n == -ENOSYS) {
+			pr_dbg("splice is not supported, fallback to read\n");
+			kernel->use_splice = false;
+		}
+		else if (n < 0)
+			return n;
+	}
+
+	return read_kernel_trace_pipe(kernel, cpu, sock);
+}
+
 /**
  * record_kernel_tracing - read and save kernel ftrace data (binary)
  * @kernel - kernel ftrace handle
@@ -838,10 +928,13 @@ int finish_kernel_tracing(struct uftrace_kernel_writer *kernel)
 	for (i = 0; i < kernel->nr_cpus; i++) {
 		close(kernel->traces[i]);
 		close(kernel->fds[i]);
+		close(kernel->pipes[i * 2]);
+		close(kernel->pipes[i * 2 + 1]);
 	}
 
 	free(kernel->traces);
 	free(kernel->fds);
+	free(kernel->pipes);
 
 	if (kernel_tracing_enabled) {
 		save_kernel_files(kernel);
@@ -1083,7 +1176,7 @@ static int load_kernel_files(struct uftrace_kernel_reader *kernel)
 
 	xasprintf(&path, "%s/kernel_header", kernel->dirname);
 
-	fp = fopen(path, "r");
+	fp = pack_fopen(path, "r");
 	if (fp == NULL)  /* old data doesn't have the kernel header */
 		return load_current_kernel(kernel);
 
@@ -1173,9 +1266,57 @@ static int load_kernel_files(struct uftrace_kernel_reader *kernel)
 	return ret;
 }
 
-static int scandir_filter(const struct dirent *d)
+static void setup_kernel_events(struct uftrace_kernel_reader *kernel)
+{
+	struct pevent *pevent = kernel->pevent;
+	struct event_format *event;
+	struct uftrace_kernel_event *kev;
+	int i, max_id = -1;
+
+	if (pevent->nr_events == 0)
+		return;
+
+	/* all events have the same common fields */
+	kernel->common_type = pevent_find_common_field(pevent->events[0],
+						       "common_type");
+	kernel->common_pid  = pevent_find_common_field(pevent->events[0],
+						       "common_pid");
+
+	for (i = 0; i < pevent->nr_events; i++) {
+		if (max_id < pevent->events[i]->id)
+			max_id = pevent->events[i]->id;
+	}
+
+	kernel->nr_events = max_id + 1;
+	kernel->events = xcalloc(kernel->nr_events, sizeof(*kernel->events));
+
+	for (i = 0; i < pevent->nr_events; i++) {
+		event = pevent->events[i];
+		if (event->id < 0)
+			continue;
+
+		kev = &kernel->events[event->id];
+		kev->event    = event;
+		kev->type     = UFTRACE_EVENT;
+		kev->depth    = pevent_find_field(event, "depth");
+		kev->func     = pevent_find_field(event, "func");
+		kev->next_pid = pevent_find_field(event, "next_pid");
+		kev->pid      = pevent_find_field(event, "pid");
+
+		/* other events are handled by event handlers */
+		if (strcmp(event->system, "ftrace") || !kev->depth || !kev->func)
+			continue;
+
+		if (!strcmp(event->name, "funcgraph_entry"))
+			kev->type = UFTRACE_ENTRY;
+		else if (!strcmp(event->name, "funcgraph_exit"))
+			kev->type = UFTRACE_EXIT;
+	}
+}
+
+static int cmp_kernel_file(const void *a, const void *b)
 {
-	return !strncmp(d->d_name, "kernel-cpu", 10);
+	return strverscmp(*(char * const *)a, *(char * const *)b);
 }
 
 /**
@@ -1192,7 +1333,7 @@ int setup_kernel_data(struct uftrace_kernel_reader *kernel)
 	char buf[PATH_MAX];
 	enum kbuffer_endian endian = KBUFFER_ENDIAN_LITTLE;
 	enum kbuffer_long_size longsize = KBUFFER_LSIZE_8;
-	struct dirent **list;
+	char **list = NULL;
 
 	kernel->pevent = pevent_alloc();
 	if (kernel->pevent == NULL)
@@ -1200,11 +1341,13 @@ int setup_kernel_data(struct uftrace_kernel_reader *kernel)
 
 	trace_seq_init(&kernel->trace_buf);
 
-	kernel->nr_cpus = scandir(kernel->dirname, &list, scandir_filter, versionsort);
+	snprintf(buf, sizeof(buf), "%s/kernel-cpu*", kernel->dirname);
+	kernel->nr_cpus = pack_glob(buf, &list);
 	if (kernel->nr_cpus <= 0) {
 		pr_out("cannot find kernel trace data\n");
 		goto out;
 	}
+	qsort(list, kernel->nr_cpus, sizeof(*list), cmp_kernel_file);
 
 	if (load_kernel_files(kernel) < 0) {
 		pr_out("cannot read kernel header: %m\n");
@@ -1217,6 +1360,8 @@ int setup_kernel_data(struct uftrace_kernel_reader *kernel)
 	kernel->offsets	= xcalloc(kernel->nr_cpus, sizeof(*kernel->offsets));
 	kernel->sizes	= xcalloc(kernel->nr_cpus, sizeof(*kernel->sizes));
 	kernel->mmaps	= xcalloc(kernel->nr_cpus, sizeof(*kernel->mmaps));
+	kernel->map_offsets = xcalloc(kernel->nr_cpus, sizeof(*kernel->map_offsets));
+	kernel->map_sizes   = xcalloc(kernel->nr_cpus, sizeof(*kernel->map_sizes));
 	kernel->kbufs	= xcalloc(kernel->nr_cpus, sizeof(*kernel->kbufs));
 	kernel->rstacks = xcalloc(kernel->nr_cpus, sizeof(*kernel->rstacks));
 
@@ -1233,20 +1378,17 @@ int setup_kernel_data(struct uftrace_kernel_reader *kernel)
 	kernel->pagesize = pevent_get_page_size(kernel->pevent);
 
 	for (i = 0; i < kernel->nr_cpus; i++) {
-		struct stat stbuf;
-
-		snprintf(buf, sizeof(buf), "%s/%s",
-			 kernel->dirname, list[i]->d_name);
-		free(list[i]);
+		off_t offset;
+		size_t size;
 
-		kernel->fds[i] = open(buf, O_RDONLY);
+		/* the data might be in a (page-aligned) section of a pack file */
+		kernel->fds[i] = pack_open(list[i], &offset, &size);
 		if (kernel->fds[i] < 0)
 			break;
 
-		if (fstat(kernel->fds[i], &stbuf) < 0)
-			break;
-
-		kernel->sizes[i] = stbuf.st_size;
+		/* sizes has the end offset of the data */
+		kernel->offsets[i] = offset;
+		kernel->sizes[i] = size ? offset + size : 0;
 
 		kernel->kbufs[i] = kbuffer_alloc(longsize, endian);
 
@@ -1262,20 +1404,24 @@ int setup_kernel_data(struct uftrace_kernel_reader *kernel)
 			break;
 	}
 
-	free(list);
 	if (i != kernel->nr_cpus) {
-		pr_dbg("failed to access to kernel trace data: %s: %m\n", buf);
+		pr_dbg("failed to access to kernel trace data: %s: %m\n", list[i]);
+		pack_globfree(list, kernel->nr_cpus);
 		finish_kernel_data(kernel);
 		return -1;
 	}
+	pack_globfree(list, kernel->nr_cpus);
 
 	pevent_register_event_handler(kernel->pevent, -1, "ftrace", "funcgraph_entry",
 				      funcgraph_entry_handler, kernel);
 	pevent_register_event_handler(kernel->pevent, -1, "ftrace", "funcgraph_exit",
 				      funcgraph_exit_handler, kernel);
+
+	setup_kernel_events(kernel);
 	return 0;
 
 out:
+	pack_globfree(list, kernel->nr_cpus);
 	pevent_free(kernel->pevent);
 	kernel->pevent = NULL;
 	return -1;
@@ -1298,8 +1444,8 @@ int finish_kernel_data(struct uftrace_kernel_reader *kernel)
 	for (i = 0; i < kernel->nr_cpus; i++) {
 		close(kernel->fds[i]);
 
-		if (!kernel->rstack_done[i])
-			munmap(kernel->mmaps[i], kernel->pagesize);
+		if (kernel->mmaps[i])
+			munmap(kernel->mmaps[i], kernel->map_sizes[i]);
 
 		kbuffer_free(kernel->kbufs[i]);
 
@@ -1310,6 +1456,8 @@ int finish_kernel_data(struct uftrace_kernel_reader *kernel)
 	free(kernel->offsets);
 	free(kernel->sizes);
 	free(kernel->mmaps);
+	free(kernel->map_offsets);
+	free(kernel->map_sizes);
 	free(kernel->kbufs);
 	free(kernel->rstacks);
 
@@ -1318,6 +1466,10 @@ int finish_kernel_data(struct uftrace_kernel_reader *kernel)
 	free(kernel->rstack_done);
 	free(kernel->missed_events);
 	free(kernel->tids);
+	free(kernel->events);
+
+	kernel->events = NULL;
+	kernel->nr_events = 0;
 
 	trace_seq_destroy(&kernel->trace_buf);
 	pevent_free(kernel->pevent);
@@ -1326,17 +1478,57 @@ int finish_kernel_data(struct uftrace_kernel_reader *kernel)
 	return 0;
 }
 
-static int prepare_kbuffer(struct uftrace_kernel_reader *kernel, int cpu)
+static void unmap_kbuffer(struct uftrace_kernel_reader *kernel, int cpu)
 {
-	kernel->mmaps[cpu] = mmap(NULL, kernel->pagesize, PROT_READ, MAP_PRIVATE,
-				  kernel->fds[cpu], kernel->offsets[cpu]);
-	if (kernel->mmaps[cpu] == MAP_FAILED) {
-		pr_dbg("loading kbuffer for cpu %d (fd: %d, offset: %lu, pagesize: %zd) failed\n",
-		       cpu, kernel->fds[cpu], kernel->offsets[cpu], kernel->pagesize);
+	if (kernel->mmaps[cpu] == NULL)
+		return;
+
+	munmap(kernel->mmaps[cpu], kernel->map_sizes[cpu]);
+	kernel->mmaps[cpu] = NULL;
+}
+
+/* map the data file from current offset in a large chunk */
+static int map_kbuffer(struct uftrace_kernel_reader *kernel, int cpu)
+{
+	int64_t offset = kernel->offsets[cpu];
+	size_t size = ALIGN(kernel->sizes[cpu] - offset, kernel->pagesize);
+	void *map;
+
+	unmap_kbuffer(kernel, cpu);
+
+	if (size > KERNEL_MAP_SIZE)
+		size = KERNEL_MAP_SIZE;
+	if (size < kernel->pagesize)
+		size = kernel->pagesize;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, kernel->fds[cpu], offset);
+	if (map == MAP_FAILED) {
+		pr_dbg("loading kbuffer for cpu %d (fd: %d, offset: %lu, size: %zd) failed\n",
+		       cpu, kernel->fds[cpu], offset, size);
 		return -1;
 	}
 
-	kbuffer_load_subbuffer(kernel->kbufs[cpu], kernel->mmaps[cpu]);
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	kernel->mmaps[cpu] = map;
+	kernel->map_offsets[cpu] = offset;
+	kernel->map_sizes[cpu] = size;
+	return 0;
+}
+
+static int prepare_kbuffer(struct uftrace_kernel_reader *kernel, int cpu)
+{
+	int64_t offset = kernel->offsets[cpu];
+	int64_t map_end = kernel->map_offsets[cpu] + kernel->map_sizes[cpu];
+
+	if (kernel->mmaps[cpu] == NULL || offset >= map_end) {
+		if (map_kbuffer(kernel, cpu) < 0)
+			return -1;
+	}
+
+	/* the page is in the current mapping, no need to call mmap() */
+	kbuffer_load_subbuffer(kernel->kbufs[cpu], kernel->mmaps[cpu] +
+			       (offset - kernel->map_offsets[cpu]));
 	kernel->missed_events[cpu] = kbuffer_missed_events(kernel->kbufs[cpu]);
 
 	return 0;
@@ -1344,12 +1536,10 @@ static int prepare_kbuffer(struct uftrace_kernel_reader *kernel, int cpu)
 
 static int next_kbuffer_page(struct uftrace_kernel_reader *kernel, int cpu)
 {
-	munmap(kernel->mmaps[cpu], kernel->pagesize);
-	kernel->mmaps[cpu] = NULL;
-
 	kernel->offsets[cpu] += kernel->pagesize;
 
 	if (kernel->offsets[cpu] >= (loff_t)kernel->sizes[cpu]) {
+		unmap_kbuffer(kernel, cpu);
 		kernel->rstack_done[cpu] = true;
 		return -1;
 	}
@@ -1469,6 +1659,13 @@ generic_event_handler(struct trace_seq *s, struct pevent_record *record,
 	return 1;
 }
 
+static unsigned long long read_kernel_field(struct uftrace_kernel_reader *kernel,
+					    void *data, struct format_field *field)
+{
+	return pevent_read_number(kernel->pevent, data + field->offset,
+				  field->size);
+}
+
 /**
  * read_kernel_cpu_data - read next kernel tracing data of specific cpu
  * @kernel - kernel ftrace handle
@@ -1482,9 +1679,9 @@ int read_kernel_cpu_data(struct uftrace_kernel_reader *kernel, int cpu)
 {
 	unsigned long long timestamp;
 	void *data;
-	int type;
+	int type = -1;
 	struct pevent_record record;
-	struct event_format *event;
+	struct uftrace_kernel_event *kev = NULL;
 
 	data = kbuffer_read_event(kernel->kbufs[cpu], &timestamp);
 	while (!data) {
@@ -1503,18 +1700,32 @@ int read_kernel_cpu_data(struct uftrace_kernel_reader *kernel, int cpu)
 //	record.ref_count = 1;
 //	record.locked = 1;
 
-	trace_seq_reset(&kernel->trace_buf);
-	type = pevent_data_type(kernel->pevent, &record);
-	event = pevent_find_event(kernel->pevent, type);
-	if (event == NULL) {
+	if (kernel->common_type) {
+		type = read_kernel_field(kernel, data, kernel->common_type);
+		if (type >= 0 && type < kernel->nr_events)
+			kev = &kernel->events[type];
+	}
+	if (kev == NULL || kev->event == NULL) {
 		pr_dbg("cannot find event for type: %d\n", type);
 		return -1;
 	}
 
-	/* this will call event handlers */
-	pevent_event_info(&kernel->trace_buf, event, &record);
+	if (kev->type == UFTRACE_EVENT) {
+		trace_seq_reset(&kernel->trace_buf);
+
+		/* this will call event handlers */
+		pevent_event_info(&kernel->trace_buf, kev->event, &record);
+	}
+	else {
+		/* decode function graph records directly */
+		kernel->trace_rec.type  = kev->type;
+		kernel->trace_rec.time  = record.ts;
+		kernel->trace_rec.addr  = read_kernel_field(kernel, data, kev->func);
+		kernel->trace_rec.depth = read_kernel_field(kernel, data, kev->depth);
+		kernel->trace_rec.more  = 0;
+	}
 
-	kernel->tids[cpu] = pevent_data_pid(kernel->pevent, &record);
+	kernel->tids[cpu] = read_kernel_field(kernel, data, kernel->common_pid);
 	memcpy(&kernel->rstacks[cpu], &kernel->trace_rec, sizeof(kernel->trace_rec));
 	kernel->rstack_valid[cpu] = true;
 
@@ -1524,18 +1735,21 @@ int read_kernel_cpu_data(struct uftrace_kernel_reader *kernel, int cpu)
 	 */
 	if (kernel->trace_rec.type == UFTRACE_EVENT &&
 	    get_task_handle(kernel->handle, kernel->tids[cpu]) == NULL) {
+		struct format_field *fields[] = { kev->next_pid, kev->pid };
 		unsigned long long tid;
+		unsigned i;
 
-		/* for sched_switch event */
-		if (pevent_get_field_val(NULL, event, "next_pid",
-					 &record, &tid, 0) == 0 &&
-		    get_task_handle(kernel->handle, tid) != NULL)
-			kernel->tids[cpu] = tid;
-		/* for sched_wakeup event (or others) */
-		else if (pevent_get_field_val(NULL, event, "pid",
-					 &record, &tid, 0) == 0 &&
-		    get_task_handle(kernel->handle, tid) != NULL)
-			kernel->tids[cpu] = tid;
+		/* next_pid for sched_switch, pid for sched_wakeup (or others) */
+		for (i = 0; i < ARRAY_SIZE(fields); i++) {
+			if (fields[i] == NULL)
+				continue;
+
+			tid = read_kernel_field(kernel, data, fields[i]);
+			if (get_task_handle(kernel->handle, tid) != NULL) {
+				kernel->tids[cpu] = tid;
+				break;
+			}
+		}
 	}
 
 	kbuffer_next_event(kernel->kbufs[cpu], NULL);
@@ -2218,6 +2432,15 @@ TEST_CASE(kernel_cpu_read)
 
 	TEST_EQ(kernel_test_setup_file(kernel, false), 0);
 
+	pr_dbg("event fields should be resolved at setup\n");
+	TEST_NE(kernel->common_type, NULL);
+	TEST_NE(kernel->common_pid, NULL);
+	TEST_GT(kernel->nr_events, FUNCGRAPH_ENTRY);
+	TEST_EQ(kernel->events[FUNCGRAPH_ENTRY].type, UFTRACE_ENTRY);
+	TEST_EQ(kernel->events[FUNCGRAPH_EXIT].type, UFTRACE_EXIT);
+	TEST_NE(kernel->events[FUNCGRAPH_EXIT].depth, NULL);
+	TEST_NE(kernel->events[FUNCGRAPH_EXIT].func, NULL);
+
 	for (cpu = 0; cpu < NUM_CPU; cpu++) {
 		for (i = 0; i < NUM_RECORD; i++) {
 			struct funcgraph_exit *rec = &test_record[cpu][i];
@@ -2246,6 +2469,11 @@ TEST_CASE(kernel_event_read)
 
 	TEST_EQ(kernel_test_setup_file(kernel, true), 0);
 
+	pr_dbg("other events should use the event handlers\n");
+	TEST_GT(kernel->nr_events, TEST_EXAMPLE);
+	TEST_NE(kernel->events[TEST_EXAMPLE].event, NULL);
+	TEST_EQ(kernel->events[TEST_EXAMPLE].type, UFTRACE_EVENT);
+
 	for (cpu = 0; cpu < NUM_CPU; cpu++) {
 		for (i = 0; i < NUM_EVENT; i++) {
 			struct test_example *rec = &test_event[cpu][i];
@@ -15,6 +15,8 @@ struct uftrace_kernel_writer {
 	char			*tracer;
 	int			*traces;
 	int			*fds;
+	int			*pipes;  /* pair of pipe fds per cpu for splice */
+	bool			use_splice;
 	char			*output_dir;
 	struct list_head	filters;
 	struct list_head	notrace;
@@ -23,6 +25,16 @@ struct uftrace_kernel_writer {
 	struct list_head	events;
 };
 
+/* pre-resolved event info to decode kernel records without lookups */
+struct uftrace_kernel_event {
+	struct event_format		*event;
+	int				type;  /* UFTRACE_ENTRY, EXIT or EVENT */
+	struct format_field		*depth;
+	struct format_field		*func;
+	struct format_field		*next_pid;
+	struct format_field		*pid;
+};
+
 struct uftrace_kernel_reader {
 	int				nr_cpus;
 	int				last_read_cpu;
@@ -33,8 +45,14 @@ struct uftrace_kernel_reader {
 	int64_t 			*sizes;
 	size_t				pagesize;
 	void				**mmaps;
+	int64_t				*map_offsets;
+	size_t				*map_sizes;
 	struct kbuffer			**kbufs;
 	struct pevent			*pevent;
+	struct uftrace_kernel_event	*events;  /* indexed by event id */
+	int				nr_events;
+	struct format_field		*common_type;
+	struct format_field		*common_pid;
 	struct uftrace_data	*handle;
 	struct uftrace_record		*rstacks;
 	struct uftrace_rstack_list	*rstack_list;
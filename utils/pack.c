@@ -0,0 +1,698 @@
+/*
+ * single-file container for uftrace data
+ *
+ * A pack file has all the files in a uftrace data directory so that it
+ * can be copied and opened easily.  Analysis commands can use it just
+ * like a directory (i.e. 'uftrace replay -d uftrace.data.pack') since
+ * the helpers below resolve "<pack>/<name>" to a section in the pack.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <glob.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <utime.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT     "pack"
+#define PR_DOMAIN  DBG_UFTRACE
+
+#include "utils/utils.h"
+#include "utils/pack.h"
+#include "utils/list.h"
+
+/* pack files opened so far */
+struct pack_cache {
+	struct list_head	list;
+	char			*dirname;
+	struct uftrace_pack	*pack;
+};
+
+static LIST_HEAD(pack_cache_list);
+static pthread_mutex_t pack_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * is_pack_file - check if given file is a uftrace pack file
+ * @filename - name of the file
+ *
+ * This function returns %true if @filename is a regular file and it
+ * starts with the pack magic string.
+ */
+bool is_pack_file(const char *filename)
+{
+	struct stat stbuf;
+	char magic[sizeof(UFTRACE_PACK_MAGIC) - 1];
+	bool ret = false;
+	int fd;
+
+	if (stat(filename, &stbuf) < 0 || !S_ISREG(stbuf.st_mode))
+		return false;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	if (read(fd, magic, sizeof(magic)) == (ssize_t)sizeof(magic))
+		ret = !memcmp(magic, UFTRACE_PACK_MAGIC, sizeof(magic));
+
+	close(fd);
+	return ret;
+}
+
+/* check all TOC entries point to valid data and names in the pack */
+static bool check_pack_entries(void *map, uint64_t map_size,
+			       struct uftrace_pack_header *hdr)
+{
+	struct uftrace_pack_entry *toc = map + hdr->toc_offset;
+	const char *strtab = map + hdr->strtab_offset;
+	uint32_t i;
+
+	/* all names should be terminated in the string table */
+	if (hdr->strtab_size && strtab[hdr->strtab_size - 1] != '\0')
+		return false;
+
+	for (i = 0; i < hdr->nr_entries; i++) {
+		if (toc[i].offset > map_size ||
+		    toc[i].size > map_size - toc[i].offset)
+			return false;
+		if (toc[i].name >= hdr->strtab_size)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * open_pack_file - open and map a pack file
+ * @filename - name of the pack file
+ *
+ * This function maps the whole pack file and checks its header and
+ * table of contents including the data and name of each entry.  It returns a new pack handle or %NULL on error.
+ */
+struct uftrace_pack *open_pack_file(const char *filename)
+{
+	struct uftrace_pack *pack;
+	struct uftrace_pack_header *hdr;
+	struct stat stbuf;
+	uint64_t toc_size;
+	void *map;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &stbuf) < 0 || (size_t)stbuf.st_size < sizeof(*hdr))
+		goto err;
+
+	map = mmap(NULL, stbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+
+	hdr = map;
+	toc_size = (uint64_t)hdr->nr_entries * sizeof(struct uftrace_pack_entry);
+
+	if (memcmp(hdr->magic, UFTRACE_PACK_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != UFTRACE_PACK_VERSION ||
+	    hdr->toc_offset > (uint64_t)stbuf.st_size ||
+	    toc_size > (uint64_t)stbuf.st_size - hdr->toc_offset ||
+	    hdr->strtab_offset > (uint64_t)stbuf.st_size ||
+	    hdr->strtab_size > (uint64_t)stbuf.st_size - hdr->strtab_offset ||
+	    !check_pack_entries(map, stbuf.st_size, hdr)) {
+		pr_dbg("invalid pack file: %s\n", filename);
+		munmap(map, stbuf.st_size);
+		errno = EINVAL;
+		goto err;
+	}
+
+	pack = xzalloc(sizeof(*pack));
+	pack->filename = xstrdup(filename);
+	pack->fd       = fd;
+	pack->map      = map;
+	pack->map_size = stbuf.st_size;
+	pack->hdr      = hdr;
+	pack->toc      = map + hdr->toc_offset;
+	pack->strtab   = map + hdr->strtab_offset;
+
+	pr_dbg("open pack file: %s (%u entries)\n", filename, hdr->nr_entries);
+	return pack;
+
+err:
+	close(fd);
+	return NULL;
+}
+
+void close_pack_file(struct uftrace_pack *pack)
+{
+	if (pack == NULL)
+		return;
+
+	munmap(pack->map, pack->map_size);
+	close(pack->fd);
+	free(pack->filename);
+	free(pack);
+}
+
+static int cmp_entry_name(const void *key, const void *elem)
+{
+	const struct uftrace_pack_entry *entry = elem;
+	const char **name = (const char **)key;
+
+	return strcmp(name[0], name[1] + entry->name);
+}
+
+/**
+ * pack_find_entry - find a section for the given file
+ * @pack - pack file handle
+ * @name - name of the file (without directory)
+ *
+ * This function returns the TOC entry of the @name or %NULL if not found.
+ */
+struct uftrace_pack_entry *pack_find_entry(struct uftrace_pack *pack,
+					   const char *name)
+{
+	const char *key[2] = { name, pack->strtab };
+
+	return bsearch(key, pack->toc, pack->hdr->nr_entries,
+		       sizeof(*pack->toc), cmp_entry_name);
+}
+
+/*
+ * find a pack file for the directory part of @pathname and set @name
+ * to the remaining file name part.  It returns %NULL if the directory
+ * is a normal directory (or doesn't exist at all).  Only pack files are
+ * kept in the cache as others can be changed to a pack later.
+ */
+static struct uftrace_pack *find_pack(const char *pathname, const char **name)
+{
+	struct pack_cache *pc;
+	struct uftrace_pack *pack = NULL;
+	const char *slash = strrchr(pathname, '/');
+	char *dirname;
+	int len;
+
+	if (slash == NULL)
+		return NULL;
+
+	len = slash - pathname;
+	while (len > 1 && pathname[len - 1] == '/')
+		len--;
+	if (len == 0)
+		return NULL;
+
+	dirname = xstrndup(pathname, len);
+
+	pthread_mutex_lock(&pack_lock);
+	list_for_each_entry(pc, &pack_cache_list, list) {
+		if (!strcmp(pc->dirname, dirname)) {
+			pack = pc->pack;
+			free(dirname);
+			goto out;
+		}
+	}
+
+	if (is_pack_file(dirname))
+		pack = open_pack_file(dirname);
+
+	if (pack == NULL) {
+		free(dirname);
+		goto out;
+	}
+
+	pc = xmalloc(sizeof(*pc));
+	pc->dirname = dirname;
+	pc->pack = pack;
+	list_add(&pc->list, &pack_cache_list);
+
+out:
+	pthread_mutex_unlock(&pack_lock);
+
+	*name = slash + 1;
+	return pack;
+}
+
+/**
+ * pack_fopen - open a file in a data directory or a pack file
+ * @pathname - path of the file
+ * @mode - open mode
+ *
+ * This function returns a read-only stream for the corresponding
+ * section if the directory part of @pathname is a pack file.
+ * Otherwise it just calls fopen().
+ */
+FILE *pack_fopen(const char *pathname, const char *mode)
+{
+	struct uftrace_pack *pack;
+	struct uftrace_pack_entry *entry;
+	const char *name;
+
+	if (strpbrk(mode, "wa+"))
+		return fopen(pathname, mode);
+
+	pack = find_pack(pathname, &name);
+	if (pack == NULL)
+		return fopen(pathname, mode);
+
+	entry = pack_find_entry(pack, name);
+	if (entry == NULL) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	/* fmemopen() might not accept an empty buffer */
+	if (entry->size == 0)
+		return fopen("/dev/null", mode);
+
+	return fmemopen(pack->map + entry->offset, entry->size, mode);
+}
+
+/**
+ * pack_open - open a file in a data directory or a pack file
+ * @pathname - path of the file
+ * @offset - pointer to save offset of the file data
+ * @size - pointer to save size of the file data
+ *
+ * This function returns a read-only file descriptor which has the file
+ * data at @offset.  It's always 0 for a normal file.  For pack files,
+ * the offset is aligned to page size so that it can be mmap-ed.
+ */
+int pack_open(const char *pathname, off_t *offset, size_t *size)
+{
+	struct uftrace_pack *pack;
+	struct uftrace_pack_entry *entry;
+	struct stat stbuf;
+	const char *name;
+	int fd;
+
+	pack = find_pack(pathname, &name);
+	if (pack == NULL) {
+		fd = open(pathname, O_RDONLY);
+		if (fd < 0)
+			return -1;
+
+		if (fstat(fd, &stbuf) < 0) {
+			close(fd);
+			return -1;
+		}
+
+		*offset = 0;
+		*size = stbuf.st_size;
+		return fd;
+	}
+
+	entry = pack_find_entry(pack, name);
+	if (entry == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	*offset = entry->offset;
+	*size = entry->size;
+	return dup(pack->fd);
+}
+
+/**
+ * pack_stat - get file status in a data directory or a pack file
+ * @pathname - path of the file
+ * @stbuf - stat buffer
+ *
+ * Files in a pack file share the status of the pack file except size
+ * and modification time (if saved).
+ */
+int pack_stat(const char *pathname, struct stat *stbuf)
+{
+	struct uftrace_pack *pack;
+	struct uftrace_pack_entry *entry;
+	const char *name;
+
+	pack = find_pack(pathname, &name);
+	if (pack == NULL)
+		return stat(pathname, stbuf);
+
+	entry = pack_find_entry(pack, name);
+	if (entry == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (fstat(pack->fd, stbuf) < 0)
+		return -1;
+
+	stbuf->st_size = entry->size;
+	if (entry->mtime) {
+		stbuf->st_mtim.tv_sec  = entry->mtime;
+		stbuf->st_mtim.tv_nsec = 0;
+	}
+	return 0;
+}
+
+/* same as access(@pathname, F_OK) */
+int pack_access(const char *pathname)
+{
+	struct stat stbuf;
+
+	return pack_stat(pathname, &stbuf);
+}
+
+/**
+ * pack_glob - find files matching to a pattern
+ * @pattern - pattern of files (wildcard in file name part only)
+ * @pathv - pointer to an array of matched path names
+ *
+ * This function returns number of matched files or -1 on error.
+ * The result is sorted by name and should be released with
+ * pack_globfree().
+ */
+int pack_glob(const char *pattern, char ***pathv)
+{
+	struct uftrace_pack *pack;
+	const char *name;
+	char **paths = NULL;
+	int count = 0;
+	int dirlen;
+	unsigned i;
+
+	pack = find_pack(pattern, &name);
+	if (pack == NULL) {
+		glob_t g;
+		int ret;
+
+		ret = glob(pattern, GLOB_ERR, NULL, &g);
+		if (ret == GLOB_NOMATCH) {
+			*pathv = NULL;
+			return 0;
+		}
+		if (ret) {
+			pr_dbg("glob matching failed: %s: %m\n", pattern);
+			return -1;
+		}
+
+		paths = xcalloc(g.gl_pathc, sizeof(*paths));
+		for (i = 0; i < g.gl_pathc; i++)
+			paths[i] = xstrdup(g.gl_pathv[i]);
+
+		count = g.gl_pathc;
+		globfree(&g);
+
+		*pathv = paths;
+		return count;
+	}
+
+	dirlen = name - pattern;
+	for (i = 0; i < pack->hdr->nr_entries; i++) {
+		char *ent_name = pack->strtab + pack->toc[i].name;
+
+		if (fnmatch(name, ent_name, 0))
+			continue;
+
+		paths = xrealloc(paths, (count + 1) * sizeof(*paths));
+		xasprintf(&paths[count++], "%.*s%s", dirlen, pattern, ent_name);
+	}
+
+	*pathv = paths;
+	return count;
+}
+
+void pack_globfree(char **pathv, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		free(pathv[i]);
+	free(pathv);
+}
+
+/* release all pack files opened so far */
+void pack_cleanup(void)
+{
+	struct pack_cache *pc, *tmp;
+
+	pthread_mutex_lock(&pack_lock);
+	list_for_each_entry_safe(pc, tmp, &pack_cache_list, list) {
+		list_del(&pc->list);
+		close_pack_file(pc->pack);
+		free(pc->dirname);
+		free(pc);
+	}
+	pthread_mutex_unlock(&pack_lock);
+}
+
+static int pack_filter(const struct dirent *de)
+{
+	/* skip hidden files like ".channel" */
+	return de->d_name[0] != '.';
+}
+
+static int pack_sort(const struct dirent **a, const struct dirent **b)
+{
+	/* TOC should be sorted by strcmp() for binary search */
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+static int copy_section(int ofd, const char *pathname, off_t offset,
+			uint64_t *size)
+{
+	char buf[65536];
+	ssize_t len;
+	int ifd;
+
+	ifd = open(pathname, O_RDONLY);
+	if (ifd < 0)
+		return -1;
+
+	*size = 0;
+	while ((len = read(ifd, buf, sizeof(buf))) > 0) {
+		if (pwrite_all(ofd, buf, len, offset + *size) < 0) {
+			len = -1;
+			break;
+		}
+		*size += len;
+	}
+
+	close(ifd);
+	return len < 0 ? -1 : 0;
+}
+
+/**
+ * pack_data_dir - save all files in a data directory to a pack file
+ * @dirname - name of the data directory
+ * @filename - name of the (new) pack file
+ *
+ * This function writes all regular files in @dirname to @filename.
+ * Each file is aligned to page size and the TOC is sorted by name.
+ * It returns 0 on success, -1 on failure.
+ */
+int pack_data_dir(const char *dirname, const char *filename)
+{
+	struct uftrace_pack_header hdr = {
+		.magic   = UFTRACE_PACK_MAGIC,
+		.version = UFTRACE_PACK_VERSION,
+	};
+	struct uftrace_pack_entry *toc;
+	struct dirent **list;
+	char *strtab = NULL;
+	size_t strtab_size = 0;
+	uint64_t align;
+	off_t offset;
+	int nr_files, nr_entries = 0;
+	int fd, i;
+	int ret = -1;
+
+	nr_files = scandir(dirname, &list, pack_filter, pack_sort);
+	if (nr_files < 0)
+		return -1;
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		goto out;
+
+	align = sysconf(_SC_PAGESIZE);
+	if (align < UFTRACE_PACK_ALIGN)
+		align = UFTRACE_PACK_ALIGN;
+
+	toc = xcalloc(nr_files + 1, sizeof(*toc));
+	offset = align;
+
+	for (i = 0; i < nr_files; i++) {
+		struct uftrace_pack_entry *entry = &toc[nr_entries];
+		char *pathname = NULL;
+		struct stat stbuf;
+		size_t len;
+
+		xasprintf(&pathname, "%s/%s", dirname, list[i]->d_name);
+
+		if (stat(pathname, &stbuf) < 0 || !S_ISREG(stbuf.st_mode)) {
+			free(pathname);
+			continue;
+		}
+
+		if (copy_section(fd, pathname, offset, &entry->size) < 0) {
+			pr_dbg("cannot copy %s: %m\n", pathname);
+			free(pathname);
+			goto err;
+		}
+		free(pathname);
+
+		len = strlen(list[i]->d_name) + 1;
+		strtab = xrealloc(strtab, strtab_size + len);
+		memcpy(strtab + strtab_size, list[i]->d_name, len);
+
+		entry->offset = offset;
+		entry->name   = strtab_size;
+		entry->mtime  = stbuf.st_mtime;
+
+		strtab_size += len;
+		offset = ALIGN(offset + entry->size, align);
+		nr_entries++;
+	}
+
+	hdr.align         = align;
+	hdr.nr_entries    = nr_entries;
+	hdr.toc_offset    = offset;
+	hdr.strtab_offset = offset + nr_entries * sizeof(*toc);
+	hdr.strtab_size   = strtab_size;
+
+	if (pwrite_all(fd, toc, nr_entries * sizeof(*toc), hdr.toc_offset) < 0 ||
+	    pwrite_all(fd, strtab, strtab_size, hdr.strtab_offset) < 0 ||
+	    pwrite_all(fd, &hdr, sizeof(hdr), 0) < 0)
+		goto err;
+
+	pr_dbg("packed %d files in %s to %s\n", nr_entries, dirname, filename);
+	ret = 0;
+
+err:
+	free(toc);
+	free(strtab);
+	close(fd);
+	if (ret < 0)
+		unlink(filename);
+out:
+	for (i = 0; i < nr_files; i++)
+		free(list[i]);
+	free(list);
+	return ret;
+}
+
+#ifdef UNIT_TEST
+
+#define PACK_TEST_DIR   "pack-test.dir"
+#define PACK_TEST_FILE  "pack-test.pack"
+
+static void write_test_file(const char *name, const char *data)
+{
+	char *pathname = NULL;
+	FILE *fp;
+
+	xasprintf(&pathname, "%s/%s", PACK_TEST_DIR, name);
+	fp = fopen(pathname, "w");
+	if (fp) {
+		fputs(data, fp);
+		fclose(fp);
+	}
+	free(pathname);
+}
+
+TEST_CASE(pack_data_dir)
+{
+	FILE *fp;
+	int fd;
+	off_t offset;
+	size_t size;
+	uint64_t bad_size;
+	char buf[64];
+	char **paths;
+	struct stat stbuf;
+	struct uftrace_pack *pack;
+	struct utimbuf times = {
+		.actime  = 1500000000,
+		.modtime = 1500000000,
+	};
+
+	mkdir(PACK_TEST_DIR, 0755);
+	write_test_file("info", "uftrace info");
+	utime(PACK_TEST_DIR "/info", &times);
+	write_test_file("1234.dat", "task data 1234");
+	write_test_file("5678.dat", "task data 5678");
+	write_test_file("empty.txt", "");
+	write_test_file(".channel", "hidden");
+
+	pr_dbg("save test data to a pack file\n");
+	TEST_EQ(pack_data_dir(PACK_TEST_DIR, PACK_TEST_FILE), 0);
+	TEST_EQ(is_pack_file(PACK_TEST_FILE), true);
+	TEST_EQ(is_pack_file(PACK_TEST_DIR), false);
+
+	pack = open_pack_file(PACK_TEST_FILE);
+	TEST_NE(pack, NULL);
+	TEST_EQ(pack->hdr->nr_entries, 4);
+	TEST_EQ(pack_find_entry(pack, ".channel"), NULL);
+	TEST_NE(pack_find_entry(pack, "info"), NULL);
+	TEST_EQ(pack_find_entry(pack, "info")->offset % UFTRACE_PACK_ALIGN, 0);
+	close_pack_file(pack);
+
+	pr_dbg("read files in the pack file\n");
+	fp = pack_fopen(PACK_TEST_FILE "/1234.dat", "rb");
+	TEST_NE(fp, NULL);
+	TEST_NE(fgets(buf, sizeof(buf), fp), NULL);
+	TEST_STREQ(buf, "task data 1234");
+	fclose(fp);
+
+	fp = pack_fopen(PACK_TEST_FILE "/empty.txt", "r");
+	TEST_NE(fp, NULL);
+	TEST_EQ(fgets(buf, sizeof(buf), fp), NULL);
+	fclose(fp);
+
+	TEST_EQ(pack_fopen(PACK_TEST_FILE "/no-such-file", "r"), NULL);
+	TEST_EQ(errno, ENOENT);
+
+	TEST_EQ(pack_stat(PACK_TEST_FILE "/info", &stbuf), 0);
+	TEST_EQ(stbuf.st_size, strlen("uftrace info"));
+	TEST_EQ(stbuf.st_mtime, times.modtime);
+	TEST_LT(pack_access(PACK_TEST_FILE "/task.txt"), 0);
+
+	fd = pack_open(PACK_TEST_FILE "/5678.dat", &offset, &size);
+	TEST_GE(fd, 0);
+	TEST_EQ(size, strlen("task data 5678"));
+	TEST_EQ(pread(fd, buf, size, offset), (ssize_t)size);
+	TEST_EQ(memcmp(buf, "task data 5678", size), 0);
+	close(fd);
+
+	pr_dbg("find files using a pattern\n");
+	TEST_EQ(pack_glob(PACK_TEST_FILE "/*.dat", &paths), 2);
+	TEST_STREQ(paths[0], PACK_TEST_FILE "/1234.dat");
+	TEST_STREQ(paths[1], PACK_TEST_FILE "/5678.dat");
+	pack_globfree(paths, 2);
+
+	TEST_EQ(pack_glob(PACK_TEST_DIR "/*.dat", &paths), 2);
+	pack_globfree(paths, 2);
+	TEST_EQ(pack_glob(PACK_TEST_FILE "/kernel-cpu*.dat", &paths), 0);
+	pack_globfree(paths, 0);
+
+	pr_dbg("check a corrupted pack file\n");
+	pack = open_pack_file(PACK_TEST_FILE);
+	TEST_NE(pack, NULL);
+	offset = pack->hdr->toc_offset + offsetof(struct uftrace_pack_entry, size);
+	bad_size = pack->map_size;
+	close_pack_file(pack);
+
+	fd = open(PACK_TEST_FILE, O_WRONLY);
+	TEST_GE(fd, 0);
+	TEST_EQ(pwrite(fd, &bad_size, sizeof(bad_size), offset),
+		(ssize_t)sizeof(bad_size));
+	close(fd);
+	TEST_EQ(open_pack_file(PACK_TEST_FILE), NULL);
+
+	pack_cleanup();
+	remove_directory(PACK_TEST_DIR);
+	unlink(PACK_TEST_FILE);
+
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
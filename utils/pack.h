@@ -0,0 +1,77 @@
+#ifndef UFTRACE_PACK_H
+#define UFTRACE_PACK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define UFTRACE_PACK_MAGIC    "Ftrace!P"
+#define UFTRACE_PACK_VERSION  1
+#define UFTRACE_PACK_ALIGN    4096
+
+/*
+ * A pack file keeps all files in a uftrace data directory in a single
+ * file.  Each file is saved as a section aligned to (at least) the
+ * page size so that it can be mmap-ed independently.  The table of
+ * contents (TOC) is sorted by name and follows the last section.
+ *
+ *   +---------------+  0
+ *   |    header     |
+ *   +---------------+  align
+ *   |   section 0   |
+ *   +---------------+  align * N
+ *   |      ...      |
+ *   +---------------+  toc_offset
+ *   | TOC entry 0   |  (struct uftrace_pack_entry)
+ *   |      ...      |
+ *   +---------------+  strtab_offset
+ *   | string table  |  (NUL-terminated file names)
+ *   +---------------+
+ */
+struct uftrace_pack_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	align;
+	uint32_t	nr_entries;
+	uint32_t	unused;
+	uint64_t	toc_offset;
+	uint64_t	strtab_offset;
+	uint64_t	strtab_size;
+};
+
+struct uftrace_pack_entry {
+	uint64_t	offset;
+	uint64_t	size;
+	uint32_t	name;  /* offset in the string table */
+	uint32_t	mtime; /* modification time (in sec), 0 if unknown */
+};
+
+struct uftrace_pack {
+	char				*filename;
+	int				fd;
+	void				*map;
+	size_t				map_size;
+	struct uftrace_pack_header	*hdr;
+	struct uftrace_pack_entry	*toc;
+	char				*strtab;
+};
+
+bool is_pack_file(const char *filename);
+struct uftrace_pack *open_pack_file(const char *filename);
+void close_pack_file(struct uftrace_pack *pack);
+struct uftrace_pack_entry *pack_find_entry(struct uftrace_pack *pack,
+					   const char *name);
+int pack_data_dir(const char *dirname, const char *filename);
+
+/* transparent access to files in a (possibly packed) data directory */
+FILE *pack_fopen(const char *pathname, const char *mode);
+int pack_open(const char *pathname, off_t *offset, size_t *size);
+int pack_stat(const char *pathname, struct stat *stbuf);
+int pack_access(const char *pathname);
+int pack_glob(const char *pattern, char ***pathv);
+void pack_globfree(char **pathv, int count);
+void pack_cleanup(void);
+
+#endif /* UFTRACE_PACK_H */
@@ -1,10 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
-#include <glob.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <byteswap.h>
+#include <sys/uio.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 
@@ -12,6 +14,7 @@
 #include "utils/perf.h"
 #include "utils/fstack.h"
 #include "utils/compiler.h"
+#include "utils/pack.h"
 
 /* It needs to synchronize records using monotonic clock */
 #ifdef HAVE_PERF_CLOCKID
@@ -20,7 +23,8 @@
 
 static bool use_perf = true;
 
-static int open_perf_event(int pid, int cpu, int use_ctxsw)
+static int open_perf_event(int pid, int cpu, int use_ctxsw,
+			   unsigned long bufsize)
 {
 	/* use dummy events to get scheduling info (Linux v4.3 or later) */
 	struct perf_event_attr attr = {
@@ -34,8 +38,9 @@ static int open_perf_event(int pid, int cpu, int use_ctxsw)
 		.disabled		= 1,
 		.enable_on_exec		= 1,
 		.inherit		= 1,
+		/* wake up writers when a quarter of buffer is filled */
 		.watermark		= 1,
-		.wakeup_watermark	= PERF_WATERMARK,
+		.wakeup_watermark	= bufsize / 4,
 		.task			= 1,
 		.comm			= 1,
 		.use_clockid		= 1,
@@ -56,26 +61,35 @@ static int open_perf_event(int pid, int cpu, int use_ctxsw)
  * @pid: process id to record
  * @dirname: directory name to save perf record data
  * @use_ctxsw: whether to use context_switch attribute
+ * @bufsize: size of perf ring buffer for each cpu (0 for default)
  *
  * This function prepares recording linux perf events.  The perf_event
- * fd should be opened and mmaped for each cpu.
+ * fd should be opened and mmaped for each cpu.  The @bufsize should be
+ * a power of 2 multiple of page size.
  *
  * It returns 0 for success, -1 if failed.  Callers should call
  * finish_perf_record() after recording.
  */
 int setup_perf_record(struct uftrace_perf_writer *perf, int nr_cpu, int pid,
-		      const char *dirname, int use_ctxsw)
+		      const char *dirname, int use_ctxsw, unsigned long bufsize)
 {
 	char filename[PATH_MAX];
 	int fd, cpu;
 
+	if (bufsize == 0)
+		bufsize = PERF_BUFFER_SIZE;
+
 	perf->event_fd = xcalloc(nr_cpu, sizeof(*perf->event_fd));
 	perf->data_pos = xcalloc(nr_cpu, sizeof(*perf->data_pos));
 	perf->page     = xcalloc(nr_cpu, sizeof(*perf->page));
-	perf->fp       = xcalloc(nr_cpu, sizeof(*perf->fp));
+	perf->data_fd  = xcalloc(nr_cpu, sizeof(*perf->data_fd));
 	perf->nr_event = nr_cpu;
 
+	/* the first page is for the control data */
+	perf->mmap_size = bufsize + getpagesize();
+
 	memset(perf->event_fd, -1, nr_cpu * sizeof(fd));
+	memset(perf->data_fd, -1, nr_cpu * sizeof(fd));
 
 	if (!PERF_CTXSW_AVAILABLE && use_ctxsw) {
 		/* Operation not supported */
@@ -84,7 +98,7 @@ int setup_perf_record(struct uftrace_perf_writer *perf, int nr_cpu, int pid,
 	}
 
 	for (cpu = 0; cpu < nr_cpu; cpu++) {
-		fd = open_perf_event(pid, cpu, use_ctxsw);
+		fd = open_perf_event(pid, cpu, use_ctxsw, bufsize);
 		if (fd < 0) {
 			int saved_errno = errno;
 
@@ -98,10 +112,11 @@ int setup_perf_record(struct uftrace_perf_writer *perf, int nr_cpu, int pid,
 		}
 		perf->event_fd[cpu] = fd;
 
-		perf->page[cpu] = mmap(NULL, PERF_MMAP_SIZE, PROT_READ|PROT_WRITE,
+		perf->page[cpu] = mmap(NULL, perf->mmap_size, PROT_READ|PROT_WRITE,
 				       MAP_SHARED, fd, 0);
 		if (perf->page[cpu] == MAP_FAILED) {
 			pr_warn("failed to mmap perf event: %m\n");
+			perf->page[cpu] = NULL;
 			use_perf = false;
 			break;
 		}
@@ -109,8 +124,9 @@ int setup_perf_record(struct uftrace_perf_writer *perf, int nr_cpu, int pid,
 		snprintf(filename, sizeof(filename),
 			 "%s/perf-cpu%d.dat", dirname, cpu);
 
-		perf->fp[cpu] = fopen(filename, "w");
-		if (perf->fp[cpu] == NULL) {
+		perf->data_fd[cpu] = open(filename, O_WRONLY | O_CREAT | O_TRUNC,
+					  0644);
+		if (perf->data_fd[cpu] < 0) {
 			pr_warn("failed to create perf data file: %m\n");
 			use_perf = false;
 			break;
@@ -137,20 +153,21 @@ void finish_perf_record(struct uftrace_perf_writer *perf)
 
 	for (cpu = 0; cpu < perf->nr_event; cpu++) {
 		close(perf->event_fd[cpu]);
-		munmap(perf->page[cpu], PERF_MMAP_SIZE);
-		if (perf->fp[cpu])
-			fclose(perf->fp[cpu]);
+		if (perf->page[cpu])
+			munmap(perf->page[cpu], perf->mmap_size);
+		if (perf->data_fd[cpu] >= 0)
+			close(perf->data_fd[cpu]);
 	}
 
 	free(perf->event_fd);
 	free(perf->page);
 	free(perf->data_pos);
-	free(perf->fp);
+	free(perf->data_fd);
 
 	perf->event_fd = NULL;
 	perf->page     = NULL;
 	perf->data_pos = NULL;
-	perf->fp       = NULL;
+	perf->data_fd  = NULL;
 
 	perf->nr_event = 0;
 }
@@ -172,7 +189,8 @@ void record_perf_data(struct uftrace_perf_writer *perf, int cpu, int sock)
 	uint64_t mask = pc->data_size - 1;
 	uint64_t old, pos, start, end;
 	unsigned long size;
-	unsigned char *buf;
+	struct iovec iov[2];
+	int i, nr_iov;
 
 	pos = *ptr;
 	old = perf->data_pos[cpu];
@@ -197,33 +215,31 @@ void record_perf_data(struct uftrace_perf_writer *perf, int cpu, int sock)
 		return;
 	}
 
-	start = old;
-	end   = pos;
+	start = old & mask;
+	end   = pos & mask;
 
-	/* handle wrap around */
-	if ((start & mask) + size != (end & mask)) {
-		buf = &data[start & mask];
-		size = mask + 1 - (start & mask);
-		start += size;
-
-		if (sock > 0)
-			send_trace_perf_data(sock, cpu, buf, size);
-		else if (fwrite(buf, 1, size, perf->fp[cpu]) != size) {
-			pr_dbg("failed to write perf data: %m\n");
-			goto out;
-		}
+	/* handle wrap around: the data is in two chunks */
+	if (start + size != end) {
+		iov[0].iov_base = &data[start];
+		iov[0].iov_len  = mask + 1 - start;
+		iov[1].iov_base = data;
+		iov[1].iov_len  = end;
+		nr_iov = 2;
+	}
+	else {
+		iov[0].iov_base = &data[start];
+		iov[0].iov_len  = size;
+		nr_iov = 1;
 	}
 
-	buf = &data[start & mask];
-	size = end - start;
-	start += size;
-
-	if (sock > 0)
-		send_trace_perf_data(sock, cpu, buf, size);
-	else if (fwrite(buf, 1, size, perf->fp[cpu]) != size)
+	if (sock > 0) {
+		for (i = 0; i < nr_iov; i++)
+			send_trace_perf_data(sock, cpu, iov[i].iov_base,
+					     iov[i].iov_len);
+	}
+	else if (writev_all(perf->data_fd[cpu], iov, nr_iov) < 0)
 		pr_dbg("failed to write perf data: %m\n");
 
-out:
 	/* ensure all reads are done before we write the tail. */
 	full_memory_barrier();
 
@@ -232,6 +248,43 @@ out:
 }
 #endif /* HAVE_PERF_CLOCKID */
 
+/* count events lost in the kernel due to the full ring buffer */
+static uint64_t count_perf_lost(struct uftrace_data *handle,
+				struct uftrace_perf_reader *perf)
+{
+	struct perf_event_header h;
+	struct perf_lost_event lost;
+	size_t pos = 0;
+	uint64_t count = 0;
+
+	while (pos + sizeof(h) <= perf->size) {
+		memcpy(&h, perf->map + pos, sizeof(h));
+
+		if (handle->needs_byte_swap) {
+			h.type = bswap_32(h.type);
+			h.size = bswap_16(h.size);
+		}
+
+		if (h.size < sizeof(h) || pos + h.size > perf->size)
+			break;
+
+		if (h.type == PERF_RECORD_LOST &&
+		    h.size >= sizeof(h) + offsetof(struct perf_lost_event, sample_id)) {
+			memcpy(&lost, perf->map + pos + sizeof(h),
+			       offsetof(struct perf_lost_event, sample_id));
+
+			if (handle->needs_byte_swap)
+				lost.lost = bswap_64(lost.lost);
+
+			count += lost.lost;
+		}
+
+		pos += h.size;
+	}
+
+	return count;
+}
+
 /**
  * setup_perf_data - preapre reading perf event data
  * @handle - uftrace data file handle
@@ -243,33 +296,57 @@ out:
 int setup_perf_data(struct uftrace_data *handle)
 {
 	struct uftrace_perf_reader *perf;
-	glob_t globbuf;
+	char **paths = NULL;
 	char *pattern;
-	size_t i;
+	int i, count;
 	int ret = -1;
 
 	xasprintf(&pattern, "%s/perf-cpu*.dat", handle->dirname);
-	if (glob(pattern, GLOB_ERR, NULL, &globbuf)) {
+	count = pack_glob(pattern, &paths);
+	if (count <= 0) {
 		pr_dbg("failed to search perf data file\n");
 		handle->hdr.feat_mask &= ~PERF_EVENT;
 		handle->nr_perf = 0;
 		goto out;
 	}
 
-	perf = xcalloc(globbuf.gl_pathc, sizeof(*perf));
+	perf = xcalloc(count, sizeof(*perf));
+
+	for (i = 0; i < count; i++) {
+		off_t offset;
+		size_t size;
+		int fd;
+
+		/* the data might be in a (page-aligned) section of a pack file */
+		fd = pack_open(paths[i], &offset, &size);
+		if (fd < 0)
+			pr_err("open failed: %s", paths[i]);
+
+		if (size) {
+			perf[i].map = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+					   fd, offset);
+			if (perf[i].map == MAP_FAILED)
+				pr_err("mmap failed: %s", paths[i]);
 
-	for (i = 0; i < globbuf.gl_pathc; i++) {
-		perf[i].fp = fopen(globbuf.gl_pathv[i], "r");
-		if (perf[i].fp == NULL)
-			pr_err("open failed: %s", globbuf.gl_pathv[i]);
+			madvise(perf[i].map, size, MADV_SEQUENTIAL);
+		}
+		perf[i].size = size;
+		perf[i].lost = count_perf_lost(handle, &perf[i]);
+
+		if (perf[i].lost) {
+			pr_dbg("%s: %"PRIu64" events lost\n",
+			       paths[i], perf[i].lost);
+		}
+
+		close(fd);
 	}
 
-	handle->nr_perf = globbuf.gl_pathc;
+	handle->nr_perf = count;
 	handle->perf = perf;
 	ret = 0;
 
 out:
-	globfree(&globbuf);
+	pack_globfree(paths, count);
 	free(pattern);
 	return ret;
 }
@@ -287,13 +364,29 @@ void finish_perf_data(struct uftrace_data *handle)
 	if (handle->perf == NULL)
 		return;
 
-	for (i = 0; i < handle->nr_perf; i++)
-		fclose(handle->perf[i].fp);
+	for (i = 0; i < handle->nr_perf; i++) {
+		if (handle->perf[i].map)
+			munmap(handle->perf[i].map, handle->perf[i].size);
+	}
 
 	free(handle->perf);
 	handle->perf = NULL;
 }
 
+static int read_perf_buf(struct uftrace_perf_reader *perf, void *buf,
+			 size_t len)
+{
+	if (perf->pos + len > perf->size) {
+		/* consume the remaining (broken) data like fread() */
+		perf->pos = perf->size;
+		return -1;
+	}
+
+	memcpy(buf, perf->map + perf->pos, len);
+	perf->pos += len;
+	return 0;
+}
+
 static int read_perf_event(struct uftrace_data *handle,
 			   struct uftrace_perf_reader *perf)
 {
@@ -307,11 +400,11 @@ static int read_perf_event(struct uftrace_data *handle,
 	size_t len;
 	int comm_len;
 
-	if (perf->done || perf->fp == NULL)
+	if (perf->done)
 		return -1;
 
 again:
-	if (fread(&h, sizeof(h), 1, perf->fp) != 1) {
+	if (read_perf_buf(perf, &h, sizeof(h)) < 0) {
 		perf->done = true;
 		return -1;
 	}
@@ -326,7 +419,7 @@ again:
 
 	switch (h.type) {
 	case PERF_RECORD_SWITCH:
-		if (fread(&u.cs, len, 1, perf->fp) != 1)
+		if (read_perf_buf(perf, &u.cs, len) < 0)
 			return -1;
 
 		if (handle->needs_byte_swap) {
@@ -342,7 +435,7 @@ again:
 
 	case PERF_RECORD_FORK:
 	case PERF_RECORD_EXIT:
-		if (fread(&u.t, len, 1, perf->fp) != 1)
+		if (read_perf_buf(perf, &u.t, len) < 0)
 			return -1;
 
 		if (handle->needs_byte_swap) {
@@ -362,10 +455,10 @@ again:
 	case PERF_RECORD_COMM:
 		/* length of comm event is variable */
 		comm_len = ALIGN(len - sizeof(u.c.sample_id), 8);
-		if (fread(&u.c, comm_len, 1, perf->fp) != 1)
+		if (read_perf_buf(perf, &u.c, comm_len) < 0)
 			return -1;
 
-		if (fread(&u.c.sample_id, sizeof(u.c.sample_id), 1, perf->fp) != 1)
+		if (read_perf_buf(perf, &u.c.sample_id, sizeof(u.c.sample_id)) < 0)
 			return -1;
 
 		if (handle->needs_byte_swap) {
@@ -385,11 +478,11 @@ again:
 	default:
 		pr_dbg3("skip unknown event: %u\n", h.type);
 
-		if (fseek(perf->fp, len, SEEK_CUR) < 0) {
-			pr_warn("skipping perf data failed: %m\n");
-			perf->done = true;
-			return -1;
-		}
+		/* it'll fail to read next event if there's not enough data */
+		if (perf->pos + len > perf->size)
+			perf->pos = perf->size;
+		else
+			perf->pos += len;
 
 		goto again;
 	}
@@ -521,12 +614,30 @@ void update_perf_task_comm(struct uftrace_data *handle)
 		}
 
 		/* reset file position for future processing */
-		rewind(perf->fp);
+		perf->pos   = 0;
 		perf->valid = false;
 		perf->done  = false;
 	}
 }
 
+/**
+ * get_perf_lost_events - get number of lost perf events
+ * @handle: uftrace data file handle
+ *
+ * This function returns total number of perf events lost during the
+ * record.  If it's not 0, schedule info would be incomplete.
+ */
+uint64_t get_perf_lost_events(struct uftrace_data *handle)
+{
+	uint64_t lost = 0;
+	int i;
+
+	for (i = 0; i < handle->nr_perf; i++)
+		lost += handle->perf[i].lost;
+
+	return lost;
+}
+
 static void remove_event_rstack(struct uftrace_task_reader *task)
 {
 	struct uftrace_rstack_list_node *last;
@@ -5,8 +5,7 @@
 #include <stdbool.h>
 #include <linux/perf_event.h>
 
-#define PERF_MMAP_SIZE  (132 * 1024)  /* 32 + 1 pages */
-#define PERF_WATERMARK  (8 * 1024)    /* 2 pages */
+#define PERF_BUFFER_SIZE  (128 * 1024)  /* 32 pages (default) */
 
 #define COMM_LEN  16
 
@@ -14,8 +13,9 @@ struct uftrace_perf_writer {
 	int			*event_fd;
 	void			**page;
 	uint64_t		*data_pos;
-	FILE			**fp;
+	int			*data_fd;
 	int			nr_event;
+	size_t			mmap_size;
 };
 
 struct sample_id {
@@ -45,6 +45,15 @@ struct perf_comm_event {
 	struct sample_id	 sample_id;
 };
 
+struct perf_lost_event {
+	/*
+	 * type: PERF_RECORD_LOST (2)
+	 */
+	uint64_t		 id;
+	uint64_t		 lost;
+	struct sample_id	 sample_id;
+};
+
 struct perf_context_switch_event {
 	/*
 	 * type: PERF_RECORD_SWITCH (14)
@@ -72,7 +81,7 @@ struct uftrace_comm_event {
 #ifdef HAVE_PERF_CLOCKID
 
 int setup_perf_record(struct uftrace_perf_writer *perf, int nr_cpu, int pid,
-		      const char *dirname, int use_ctxsw);
+		      const char *dirname, int use_ctxsw, unsigned long bufsize);
 void finish_perf_record(struct uftrace_perf_writer *perf);
 void record_perf_data(struct uftrace_perf_writer *perf, int cpu, int sock);
 
@@ -80,7 +89,7 @@ void record_perf_data(struct uftrace_perf_writer *perf, int cpu, int sock);
 
 static inline int setup_perf_record(struct uftrace_perf_writer *perf,
 				    int nr_cpu, int pid, const char *dirname,
-				    int use_ctxsw)
+				    int use_ctxsw, unsigned long bufsize)
 {
 	return -1;
 }
@@ -107,7 +116,10 @@ static inline void record_perf_data(struct uftrace_perf_writer *perf,
 #endif /* HAVE_PERF_CTXSW */
 
 struct uftrace_perf_reader {
-	FILE			*fp;
+	void			*map;  /* mmap-ed data file */
+	size_t			size;
+	size_t			pos;
+	uint64_t		lost;  /* number of events lost in the kernel */
 	bool			valid;
 	bool			done;
 	int			type;
@@ -129,6 +141,7 @@ int read_perf_data(struct uftrace_data *handle);
 struct uftrace_record * get_perf_record(struct uftrace_data *handle,
 					struct uftrace_perf_reader *perf);
 void update_perf_task_comm(struct uftrace_data *handle);
+uint64_t get_perf_lost_events(struct uftrace_data *handle);
 void process_perf_event(struct uftrace_data *handle);
 
 #endif /* UFTRACE_PERF_H */
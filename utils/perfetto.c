@@ -0,0 +1,505 @@
+/*
+ * Perfetto trace format support
+ *
+ * The trace is a sequence of TracePacket messages (field 1 of Trace).
+ * All packets are written in a single sequence so that it can use
+ * interned event names and an incremental clock for timestamps.  See
+ * protos/perfetto/trace/ in the Perfetto source for the definitions.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/utils.h"
+#include "utils/perfetto.h"
+
+/* field numbers in the Perfetto protos */
+#define TRACE_PACKET				1
+
+#define PACKET_CLOCK_SNAPSHOT			6
+#define PACKET_TIMESTAMP			8
+#define PACKET_SEQUENCE_ID			10
+#define PACKET_TRACK_EVENT			11
+#define PACKET_INTERNED_DATA			12
+#define PACKET_SEQUENCE_FLAGS			13
+#define PACKET_TIMESTAMP_CLOCK_ID		58
+#define PACKET_DEFAULTS				59
+#define PACKET_TRACK_DESCRIPTOR			60
+
+#define DEFAULTS_TIMESTAMP_CLOCK_ID		58
+
+#define CLOCK_SNAPSHOT_CLOCKS			1
+#define CLOCK_ID				1
+#define CLOCK_TIMESTAMP				2
+#define CLOCK_IS_INCREMENTAL			3
+
+#define TRACK_DESC_UUID				1
+#define TRACK_DESC_PROCESS			3
+#define TRACK_DESC_THREAD			4
+#define TRACK_DESC_PARENT_UUID			5
+
+#define PROCESS_DESC_PID			1
+#define PROCESS_DESC_NAME			6
+
+#define THREAD_DESC_PID				1
+#define THREAD_DESC_TID				2
+#define THREAD_DESC_NAME			5
+
+#define TRACK_EVENT_DEBUG_ANNOTATIONS		4
+#define TRACK_EVENT_TYPE			9
+#define TRACK_EVENT_NAME_IID			10
+#define TRACK_EVENT_TRACK_UUID			11
+
+#define DEBUG_ANNOTATION_NAME_IID		1
+#define DEBUG_ANNOTATION_STRING			6
+
+#define INTERNED_EVENT_NAMES			2
+#define INTERNED_DEBUG_ANNOTATION_NAMES		3
+#define INTERNED_IID				1
+#define INTERNED_NAME				2
+
+#define TYPE_SLICE_BEGIN			1
+#define TYPE_SLICE_END				2
+
+#define SEQ_INCREMENTAL_STATE_CLEARED		1
+#define SEQ_NEEDS_INCREMENTAL_STATE		2
+
+/* there's only one sequence in the file */
+#define UFTRACE_SEQUENCE_ID			1
+
+/* interned names of debug annotations */
+#define ANNOTATION_ARGS_IID			1
+#define ANNOTATION_RETVAL_IID			2
+
+/* process tracks should not conflict with thread tracks */
+#define PROCESS_UUID(pid)			((1ULL << 32) | (uint32_t)(pid))
+#define THREAD_UUID(tid)			((uint64_t)(uint32_t)(tid))
+
+struct perfetto_name {
+	struct rb_node		link;
+	char			*name;
+	uint64_t		iid;
+};
+
+static void pb_reserve(struct pb_buf *buf, size_t len)
+{
+	if (buf->len + len <= buf->size)
+		return;
+
+	buf->size = ALIGN(buf->len + len, 256);
+	buf->data = xrealloc(buf->data, buf->size);
+}
+
+void pb_reset(struct pb_buf *buf)
+{
+	buf->len = 0;
+}
+
+void pb_free(struct pb_buf *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->size = 0;
+}
+
+void pb_put_varint(struct pb_buf *buf, uint64_t val)
+{
+	pb_reserve(buf, 10);
+
+	while (val >= 0x80) {
+		buf->data[buf->len++] = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	buf->data[buf->len++] = val;
+}
+
+static void pb_put_tag(struct pb_buf *buf, unsigned field,
+		       enum pb_wire_type type)
+{
+	pb_put_varint(buf, (field << 3) | type);
+}
+
+void pb_put_uint(struct pb_buf *buf, unsigned field, uint64_t val)
+{
+	pb_put_tag(buf, field, PB_WIRE_VARINT);
+	pb_put_varint(buf, val);
+}
+
+void pb_put_bytes(struct pb_buf *buf, unsigned field,
+		  const void *data, size_t len)
+{
+	pb_put_tag(buf, field, PB_WIRE_BYTES);
+	pb_put_varint(buf, len);
+
+	pb_reserve(buf, len);
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+void pb_put_string(struct pb_buf *buf, unsigned field, const char *str)
+{
+	pb_put_bytes(buf, field, str, strlen(str));
+}
+
+void pb_put_msg(struct pb_buf *buf, unsigned field, struct pb_buf *msg)
+{
+	pb_put_bytes(buf, field, msg->data, msg->len);
+}
+
+static void write_packet(struct uftrace_perfetto *pf)
+{
+	struct pb_buf hdr = {};
+	unsigned char tmp[16];
+
+	/* tag and length of the packet in the Trace message */
+	hdr.data = tmp;
+	hdr.size = sizeof(tmp);
+	pb_put_tag(&hdr, TRACE_PACKET, PB_WIRE_BYTES);
+	pb_put_varint(&hdr, pf->packet.len);
+
+	if (fwrite(hdr.data, hdr.len, 1, pf->fp) != 1 ||
+	    fwrite(pf->packet.data, pf->packet.len, 1, pf->fp) != 1)
+		pr_err("failed to write perfetto trace");
+
+	pf->file_size += hdr.len + pf->packet.len;
+	pb_reset(&pf->packet);
+}
+
+static void put_interned_name(struct pb_buf *buf, unsigned field,
+			      struct pb_buf *scratch, uint64_t iid,
+			      const char *name)
+{
+	pb_reset(scratch);
+	pb_put_uint(scratch, INTERNED_IID, iid);
+	pb_put_string(scratch, INTERNED_NAME, name);
+	pb_put_msg(buf, field, scratch);
+}
+
+/* the first packet to setup the incremental state of the sequence */
+static void start_sequence(struct uftrace_perfetto *pf, uint64_t time)
+{
+	struct pb_buf *pkt = &pf->packet;
+	struct pb_buf *msg = &pf->msg;
+	struct pb_buf *sub = &pf->submsg;
+
+	pb_put_uint(pkt, PACKET_TIMESTAMP, time);
+	pb_put_uint(pkt, PACKET_TIMESTAMP_CLOCK_ID, PERFETTO_CLOCK_MONOTONIC);
+	pb_put_uint(pkt, PACKET_SEQUENCE_ID, UFTRACE_SEQUENCE_ID);
+	pb_put_uint(pkt, PACKET_SEQUENCE_FLAGS, SEQ_INCREMENTAL_STATE_CLEARED);
+
+	/* the incremental clock starts at the same time */
+	pb_reset(msg);
+	pb_reset(sub);
+	pb_put_uint(sub, CLOCK_ID, PERFETTO_CLOCK_MONOTONIC);
+	pb_put_uint(sub, CLOCK_TIMESTAMP, time);
+	pb_put_msg(msg, CLOCK_SNAPSHOT_CLOCKS, sub);
+
+	pb_reset(sub);
+	pb_put_uint(sub, CLOCK_ID, PERFETTO_CLOCK_INCREMENTAL);
+	pb_put_uint(sub, CLOCK_TIMESTAMP, time);
+	pb_put_uint(sub, CLOCK_IS_INCREMENTAL, 1);
+	pb_put_msg(msg, CLOCK_SNAPSHOT_CLOCKS, sub);
+	pb_put_msg(pkt, PACKET_CLOCK_SNAPSHOT, msg);
+
+	/* following packets use delta timestamps */
+	pb_reset(msg);
+	pb_put_uint(msg, DEFAULTS_TIMESTAMP_CLOCK_ID, PERFETTO_CLOCK_INCREMENTAL);
+	pb_put_msg(pkt, PACKET_DEFAULTS, msg);
+
+	pb_reset(msg);
+	put_interned_name(msg, INTERNED_DEBUG_ANNOTATION_NAMES, sub,
+			  ANNOTATION_ARGS_IID, "arguments");
+	put_interned_name(msg, INTERNED_DEBUG_ANNOTATION_NAMES, sub,
+			  ANNOTATION_RETVAL_IID, "retval");
+	pb_put_msg(pkt, PACKET_INTERNED_DATA, msg);
+
+	write_packet(pf);
+
+	pf->last_time = time;
+	pf->started = true;
+}
+
+/* returns iid of the name, or 0 if it's newly added */
+static uint64_t find_name(struct uftrace_perfetto *pf, const char *name,
+			  uint64_t *new_iid)
+{
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &pf->names.rb_node;
+	struct perfetto_name *iname;
+	int cmp;
+
+	while (*p) {
+		parent = *p;
+		iname = rb_entry(parent, struct perfetto_name, link);
+
+		cmp = strcmp(iname->name, name);
+		if (cmp == 0)
+			return iname->iid;
+
+		if (cmp > 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	iname = xmalloc(sizeof(*iname));
+	iname->name = xstrdup(name);
+	iname->iid  = ++pf->next_iid;
+
+	rb_link_node(&iname->link, parent, p);
+	rb_insert_color(&iname->link, &pf->names);
+
+	*new_iid = iname->iid;
+	return 0;
+}
+
+static void put_timestamp(struct uftrace_perfetto *pf, uint64_t time)
+{
+	struct pb_buf *pkt = &pf->packet;
+
+	if (!pf->started)
+		start_sequence(pf, time);
+
+	/* delta should not be negative, use absolute time instead */
+	if (time < pf->last_time) {
+		pb_put_uint(pkt, PACKET_TIMESTAMP, time);
+		pb_put_uint(pkt, PACKET_TIMESTAMP_CLOCK_ID,
+			    PERFETTO_CLOCK_MONOTONIC);
+		return;
+	}
+
+	pb_put_uint(pkt, PACKET_TIMESTAMP, time - pf->last_time);
+	pf->last_time = time;
+}
+
+static void put_slice_event(struct uftrace_perfetto *pf, uint64_t time,
+			    int tid, int type, const char *name,
+			    uint64_t annotation_iid, const char *annotation)
+{
+	struct pb_buf *pkt = &pf->packet;
+	struct pb_buf *msg = &pf->msg;
+	struct pb_buf *sub = &pf->submsg;
+	uint64_t new_iid = 0;
+	uint64_t iid = 0;
+
+	put_timestamp(pf, time);
+	pb_put_uint(pkt, PACKET_SEQUENCE_ID, UFTRACE_SEQUENCE_ID);
+	pb_put_uint(pkt, PACKET_SEQUENCE_FLAGS, SEQ_NEEDS_INCREMENTAL_STATE);
+
+	if (name) {
+		iid = find_name(pf, name, &new_iid);
+		if (iid == 0) {
+			iid = new_iid;
+
+			pb_reset(msg);
+			put_interned_name(msg, INTERNED_EVENT_NAMES, sub,
+					  iid, name);
+			pb_put_msg(pkt, PACKET_INTERNED_DATA, msg);
+		}
+	}
+
+	pb_reset(msg);
+	pb_put_uint(msg, TRACK_EVENT_TYPE, type);
+	pb_put_uint(msg, TRACK_EVENT_TRACK_UUID, THREAD_UUID(tid));
+	if (iid)
+		pb_put_uint(msg, TRACK_EVENT_NAME_IID, iid);
+
+	if (annotation) {
+		pb_reset(sub);
+		pb_put_uint(sub, DEBUG_ANNOTATION_NAME_IID, annotation_iid);
+		pb_put_string(sub, DEBUG_ANNOTATION_STRING, annotation);
+		pb_put_msg(msg, TRACK_EVENT_DEBUG_ANNOTATIONS, sub);
+	}
+
+	pb_put_msg(pkt, PACKET_TRACK_EVENT, msg);
+	write_packet(pf);
+}
+
+/**
+ * perfetto_init - initialize perfetto trace writer
+ * @pf: perfetto trace writer
+ * @fp: file to write the trace
+ */
+void perfetto_init(struct uftrace_perfetto *pf, FILE *fp)
+{
+	memset(pf, 0, sizeof(*pf));
+
+	pf->fp = fp;
+	pf->names = RB_ROOT;
+}
+
+/**
+ * perfetto_finish - finish perfetto trace writer
+ * @pf: perfetto trace writer
+ *
+ * This function releases resources in @pf, the file is not closed.
+ */
+void perfetto_finish(struct uftrace_perfetto *pf)
+{
+	struct rb_node *node;
+	struct perfetto_name *iname;
+
+	fflush(pf->fp);
+
+	while (!RB_EMPTY_ROOT(&pf->names)) {
+		node = rb_first(&pf->names);
+		iname = rb_entry(node, struct perfetto_name, link);
+
+		rb_erase(node, &pf->names);
+		free(iname->name);
+		free(iname);
+	}
+
+	pb_free(&pf->packet);
+	pb_free(&pf->msg);
+	pb_free(&pf->submsg);
+}
+
+/**
+ * perfetto_add_process - add (or update) a process track
+ * @pf: perfetto trace writer
+ * @pid: process id
+ * @name: name of the process
+ */
+void perfetto_add_process(struct uftrace_perfetto *pf, int pid,
+			  const char *name)
+{
+	struct pb_buf *pkt = &pf->packet;
+	struct pb_buf *msg = &pf->msg;
+	struct pb_buf *sub = &pf->submsg;
+
+	pb_reset(sub);
+	pb_put_uint(sub, PROCESS_DESC_PID, pid);
+	pb_put_string(sub, PROCESS_DESC_NAME, name);
+
+	pb_reset(msg);
+	pb_put_uint(msg, TRACK_DESC_UUID, PROCESS_UUID(pid));
+	pb_put_msg(msg, TRACK_DESC_PROCESS, sub);
+
+	pb_put_uint(pkt, PACKET_SEQUENCE_ID, UFTRACE_SEQUENCE_ID);
+	pb_put_msg(pkt, PACKET_TRACK_DESCRIPTOR, msg);
+	write_packet(pf);
+}
+
+/**
+ * perfetto_add_thread - add (or update) a thread track
+ * @pf: perfetto trace writer
+ * @pid: process id of the thread
+ * @tid: thread id
+ * @name: name of the thread
+ */
+void perfetto_add_thread(struct uftrace_perfetto *pf, int pid, int tid,
+			 const char *name)
+{
+	struct pb_buf *pkt = &pf->packet;
+	struct pb_buf *msg = &pf->msg;
+	struct pb_buf *sub = &pf->submsg;
+
+	pb_reset(sub);
+	pb_put_uint(sub, THREAD_DESC_PID, pid);
+	pb_put_uint(sub, THREAD_DESC_TID, tid);
+	pb_put_string(sub, THREAD_DESC_NAME, name);
+
+	pb_reset(msg);
+	pb_put_uint(msg, TRACK_DESC_UUID, THREAD_UUID(tid));
+	pb_put_uint(msg, TRACK_DESC_PARENT_UUID, PROCESS_UUID(pid));
+	pb_put_msg(msg, TRACK_DESC_THREAD, sub);
+
+	pb_put_uint(pkt, PACKET_SEQUENCE_ID, UFTRACE_SEQUENCE_ID);
+	pb_put_msg(pkt, PACKET_TRACK_DESCRIPTOR, msg);
+	write_packet(pf);
+}
+
+/**
+ * perfetto_slice_begin - add a slice begin event
+ * @pf: perfetto trace writer
+ * @time: timestamp of the event
+ * @tid: thread id
+ * @name: name of the slice (function)
+ * @args: string of arguments (can be %NULL)
+ */
+void perfetto_slice_begin(struct uftrace_perfetto *pf, uint64_t time,
+			  int tid, const char *name, const char *args)
+{
+	put_slice_event(pf, time, tid, TYPE_SLICE_BEGIN, name,
+			ANNOTATION_ARGS_IID, args);
+}
+
+/**
+ * perfetto_slice_end - add a slice end event
+ * @pf: perfetto trace writer
+ * @time: timestamp of the event
+ * @tid: thread id
+ * @retval: string of return value (can be %NULL)
+ *
+ * The slice end event doesn't need a name since it closes the last
+ * slice in the thread track.
+ */
+void perfetto_slice_end(struct uftrace_perfetto *pf, uint64_t time,
+			int tid, const char *retval)
+{
+	put_slice_event(pf, time, tid, TYPE_SLICE_END, NULL,
+			ANNOTATION_RETVAL_IID, retval);
+}
+
+#ifdef UNIT_TEST
+
+TEST_CASE(perfetto_varint)
+{
+	struct pb_buf buf = {};
+	unsigned char val300[] = { 0xac, 0x02 };
+	unsigned char field[] = { 0x08, 0x96, 0x01 };
+	unsigned char str[] = { 0x12, 0x03, 'a', 'b', 'c' };
+
+	pr_dbg("check varint encoding\n");
+	pb_put_varint(&buf, 0);
+	TEST_EQ(buf.len, 1);
+	TEST_EQ(buf.data[0], 0);
+
+	pb_reset(&buf);
+	pb_put_varint(&buf, 300);
+	TEST_EQ(buf.len, sizeof(val300));
+	TEST_MEMEQ(buf.data, val300, sizeof(val300));
+
+	pb_reset(&buf);
+	pb_put_varint(&buf, -1ULL);
+	TEST_EQ(buf.len, 10);
+	TEST_EQ(buf.data[9], 1);
+
+	pr_dbg("check field encoding\n");
+	pb_reset(&buf);
+	pb_put_uint(&buf, 1, 150);
+	TEST_EQ(buf.len, sizeof(field));
+	TEST_MEMEQ(buf.data, field, sizeof(field));
+
+	pb_reset(&buf);
+	pb_put_string(&buf, 2, "abc");
+	TEST_EQ(buf.len, sizeof(str));
+	TEST_MEMEQ(buf.data, str, sizeof(str));
+
+	pb_free(&buf);
+	return TEST_OK;
+}
+
+TEST_CASE(perfetto_interned_name)
+{
+	struct uftrace_perfetto pf;
+	uint64_t iid = 0;
+
+	perfetto_init(&pf, stdout);
+
+	pr_dbg("new names get a new iid\n");
+	TEST_EQ(find_name(&pf, "foo", &iid), 0);
+	TEST_EQ(iid, 1);
+	TEST_EQ(find_name(&pf, "bar", &iid), 0);
+	TEST_EQ(iid, 2);
+
+	pr_dbg("existing names return the iid\n");
+	TEST_EQ(find_name(&pf, "foo", &iid), 1);
+	TEST_EQ(find_name(&pf, "bar", &iid), 2);
+
+	perfetto_finish(&pf);
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
@@ -0,0 +1,71 @@
+#ifndef UFTRACE_PERFETTO_H
+#define UFTRACE_PERFETTO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils/rbtree.h"
+
+/*
+ * A minimal protobuf encoder to write the Perfetto trace format.
+ * Nested messages are built in a separate buffer and then copied to
+ * the parent with a (minimal) length prefix.
+ */
+enum pb_wire_type {
+	PB_WIRE_VARINT		= 0,
+	PB_WIRE_FIXED64		= 1,
+	PB_WIRE_BYTES		= 2,
+	PB_WIRE_FIXED32		= 5,
+};
+
+struct pb_buf {
+	unsigned char		*data;
+	size_t			len;
+	size_t			size;
+};
+
+void pb_reset(struct pb_buf *buf);
+void pb_free(struct pb_buf *buf);
+void pb_put_varint(struct pb_buf *buf, uint64_t val);
+void pb_put_uint(struct pb_buf *buf, unsigned field, uint64_t val);
+void pb_put_bytes(struct pb_buf *buf, unsigned field,
+		  const void *data, size_t len);
+void pb_put_string(struct pb_buf *buf, unsigned field, const char *str);
+void pb_put_msg(struct pb_buf *buf, unsigned field, struct pb_buf *msg);
+
+/* uftrace records timestamps with CLOCK_MONOTONIC by default */
+#define PERFETTO_CLOCK_MONOTONIC     3
+/* (incremental) clock used for delta-encoded timestamps */
+#define PERFETTO_CLOCK_INCREMENTAL   64
+
+struct uftrace_perfetto {
+	FILE			*fp;
+	/* timestamp of the last packet (for delta encoding) */
+	uint64_t		last_time;
+	bool			started;
+	/* interned event names */
+	struct rb_root		names;
+	uint64_t		next_iid;
+	/* scratch buffers for each nesting level */
+	struct pb_buf		packet;
+	struct pb_buf		msg;
+	struct pb_buf		submsg;
+	/* total size written to @fp */
+	uint64_t		file_size;
+};
+
+void perfetto_init(struct uftrace_perfetto *pf, FILE *fp);
+void perfetto_finish(struct uftrace_perfetto *pf);
+
+void perfetto_add_process(struct uftrace_perfetto *pf, int pid,
+			  const char *name);
+void perfetto_add_thread(struct uftrace_perfetto *pf, int pid, int tid,
+			 const char *name);
+
+void perfetto_slice_begin(struct uftrace_perfetto *pf, uint64_t time,
+			  int tid, const char *name, const char *args);
+void perfetto_slice_end(struct uftrace_perfetto *pf, uint64_t time,
+			int tid, const char *retval);
+
+#endif /* UFTRACE_PERFETTO_H */
@@ -25,6 +25,18 @@ static void update_time_stat(struct report_time_stat *ts, uint64_t time_ns,
 		ts->max = time_ns;
 }
 
+static void merge_time_stat(struct report_time_stat *dst,
+			    struct report_time_stat *src)
+{
+	dst->sum += src->sum;
+	dst->rec += src->rec;
+
+	if (dst->min > src->min)
+		dst->min = src->min;
+	if (dst->max < src->max)
+		dst->max = src->max;
+}
+
 static void finish_time_stat(struct report_time_stat *ts, unsigned long call)
 {
 	ts->avg = (ts->sum + ts->rec) / call;
@@ -87,6 +99,126 @@ void report_delete_node(struct rb_root *root, struct uftrace_report_node *node)
 	free(node->name);
 }
 
+#define REPORT_HASH_INIT_SIZE  1024
+
+static inline unsigned report_hash_fn(uint64_t key, bool is_addr,
+				      unsigned size)
+{
+	key = (key ^ is_addr) * 0x9E3779B97F4A7C15ULL;
+	return (key >> 32) & (size - 1);
+}
+
+static struct report_hash_entry *
+report_hash_lookup(struct uftrace_report_hash *hash, uint64_t key, bool is_addr)
+{
+	unsigned idx = report_hash_fn(key, is_addr, hash->size);
+	struct report_hash_entry *entry;
+
+	/* linear probing: there's always an empty entry */
+	while (true) {
+		entry = &hash->entries[idx];
+
+		if (entry->node == NULL)
+			return entry;
+		if (entry->key == key && entry->is_addr == is_addr)
+			return entry;
+
+		idx = (idx + 1) & (hash->size - 1);
+	}
+}
+
+/**
+ * report_hash_find - find a report node using the symbol ID
+ * @hash: hash table of report nodes
+ * @key: symbol ID (or address)
+ * @is_addr: whether @key is an address
+ *
+ * This function returns a report node added by report_hash_add()
+ * or %NULL if not found.
+ */
+struct uftrace_report_node * report_hash_find(struct uftrace_report_hash *hash,
+					      uint64_t key, bool is_addr)
+{
+	if (hash->nr == 0)
+		return NULL;
+
+	return report_hash_lookup(hash, key, is_addr)->node;
+}
+
+static void report_hash_resize(struct uftrace_report_hash *hash, unsigned size)
+{
+	struct report_hash_entry *old = hash->entries;
+	unsigned old_size = hash->size;
+	unsigned i;
+
+	hash->entries = xcalloc(size, sizeof(*hash->entries));
+	hash->size = size;
+
+	for (i = 0; i < old_size; i++) {
+		struct report_hash_entry *entry;
+
+		if (old[i].node == NULL)
+			continue;
+
+		entry = report_hash_lookup(hash, old[i].key, old[i].is_addr);
+		*entry = old[i];
+	}
+	free(old);
+}
+
+/**
+ * report_hash_add - add a report node to the hash table
+ * @hash: hash table of report nodes
+ * @key: symbol ID (or address)
+ * @is_addr: whether @key is an address
+ * @node: report node (already added to a name tree)
+ *
+ * Note that multiple keys can point to a same node since nodes are
+ * merged by name.
+ */
+void report_hash_add(struct uftrace_report_hash *hash, uint64_t key,
+		     bool is_addr, struct uftrace_report_node *node)
+{
+	struct report_hash_entry *entry;
+
+	/* keep load factor under 50% */
+	if (hash->size == 0)
+		report_hash_resize(hash, REPORT_HASH_INIT_SIZE);
+	else if ((hash->nr + 1) * 2 > hash->size)
+		report_hash_resize(hash, hash->size * 2);
+
+	entry = report_hash_lookup(hash, key, is_addr);
+	if (entry->node == NULL)
+		hash->nr++;
+
+	entry->key = key;
+	entry->is_addr = is_addr;
+	entry->node = node;
+}
+
+void report_hash_destroy(struct uftrace_report_hash *hash)
+{
+	free(hash->entries);
+	hash->entries = NULL;
+	hash->size = 0;
+	hash->nr = 0;
+}
+
+/**
+ * report_add_time - add a function call to the report node
+ * @node: report node
+ * @total_time: total time of the function call
+ * @self_time: self time of the function call
+ * @recursive: whether it's called recursively
+ */
+void report_add_time(struct uftrace_report_node *node, uint64_t total_time,
+		     uint64_t self_time, bool recursive)
+{
+	update_time_stat(&node->total, total_time, recursive);
+	update_time_stat(&node->self, self_time, false);
+	node->call++;
+}
+
 void report_update_node(struct uftrace_report_node *node,
 			struct uftrace_task_reader *task)
 {
@@ -103,9 +235,101 @@ void report_update_node(struct uftrace_report_node *node,
 		}
 	}
 
-	update_time_stat(&node->total, total_time, recursive);
-	update_time_stat(&node->self, self_time, false);
-	node->call++;
+	report_add_time(node, total_time, self_time, recursive);
+}
+
+/**
+ * report_merge_node - merge statistics of a report node into another
+ * @dst: report node to be updated
+ * @src: report node to be merged
+ */
+void report_merge_node(struct uftrace_report_node *dst,
+		       struct uftrace_report_node *src)
+{
+	merge_time_stat(&dst->total, &src->total);
+	merge_time_stat(&dst->self, &src->self);
+	dst->call += src->call;
+}
+
+/* saved format of a report node, followed by the name */
+struct report_node_msg {
+	struct report_time_stat	total;
+	struct report_time_stat	self;
+	uint64_t		call;
+	uint32_t		namelen;
+	uint32_t		unused;
+};
+
+/**
+ * report_save_nodes - write report nodes to a file
+ * @root: name tree of report nodes
+ * @fp: file pointer to write
+ *
+ * This is used to pass the result of parallel workers and to save it
+ * in the cache.  It returns 0 on success, -1 on error.
+ */
+int report_save_nodes(struct rb_root *root, FILE *fp)
+{
+	struct rb_node *n = rb_first(root);
+
+	while (n) {
+		struct uftrace_report_node *node;
+		struct report_node_msg msg;
+
+		node = rb_entry(n, typeof(*node), name_link);
+
+		memset(&msg, 0, sizeof(msg));
+		msg.total   = node->total;
+		msg.self    = node->self;
+		msg.call    = node->call;
+		msg.namelen = strlen(node->name);
+
+		if (fwrite(&msg, sizeof(msg), 1, fp) != 1 ||
+		    fwrite(node->name, msg.namelen, 1, fp) != 1)
+			return -1;
+
+		n = rb_next(n);
+	}
+	return 0;
+}
+
+/**
+ * report_load_nodes - read report nodes saved by report_save_nodes()
+ * @root: name tree of report nodes
+ * @fp: file pointer to read
+ *
+ * Nodes are merged into existing nodes of the same name.  It returns 0
+ * on success, -1 on error.
+ */
+int report_load_nodes(struct rb_root *root, FILE *fp)
+{
+	struct report_node_msg msg;
+	struct uftrace_report_node *node;
+	struct uftrace_report_node part;
+	char *name;
+
+	while (fread(&msg, sizeof(msg), 1, fp) == 1) {
+		name = xmalloc(msg.namelen + 1);
+		if (fread(name, msg.namelen, 1, fp) != 1 && msg.namelen) {
+			free(name);
+			return -1;
+		}
+		name[msg.namelen] = '\0';
+
+		node = report_find_node(root, name);
+		if (node == NULL) {
+			node = xzalloc(sizeof(*node));
+			report_add_node(root, name, node);
+		}
+		free(name);
+
+		part.total = msg.total;
+		part.self  = msg.self;
+		part.call  = msg.call;
+		report_merge_node(node, &part);
+	}
+
+	return ferror(fp) ? -1 : 0;
 }
 
 void report_calc_avg(struct rb_root *root)
@@ -578,6 +802,57 @@ TEST_CASE(report_find)
 	return TEST_OK;
 }
 
+TEST_CASE(report_hash)
+{
+	struct rb_root root = RB_ROOT;
+	struct uftrace_report_hash hash = {};
+	struct uftrace_report_node *node;
+	struct rb_node *rbnode;
+	const int NR_KEYS = 3000;
+	int i;
+
+	TEST_EQ(report_hash_find(&hash, 1, false), NULL);
+
+	for (i = 0; i < NR_KEYS; i++) {
+		char name[32];
+
+		/* two keys share a name */
+		snprintf(name, sizeof(name), "func%d", i / 2);
+
+		node = report_find_node(&root, name);
+		if (node == NULL) {
+			node = xzalloc(sizeof(*node));
+			report_add_node(&root, name, node);
+		}
+		report_hash_add(&hash, i * 8, false, node);
+	}
+	TEST_EQ(hash.nr, (unsigned)NR_KEYS);
+
+	for (i = 0; i < NR_KEYS; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "func%d", i / 2);
+
+		node = report_hash_find(&hash, i * 8, false);
+		TEST_NE(node, NULL);
+		TEST_STREQ(node->name, name);
+
+		/* same value but different kind of key */
+		TEST_EQ(report_hash_find(&hash, i * 8, true), NULL);
+	}
+
+	report_hash_destroy(&hash);
+
+	while (!RB_EMPTY_ROOT(&root)) {
+		rbnode = rb_first(&root);
+		node = rb_entry(rbnode, typeof(*node), name_link);
+		report_delete_node(&root, node);
+		free(node);
+	}
+
+	return TEST_OK;
+}
+
 TEST_CASE(report_sort)
 {
 	struct rb_root name_tree = RB_ROOT;
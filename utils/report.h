@@ -1,6 +1,7 @@
 #ifndef UFTRACE_REPORT_H
 #define UFTRACE_REPORT_H
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -29,6 +30,24 @@ struct uftrace_report_node {
 	struct uftrace_report_node	*pair;
 };
 
+/*
+ * open-addressing hash table to find a report node by symbol ID
+ * (address of the struct sym) or by address if no symbol found.
+ * Each node is still kept in the name tree, the hash table is just
+ * a shortcut to avoid string comparisons for every record.
+ */
+struct report_hash_entry {
+	uint64_t			key;
+	bool				is_addr;
+	struct uftrace_report_node	*node;
+};
+
+struct uftrace_report_hash {
+	struct report_hash_entry	*entries;
+	unsigned			size;  /* power of 2 */
+	unsigned			nr;
+};
+
 struct uftrace_diff_policy {
 	/* show percentage rather than value of diff */
 	bool percent;
@@ -48,9 +67,21 @@ void report_add_node(struct rb_root *root, const char *name,
 		     struct uftrace_report_node *node);
 void report_update_node(struct uftrace_report_node *node,
 			struct uftrace_task_reader *task);
+void report_add_time(struct uftrace_report_node *node, uint64_t total_time,
+		     uint64_t self_time, bool recursive);
+void report_merge_node(struct uftrace_report_node *dst,
+		       struct uftrace_report_node *src);
 void report_calc_avg(struct rb_root *root);
+int report_save_nodes(struct rb_root *root, FILE *fp);
+int report_load_nodes(struct rb_root *root, FILE *fp);
 void report_delete_node(struct rb_root *root, struct uftrace_report_node *node);
 
+struct uftrace_report_node * report_hash_find(struct uftrace_report_hash *hash,
+					      uint64_t key, bool is_addr);
+void report_hash_add(struct uftrace_report_hash *hash, uint64_t key,
+		     bool is_addr, struct uftrace_report_node *node);
+void report_hash_destroy(struct uftrace_report_hash *hash);
+
 int report_setup_sort(const char *sort_keys);
 void report_sort_nodes(struct rb_root *name_root, struct rb_root *sort_root);
 
@@ -11,6 +11,7 @@
 #include "utils/rbtree.h"
 #include "utils/utils.h"
 #include "utils/fstack.h"
+#include "utils/pack.h"
 #include "libmcount/mcount.h"
 
 static void delete_tasks(struct uftrace_session_link *sessions);
@@ -33,7 +34,7 @@ void read_session_map(char *dirname, struct symtabs *symtabs, char *sid)
 	struct uftrace_mmap **maps = &symtabs->maps;
 
 	snprintf(buf, sizeof(buf), "%s/sid-%.16s.map", dirname, sid);
-	fp = fopen(buf, "rb");
+	fp = pack_fopen(buf, "rb");
 	if (fp == NULL)
 		pr_err("cannot open maps file: %s", buf);
 
@@ -84,6 +85,8 @@ void read_session_map(char *dirname, struct symtabs *symtabs, char *sid)
 		maps = &map->next;
 	}
 	fclose(fp);
+
+	build_map_index(symtabs);
 }
 
 /**
@@ -105,6 +108,10 @@ void delete_session_map(struct symtabs *symtabs)
 	}
 
 	symtabs->maps = NULL;
+
+	free(symtabs->map_index);
+	symtabs->map_index = NULL;
+	symtabs->nr_map_index = 0;
 }
 
 /**
@@ -321,6 +328,44 @@ struct sym * session_find_dlsym(struct uftrace_session *sess, uint64_t timestamp
 	return NULL;
 }
 
+static inline unsigned symcache_hash(uint64_t addr)
+{
+	return (addr * 0x9E3779B97F4A7C15ULL) >> (64 - SESSION_SYMCACHE_BITS);
+}
+
+/**
+ * session_find_sym - find symbol in a session using a cache
+ * @sess: pointer to a current session
+ * @addr: instruction address
+ *
+ * This function is same as find_symtabs() for @sess but it keeps the
+ * result in a (direct-mapped) cache since the same addresses are
+ * looked up over and over during analysis.  Note that symbols from
+ * dlopen'ed libraries are not cached as they depend on timestamp.
+ * The cache is not thread-safe, see struct uftrace_sym_cache.
+ */
+struct sym * session_find_sym(struct uftrace_session *sess, uint64_t addr)
+{
+	struct uftrace_sym_cache *sc;
+	struct sym *sym;
+
+	if (unlikely(sess->symcache == NULL)) {
+		sess->symcache = xcalloc(SESSION_SYMCACHE_SIZE,
+					 sizeof(*sess->symcache));
+	}
+
+	sc = &sess->symcache[symcache_hash(addr)];
+	if (sc->sym && sc->addr == addr)
+		return sc->sym;
+
+	sym = find_symtabs(&sess->symtabs, addr);
+	if (sym) {
+		sc->addr = addr;
+		sc->sym  = sym;
+	}
+	return sym;
+}
+
 void delete_session(struct uftrace_session *sess)
 {
 	struct uftrace_dlopen_list *udl, *tmp;
@@ -330,6 +375,7 @@ void delete_session(struct uftrace_session *sess)
 		free(udl);
 	}
 
+	free(sess->symcache);
 	finish_debug_info(&sess->symtabs);
 	delete_session_map(&sess->symtabs);
 	uftrace_cleanup_filter(&sess->filters);
@@ -360,29 +406,57 @@ void delete_sessions(struct uftrace_session_link *sessions)
 	}
 }
 
+/*
+ * invalidates cached results of find_task_session().  Like the cache in
+ * each task, it's not protected by a lock so callers should not look up
+ * and add sessions concurrently from multiple threads.
+ */
+static unsigned sref_generation = 1;
+
 static void add_session_ref(struct uftrace_task *task, struct uftrace_session *sess,
 			    uint64_t timestamp)
 {
-	struct uftrace_sess_ref *sref = &task->sref;
+	struct uftrace_sess_ref *sref;
+	int i;
 
 	if (sess == NULL) {
 		pr_dbg("task %d/%d has no session\n", task->tid, task->pid);
 		return;
 	}
 
-	if (task->sref_last) {
-		task->sref_last->next = sref = xmalloc(sizeof(*sref));
-		task->sref_last->end = timestamp;
+	task->sref = xrealloc(task->sref, (task->nr_sref + 1) * sizeof(*sref));
+
+	/* keep it sorted by start time (usually appended at the end) */
+	for (i = task->nr_sref; i > 0; i--) {
+		if (task->sref[i - 1].start <= timestamp)
+			break;
+		task->sref[i] = task->sref[i - 1];
 	}
+	task->nr_sref++;
 
-	sref->next = NULL;
+	sref = &task->sref[i];
 	sref->sess = sess;
 	sref->start = timestamp;
-	sref->end = -1ULL;
+	sref->end = (i + 1 < task->nr_sref) ? task->sref[i + 1].start : -1ULL;
+
+	if (i > 0)
+		task->sref[i - 1].end = timestamp;
 
 	pr_dbg2("task session: tid = %d, session = %.16s\n",
 		task->tid, sess->sid);
-	task->sref_last = sref;
+	sref_generation++;
+}
+
+static int sref_search(const void *a, const void *b)
+{
+	uint64_t timestamp = *(const uint64_t *)a;
+	const struct uftrace_sess_ref *sref = b;
+
+	if (timestamp < sref->start)
+		return -1;
+	if (timestamp >= sref->end)
+		return 1;
+	return 0;
 }
 
 /**
@@ -394,23 +468,42 @@ static void add_session_ref(struct uftrace_task *task, struct uftrace_session *s
  * This function searches the sessions tree using @task and @timestamp.
  * The most recent session that has a smaller than the @timestamp will
  * be returned.  If it didn't find a session tries to search sesssion
- * list of parent or thread-leader.
+ * list of parent or thread-leader.  The result is cached in the @task
+ * with its valid time range.
  */
 struct uftrace_session *find_task_session(struct uftrace_session_link *sessions,
 					  struct uftrace_task *task,
 					  uint64_t timestamp)
 {
 	int parent_id;
+	struct uftrace_task *orig = task;
 	struct uftrace_sess_ref *ref;
+	struct uftrace_sess_ref *cache;
+	uint64_t limit = -1ULL;
+
+	if (task == NULL)
+		return NULL;
+
+	cache = &orig->sref_cache;
+	if (orig->sref_gen == sref_generation && cache->sess &&
+	    cache->start <= timestamp && timestamp < cache->end)
+		return cache->sess;
 
 	while (task != NULL) {
-		ref = &task->sref;
-		while (ref) {
-			if (ref->start <= timestamp && timestamp < ref->end)
-				return ref->sess;
-			ref = ref->next;
+		ref = bsearch(&timestamp, task->sref, task->nr_sref,
+			      sizeof(*ref), sref_search);
+		if (ref) {
+			cache->sess  = ref->sess;
+			cache->start = ref->start;
+			cache->end   = ref->end < limit ? ref->end : limit;
+			orig->sref_gen = sref_generation;
+			return ref->sess;
 		}
 
+		/* sessions of the child override the parent's */
+		if (task->nr_sref && task->sref[0].start < limit)
+			limit = task->sref[0].start;
+
 		/*
 		 * if it cannot find its own session,
 		 * inherit from parent or leader.
@@ -472,9 +565,9 @@ void create_task(struct uftrace_session_link *sessions,
 		struct uftrace_task *parent;
 
 		parent = find_task(sessions, msg->pid);
-		if (parent && parent->sref_last &&
-		    parent->sref_last->start < msg->time)
-			s = parent->sref_last->sess;
+		if (parent && parent->nr_sref &&
+		    parent->sref[parent->nr_sref - 1].start < msg->time)
+			s = parent->sref[parent->nr_sref - 1].sess;
 	}
 
 	if (s) {
@@ -493,14 +586,7 @@ void create_task(struct uftrace_session_link *sessions,
 
 static void delete_task(struct uftrace_task *t)
 {
-	struct uftrace_sess_ref *sref, *tmp;
-
-	sref = t->sref.next;
-	while (sref) {
-		tmp = sref->next;
-		free(sref);
-		sref = tmp;
-	}
+	free(t->sref);
 	free(t);
 }
 
@@ -583,7 +669,6 @@ struct sym * task_find_sym(struct uftrace_session_link *sessions,
 			   struct uftrace_record *rec)
 {
 	struct uftrace_session *sess;
-	struct symtabs *symtabs;
 	struct sym *sym = NULL;
 	uint64_t addr = rec->addr;
 
@@ -598,8 +683,7 @@ struct sym * task_find_sym(struct uftrace_session_link *sessions,
 	if (sess == NULL)
 		return NULL;
 
-	symtabs = &sess->symtabs;
-	sym = find_symtabs(symtabs, addr);
+	sym = session_find_sym(sess, addr);
 
 	if (sym == NULL)
 		sym = session_find_dlsym(sess, rec->time, addr);
@@ -634,7 +718,7 @@ struct sym * task_find_sym_addr(struct uftrace_session_link *sessions,
 			return NULL;
 	}
 
-	sym = find_symtabs(&sess->symtabs, addr);
+	sym = session_find_sym(sess, addr);
 	if (sym == NULL)
 		sym = session_find_dlsym(sess, time, addr);
 
@@ -733,7 +817,7 @@ TEST_CASE(task_search)
 
 		TEST_NE(task, NULL);
 		TEST_EQ(task->tid, tmsg.tid);
-		TEST_EQ(task->sref.sess, test_sessions.first);
+		TEST_EQ(task->sref[0].sess, test_sessions.first);
 		TEST_NE(test_sessions.first, NULL);
 
 		sess = find_session(&test_sessions, tmsg.pid, tmsg.time);
@@ -756,7 +840,7 @@ TEST_CASE(task_search)
 
 		TEST_NE(task, NULL);
 		TEST_EQ(task->tid, tmsg.tid);
-		TEST_EQ(task->sref.sess, test_sessions.first);
+		TEST_EQ(task->sref[0].sess, test_sessions.first);
 
 		sess = find_task_session(&test_sessions, task, tmsg.time);
 		TEST_NE(sess, NULL);
@@ -778,7 +862,7 @@ TEST_CASE(task_search)
 
 		TEST_NE(task, NULL);
 		TEST_EQ(task->tid, tmsg.tid);
-		TEST_EQ(task->sref.sess, test_sessions.first);
+		TEST_EQ(task->sref[0].sess, test_sessions.first);
 
 		sess = find_task_session(&test_sessions, task, tmsg.time);
 		TEST_NE(sess, NULL);
@@ -800,7 +884,7 @@ TEST_CASE(task_search)
 
 		TEST_NE(task, NULL);
 		TEST_EQ(task->tid, tmsg.tid);
-		TEST_EQ(task->sref.sess, test_sessions.first);
+		TEST_EQ(task->sref[0].sess, test_sessions.first);
 
 		sess = find_task_session(&test_sessions, task, tmsg.time);
 		TEST_NE(sess, NULL);
@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <sys/mman.h>
 
 /* This should be defined before #include "utils.h" */
 #define PR_FMT     "symbol"
@@ -24,6 +25,7 @@
 #include "utils/symbol.h"
 #include "utils/filter.h"
 #include "utils/rbtree.h"
+#include "utils/pack.h"
 
 #ifndef  EM_AARCH64
 # define EM_AARCH64  183
@@ -183,21 +185,35 @@ static bool is_symbol_end(const char *name)
 	return false;
 }
 
+/* names from a binary symbol file are not allocated */
+static bool is_mapped_name(struct symtab *symtab, char *name)
+{
+	return symtab->map && (void *)name >= symtab->map &&
+		(void *)name < symtab->map + symtab->map_size;
+}
+
 static void unload_symtab(struct symtab *symtab)
 {
 	size_t i;
 
 	for (i = 0; i < symtab->nr_sym; i++) {
 		struct sym *sym = symtab->sym + i;
-		free(sym->name);
+
+		if (!is_mapped_name(symtab, sym->name))
+			free(sym->name);
 	}
 
 	free(symtab->sym_names);
 	free(symtab->sym);
 
+	if (symtab->map)
+		munmap(symtab->map, symtab->map_size);
+
 	symtab->nr_sym = 0;
 	symtab->sym = NULL;
 	symtab->sym_names = NULL;
+	symtab->map = NULL;
+	symtab->map_size = 0;
 }
 
 static int load_symbol(struct symtab *symtab, unsigned long prev_sym_value,
@@ -845,8 +861,8 @@ struct uftrace_mmap *find_map_by_name(struct symtabs *symtabs,
 	return NULL;
 }
 
-static int load_module_symbol_file(struct symtab *symtab, const char *symfile,
-				   uint64_t offset)
+static int __load_module_symbol_file(struct symtab *symtab, const char *symfile,
+				     uint64_t offset, bool needs_demangle)
 {
 	FILE *fp;
 	char *line = NULL;
@@ -857,7 +873,7 @@ static int load_module_symbol_file(struct symtab *symtab, const char *symfile,
 	uint64_t prev_addr = -1;
 	char prev_type = 'X';
 
-	fp = fopen(symfile, "r");
+	fp = pack_fopen(symfile, "r");
 	if (fp == NULL) {
 		pr_dbg("reading %s failed: %m\n", symfile);
 		return -1;
@@ -958,7 +974,7 @@ static int load_module_symbol_file(struct symtab *symtab, const char *symfile,
 
 		sym->addr = addr + offset;
 		sym->type = type;
-		sym->name = demangle(name);
+		sym->name = needs_demangle ? demangle(name) : xstrdup(name);
 		sym->size = 0;
 
 		pr_dbg3("[%zd] %c %lx + %-5u %s\n", symtab->nr_sym,
@@ -984,6 +1000,162 @@ static int load_module_symbol_file(struct symtab *symtab, const char *symfile,
 	return 0;
 }
 
+static int load_module_symbol_file(struct symtab *symtab, const char *symfile,
+				   uint64_t offset)
+{
+	return __load_module_symbol_file(symtab, symfile, offset, true);
+}
+
+/*
+ * Binary symbol file (<module>.symtab) has the same symbols as the text
+ * symbol file (<module>.sym) but it can be used without parsing.
+ *
+ *   +------------------+  0
+ *   |      header      |  (struct symtab_file_header)
+ *   +------------------+  sym_offset
+ *   | symbol entry 0   |  (struct symtab_file_entry) sorted by address
+ *   |       ...        |
+ *   +------------------+  idx_offset
+ *   | name index       |  (uint32_t) sorted by (simple) demangled name
+ *   +------------------+  str_offset
+ *   | string table     |  (NUL-terminated symbol names)
+ *   +------------------+
+ */
+#define SYMTAB_FILE_MAGIC    "UFTSYMTB"
+#define SYMTAB_FILE_VERSION  1
+
+/* all symbols have same name after demangling */
+#define SYMTAB_FILE_FL_NO_MANGLED  (1U << 0)
+
+struct symtab_file_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	flags;
+	uint64_t	nr_sym;
+	uint64_t	sym_offset;
+	uint64_t	idx_offset;
+	uint64_t	str_offset;
+	uint64_t	str_size;
+};
+
+struct symtab_file_entry {
+	uint64_t	addr;
+	uint32_t	size;
+	uint32_t	type;
+	uint32_t	name;   /* original name */
+	uint32_t	dname;  /* name demangled by the simple demangler */
+};
+
+/* check the sections, indexes and name offsets are inside of the file */
+static bool check_symtab_file(struct symtab_file_header *hdr, size_t size)
+{
+	struct symtab_file_entry *entry;
+	uint32_t *idx;
+	char *strtab;
+	uint64_t i;
+
+	if (hdr->nr_sym > size / sizeof(*entry) ||
+	    hdr->sym_offset > size - hdr->nr_sym * sizeof(*entry) ||
+	    hdr->idx_offset > size - hdr->nr_sym * sizeof(*idx) ||
+	    hdr->str_offset > size || hdr->str_size > size - hdr->str_offset)
+		return false;
+
+	entry  = (void *)hdr + hdr->sym_offset;
+	idx    = (void *)hdr + hdr->idx_offset;
+	strtab = (void *)hdr + hdr->str_offset;
+
+	/* all names should be terminated in the string table */
+	if (hdr->nr_sym && (hdr->str_size == 0 ||
+			    strtab[hdr->str_size - 1] != '\0'))
+		return false;
+
+	for (i = 0; i < hdr->nr_sym; i++) {
+		if (idx[i] >= hdr->nr_sym ||
+		    entry[i].name >= hdr->str_size ||
+		    entry[i].dname >= hdr->str_size)
+			return false;
+	}
+	return true;
+}
+
+static int load_module_symbol_bin(struct symtab *symtab, const char *binfile)
+{
+	struct symtab_file_header *hdr;
+	struct symtab_file_entry *entry;
+	uint32_t *idx;
+	char *strtab;
+	void *map;
+	off_t offset;
+	size_t size;
+	size_t i;
+	bool use_idx;
+	int fd;
+
+	fd = pack_open(binfile, &offset, &size);
+	if (fd < 0)
+		return -1;
+
+	if (size < sizeof(*hdr)) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, offset);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = map;
+	if (memcmp(hdr->magic, SYMTAB_FILE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != SYMTAB_FILE_VERSION ||
+	    !check_symtab_file(hdr, size)) {
+		pr_dbg("invalid symbol file: %s\n", binfile);
+		munmap(map, size);
+		return -1;
+	}
+
+	pr_dbg2("loading symbols from %s\n", binfile);
+
+	entry  = map + hdr->sym_offset;
+	idx    = map + hdr->idx_offset;
+	strtab = map + hdr->str_offset;
+
+	/* the name index is valid only if names are same as the file */
+	use_idx = demangler == DEMANGLE_SIMPLE ||
+		  (hdr->flags & SYMTAB_FILE_FL_NO_MANGLED);
+
+	symtab->map = map;
+	symtab->map_size = size;
+	symtab->nr_sym = symtab->nr_alloc = hdr->nr_sym;
+	symtab->sym = xmalloc(symtab->nr_sym * sizeof(*symtab->sym));
+	symtab->sym_names = xmalloc(symtab->nr_sym * sizeof(*symtab->sym_names));
+
+	for (i = 0; i < symtab->nr_sym; i++) {
+		struct sym *sym = &symtab->sym[i];
+
+		sym->addr = entry[i].addr;
+		sym->size = entry[i].size;
+		sym->type = entry[i].type;
+
+		if (use_idx)
+			sym->name = strtab + entry[i].dname;
+		else if (demangler == DEMANGLE_NONE)
+			sym->name = strtab + entry[i].name;
+		else
+			sym->name = demangle(strtab + entry[i].name);
+
+		symtab->sym_names[i] = use_idx ? &symtab->sym[idx[i]] : sym;
+	}
+
+	if (!use_idx) {
+		qsort(symtab->sym_names, symtab->nr_sym,
+		      sizeof(*symtab->sym_names), namesort);
+	}
+	symtab->name_sorted = true;
+
+	return 0;
+}
+
 static void load_module_symbol(struct symtabs *symtabs, struct uftrace_module *m)
 {
 	unsigned flags = symtabs->flags;
@@ -992,9 +1164,18 @@ static void load_module_symbol(struct symtabs *symtabs, struct uftrace_module *m
 	if (flags & SYMTAB_FL_USE_SYMFILE) {
 		char *symfile = NULL;
 
+		/* try binary symbol file first */
+		xasprintf(&symfile, "%s/%s.symtab",
+			  symtabs->dirname, basename(m->name));
+		if (load_module_symbol_bin(&m->symtab, symfile) == 0) {
+			free(symfile);
+			return;
+		}
+		free(symfile);
+
 		xasprintf(&symfile, "%s/%s.sym",
 			  symtabs->dirname, basename(m->name));
-		if (access(symfile, F_OK) == 0) {
+		if (pack_access(symfile) == 0) {
 			load_module_symbol_file(&m->symtab, symfile, 0);
 		}
 
@@ -1193,22 +1374,206 @@ static void save_module_symbol_file(struct symtab *stab, const char *symfile,
 	fclose(fp);
 }
 
+static bool is_mangled_name(const char *name)
+{
+	return !strncmp(name, "_Z", 2) || !strncmp(name, "_GLOBAL__sub_I_", 15);
+}
+
+static struct symtab *sort_stab;
+
+static int dnamesort(const void *a, const void *b)
+{
+	const uint32_t ia = *(const uint32_t *)a;
+	const uint32_t ib = *(const uint32_t *)b;
+
+	return strcmp(sort_stab->sym[ia].name, sort_stab->sym[ib].name);
+}
+
+/*
+ * copy symbols in @stab as they're read back from the text symbol file
+ * saved by save_module_symbol_file().  The size of a symbol is extended
+ * to the next one unless an end marker is saved between them, and
+ * duplicate symbols are dropped.  The names are not copied.
+ */
+static void copy_saved_symbols(struct symtab *stab, struct symtab *copy)
+{
+	struct sym *sym, *prev = NULL;
+	struct sym *last = NULL;
+	bool end_marker;
+	size_t i;
+
+	copy->sym = xcalloc(stab->nr_sym, sizeof(*copy->sym));
+
+	for (i = 0; i < stab->nr_sym; i++) {
+		sym = &stab->sym[i];
+
+		if (prev) {
+			end_marker = (sym->type == ST_PLT_FUNC) !=
+				     (prev->type == ST_PLT_FUNC) ||
+				     (symbol_is_func(prev) && !symbol_is_func(sym));
+
+			if (end_marker) {
+				last->size = prev->addr + prev->size - last->addr;
+			}
+			else if (sym->addr == prev->addr &&
+				 sym->type == prev->type) {
+				prev = sym;
+				continue;
+			}
+
+			if (last->size == 0)
+				last->size = sym->addr - last->addr;
+		}
+
+		last = &copy->sym[copy->nr_sym++];
+		last->addr = sym->addr;
+		last->type = sym->type;
+		last->name = sym->name;
+
+		prev = sym;
+	}
+
+	if (last)
+		last->size = prev->addr + prev->size - last->addr;
+
+	qsort(copy->sym, copy->nr_sym, sizeof(*copy->sym), addrsort);
+}
+
+/*
+ * save_module_symbol_bin - save binary symbol file
+ * @stab - symbol table of the module (already saved in a text file)
+ * @binfile - binary symbol file (<module>.symtab) to save
+ *
+ * This saves the same symbols (and sizes) as the text symbol file
+ * would have when it's loaded.
+ */
+static void save_module_symbol_bin(struct symtab *stab, const char *binfile)
+{
+	struct symtab raw = {};
+	struct symtab dem = {};
+	struct symtab_file_header hdr = {
+		.magic   = SYMTAB_FILE_MAGIC,
+		.version = SYMTAB_FILE_VERSION,
+		.flags   = SYMTAB_FILE_FL_NO_MANGLED,
+	};
+	struct symtab_file_entry *entry;
+	uint32_t *idx;
+	struct strv strtab = STRV_INIT;
+	enum symbol_demangler saved_demangler = demangler;
+	size_t str_size = 0;
+	size_t i;
+	int fd;
+
+	if (stab->nr_sym == 0)
+		return;
+
+	fd = open(binfile, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		if (errno != EEXIST)
+			pr_dbg("cannot open %s file: %m\n", binfile);
+		return;
+	}
+
+	pr_dbg2("saving symbols to %s\n", binfile);
+
+	copy_saved_symbols(stab, &raw);
+
+	entry = xcalloc(raw.nr_sym, sizeof(*entry));
+	idx   = xcalloc(raw.nr_sym, sizeof(*idx));
+
+	/* name index should be sorted by the default (simple) demangler */
+	dem.nr_sym = raw.nr_sym;
+	dem.sym = xcalloc(raw.nr_sym, sizeof(*dem.sym));
+
+	demangler = DEMANGLE_SIMPLE;
+	for (i = 0; i < raw.nr_sym; i++) {
+		struct sym *sym = &raw.sym[i];
+
+		dem.sym[i].name = demangle(sym->name);
+
+		entry[i].addr = sym->addr;
+		entry[i].size = sym->size;
+		entry[i].type = sym->type;
+		entry[i].name = str_size;
+		strv_append(&strtab, sym->name);
+		str_size += strlen(sym->name) + 1;
+
+		if (is_mangled_name(sym->name) ||
+		    strcmp(sym->name, dem.sym[i].name)) {
+			hdr.flags &= ~SYMTAB_FILE_FL_NO_MANGLED;
+
+			entry[i].dname = str_size;
+			strv_append(&strtab, dem.sym[i].name);
+			str_size += strlen(dem.sym[i].name) + 1;
+		}
+		else {
+			entry[i].dname = entry[i].name;
+		}
+
+		idx[i] = i;
+	}
+	demangler = saved_demangler;
+
+	sort_stab = &dem;
+	qsort(idx, raw.nr_sym, sizeof(*idx), dnamesort);
+	sort_stab = NULL;
+
+	hdr.nr_sym     = raw.nr_sym;
+	hdr.sym_offset = sizeof(hdr);
+	hdr.idx_offset = hdr.sym_offset + raw.nr_sym * sizeof(*entry);
+	hdr.str_offset = hdr.idx_offset + raw.nr_sym * sizeof(*idx);
+	hdr.str_size   = str_size;
+
+	if (write_all(fd, &hdr, sizeof(hdr)) < 0 ||
+	    write_all(fd, entry, raw.nr_sym * sizeof(*entry)) < 0 ||
+	    write_all(fd, idx, raw.nr_sym * sizeof(*idx)) < 0)
+		goto err;
+
+	for (i = 0; i < (size_t)strtab.nr; i++) {
+		if (write_all(fd, strtab.p[i], strlen(strtab.p[i]) + 1) < 0)
+			goto err;
+	}
+
+	close(fd);
+	goto out;
+
+err:
+	/* text symbol file is still usable */
+	pr_dbg("cannot write %s file: %m\n", binfile);
+	close(fd);
+	unlink(binfile);
+
+out:
+	free(entry);
+	free(idx);
+	unload_symtab(&dem);
+	strv_free(&strtab);
+	/* names are owned by @stab */
+	free(raw.sym);
+}
+
 void save_module_symtabs(const char *dirname)
 {
 	struct rb_node *n = rb_first(&modules);
 	struct uftrace_module *mod;
 	char *symfile = NULL;
+	char *binfile = NULL;
 
 	while (n != NULL) {
 		mod = rb_entry(n, typeof (*mod), node);
 
 		xasprintf(&symfile, "%s/%s.sym", dirname,
 			  basename(mod->name));
+		xasprintf(&binfile, "%s/%s.symtab", dirname,
+			  basename(mod->name));
 
 		save_module_symbol_file(&mod->symtab, symfile, 0);
+		save_module_symbol_bin(&mod->symtab, binfile);
 
 		free(symfile);
+		free(binfile);
 		symfile = NULL;
+		binfile = NULL;
 
 		n = rb_next(n);
 	}
@@ -1314,6 +1679,62 @@ bool check_dynsym_idxlist(struct dynsym_idxlist *idxlist, unsigned idx)
 	return false;
 }
 
+static int mapsort(const void *a, const void *b)
+{
+	const struct uftrace_mmap *mapa = *(const struct uftrace_mmap **)a;
+	const struct uftrace_mmap *mapb = *(const struct uftrace_mmap **)b;
+
+	if (mapa->start > mapb->start)
+		return 1;
+	if (mapa->start < mapb->start)
+		return -1;
+	return 0;
+}
+
+static int mapfind(const void *a, const void *b)
+{
+	uint64_t addr = *(uint64_t *) a;
+	const struct uftrace_mmap *map = *(const struct uftrace_mmap **)b;
+
+	if (map->start <= addr && addr < map->end)
+		return 0;
+
+	if (map->start > addr)
+		return -1;
+	return 1;
+}
+
+/**
+ * build_map_index - build an address index of memory mappings
+ * @symtabs: symbol table has the memory mapping
+ *
+ * This function builds an array of the mappings sorted by address so
+ * that find_map() can use binary search instead of walking the list.
+ * It should be called again (or the index should be freed) whenever
+ * the mappings are changed.
+ */
+void build_map_index(struct symtabs *symtabs)
+{
+	struct uftrace_mmap *map;
+	size_t nr = 0;
+
+	free(symtabs->map_index);
+	symtabs->map_index = NULL;
+	symtabs->nr_map_index = 0;
+
+	for_each_map(symtabs, map)
+		nr++;
+
+	if (nr == 0)
+		return;
+
+	symtabs->map_index = xmalloc(nr * sizeof(*symtabs->map_index));
+	for_each_map(symtabs, map)
+		symtabs->map_index[symtabs->nr_map_index++] = map;
+
+	qsort(symtabs->map_index, nr, sizeof(*symtabs->map_index), mapsort);
+}
+
 struct uftrace_mmap * find_map(struct symtabs *symtabs, uint64_t addr)
 {
 	struct uftrace_mmap *map;
@@ -1321,6 +1742,14 @@ struct uftrace_mmap * find_map(struct symtabs *symtabs, uint64_t addr)
 	if (is_kernel_address(symtabs, addr))
 		return MAP_KERNEL;
 
+	if (symtabs->map_index) {
+		struct uftrace_mmap **pmap;
+
+		pmap = bsearch(&addr, symtabs->map_index, symtabs->nr_map_index,
+			       sizeof(*pmap), mapfind);
+		return pmap ? *pmap : NULL;
+	}
+
 	for_each_map(symtabs, map) {
 		if (map->start <= addr && addr < map->end)
 			return map;
@@ -1577,6 +2006,91 @@ TEST_CASE(symbol_load_module) {
 	return TEST_OK;
 }
 
+static int test_corrupt_symtab_idx(const char *binfile)
+{
+	struct symtab_file_header hdr;
+	uint32_t bad_idx = UINT32_MAX;
+	int fd;
+	int ret = -1;
+
+	fd = open(binfile, O_RDWR);
+	if (fd < 0)
+		return -1;
+
+	if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+	    pwrite(fd, &bad_idx, sizeof(bad_idx), hdr.idx_offset) == sizeof(bad_idx))
+		ret = 0;
+
+	close(fd);
+	return ret;
+}
+
+TEST_CASE(symbol_load_binary) {
+	struct symtab stab = {
+		.nr_alloc = 0,
+	};
+	struct sym mixed_sym[] = {
+		{ 0x100, 256, ST_PLT_FUNC, "plt1" },
+		{ 0x200, 256, ST_PLT_FUNC, "plt2" },
+		{ 0x1100, 128, ST_GLOBAL_FUNC, "normal1" },
+		{ 0x1200, 256, ST_LOCAL_FUNC,  "_ZN3ABC3fooEv" },
+		{ 0x1200, 256, ST_LOCAL_FUNC,  "_ZN3ABC3fooEv" },
+		{ 0x1300, 256, ST_GLOBAL_FUNC, "abc" },
+		{ 0x1480, 8,   ST_GLOBAL_DATA, "data" },
+	};
+	struct symtab text = {
+		.nr_sym = 0,
+	};
+	struct symtab test = {
+		.nr_sym = 0,
+	};
+	char symfile[] = "SYM.sym";
+	char binfile[] = "SYM.symtab";
+	size_t i;
+
+	/* recover from earlier failures */
+	unlink(symfile);
+	unlink(binfile);
+
+	stab.sym = mixed_sym;
+	stab.nr_sym = ARRAY_SIZE(mixed_sym);
+
+	save_module_symbol_file(&stab, symfile, 0);
+	save_module_symbol_bin(&stab, binfile);
+
+	TEST_EQ(load_module_symbol_file(&text, symfile, 0), 0);
+	TEST_EQ(load_module_symbol_bin(&test, binfile), 0);
+
+	TEST_EQ(test.nr_sym, text.nr_sym);
+	TEST_EQ(test.name_sorted, true);
+	for (i = 0; i < test.nr_sym; i++) {
+		TEST_EQ(test.sym[i].addr, text.sym[i].addr);
+		TEST_EQ(test.sym[i].size, text.sym[i].size);
+		TEST_EQ(test.sym[i].type, text.sym[i].type);
+		TEST_STREQ(test.sym[i].name, text.sym[i].name);
+
+		TEST_STREQ(test.sym_names[i]->name, text.sym_names[i]->name);
+	}
+
+	TEST_NE(find_symname(&test, "ABC::foo"), NULL);
+
+	unload_symtab(&text);
+	unload_symtab(&test);
+
+	/* corrupted index should be rejected */
+	if (test_corrupt_symtab_idx(binfile) == 0) {
+		struct symtab bad = {
+			.nr_sym = 0,
+		};
+
+		TEST_EQ(load_module_symbol_bin(&bad, binfile), -1);
+	}
+
+	unlink(symfile);
+	unlink(binfile);
+	return TEST_OK;
+}
+
 #include <link.h>
 
 static int add_map(struct dl_phdr_info *info, size_t sz, void *data)
@@ -59,6 +59,9 @@ struct symtab {
 	size_t nr_sym;
 	size_t nr_alloc;
 	bool name_sorted;
+	/* mapped binary symbol file (names might point into it) */
+	void *map;
+	size_t map_size;
 };
 
 struct uftrace_module {
@@ -95,6 +98,9 @@ struct symtabs {
 	uint64_t kernel_base;
 	uint64_t exec_base;
 	struct uftrace_mmap *maps;
+	/* maps sorted by address for binary search (optional) */
+	struct uftrace_mmap **map_index;
+	size_t nr_map_index;
 };
 
 #define for_each_map(symtabs, map)					\
@@ -148,6 +154,7 @@ char * check_script_file(const char *filename);
 /* pseudo-map for kernel image */
 #define MAP_KERNEL (struct uftrace_mmap *)1
 
+void build_map_index(struct symtabs *symtabs);
 struct uftrace_mmap * find_map(struct symtabs *symtabs, uint64_t addr);
 struct uftrace_mmap * find_map_by_name(struct symtabs *symtabs,
 				       const char *prefix);
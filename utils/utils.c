@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
 #include <libgen.h>
@@ -101,6 +102,24 @@ int write_all(int fd, const void *buf, size_t size)
 	return 0;
 }
 
+int pwrite_all(int fd, const void *buf, size_t size, off_t off)
+{
+	int ret;
+
+	while (size) {
+		ret = pwrite(fd, buf, size, off);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+
+		buf  += ret;
+		size -= ret;
+		off  += ret;
+	}
+	return 0;
+}
+
 int writev_all(int fd, struct iovec *iov, int count)
 {
 	int i, ret;
@@ -136,6 +155,23 @@ int writev_all(int fd, struct iovec *iov, int count)
 	return 0;
 }
 
+/* move data in a pipe (@fd_in) to @fd_out without copying to userspace */
+int splice_all(int fd_in, int fd_out, size_t size)
+{
+	ssize_t ret;
+
+	while (size) {
+		ret = splice(fd_in, NULL, fd_out, NULL, size, SPLICE_F_MOVE);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+
+		size -= ret;
+	}
+	return 0;
+}
+
 int remove_directory(const char *dirname)
 {
 	DIR *dp;
@@ -922,4 +958,31 @@ TEST_CASE(utils_strv)
 
 	return TEST_OK;
 }
+
+TEST_CASE(utils_splice_all)
+{
+	int pfd[2];
+	int fd;
+	char buf[16] = {};
+	char filename[] = "/tmp/uftrace-splice-XXXXXX";
+	const char test_str[] = "splice test";
+
+	TEST_EQ(pipe(pfd), 0);
+
+	fd = mkstemp(filename);
+	TEST_GE(fd, 0);
+	unlink(filename);
+
+	TEST_EQ(write_all(pfd[1], test_str, sizeof(test_str)), 0);
+	TEST_EQ(splice_all(pfd[0], fd, sizeof(test_str)), 0);
+
+	TEST_EQ(pread_all(fd, buf, sizeof(test_str), 0), 0);
+	TEST_STREQ(buf, test_str);
+
+	close(pfd[0]);
+	close(pfd[1]);
+	close(fd);
+
+	return TEST_OK;
+}
 #endif /* UNIT_TEST */
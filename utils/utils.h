@@ -310,13 +310,21 @@ int read_all(int fd, void *buf, size_t size);
 int pread_all(int fd, void *buf, size_t size, off_t off);
 int fread_all(void *byf, size_t size, FILE *fp);
 int write_all(int fd, const void *buf, size_t size);
+int pwrite_all(int fd, const void *buf, size_t size, off_t off);
 int writev_all(int fd, struct iovec *iov, int count);
+int splice_all(int fd_in, int fd_out, size_t size);
 
 int create_directory(const char *dirname);
 int remove_directory(const char *dirname);
 int chown_directory(const char *dirname);
 char *read_exename(void);
 
+/* enough for time with colored unit */
+#define TIME_UNIT_BUFSIZE  32
+
+const char *out_color_str(char code);
+int format_time_unit(char *buf, uint64_t delta_nsec);
+int format_time_unit_plain(char *buf, uint64_t delta_nsec);
 void print_time_unit(uint64_t delta_nsec);
 void print_diff_percent(uint64_t base_nsec, uint64_t delta_nsec);
 void print_diff_time_unit(uint64_t base_nsec, uint64_t pair_nsec);
@@ -0,0 +1 @@
+#define UFTRACE_VERSION  " ( tui perf sched )"